@@ -0,0 +1,168 @@
+#include "bench_results.hpp"
+#include "chim.hpp"
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr const char *kUsage =
+    "Usage: chim_bench [options] <capture>...\n"
+    "  --trials <count>     Replay every capture <count> times per configuration (default 1)\n"
+    "  --json <file>        Write the results with machine and driver details to <file>\n"
+    "  --baseline <file>    Compare with results written by --json and fail on significant regressions\n"
+    "  --threshold <pct>    Ignore changes smaller than <pct> percent of the baseline (default 2)\n"
+    "  --perf-counters      Report hardware counters per frame phase below the frame times";
+} // namespace
+
+/**
+ * @brief Replays each capture given on the command line headless and prints its frame time statistics.
+ * @details Every capture is replayed with fixed vertex input and with vertex pulling, each time with a fresh renderer
+ * so one replay cannot warm the caches of the next. With --trials every configuration is replayed several times and
+ * the mean frame time is reported with its 95% confidence interval. --json stores the trials, and --baseline compares
+ * them with stored ones: the exit code is non-zero when a configuration got significantly slower.
+ */
+int main(int argc, char *argv[])
+{
+    bool perf_counters = false;
+    uint32_t trials = 1;
+    double threshold = 0.02;
+    std::string json_path;
+    std::string baseline_path;
+    std::vector<std::string> captures;
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string option = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (option == "--perf-counters")
+            {
+                perf_counters = true;
+            }
+            else if (option == "--trials" && hasValue)
+            {
+                trials = static_cast<uint32_t>(std::max(1ul, std::stoul(argv[++i])));
+            }
+            else if (option == "--threshold" && hasValue)
+            {
+                threshold = std::stod(argv[++i]) / 100.0;
+            }
+            else if (option == "--json" && hasValue)
+            {
+                json_path = argv[++i];
+            }
+            else if (option == "--baseline" && hasValue)
+            {
+                baseline_path = argv[++i];
+            }
+            else if (option.rfind("--", 0) == 0)
+            {
+                throw std::invalid_argument(option);
+            }
+            else
+            {
+                captures.push_back(option);
+            }
+        }
+    }
+    catch (std::exception&)
+    {
+        captures.clear();
+    }
+    if (captures.empty())
+    {
+        std::cerr << kUsage << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    bool regressed = false;
+    try
+    {
+        // Read first, so that a bad baseline fails before minutes of replays
+        std::optional<chim::BenchRun> baseline;
+        if (!baseline_path.empty())
+        {
+            baseline = chim::BenchRun::Load(baseline_path);
+        }
+
+        chim::BenchRun run;
+        for (const std::string& capture : captures)
+        {
+            for (bool vertex_pulling : {false, true})
+            {
+                chim::BenchResult result;
+                result.capture = capture;
+                result.variant = vertex_pulling ? "vertex pulling" : "vertex input";
+                for (uint32_t trial = 0; trial < trials; trial++)
+                {
+                    chim::ChimSettings settings;
+                    settings.replay_path = capture;
+                    settings.headless = true;
+                    settings.vertex_pulling = vertex_pulling;
+                    settings.perf_counters = perf_counters;
+
+                    chim::Chim app(settings);
+                    app.Init();
+                    if (run.machine.device.empty())
+                    {
+                        run.machine = chim::BenchMachine::Describe(app.DeviceProperties());
+                    }
+                    if (vertex_pulling && !app.UsesVertexPulling())
+                    {
+                        app.Cleanup();
+                        break;
+                    }
+                    chim::ReplayStats stats = app.Replay();
+                    app.Cleanup();
+
+                    std::cout << capture << " (" << result.variant << ")"
+                              << (trials > 1 ? " trial " + std::to_string(trial + 1) : "") << ": " << stats.Report()
+                              << std::endl;
+                    result.frames = stats.frames;
+                    result.mean_ms.push_back(stats.mean_ms);
+                    result.median_ms.push_back(stats.median_ms);
+                    result.p95_ms.push_back(stats.p95_ms);
+                }
+
+                if (result.mean_ms.empty())
+                {
+                    std::cout << capture << " (" << result.variant << "): not supported" << std::endl;
+                    continue;
+                }
+                run.results.push_back(std::move(result));
+            }
+        }
+
+        if (!json_path.empty())
+        {
+            run.Save(json_path);
+        }
+
+        chim::BenchRun empty;
+        const chim::BenchRun& reference = baseline ? *baseline : empty;
+        if (baseline && !baseline->machine.SameDevice(run.machine))
+        {
+            std::cout << "Warning: the baseline was measured on " << baseline->machine.device << " (driver "
+                      << baseline->machine.driver_version << "), not on this device and driver" << std::endl;
+        }
+        for (const chim::BenchComparison& comparison : chim::CompareRuns(reference, run, threshold))
+        {
+            if (baseline || trials > 1)
+            {
+                std::cout << comparison.Report() << std::endl;
+            }
+            regressed = regressed || comparison.verdict == chim::BenchVerdict::Regression;
+        }
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return regressed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
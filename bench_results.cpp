@@ -0,0 +1,561 @@
+#include "bench_results.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#ifndef _WIN32
+#include <sys/utsname.h>
+#include <unistd.h>
+#endif
+
+using namespace chim;
+
+namespace
+{
+/**
+ * @brief Just enough JSON to read back what ToJson writes: objects, arrays, strings, numbers and literals.
+ */
+struct JsonValue
+{
+    enum class Type
+    {
+        Null,
+        Boolean,
+        Number,
+        String,
+        Array,
+        Object
+    };
+
+    Type type = Type::Null;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+
+    const JsonValue& operator[](const std::string& key) const
+    {
+        static const JsonValue null;
+        for (const auto& member : object)
+        {
+            if (member.first == key)
+            {
+                return member.second;
+            }
+        }
+        return null;
+    }
+};
+
+class JsonParser
+{
+  public:
+    explicit JsonParser(const std::string& text) : text_(text) {}
+
+    JsonValue Parse(void)
+    {
+        JsonValue value = ParseValue();
+        SkipSpace();
+        if (position_ != text_.size())
+        {
+            Fail();
+        }
+        return value;
+    }
+
+  private:
+    [[noreturn]] void Fail(void) const
+    {
+        throw std::runtime_error("Failed to parse benchmark results at offset " + std::to_string(position_) + "!");
+    }
+
+    void SkipSpace(void)
+    {
+        while (position_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[position_])))
+        {
+            position_++;
+        }
+    }
+
+    bool Consume(char c)
+    {
+        SkipSpace();
+        if (position_ < text_.size() && text_[position_] == c)
+        {
+            position_++;
+            return true;
+        }
+        return false;
+    }
+
+    void Expect(char c)
+    {
+        if (!Consume(c))
+        {
+            Fail();
+        }
+    }
+
+    JsonValue ParseValue(void)
+    {
+        SkipSpace();
+        if (position_ == text_.size())
+        {
+            Fail();
+        }
+
+        JsonValue value;
+        char c = text_[position_];
+        if (c == '{')
+        {
+            value.type = JsonValue::Type::Object;
+            position_++;
+            if (!Consume('}'))
+            {
+                do
+                {
+                    SkipSpace();
+                    std::string key = ParseString();
+                    Expect(':');
+                    value.object.emplace_back(std::move(key), ParseValue());
+                } while (Consume(','));
+                Expect('}');
+            }
+        }
+        else if (c == '[')
+        {
+            value.type = JsonValue::Type::Array;
+            position_++;
+            if (!Consume(']'))
+            {
+                do
+                {
+                    value.array.push_back(ParseValue());
+                } while (Consume(','));
+                Expect(']');
+            }
+        }
+        else if (c == '"')
+        {
+            value.type = JsonValue::Type::String;
+            value.string = ParseString();
+        }
+        else if (text_.compare(position_, 4, "true") == 0 || text_.compare(position_, 5, "false") == 0)
+        {
+            value.type = JsonValue::Type::Boolean;
+            value.number = c == 't' ? 1.0 : 0.0;
+            position_ += c == 't' ? 4 : 5;
+        }
+        else if (text_.compare(position_, 4, "null") == 0)
+        {
+            position_ += 4;
+        }
+        else
+        {
+            const char *begin = text_.c_str() + position_;
+            char *end = nullptr;
+            value.type = JsonValue::Type::Number;
+            value.number = std::strtod(begin, &end);
+            if (end == begin)
+            {
+                Fail();
+            }
+            position_ += static_cast<size_t>(end - begin);
+        }
+        return value;
+    }
+
+    std::string ParseString(void)
+    {
+        if (position_ >= text_.size() || text_[position_] != '"')
+        {
+            Fail();
+        }
+        position_++;
+
+        std::string result;
+        while (position_ < text_.size() && text_[position_] != '"')
+        {
+            char c = text_[position_++];
+            if (c == '\\' && position_ < text_.size())
+            {
+                char escaped = text_[position_++];
+                switch (escaped)
+                {
+                case 'n':
+                    c = '\n';
+                    break;
+                case 't':
+                    c = '\t';
+                    break;
+                case 'u':
+                    // Only written for control characters, which ToJson never needs to round-trip
+                    position_ = std::min(position_ + 4, text_.size());
+                    c = '?';
+                    break;
+                default:
+                    c = escaped;
+                }
+            }
+            result.push_back(c);
+        }
+        if (position_ == text_.size())
+        {
+            Fail();
+        }
+        position_++;
+        return result;
+    }
+
+  private:
+    const std::string& text_;
+    size_t position_ = 0;
+};
+
+std::string Quote(const std::string& text)
+{
+    std::string quoted = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            quoted.push_back('\\');
+            quoted.push_back(c);
+        }
+        else if (c == '\n')
+        {
+            quoted += "\\n";
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            quoted += "\\u00" + std::string(1, "0123456789abcdef"[(c >> 4) & 0xf]) + "0123456789abcdef"[c & 0xf];
+        }
+        else
+        {
+            quoted.push_back(c);
+        }
+    }
+    return quoted + "\"";
+}
+
+void WriteSamples(std::ostringstream& out, const std::vector<double>& samples)
+{
+    out << "[";
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        out << (i > 0 ? ", " : "") << samples[i];
+    }
+    out << "]";
+}
+
+std::vector<double> ReadSamples(const JsonValue& value)
+{
+    std::vector<double> samples;
+    for (const JsonValue& sample : value.array)
+    {
+        samples.push_back(sample.number);
+    }
+    return samples;
+}
+
+// Two-sided 95% critical values of Student's t for 1 to 30 degrees of freedom
+constexpr double kStudentT95[30] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                    2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                    2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+
+/**
+ * @brief Critical value for the largest tabulated degrees of freedom not above dof, which errs on the wide side.
+ */
+double StudentT95(double dof)
+{
+    if (dof < 1.0)
+    {
+        return kStudentT95[0];
+    }
+    if (dof < 31.0)
+    {
+        return kStudentT95[static_cast<size_t>(dof) - 1];
+    }
+    return dof < 40.0 ? 2.042 : dof < 60.0 ? 2.021 : dof < 120.0 ? 2.000 : dof < 1000.0 ? 1.980 : 1.960;
+}
+
+double Variance(const std::vector<double>& samples, double mean)
+{
+    double sum = 0.0;
+    for (double sample : samples)
+    {
+        sum += (sample - mean) * (sample - mean);
+    }
+    return samples.size() > 1 ? sum / (samples.size() - 1) : 0.0;
+}
+} // namespace
+
+/**
+ * @brief The host, CPU, OS and Vulkan device and driver of this run, stamped with the current time.
+ */
+BenchMachine BenchMachine::Describe(const VkPhysicalDeviceProperties& device)
+{
+    BenchMachine machine;
+    machine.cores = std::thread::hardware_concurrency();
+    machine.device = device.deviceName;
+    machine.vendor_id = device.vendorID;
+    machine.device_id = device.deviceID;
+    machine.driver_version = device.driverVersion;
+    machine.api_version = device.apiVersion;
+
+#ifdef _WIN32
+    const char *host = std::getenv("COMPUTERNAME");
+    machine.host = host != nullptr ? host : "";
+    const char *cpu = std::getenv("PROCESSOR_IDENTIFIER");
+    machine.cpu = cpu != nullptr ? cpu : "";
+    machine.os = "Windows";
+#else
+    char host[256] = {};
+    if (gethostname(host, sizeof(host) - 1) == 0)
+    {
+        machine.host = host;
+    }
+    utsname name{};
+    if (uname(&name) == 0)
+    {
+        machine.os = std::string(name.sysname) + " " + name.release + " " + name.machine;
+    }
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    for (std::string line; std::getline(cpuinfo, line);)
+    {
+        if (line.rfind("model name", 0) == 0 && line.find(':') != std::string::npos)
+        {
+            machine.cpu = line.substr(line.find(':') + 2);
+            break;
+        }
+    }
+#endif
+
+    std::time_t now = std::time(nullptr);
+    char timestamp[32] = {};
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    machine.timestamp = timestamp;
+    return machine;
+}
+
+bool BenchMachine::SameDevice(const BenchMachine& other) const
+{
+    return vendor_id == other.vendor_id && device_id == other.device_id && driver_version == other.driver_version;
+}
+
+std::string BenchRun::ToJson(void) const
+{
+    std::ostringstream out;
+    out.precision(6);
+    out << "{\n  \"version\": " << kVersion << ",\n  \"machine\": {\n"
+        << "    \"host\": " << Quote(machine.host) << ",\n"
+        << "    \"cpu\": " << Quote(machine.cpu) << ",\n"
+        << "    \"cores\": " << machine.cores << ",\n"
+        << "    \"os\": " << Quote(machine.os) << ",\n"
+        << "    \"device\": " << Quote(machine.device) << ",\n"
+        << "    \"vendor_id\": " << machine.vendor_id << ",\n"
+        << "    \"device_id\": " << machine.device_id << ",\n"
+        << "    \"driver_version\": " << machine.driver_version << ",\n"
+        << "    \"api_version\": \"" << VK_API_VERSION_MAJOR(machine.api_version) << "."
+        << VK_API_VERSION_MINOR(machine.api_version) << "." << VK_API_VERSION_PATCH(machine.api_version) << "\",\n"
+        << "    \"api_version_raw\": " << machine.api_version << ",\n"
+        << "    \"timestamp\": " << Quote(machine.timestamp) << "\n  },\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult& result = results[i];
+        out << (i > 0 ? "," : "") << "\n    {\"capture\": " << Quote(result.capture)
+            << ", \"variant\": " << Quote(result.variant) << ", \"frames\": " << result.frames
+            << ",\n     \"mean_ms\": ";
+        WriteSamples(out, result.mean_ms);
+        out << ",\n     \"median_ms\": ";
+        WriteSamples(out, result.median_ms);
+        out << ",\n     \"p95_ms\": ";
+        WriteSamples(out, result.p95_ms);
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+    return out.str();
+}
+
+BenchRun BenchRun::FromJson(const std::string& json)
+{
+    JsonValue root = JsonParser(json).Parse();
+    if (root["version"].number != kVersion)
+    {
+        throw std::runtime_error("Failed to read benchmark results, unsupported version!");
+    }
+
+    BenchRun run;
+    const JsonValue& machine = root["machine"];
+    run.machine.host = machine["host"].string;
+    run.machine.cpu = machine["cpu"].string;
+    run.machine.cores = static_cast<uint32_t>(machine["cores"].number);
+    run.machine.os = machine["os"].string;
+    run.machine.device = machine["device"].string;
+    run.machine.vendor_id = static_cast<uint32_t>(machine["vendor_id"].number);
+    run.machine.device_id = static_cast<uint32_t>(machine["device_id"].number);
+    run.machine.driver_version = static_cast<uint32_t>(machine["driver_version"].number);
+    run.machine.api_version = static_cast<uint32_t>(machine["api_version_raw"].number);
+    run.machine.timestamp = machine["timestamp"].string;
+
+    for (const JsonValue& entry : root["results"].array)
+    {
+        BenchResult result;
+        result.capture = entry["capture"].string;
+        result.variant = entry["variant"].string;
+        result.frames = static_cast<uint32_t>(entry["frames"].number);
+        result.mean_ms = ReadSamples(entry["mean_ms"]);
+        result.median_ms = ReadSamples(entry["median_ms"]);
+        result.p95_ms = ReadSamples(entry["p95_ms"]);
+        run.results.push_back(std::move(result));
+    }
+    return run;
+}
+
+void BenchRun::Save(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Failed to open file! " + path);
+    }
+    file << ToJson();
+}
+
+BenchRun BenchRun::Load(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Failed to open file! " + path);
+    }
+    std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return FromJson(json);
+}
+
+const BenchResult *BenchRun::Find(const std::string& capture, const std::string& variant) const
+{
+    for (const BenchResult& result : results)
+    {
+        if (result.capture == capture && result.variant == variant)
+        {
+            return &result;
+        }
+    }
+    return nullptr;
+}
+
+ConfidenceInterval ConfidenceInterval::Of(const std::vector<double>& samples)
+{
+    ConfidenceInterval interval;
+    interval.trials = samples.size();
+    if (samples.empty())
+    {
+        return interval;
+    }
+    for (double sample : samples)
+    {
+        interval.mean += sample;
+    }
+    interval.mean /= samples.size();
+    if (samples.size() > 1)
+    {
+        double standardError = std::sqrt(Variance(samples, interval.mean) / samples.size());
+        interval.half_width = StudentT95(static_cast<double>(samples.size() - 1)) * standardError;
+    }
+    return interval;
+}
+
+std::string BenchComparison::Report(void) const
+{
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    out << current->capture << " (" << current->variant << "): mean " << now.mean << " ms +- " << now.half_width
+        << " over " << now.trials << " trials";
+    if (verdict == BenchVerdict::NoBaseline)
+    {
+        return out.str();
+    }
+
+    out << ", baseline " << before.mean << " ms +- " << before.half_width;
+    out.precision(1);
+    out << " (" << (change >= 0.0 ? "+" : "") << change * 100.0 << "%): ";
+    switch (verdict)
+    {
+    case BenchVerdict::Regression:
+        out << "REGRESSION";
+        break;
+    case BenchVerdict::Improvement:
+        out << "improvement";
+        break;
+    case BenchVerdict::Inconclusive:
+        out << "inconclusive, needs at least two trials on both sides";
+        break;
+    default:
+        out << "no significant change";
+    }
+    return out.str();
+}
+
+/**
+ * @brief Compares the mean frame times of every result in current with the same capture and variant in baseline.
+ * @details Each trial's mean frame time is one sample, and the two sets of samples are compared with Welch's t-test,
+ * which does not assume equal variances. A change counts when it is significant at the 95% level and larger than
+ * threshold, a fraction of the baseline mean, so that a real but negligible difference does not fail a run.
+ */
+std::vector<BenchComparison> chim::CompareRuns(const BenchRun& baseline, const BenchRun& current, double threshold)
+{
+    std::vector<BenchComparison> comparisons;
+    for (const BenchResult& result : current.results)
+    {
+        BenchComparison comparison;
+        comparison.current = &result;
+        comparison.now = ConfidenceInterval::Of(result.mean_ms);
+
+        const BenchResult *before = baseline.Find(result.capture, result.variant);
+        if (before == nullptr || before->mean_ms.empty())
+        {
+            comparisons.push_back(comparison);
+            continue;
+        }
+        comparison.before = ConfidenceInterval::Of(before->mean_ms);
+        comparison.change = comparison.before.mean > 0.0 ? comparison.now.mean / comparison.before.mean - 1.0 : 0.0;
+
+        if (result.mean_ms.size() < 2 || before->mean_ms.size() < 2)
+        {
+            comparison.verdict = BenchVerdict::Inconclusive;
+            comparisons.push_back(comparison);
+            continue;
+        }
+
+        double nowVariance = Variance(result.mean_ms, comparison.now.mean) / result.mean_ms.size();
+        double beforeVariance = Variance(before->mean_ms, comparison.before.mean) / before->mean_ms.size();
+        double difference = comparison.now.mean - comparison.before.mean;
+        bool significant = difference != 0.0;
+        if (nowVariance + beforeVariance > 0.0)
+        {
+            double t = difference / std::sqrt(nowVariance + beforeVariance);
+            // Welch–Satterthwaite degrees of freedom
+            double dof = (nowVariance + beforeVariance) * (nowVariance + beforeVariance) /
+                         (nowVariance * nowVariance / (result.mean_ms.size() - 1) +
+                          beforeVariance * beforeVariance / (before->mean_ms.size() - 1));
+            significant = std::abs(t) > StudentT95(dof);
+        }
+
+        comparison.verdict = BenchVerdict::Unchanged;
+        if (significant && std::abs(comparison.change) > threshold)
+        {
+            comparison.verdict = comparison.change > 0.0 ? BenchVerdict::Regression : BenchVerdict::Improvement;
+        }
+        comparisons.push_back(comparison);
+    }
+    return comparisons;
+}
@@ -0,0 +1,97 @@
+/**
+ * @file bench_results.hpp
+ * @author George Power
+ * @brief Benchmark results stored as JSON, and their statistical comparison against a baseline.
+ */
+#ifndef BENCH_RESULTS_HPP
+#define BENCH_RESULTS_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace chim
+{
+/**
+ * @brief Where a benchmark ran. Results are only comparable between runs on the same device and driver.
+ */
+struct BenchMachine
+{
+    std::string host;
+    std::string cpu;
+    uint32_t cores = 0;
+    std::string os;
+    std::string device;
+    uint32_t vendor_id = 0;
+    uint32_t device_id = 0;
+    uint32_t driver_version = 0;
+    uint32_t api_version = 0;
+    std::string timestamp; // UTC, ISO 8601
+
+    static BenchMachine Describe(const VkPhysicalDeviceProperties& device);
+    bool SameDevice(const BenchMachine& other) const;
+};
+
+/**
+ * @brief Every trial of one capture in one configuration. Each trial is a full replay with a fresh renderer.
+ */
+struct BenchResult
+{
+    std::string capture;
+    std::string variant;
+    uint32_t frames = 0;
+    std::vector<double> mean_ms; // Per trial
+    std::vector<double> median_ms;
+    std::vector<double> p95_ms;
+};
+
+struct BenchRun
+{
+    static constexpr uint32_t kVersion = 1;
+
+    BenchMachine machine;
+    std::vector<BenchResult> results;
+
+    std::string ToJson(void) const;
+    static BenchRun FromJson(const std::string& json);
+    void Save(const std::string& path) const;
+    static BenchRun Load(const std::string& path);
+    const BenchResult *Find(const std::string& capture, const std::string& variant) const;
+};
+
+/**
+ * @brief Mean of a sample with the half width of its 95% confidence interval (Student's t).
+ */
+struct ConfidenceInterval
+{
+    double mean = 0.0;
+    double half_width = 0.0;
+    size_t trials = 0;
+
+    static ConfidenceInterval Of(const std::vector<double>& samples);
+};
+
+enum class BenchVerdict
+{
+    Unchanged,
+    Regression,
+    Improvement,
+    Inconclusive, // Fewer than two trials on one side
+    NoBaseline
+};
+
+struct BenchComparison
+{
+    const BenchResult *current = nullptr;
+    ConfidenceInterval now;
+    ConfidenceInterval before;
+    double change = 0.0; // Relative change of the mean frame time, positive when slower
+    BenchVerdict verdict = BenchVerdict::NoBaseline;
+
+    std::string Report(void) const;
+};
+
+std::vector<BenchComparison> CompareRuns(const BenchRun& baseline, const BenchRun& current, double threshold);
+} // namespace chim
+#endif // BENCH_RESULTS_HPP
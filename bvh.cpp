@@ -0,0 +1,409 @@
+#include "bvh.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+using namespace chim;
+
+namespace
+{
+// Segment ends closer than this fraction of the segment to a surface do not count as blocked
+constexpr float kSegmentEpsilon = 1e-4f;
+
+bool SegmentHitsBox(const glm::vec3& origin, const glm::vec3& inverse_direction, const glm::vec3& min,
+                    const glm::vec3& max)
+{
+    float near = 0.0f;
+    float far = 1.0f;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float t0 = (min[axis] - origin[axis]) * inverse_direction[axis];
+        float t1 = (max[axis] - origin[axis]) * inverse_direction[axis];
+        if (t0 > t1)
+        {
+            std::swap(t0, t1);
+        }
+        near = std::max(near, t0);
+        far = std::min(far, t1);
+    }
+    return near <= far;
+}
+
+// Möller–Trumbore, for t along a segment of direction d in (epsilon, 1 - epsilon)
+bool SegmentHitsTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3 *corners)
+{
+    const glm::vec3 edge1 = corners[1] - corners[0];
+    const glm::vec3 edge2 = corners[2] - corners[0];
+    const glm::vec3 p = glm::cross(direction, edge2);
+    const float determinant = glm::dot(edge1, p);
+    if (std::abs(determinant) < 1e-12f)
+    {
+        return false;
+    }
+    const float inverse = 1.0f / determinant;
+    const glm::vec3 s = origin - corners[0];
+    const float u = glm::dot(s, p) * inverse;
+    if (u < 0.0f || u > 1.0f)
+    {
+        return false;
+    }
+    const glm::vec3 q = glm::cross(s, edge1);
+    const float v = glm::dot(direction, q) * inverse;
+    if (v < 0.0f || u + v > 1.0f)
+    {
+        return false;
+    }
+    const float t = glm::dot(edge2, q) * inverse;
+    return t > kSegmentEpsilon && t < 1.0f - kSegmentEpsilon;
+}
+
+// Packet rays ignore hits closer than this to their origin, so a ray leaving a surface does not hit it again
+constexpr float kRayEpsilon = 1e-4f;
+
+using PacketComponents = float[3][RayPacket::kSize];
+
+/**
+ * @brief Bit i set when ray i of the lanes given enters the box before its t_max.
+ */
+uint8_t BoxLanes(const RayPacket& packet, const PacketComponents& inverse_direction, const glm::vec3& min,
+                 const glm::vec3& max, uint8_t lanes)
+{
+#ifdef __AVX2__
+    __m256 near = _mm256_setzero_ps();
+    __m256 far = _mm256_load_ps(packet.t_max);
+    for (int axis = 0; axis < 3; axis++)
+    {
+        const __m256 origin = _mm256_load_ps(packet.origin[axis]);
+        const __m256 inverse = _mm256_load_ps(inverse_direction[axis]);
+        const __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(min[axis]), origin), inverse);
+        const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(max[axis]), origin), inverse);
+        near = _mm256_max_ps(near, _mm256_min_ps(t0, t1));
+        far = _mm256_min_ps(far, _mm256_max_ps(t0, t1));
+    }
+    return static_cast<uint8_t>(_mm256_movemask_ps(_mm256_cmp_ps(near, far, _CMP_LE_OQ))) & lanes;
+#else
+    uint8_t hits = 0;
+    for (uint32_t lane = 0; lane < RayPacket::kSize; lane++)
+    {
+        if (!(lanes & (1u << lane)))
+        {
+            continue;
+        }
+        float near = 0.0f;
+        float far = packet.t_max[lane];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float t0 = (min[axis] - packet.origin[axis][lane]) * inverse_direction[axis][lane];
+            float t1 = (max[axis] - packet.origin[axis][lane]) * inverse_direction[axis][lane];
+            near = std::max(near, std::min(t0, t1));
+            far = std::min(far, std::max(t0, t1));
+        }
+        hits |= near <= far ? 1u << lane : 0u;
+    }
+    return hits;
+#endif
+}
+
+/**
+ * @brief Möller–Trumbore for the lanes given; shortens t_max and stores u and v of the lanes that hit, and returns
+ * them.
+ */
+uint8_t TriangleLanes(RayPacket& packet, const glm::vec3 *corners, uint8_t lanes)
+{
+    const glm::vec3 edge1 = corners[1] - corners[0];
+    const glm::vec3 edge2 = corners[2] - corners[0];
+#ifdef __AVX2__
+    const __m256 dx = _mm256_load_ps(packet.direction[0]);
+    const __m256 dy = _mm256_load_ps(packet.direction[1]);
+    const __m256 dz = _mm256_load_ps(packet.direction[2]);
+    const __m256 e1x = _mm256_set1_ps(edge1.x), e1y = _mm256_set1_ps(edge1.y), e1z = _mm256_set1_ps(edge1.z);
+    const __m256 e2x = _mm256_set1_ps(edge2.x), e2y = _mm256_set1_ps(edge2.y), e2z = _mm256_set1_ps(edge2.z);
+
+    const __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+    const __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+    const __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+    const __m256 determinant =
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+    const __m256 inverse = _mm256_div_ps(_mm256_set1_ps(1.0f), determinant);
+
+    const __m256 sx = _mm256_sub_ps(_mm256_load_ps(packet.origin[0]), _mm256_set1_ps(corners[0].x));
+    const __m256 sy = _mm256_sub_ps(_mm256_load_ps(packet.origin[1]), _mm256_set1_ps(corners[0].y));
+    const __m256 sz = _mm256_sub_ps(_mm256_load_ps(packet.origin[2]), _mm256_set1_ps(corners[0].z));
+    const __m256 u = _mm256_mul_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)), inverse);
+
+    const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+    const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+    const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+    const __m256 v = _mm256_mul_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), inverse);
+    const __m256 t = _mm256_mul_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), inverse);
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 absDeterminant = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), determinant);
+    __m256 hit = _mm256_cmp_ps(absDeterminant, _mm256_set1_ps(1e-12f), _CMP_GT_OQ);
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_add_ps(u, v), _mm256_set1_ps(1.0f), _CMP_LE_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, _mm256_set1_ps(kRayEpsilon), _CMP_GT_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, _mm256_load_ps(packet.t_max), _CMP_LT_OQ));
+
+    const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256i selected = _mm256_and_si256(_mm256_set1_epi32(lanes), laneBits);
+    hit = _mm256_and_ps(hit, _mm256_castsi256_ps(_mm256_cmpeq_epi32(selected, laneBits)));
+
+    _mm256_store_ps(packet.t_max, _mm256_blendv_ps(_mm256_load_ps(packet.t_max), t, hit));
+    _mm256_store_ps(packet.u, _mm256_blendv_ps(_mm256_load_ps(packet.u), u, hit));
+    _mm256_store_ps(packet.v, _mm256_blendv_ps(_mm256_load_ps(packet.v), v, hit));
+    return static_cast<uint8_t>(_mm256_movemask_ps(hit));
+#else
+    uint8_t hits = 0;
+    for (uint32_t lane = 0; lane < RayPacket::kSize; lane++)
+    {
+        if (!(lanes & (1u << lane)))
+        {
+            continue;
+        }
+        const glm::vec3 direction(packet.direction[0][lane], packet.direction[1][lane], packet.direction[2][lane]);
+        const glm::vec3 p = glm::cross(direction, edge2);
+        const float determinant = glm::dot(edge1, p);
+        if (std::abs(determinant) <= 1e-12f)
+        {
+            continue;
+        }
+        const float inverse = 1.0f / determinant;
+        const glm::vec3 s =
+            glm::vec3(packet.origin[0][lane], packet.origin[1][lane], packet.origin[2][lane]) - corners[0];
+        const float u = glm::dot(s, p) * inverse;
+        const glm::vec3 q = glm::cross(s, edge1);
+        const float v = glm::dot(direction, q) * inverse;
+        const float t = glm::dot(edge2, q) * inverse;
+        if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > kRayEpsilon && t < packet.t_max[lane])
+        {
+            packet.t_max[lane] = t;
+            packet.u[lane] = u;
+            packet.v[lane] = v;
+            hits |= 1u << lane;
+        }
+    }
+    return hits;
+#endif
+}
+} // namespace
+
+void RayPacket::SetRay(uint32_t lane, const glm::vec3& from, const glm::vec3& dir, float length)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        origin[axis][lane] = from[axis];
+        direction[axis][lane] = dir[axis];
+    }
+    t_max[lane] = length;
+    u[lane] = 0.0f;
+    v[lane] = 0.0f;
+    triangle[lane] = kNoHit;
+}
+
+void TriangleBvh::Build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& objects)
+{
+    const uint32_t triangles = static_cast<uint32_t>(std::min(positions.size() / 3, objects.size()));
+    std::vector<glm::vec3> centroids(triangles);
+    std::vector<uint32_t> order(triangles);
+    for (uint32_t i = 0; i < triangles; i++)
+    {
+        centroids[i] = (positions[i * 3] + positions[i * 3 + 1] + positions[i * 3 + 2]) / 3.0f;
+        order[i] = i;
+    }
+
+    nodes_.clear();
+    nodes_.reserve(triangles > 0 ? 2 * triangles / kLeafSize + 1 : 0);
+    if (triangles > 0)
+    {
+        BuildNode(order, 0, triangles, positions, centroids);
+    }
+
+    positions_.resize(triangles * 3);
+    objects_.resize(triangles);
+    for (uint32_t i = 0; i < triangles; i++)
+    {
+        std::copy_n(positions.begin() + order[i] * 3, 3, positions_.begin() + i * 3);
+        objects_[i] = objects[order[i]];
+    }
+    sources_ = std::move(order);
+}
+
+/**
+ * @brief Builds the subtree over order[begin, end) and returns its index. Nodes are laid out depth first, so the left
+ * child of an inner node is always the node right after it.
+ */
+uint32_t TriangleBvh::BuildNode(std::vector<uint32_t>& order, uint32_t begin, uint32_t end,
+                                const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& centroids)
+{
+    const uint32_t index = static_cast<uint32_t>(nodes_.size());
+    nodes_.push_back({});
+
+    // The box must hold the triangles themselves, the split only looks at their centroids
+    glm::vec3 min(std::numeric_limits<float>::max());
+    glm::vec3 max(-std::numeric_limits<float>::max());
+    glm::vec3 centroidMin = min;
+    glm::vec3 centroidMax = max;
+    for (uint32_t i = begin; i < end; i++)
+    {
+        for (int corner = 0; corner < 3; corner++)
+        {
+            min = glm::min(min, positions[order[i] * 3 + corner]);
+            max = glm::max(max, positions[order[i] * 3 + corner]);
+        }
+        centroidMin = glm::min(centroidMin, centroids[order[i]]);
+        centroidMax = glm::max(centroidMax, centroids[order[i]]);
+    }
+
+    if (end - begin <= kLeafSize)
+    {
+        nodes_[index] = {min, max, begin, end - begin};
+        return index;
+    }
+
+    const glm::vec3 extent = centroidMax - centroidMin;
+    const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+    const uint32_t middle = begin + (end - begin) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                     [&centroids, axis](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+
+    BuildNode(order, begin, middle, positions, centroids);
+    const uint32_t right = BuildNode(order, middle, end, positions, centroids);
+    nodes_[index] = {min, max, right, 0};
+    return index;
+}
+
+/**
+ * @brief True when the segment from from to to passes through a triangle of any object other than ignore_object.
+ */
+bool TriangleBvh::Occluded(const glm::vec3& from, const glm::vec3& to, uint32_t ignore_object) const
+{
+    if (nodes_.empty())
+    {
+        return false;
+    }
+
+    const glm::vec3 direction = to - from;
+    glm::vec3 inverseDirection;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        inverseDirection[axis] = direction[axis] != 0.0f ? 1.0f / direction[axis] : std::numeric_limits<float>::max();
+    }
+
+    uint32_t stack[64];
+    uint32_t depth = 0;
+    stack[depth++] = 0;
+    while (depth > 0)
+    {
+        const Node& node = nodes_[stack[--depth]];
+        if (!SegmentHitsBox(from, inverseDirection, node.min, node.max))
+        {
+            continue;
+        }
+        if (node.count == 0)
+        {
+            const uint32_t self = static_cast<uint32_t>(&node - nodes_.data());
+            stack[depth++] = node.first;
+            stack[depth++] = self + 1;
+            continue;
+        }
+        for (uint32_t i = node.first; i < node.first + node.count; i++)
+        {
+            if (objects_[i] != ignore_object && SegmentHitsTriangle(from, direction, &positions_[i * 3]))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Finds the closest hit of every active ray. Rays that hit get triangle, u and v set and t_max shortened to the
+ * hit; the others keep kNoHit.
+ */
+void TriangleBvh::Intersect(RayPacket& packet) const
+{
+    std::fill(std::begin(packet.triangle), std::end(packet.triangle), RayPacket::kNoHit);
+    Traverse<false>(packet);
+}
+
+/**
+ * @brief Returns the active rays that hit anything before their t_max.
+ */
+uint8_t TriangleBvh::Occluded(const RayPacket& packet) const
+{
+    RayPacket copy = packet;
+    return Traverse<true>(copy);
+}
+
+template <bool kAnyHit> uint8_t TriangleBvh::Traverse(RayPacket& packet) const
+{
+    uint8_t hits = 0;
+    if (nodes_.empty() || packet.active == 0)
+    {
+        return hits;
+    }
+
+    alignas(32) PacketComponents inverseDirection;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        for (uint32_t lane = 0; lane < RayPacket::kSize; lane++)
+        {
+            const float direction = packet.direction[axis][lane];
+            inverseDirection[axis][lane] = direction != 0.0f ? 1.0f / direction : std::numeric_limits<float>::max();
+        }
+    }
+
+    uint32_t stack[64];
+    uint32_t depth = 0;
+    stack[depth++] = 0;
+    while (depth > 0)
+    {
+        const uint32_t index = stack[--depth];
+        const Node& node = nodes_[index];
+        // Any-hit queries are done with a ray once it hits; closest-hit ones keep looking for nearer hits
+        const uint8_t searching = kAnyHit ? packet.active & ~hits : packet.active;
+        const uint8_t lanes = BoxLanes(packet, inverseDirection, node.min, node.max, searching);
+        if (lanes == 0)
+        {
+            continue;
+        }
+        if (node.count == 0)
+        {
+            stack[depth++] = node.first;
+            stack[depth++] = index + 1;
+            continue;
+        }
+        for (uint32_t i = node.first; i < node.first + node.count; i++)
+        {
+            const uint8_t hit = TriangleLanes(packet, &positions_[i * 3], kAnyHit ? lanes & ~hits : lanes);
+            hits |= hit;
+            if constexpr (kAnyHit)
+            {
+                if (hits == packet.active)
+                {
+                    return hits;
+                }
+            }
+            else
+            {
+                for (uint32_t lane = 0; lane < RayPacket::kSize; lane++)
+                {
+                    if (hit & (1u << lane))
+                    {
+                        packet.triangle[lane] = i;
+                    }
+                }
+            }
+        }
+    }
+    return hits;
+}
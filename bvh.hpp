@@ -0,0 +1,84 @@
+/**
+ * @file bvh.hpp
+ * @author George Power
+ * @brief Bounding volume hierarchy over triangles, for ray queries of the offline bake tools.
+ */
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace chim
+{
+/**
+ * @struct RayPacket
+ * @brief Eight rays traced through the BVH together, stored one array per component so that a lane is a SIMD lane.
+ * @details Directions need not be normalized; distances are in units of the direction's length.
+ */
+struct RayPacket
+{
+    static constexpr uint32_t kSize = 8;
+    static constexpr uint32_t kNoHit = ~0u;
+
+    alignas(32) float origin[3][kSize] = {};
+    alignas(32) float direction[3][kSize] = {};
+    alignas(32) float t_max[kSize] = {}; // Length of each ray; Intersect shortens it to the closest hit
+    alignas(32) float u[kSize] = {};     // Barycentric coordinates of the hit on corners 1 and 2
+    alignas(32) float v[kSize] = {};
+    uint32_t triangle[kSize] = {};       // Hit triangle, in the order of the tree, or kNoHit
+    uint8_t active = 0xFF;               // Lanes to trace, bit i for lane i
+
+    void SetRay(uint32_t lane, const glm::vec3& from, const glm::vec3& dir, float length);
+};
+
+/**
+ * @class TriangleBvh
+ * @brief Binary tree of axis-aligned boxes over a triangle soup, split at the median of the longest axis.
+ * @details Every triangle carries the id of the object it belongs to, so that a query can ignore the object it is
+ * aiming at. The tree is immutable after Build and safe to query from any number of threads.
+ *
+ * Packets walk the tree once for all their rays: a node is entered when any active ray hits its box, and the boxes
+ * and triangles are tested against all eight rays at once. With AVX2 that is one instruction per step, otherwise a
+ * loop over the lanes. Packets pay off when their rays start close together and point roughly the same way.
+ */
+class TriangleBvh
+{
+  public:
+    static constexpr uint32_t kNoObject = ~0u;
+    static constexpr uint32_t kLeafSize = 4;
+
+    // positions holds three corners per triangle, objects one id per triangle
+    void Build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& objects);
+
+    bool Occluded(const glm::vec3& from, const glm::vec3& to, uint32_t ignore_object = kNoObject) const;
+    void Intersect(RayPacket& packet) const;
+    uint8_t Occluded(const RayPacket& packet) const;
+
+    size_t TriangleCount(void) const { return objects_.size(); }
+    const glm::vec3 *Corners(uint32_t triangle) const { return &positions_[triangle * 3]; }
+    uint32_t Object(uint32_t triangle) const { return objects_[triangle]; }
+    uint32_t Source(uint32_t triangle) const { return sources_[triangle]; } // Index of the triangle given to Build
+
+  private:
+    struct Node
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+        uint32_t first; // First triangle of a leaf, or the right child of an inner node (the left one follows it)
+        uint32_t count; // Triangles of a leaf, 0 for inner nodes
+    };
+
+    uint32_t BuildNode(std::vector<uint32_t>& order, uint32_t begin, uint32_t end,
+                       const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& centroids);
+    template <bool kAnyHit> uint8_t Traverse(RayPacket& packet) const;
+
+  private:
+    std::vector<Node> nodes_;
+    std::vector<glm::vec3> positions_; // Reordered so that each leaf's triangles are contiguous
+    std::vector<uint32_t> objects_;
+    std::vector<uint32_t> sources_;
+};
+} // namespace chim
+#endif // BVH_HPP
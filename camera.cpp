@@ -0,0 +1,223 @@
+#include "camera.hpp"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace chim;
+
+namespace
+{
+const glm::vec3 kWorldUp = {0.0f, 0.0f, 1.0f};
+const float kMaxPitch = glm::radians(89.0f);
+
+glm::vec4 Row(const glm::mat4& m, int row)
+{
+    return glm::vec4(m[0][row], m[1][row], m[2][row], m[3][row]);
+}
+
+glm::vec4 NormalizePlane(const glm::vec4& plane)
+{
+    return plane / glm::length(glm::vec3(plane.x, plane.y, plane.z));
+}
+} // namespace
+
+void Camera::SetPosition(const glm::vec3& position)
+{
+    position_ = position;
+    view_dirty_ = true;
+}
+
+/**
+ * @brief Turns the camera towards target without moving it.
+ */
+void Camera::LookAt(const glm::vec3& target)
+{
+    glm::vec3 direction = glm::normalize(target - position_);
+    yaw_ = std::atan2(direction.y, direction.x);
+    pitch_ = std::clamp(std::asin(direction.z), -kMaxPitch, kMaxPitch);
+    view_dirty_ = true;
+}
+
+void Camera::Move(const glm::vec3& local_delta)
+{
+    if (local_delta.x == 0.0f && local_delta.y == 0.0f && local_delta.z == 0.0f)
+    {
+        return;
+    }
+
+    glm::vec3 forward = Forward();
+    glm::vec3 right = glm::normalize(glm::cross(forward, kWorldUp));
+    position_ += right * local_delta.x + forward * local_delta.y + kWorldUp * local_delta.z;
+    view_dirty_ = true;
+}
+
+void Camera::Rotate(float yaw_delta, float pitch_delta)
+{
+    yaw_ = std::remainder(yaw_ + yaw_delta, 2.0f * 3.14159265358979f);
+    pitch_ = std::clamp(pitch_ + pitch_delta, -kMaxPitch, kMaxPitch);
+    view_dirty_ = true;
+}
+
+void Camera::SetViewport(VkExtent2D extent)
+{
+    viewport_ = extent;
+    projection_dirty_ = true;
+}
+
+void Camera::SetFieldOfView(float vertical_fov)
+{
+    vertical_fov_ = vertical_fov;
+    projection_dirty_ = true;
+}
+
+/**
+ * @brief Offsets the projection by a fraction of a pixel, for temporal techniques. Pass {0, 0} to disable.
+ */
+void Camera::SetJitter(const glm::vec2& jitter_pixels)
+{
+    if (jitter_pixels.x != jitter_.x || jitter_pixels.y != jitter_.y)
+    {
+        jitter_ = jitter_pixels;
+        projection_dirty_ = true;
+    }
+}
+
+/**
+ * @brief The jitter as an offset in normalized device coordinates, which is what the projection adds.
+ */
+glm::vec2 Camera::JitterNdc(void) const
+{
+    return glm::vec2(2.0f * jitter_.x / std::max(viewport_.width, 1u),
+                     2.0f * jitter_.y / std::max(viewport_.height, 1u));
+}
+
+/**
+ * @brief Sub-pixel offsets from the Halton (2, 3) sequence, repeating every 8 frames, centred on the pixel.
+ */
+glm::vec2 Camera::JitterSequence(uint64_t frame)
+{
+    auto halton = [](uint32_t index, uint32_t base) {
+        float fraction = 1.0f;
+        float result = 0.0f;
+        while (index > 0)
+        {
+            fraction /= base;
+            result += fraction * (index % base);
+            index /= base;
+        }
+        return result;
+    };
+
+    uint32_t index = static_cast<uint32_t>(frame % 8) + 1;
+    return glm::vec2(halton(index, 2) - 0.5f, halton(index, 3) - 0.5f);
+}
+
+glm::vec3 Camera::Forward(void) const
+{
+    return glm::vec3(std::cos(pitch_) * std::cos(yaw_), std::cos(pitch_) * std::sin(yaw_), std::sin(pitch_));
+}
+
+const glm::mat4& Camera::View(void)
+{
+    Update();
+    return view_;
+}
+
+const glm::mat4& Camera::Projection(void)
+{
+    Update();
+    return projection_;
+}
+
+const glm::mat4& Camera::ViewProjection(void)
+{
+    Update();
+    return view_projection_;
+}
+
+const Camera::Frustum& Camera::Planes(void)
+{
+    Update();
+    return frustum_;
+}
+
+/**
+ * @brief The projection Update builds, without jitter: infinite, reverse-Z, Vulkan clip space.
+ * @details Also used for views that are not the camera's own, such as the faces of a probe.
+ */
+glm::mat4 Camera::InfiniteProjection(float vertical_fov, float aspect, float near_plane)
+{
+    float focal = 1.0f / std::tan(vertical_fov * 0.5f);
+
+    glm::mat4 projection(0.0f);
+    projection[0][0] = focal / aspect;
+    projection[1][1] = -focal;
+    projection[2][3] = -1.0f;
+    projection[3][2] = near_plane;
+    return projection;
+}
+
+/**
+ * @brief The planes of a reverse-Z, infinite clip space, in the space clip_from_world transforms from, pointing inwards
+ * with unit normals.
+ */
+Camera::Frustum Camera::FrustumPlanes(const glm::mat4& clip_from_world)
+{
+    glm::vec4 x = Row(clip_from_world, 0);
+    glm::vec4 y = Row(clip_from_world, 1);
+    glm::vec4 z = Row(clip_from_world, 2);
+    glm::vec4 w = Row(clip_from_world, 3);
+    return {NormalizePlane(w + x), NormalizePlane(w - x), NormalizePlane(w + y), NormalizePlane(w - y),
+            NormalizePlane(w - z)};
+}
+
+/**
+ * @brief Conservative sphere test against the cached frustum.
+ */
+bool Camera::SphereVisible(const glm::vec3& center, float radius)
+{
+    for (const glm::vec4& plane : Planes())
+    {
+        if (glm::dot(glm::vec3(plane.x, plane.y, plane.z), center) + plane.w < -radius)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Rebuilds whatever is dirty.
+ * @details The projection is an infinite perspective with reversed depth, for Vulkan clip space (depth 0..1, Y
+ * down). A view space point at distance d in front of the camera gets depth near / d. The frustum is taken from the
+ * projection without jitter so culling does not flicker with the jitter sequence.
+ */
+void Camera::Update(void)
+{
+    if (!view_dirty_ && !projection_dirty_)
+    {
+        return;
+    }
+
+    if (view_dirty_)
+    {
+        view_ = glm::lookAt(position_, position_ + Forward(), kWorldUp);
+    }
+
+    float aspect = viewport_.height > 0 ? viewport_.width / static_cast<float>(viewport_.height) : 1.0f;
+    glm::mat4 projection = InfiniteProjection(vertical_fov_, aspect, near_);
+
+    glm::mat4 culling = projection * view_;
+
+    // Clip space w is the view distance, so this shifts NDC by exactly the jitter at every depth
+    glm::vec2 jitter = JitterNdc();
+    projection[2][0] = -jitter.x;
+    projection[2][1] = -jitter.y;
+    projection_ = projection;
+    view_projection_ = projection_ * view_;
+
+    frustum_ = FrustumPlanes(culling);
+
+    view_dirty_ = false;
+    projection_dirty_ = false;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file camera.hpp
+ * @author George Power
+ * @brief A free-flying perspective camera with a reverse-Z, infinite far plane projection.
+ */
+#ifndef CAMERA_HPP
+#define CAMERA_HPP
+
+#include "render_types.hpp"
+#include <array>
+#include <glm/glm.hpp>
+
+namespace chim
+{
+/**
+ * @class Camera
+ * @brief Position and orientation of the viewer plus the projection derived from them.
+ * @details Depth is reversed: the near plane maps to 1 and the (infinitely far) far plane to 0, so the depth buffer
+ * must be cleared to 0 and compared with VK_COMPARE_OP_GREATER. Floating point depth then keeps its precision over
+ * the whole view distance instead of bunching it up next to the near plane.
+ *
+ * The view, projection, view-projection and frustum are cached and only rebuilt after something they depend on has
+ * changed. The world is Z-up, matching the scene.
+ */
+class Camera
+{
+  public:
+    // Left, right, bottom, top, near. An infinite projection has no far plane.
+    using Frustum = std::array<glm::vec4, 5>;
+
+    void SetPosition(const glm::vec3& position);
+    void LookAt(const glm::vec3& target);
+    void Move(const glm::vec3& local_delta); // x right, y forward, z up
+    void Rotate(float yaw_delta, float pitch_delta);
+    void SetViewport(VkExtent2D extent);
+    void SetFieldOfView(float vertical_fov);
+    void SetJitter(const glm::vec2& jitter_pixels);
+
+    const glm::vec3& Position(void) const { return position_; }
+    glm::vec3 Forward(void) const;
+    const glm::vec2& Jitter(void) const { return jitter_; }
+    glm::vec2 JitterNdc(void) const;
+    static glm::vec2 JitterSequence(uint64_t frame);
+    static glm::mat4 InfiniteProjection(float vertical_fov, float aspect, float near_plane);
+    static Frustum FrustumPlanes(const glm::mat4& clip_from_world);
+    float FieldOfView(void) const { return vertical_fov_; }
+    float NearPlane(void) const { return near_; }
+
+    const glm::mat4& View(void);
+    const glm::mat4& Projection(void);
+    const glm::mat4& ViewProjection(void);
+    const Frustum& Planes(void);
+
+    bool SphereVisible(const glm::vec3& center, float radius);
+
+  private:
+    void Update(void);
+
+  private:
+    glm::vec3 position_{0.0f, 0.0f, 0.0f};
+    float yaw_ = 0.0f;   // Radians around +Z, 0 looks down +X
+    float pitch_ = 0.0f; // Radians, positive looks up
+    float vertical_fov_ = glm::radians(45.0f);
+    float near_ = 0.1f;
+    VkExtent2D viewport_{1, 1};
+    glm::vec2 jitter_{0.0f, 0.0f}; // Sub-pixel offset, in pixels
+
+    bool view_dirty_ = true;
+    bool projection_dirty_ = true;
+    glm::mat4 view_{1.0f};
+    glm::mat4 projection_{1.0f};
+    glm::mat4 view_projection_{1.0f};
+    Frustum frustum_{};
+};
+} // namespace chim
+#endif // CAMERA_HPP
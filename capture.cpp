@@ -0,0 +1,371 @@
+#include "capture.hpp"
+#include "chim.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+
+using namespace chim;
+
+namespace
+{
+/**
+ * @brief Reads the size of the next record, throwing when it claims more bytes than the file has left.
+ * @return False at the end of the file.
+ */
+bool ReadRecordSize(std::ifstream& file, uint64_t fileSize, uint32_t& size, const std::string& path)
+{
+    if (!file.read(reinterpret_cast<char *>(&size), sizeof(size)))
+    {
+        return false;
+    }
+    if (size > fileSize - static_cast<uint64_t>(file.tellg()))
+    {
+        throw ChimException("Truncated capture file! " + path);
+    }
+    return true;
+}
+
+uint64_t FileSize(std::ifstream& file)
+{
+    file.seekg(0, std::ios::end);
+    uint64_t size = static_cast<uint64_t>(file.tellg());
+    file.seekg(0, std::ios::beg);
+    return size;
+}
+} // namespace
+
+/**
+ * @brief Starts a capture. Frames are counted by EndFrame; the file is closed after the last one.
+ */
+void CaptureWriter::Open(const std::string& path, uint32_t frames, VkExtent2D extent)
+{
+    file_.open(path, std::ios::binary | std::ios::trunc);
+    if (!file_.is_open())
+    {
+        throw ChimException("Failed to open capture file! " + path);
+    }
+
+    path_ = path;
+    frames_left_ = frames;
+
+    CaptureHeader header{kCaptureMagic, kCaptureVersion, extent.width, extent.height};
+    file_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+}
+
+void CaptureWriter::WriteVertexBuffer(const std::vector<Vertex>& vertices)
+{
+    Record(CaptureOp::CreateVertexBuffer, vertices.data(), static_cast<uint32_t>(sizeof(Vertex) * vertices.size()));
+}
+
+void CaptureWriter::WriteIndexBuffer(const std::vector<uint16_t>& indices)
+{
+    Record(CaptureOp::CreateIndexBuffer, indices.data(), static_cast<uint32_t>(sizeof(uint16_t) * indices.size()));
+}
+
+void CaptureWriter::WriteUniform(uint32_t offset, const void *data, uint32_t size)
+{
+    std::vector<uint8_t> payload(sizeof(offset) + size);
+    memcpy(payload.data(), &offset, sizeof(offset));
+    memcpy(payload.data() + sizeof(offset), data, size);
+    Record(CaptureOp::UniformWrite, payload.data(), static_cast<uint32_t>(payload.size()));
+}
+
+void CaptureWriter::WriteCamera(const glm::mat4& view, const glm::mat4& proj)
+{
+    glm::mat4 payload[2] = {view, proj};
+    Record(CaptureOp::Camera, payload, sizeof(payload));
+}
+
+void CaptureWriter::WriteDraw(const DrawCommand& draw)
+{
+    Record(CaptureOp::DrawIndexed, &draw, sizeof(draw));
+}
+
+void CaptureWriter::EndFrame(void)
+{
+    if (!IsRecording())
+    {
+        return;
+    }
+
+    Record(CaptureOp::EndFrame, nullptr, 0);
+    if (--frames_left_ == 0)
+    {
+        file_.close();
+        LOG("Capture written to " << path_);
+    }
+}
+
+void CaptureWriter::Record(CaptureOp op, const void *payload, uint32_t size)
+{
+    if (!IsRecording())
+    {
+        return;
+    }
+
+    file_.put(static_cast<char>(op));
+    file_.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    if (size > 0)
+    {
+        file_.write(static_cast<const char *>(payload), size);
+    }
+}
+
+/**
+ * @brief Reads and decodes a whole capture file.
+ * @details Records after the last EndFrame belong to an unfinished frame and are dropped.
+ */
+Capture chim::LoadCapture(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        throw ChimException("Failed to open capture file! " + path);
+    }
+    const uint64_t fileSize = FileSize(file);
+
+    CaptureHeader header{};
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!file || header.magic != kCaptureMagic || header.version != kCaptureVersion)
+    {
+        throw ChimException("Not a supported capture file! " + path);
+    }
+
+    Capture capture;
+    capture.extent = {header.width, header.height};
+
+    CapturedFrame frame;
+    std::vector<uint8_t> payload;
+    while (true)
+    {
+        int op = file.get();
+        uint32_t size = 0;
+        if (op == std::char_traits<char>::eof() || !ReadRecordSize(file, fileSize, size, path))
+        {
+            break;
+        }
+
+        payload.resize(size);
+        if (size > 0 && !file.read(reinterpret_cast<char *>(payload.data()), size))
+        {
+            throw ChimException("Truncated capture file! " + path);
+        }
+
+        switch (static_cast<CaptureOp>(op))
+        {
+        case CaptureOp::CreateVertexBuffer:
+            capture.vertices.resize(size / sizeof(Vertex));
+            memcpy(capture.vertices.data(), payload.data(), capture.vertices.size() * sizeof(Vertex));
+            break;
+        case CaptureOp::CreateIndexBuffer:
+            capture.indices.resize(size / sizeof(uint16_t));
+            memcpy(capture.indices.data(), payload.data(), capture.indices.size() * sizeof(uint16_t));
+            break;
+        case CaptureOp::UniformWrite: {
+            UniformWrite write{};
+            if (size < sizeof(write.offset))
+            {
+                throw ChimException("Malformed uniform write in capture file! " + path);
+            }
+            memcpy(&write.offset, payload.data(), sizeof(write.offset));
+            write.data.assign(payload.begin() + sizeof(write.offset), payload.end());
+            if (write.offset + write.data.size() > sizeof(UniformBufferObject))
+            {
+                throw ChimException("Uniform write out of range in capture file! " + path);
+            }
+            frame.uniforms.push_back(std::move(write));
+            break;
+        }
+        case CaptureOp::Camera:
+            if (size != 2 * sizeof(glm::mat4))
+            {
+                throw ChimException("Malformed camera in capture file! " + path);
+            }
+            memcpy(&frame.view, payload.data(), sizeof(glm::mat4));
+            memcpy(&frame.proj, payload.data() + sizeof(glm::mat4), sizeof(glm::mat4));
+            frame.has_camera = true;
+            break;
+        case CaptureOp::DrawIndexed: {
+            DrawCommand draw{};
+            if (size != sizeof(draw))
+            {
+                throw ChimException("Malformed draw in capture file! " + path);
+            }
+            memcpy(&draw, payload.data(), sizeof(draw));
+            frame.draws.push_back(draw);
+            break;
+        }
+        case CaptureOp::EndFrame:
+            capture.frames.push_back(std::move(frame));
+            frame = CapturedFrame{};
+            break;
+        case CaptureOp::Visibility:
+            capture.visibility = PvsGrid::Decode(payload);
+            break;
+        case CaptureOp::Lightmap:
+            capture.lightmap = Lightmap::Decode(payload);
+            break;
+        default:
+            throw ChimException("Unknown record in capture file! " + path);
+        }
+    }
+
+    return capture;
+}
+
+/**
+ * @brief Stores baked data in an existing capture as a record of type op, replacing any it already holds. An empty
+ * payload only removes the record.
+ * @details The file is rewritten through a temporary next to it, so a failed write leaves the original untouched.
+ */
+void chim::ReplaceCaptureRecord(const std::string& path, CaptureOp op, const std::vector<uint8_t>& payload)
+{
+    std::ifstream in(path, std::ios::binary);
+    const uint64_t fileSize = in.is_open() ? FileSize(in) : 0;
+    CaptureHeader header{};
+    if (!in.is_open() || !in.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.magic != kCaptureMagic ||
+        header.version != kCaptureVersion)
+    {
+        throw ChimException("Not a supported capture file! " + path);
+    }
+
+    const std::string temporary = path + ".tmp";
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+        throw ChimException("Failed to open capture file! " + temporary);
+    }
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    auto record = [&out](int record_op, const std::vector<uint8_t>& record_payload) {
+        uint32_t size = static_cast<uint32_t>(record_payload.size());
+        out.put(static_cast<char>(record_op));
+        out.write(reinterpret_cast<const char *>(&size), sizeof(size));
+        out.write(reinterpret_cast<const char *>(record_payload.data()), size);
+    };
+
+    std::vector<uint8_t> existing;
+    while (true)
+    {
+        int existingOp = in.get();
+        uint32_t size = 0;
+        if (existingOp == std::char_traits<char>::eof() || !ReadRecordSize(in, fileSize, size, path))
+        {
+            break;
+        }
+        existing.resize(size);
+        if (size > 0 && !in.read(reinterpret_cast<char *>(existing.data()), size))
+        {
+            throw ChimException("Truncated capture file! " + path);
+        }
+        if (static_cast<CaptureOp>(existingOp) != op)
+        {
+            record(existingOp, existing);
+        }
+    }
+    if (!payload.empty())
+    {
+        record(static_cast<int>(op), payload);
+    }
+
+    out.close();
+    if (!out)
+    {
+        throw ChimException("Failed to write capture file! " + temporary);
+    }
+    in.close();
+
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+    {
+        throw ChimException("Failed to replace capture file! " + path);
+    }
+}
+
+void PayloadReader::Get(void *data, size_t size)
+{
+    if (size > bytes_.size() - offset_)
+    {
+        throw ChimException("Truncated record in capture file!");
+    }
+    memcpy(data, bytes_.data() + offset_, size);
+    offset_ += size;
+}
+
+std::vector<DrawCommand> chim::CapturedObjects(const Capture& capture)
+{
+    std::vector<DrawCommand> objects;
+    for (const CapturedFrame& frame : capture.frames)
+    {
+        for (const DrawCommand& draw : frame.draws)
+        {
+            if (std::find(objects.begin(), objects.end(), draw) == objects.end())
+            {
+                objects.push_back(draw);
+            }
+        }
+    }
+    return objects;
+}
+
+std::vector<uint32_t> chim::DrawTriangleVertices(const Capture& capture, const DrawCommand& draw)
+{
+    std::vector<uint32_t> vertices;
+    for (uint32_t i = 0; i + 2 < draw.index_count; i += 3)
+    {
+        uint32_t corners[3];
+        bool valid = true;
+        for (uint32_t corner = 0; corner < 3 && valid; corner++)
+        {
+            const size_t index = static_cast<size_t>(draw.first_index) + i + corner;
+            const int64_t vertex =
+                index < capture.indices.size() ? int64_t(draw.vertex_offset) + capture.indices[index] : -1;
+            valid = vertex >= 0 && vertex < static_cast<int64_t>(capture.vertices.size());
+            corners[corner] = static_cast<uint32_t>(vertex);
+        }
+        if (valid)
+        {
+            vertices.insert(vertices.end(), corners, corners + 3);
+        }
+    }
+    return vertices;
+}
+
+ReplayStats ReplayStats::FromFrameTimes(std::vector<double> frame_ms)
+{
+    ReplayStats stats;
+    if (frame_ms.empty())
+    {
+        return stats;
+    }
+
+    std::sort(frame_ms.begin(), frame_ms.end());
+    stats.frames = static_cast<uint32_t>(frame_ms.size());
+    for (double ms : frame_ms)
+    {
+        stats.total_ms += ms;
+    }
+    stats.min_ms = frame_ms.front();
+    stats.max_ms = frame_ms.back();
+    stats.mean_ms = stats.total_ms / frame_ms.size();
+    stats.median_ms = frame_ms[frame_ms.size() / 2];
+    stats.p95_ms = frame_ms[std::min(frame_ms.size() - 1, frame_ms.size() * 95 / 100)];
+
+    return stats;
+}
+
+std::string ReplayStats::Report(void) const
+{
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    out << frames << " frames in " << total_ms << " ms (min " << min_ms << ", mean " << mean_ms << ", median "
+        << median_ms << ", p95 " << p95_ms << ", max " << max_ms << " ms)";
+    if (has_counters)
+    {
+        out << "\n" << PerfReport(counters, frames);
+    }
+    return out.str();
+}
@@ -0,0 +1,169 @@
+/**
+ * @file capture.hpp
+ * @author George Power
+ * @brief Records renderer-level commands into a compact binary log and loads them back for replay.
+ */
+#ifndef CAPTURE_HPP
+#define CAPTURE_HPP
+
+#include "lightmap.hpp"
+#include "perf_counters.hpp"
+#include "pvs.hpp"
+#include "render_types.hpp"
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace chim
+{
+/**
+ * @brief Record types of a capture file.
+ * @details A capture starts with a CaptureHeader followed by records of the form
+ * [uint8 op][uint32 payload size][payload]. Everything is stored in host byte order: captures are meant to be
+ * replayed on the machine (or at least the architecture) that recorded them.
+ */
+enum class CaptureOp : uint8_t
+{
+    CreateVertexBuffer = 1, // Vertex[]
+    CreateIndexBuffer,      // uint16_t[]
+    UniformWrite,           // uint32_t offset into UniformBufferObject, bytes
+    Camera,                 // glm::mat4 view, glm::mat4 proj
+    DrawIndexed,            // DrawCommand
+    EndFrame,               // Empty
+    Visibility,             // PvsGrid::Encode, written by chim_pvs after the frames
+    Lightmap                // Lightmap::Encode, written by chim_lightmap after the frames
+};
+
+struct CaptureHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+};
+
+const uint32_t kCaptureMagic = 0x4D494843; // "CHIM"
+const uint32_t kCaptureVersion = 3; // 2: projections are reverse-Z, 3: vertex positions are 3D
+
+/**
+ * @class CaptureWriter
+ * @brief Streams records to disk and closes the file after the requested number of frames.
+ */
+class CaptureWriter
+{
+  public:
+    void Open(const std::string& path, uint32_t frames, VkExtent2D extent);
+    bool IsRecording(void) const { return file_.is_open(); }
+
+    void WriteVertexBuffer(const std::vector<Vertex>& vertices);
+    void WriteIndexBuffer(const std::vector<uint16_t>& indices);
+    void WriteUniform(uint32_t offset, const void *data, uint32_t size);
+    void WriteCamera(const glm::mat4& view, const glm::mat4& proj);
+    void WriteDraw(const DrawCommand& draw);
+    void EndFrame(void);
+
+  private:
+    void Record(CaptureOp op, const void *payload, uint32_t size);
+
+  private:
+    std::ofstream file_;
+    std::string path_;
+    uint32_t frames_left_ = 0;
+};
+
+struct UniformWrite
+{
+    uint32_t offset;
+    std::vector<uint8_t> data;
+};
+
+struct CapturedFrame
+{
+    std::vector<UniformWrite> uniforms;
+    bool has_camera = false;
+    glm::mat4 view;
+    glm::mat4 proj;
+    std::vector<DrawCommand> draws;
+};
+
+/**
+ * @brief A fully decoded capture. Replays work from memory so file I/O never shows up in the timings.
+ */
+struct Capture
+{
+    VkExtent2D extent{};
+    std::vector<Vertex> vertices; // The last CreateVertexBuffer record wins
+    std::vector<uint16_t> indices;
+    std::vector<CapturedFrame> frames;
+    std::optional<PvsGrid> visibility;
+    std::optional<Lightmap> lightmap;
+};
+
+/**
+ * @brief Builds the payload of a record of baked data field by field, in host byte order like the rest of the file.
+ */
+class PayloadWriter
+{
+  public:
+    template <typename T> void Put(const T& value) { Put(&value, sizeof(value)); }
+    void Put(const void *data, size_t size)
+    {
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        bytes_.insert(bytes_.end(), bytes, bytes + size);
+    }
+    std::vector<uint8_t>& Bytes(void) { return bytes_; }
+
+  private:
+    std::vector<uint8_t> bytes_;
+};
+
+/**
+ * @brief Reads back what PayloadWriter wrote, throwing when the payload ends early.
+ */
+class PayloadReader
+{
+  public:
+    explicit PayloadReader(const std::vector<uint8_t>& bytes) : bytes_(bytes) {}
+    template <typename T> T Get(void)
+    {
+        T value{};
+        Get(&value, sizeof(value));
+        return value;
+    }
+    void Get(void *data, size_t size);
+
+  private:
+    const std::vector<uint8_t>& bytes_;
+    size_t offset_ = 0;
+};
+
+Capture LoadCapture(const std::string& path);
+void ReplaceCaptureRecord(const std::string& path, CaptureOp op, const std::vector<uint8_t>& payload);
+
+// The distinct draws of all frames, in the order they first appear: the static objects of the captured scene
+std::vector<DrawCommand> CapturedObjects(const Capture& capture);
+// Indices into capture.vertices, three per triangle of the draw; triangles reaching outside the buffers are skipped
+std::vector<uint32_t> DrawTriangleVertices(const Capture& capture, const DrawCommand& draw);
+
+/**
+ * @brief Frame time summary of one replay.
+ */
+struct ReplayStats
+{
+    uint32_t frames = 0;
+    double total_ms = 0.0;
+    double min_ms = 0.0;
+    double mean_ms = 0.0;
+    double median_ms = 0.0;
+    double p95_ms = 0.0;
+    double max_ms = 0.0;
+    bool has_counters = false; // Set when the replay ran with --perf-counters and the counters could be opened
+    PhaseCounters counters{};
+
+    static ReplayStats FromFrameTimes(std::vector<double> frame_ms);
+    std::string Report(void) const;
+};
+} // namespace chim
+#endif // CAPTURE_HPP
@@ -4,119 +4,740 @@ using namespace chim;
 
 Chim::Chim() {}
 
+Chim::Chim(const ChimSettings& settings)
+    : settings_(settings), window_width_(settings.width), window_height_(settings.height)
+{
+}
+
 Chim::~Chim() {}
 
 /**
- * @brief Initializes the main window.
- * @details The window properties are derived from the config file. If the
- * config file is invalid (or absent) the window will be set to the default:
- * - 1280x720
- * - Windowed
+ * @brief Creates everything needed to draw the first frame.
+ * @details Start-up runs as a small task graph. Work that does not depend on the step before it runs on a worker
+ * thread while the main thread, which owns SDL and the command pool, carries on: the shaders are read from disk while
+ * SDL starts, the instance is created while the window opens, and the scene pipeline compiles while the swap chain,
+ * targets and buffers are set up. Every stage is timed into startup_, which is reported after the first frame.
  */
 void Chim::Init(void)
 {
-    // Initialize SDL2 & create a window
-    if (SDL_Init(SDL_INIT_VIDEO) < 0)
+    // Opened first so that the worker threads started below see it; nothing is counted before Init finishes
+    if (settings_.perf_counters)
+    {
+        std::string error;
+        if (!perf_.Open(error))
+        {
+            LOG("Performance counters unavailable, " + error);
+        }
+    }
+
+    std::future<void> shaders =
+        std::async(std::launch::async, [this] { startup_.Time("read shaders", [this] { PreloadShaders(); }); });
+
+    // A replay renders the captured scene at the captured resolution
+    if (settings_.replay_path.empty())
+    {
+        SceneGeometry scene = BuiltinScene(settings_.scene);
+        scene_vertices_ = std::move(scene.vertices);
+        scene_indices_ = std::move(scene.indices);
+        scene_draws_ = std::move(scene.draws);
+    }
+    else
     {
-        throw ChimException(std::string("Video Initialization: ") + SDL_GetError());
+        startup_.Time("load capture", [this] {
+            replay_ = LoadCapture(settings_.replay_path);
+            window_width_ = replay_.extent.width;
+            window_height_ = replay_.extent.height;
+            if (settings_.lightmap && replay_.lightmap)
+            {
+                ApplyLightmap(*replay_.lightmap, replay_);
+            }
+            scene_vertices_ = replay_.vertices;
+            scene_indices_ = replay_.indices;
+            scene_draws_ = {{static_cast<uint32_t>(scene_indices_.size()), 0, 0}};
+            if (settings_.pvs)
+            {
+                pvs_ = replay_.visibility;
+            }
+        });
     }
-    window_ = SDL_CreateWindow("CHIM: A New Headache", SDL_WINDOWPOS_CENTERED_DISPLAY(0),
-                               SDL_WINDOWPOS_CENTERED_DISPLAY(0), window_width_, window_height_, SDL_WINDOW_VULKAN);
-    if (window_ == nullptr)
+    if (!settings_.headless)
     {
-        throw ChimException(std::string("Window creation: ") + SDL_GetError());
+        startup_.Time("init SDL", [] {
+            if (SDL_Init(SDL_INIT_VIDEO) < 0)
+            {
+                throw ChimException(std::string("Video Initialization: ") + SDL_GetError());
+            }
+            // Loaded before any window exists so that the instance extensions can be queried without one
+            if (SDL_Vulkan_LoadLibrary(nullptr) != 0)
+            {
+                throw ChimException(std::string("Vulkan loader: ") + SDL_GetError());
+            }
+        });
     }
 
-    SDL_SetWindowMinimumSize(window_, 640, 360);
+    // Initialize Vulkan. Loading the drivers is the slowest part of start-up and only needs the extension names.
+    std::vector<const char *> extensions = GetRequiredExtensions();
+    std::future<void> instance = std::async(std::launch::async, [this, extensions] {
+        startup_.Time("create instance", [this, &extensions] {
+            CreateInstance(extensions);
+            SetupDebugMessenger();
+        });
+    });
+    if (!settings_.headless)
+    {
+        // Initialize SDL2 & create a window
+        startup_.Time("create window", [this] {
+            window_ = SDL_CreateWindow("CHIM: A New Headache", SDL_WINDOWPOS_CENTERED_DISPLAY(0),
+                                       SDL_WINDOWPOS_CENTERED_DISPLAY(0), window_width_, window_height_,
+                                       SDL_WINDOW_VULKAN);
+            if (window_ == nullptr)
+            {
+                throw ChimException(std::string("Window creation: ") + SDL_GetError());
+            }
 
-    SDL_SetWindowResizable(window_, SDL_TRUE);
+            SDL_SetWindowMinimumSize(window_, 640, 360);
 
-    // Initialize Vulkan
-    CreateInstance();
-    SetupDebugMessenger();
-    CreateSurface();
-    PickPhysicalDevice();
-    CreateLogicalDevice();
-    CreateSwapChain();
-    CreateImageViews();
-    CreateRenderPass();
-    CreateDescriptorSetLayout();
-    CreateGraphicsPipeline();
-    CreateFrameBuffers();
-    CreateCommandPool();
-    CreateVertexBuffer();
-    CreateIndexBuffer();
-    CreateUniformBuffers();
-    CreateCommandBuffers();
-    CreateSyncObjects();
+            SDL_SetWindowResizable(window_, SDL_TRUE);
+        });
+    }
+    instance.get();
+
+    startup_.Time("create device", [this] {
+        if (!settings_.headless)
+        {
+            CreateSurface();
+        }
+        PickPhysicalDevice();
+        CreateLogicalDevice();
+        InitProfiler();
+    });
+    startup_.Time("create render pass", [this] {
+        CreateRenderPass();
+        CreateDescriptorSetLayout();
+        CreatePipelineCache();
+    });
+
+    // The scene pipeline only needs the scene render pass. Nothing else builds pipelines until it has been joined, so
+    // pipeline_parts_ and pending_pipelines_ stay with the worker meanwhile.
+    shaders.get();
+    std::future<void> scenePipeline = std::async(std::launch::async, [this] {
+        startup_.Time("compile scene pipeline", [this] { CreateGraphicsPipeline(); });
+    });
+
+    camera_.SetPosition(glm::vec3(2.0f, 2.0f, 2.0f));
+    camera_.LookAt(glm::vec3(0.0f, 0.0f, 0.0f));
+    startup_.Time("create swap chain", [this] {
+        if (settings_.headless)
+        {
+            CreateOffscreenTargets();
+        }
+        else
+        {
+            CreateSwapChain();
+        }
+        CreateImageViews();
+        CreateTemporalRenderPasses();
+        CreateFrameBuffers();
+    });
+    if (!settings_.capture_path.empty())
+    {
+        capture_.Open(settings_.capture_path, settings_.capture_frames, swap_chain_extent_);
+    }
+    startup_.Time("create buffers", [this] {
+        CreateCommandPool();
+        // The history transitions and the geometry upload reach the GPU in one submit
+        BeginUploadBatch();
+        CreateSceneTargets();
+        CreateGeometryBuffers();
+        scene_mesh_ = UploadMesh(scene_vertices_, scene_indices_);
+        EndUploadBatch();
+        CreateUniformBuffers();
+    });
+    draw_list_ = scene_draws_;
+    for (DrawCommand& draw : draw_list_)
+    {
+        draw.first_index += scene_mesh_.first_index;
+        draw.vertex_offset += static_cast<int32_t>(scene_mesh_.first_vertex);
+    }
+    capture_.WriteVertexBuffer(scene_vertices_);
+    capture_.WriteIndexBuffer(scene_indices_);
+    scenePipeline.get();
+
+    startup_.Time("create descriptors", [this] {
+        CreateDescriptorPool();
+        if (descriptor_buffer_)
+        {
+            CreateDescriptorBuffer();
+        }
+        else
+        {
+            CreateDescriptorSets();
+        }
+    });
+    startup_.Time("create passes", [this] {
+        CreateTemporalResources();
+        if (settings_.foliage)
+        {
+            CreateFoliageResources();
+        }
+        if (multiview_views_ > 0)
+        {
+            CreateProbeResources();
+        }
+        if (!settings_.stream_path.empty())
+        {
+            CreateStreamResources();
+        }
+        CreateOverlayResources();
+    });
+    startup_.Time("create sync objects", [this] {
+        CreateCommandBuffers();
+        CreateSyncObjects();
+    });
+    if (!settings_.export_socket.empty())
+    {
+        CreateFrameExport();
+    }
+    if (settings_.occlusion_culling)
+    {
+        occlusion_.Init(std::clamp(std::thread::hardware_concurrency(), 1u, 4u));
+    }
+    startup_.MarkInitialized();
+    perf_.Reset();
 }
 
 void Chim::Run(void)
 {
+    if (!settings_.serve_socket.empty())
+    {
+        Serve();
+        return;
+    }
+    if (!settings_.replay_path.empty())
+    {
+        LOG(Replay().Report());
+        LOG(profiler_.Report());
+        return;
+    }
+
+    // Without a window nothing can invalidate a frame, so headless runs always draw continuously
+    const bool on_demand = settings_.on_demand && !settings_.headless;
+    auto last_frame = std::chrono::steady_clock::now();
     while (keep_window_open_)
     {
-        // Check for user input
-        while (SDL_PollEvent(&ev_) != 0)
+        // Block on the event queue instead of spinning when there is nothing to draw: always while minimized, and in
+        // on-demand mode until something invalidates the frame
+        if (!settings_.headless && (window_minimized_ || (on_demand && !NeedsRedraw())))
         {
-            switch (ev_.type)
+            if (SDL_WaitEventTimeout(&ev_, kIdleWaitMs) != 0)
             {
-            case SDL_QUIT:
-                keep_window_open_ = false;
-                break;
-            case SDL_WINDOWEVENT:
-                switch (ev_.window.event)
-                {
-                case SDL_WINDOWEVENT_MINIMIZED:
-                    window_minimized_ = true;
-                    break;
-                case SDL_WINDOWEVENT_RESTORED:
-                    window_minimized_ = false;
-                    break;
-                case SDL_WINDOWEVENT_SIZE_CHANGED:
-                    frame_buffer_resized_ = true;
-                    break;
-                }
-                break;
+                HandleEvent(ev_);
             }
+            // Time spent blocked must not turn into camera movement
+            last_frame = std::chrono::steady_clock::now();
+        }
+
+        // Check for user input
+        while (!settings_.headless && SDL_PollEvent(&ev_) != 0)
+        {
+            HandleEvent(ev_);
         }
+        profiler_.SampleUsage();
+
+        auto now = std::chrono::steady_clock::now();
+        float delta = std::chrono::duration<float>(now - last_frame).count();
+        last_frame = now;
+        camera_.Move(camera_input_ * (camera_speed_ * delta));
 
         if (frame_buffer_resized_)
         {
             frame_buffer_resized_ = false;
             RecreateSwapChain();
         }
-        if (!window_minimized_)
+        if (!window_minimized_ && (!on_demand || NeedsRedraw()))
         {
             DrawFrame();
+            profiler_.MarkFrame();
+            if (redraw_frames_ > 0)
+            {
+                redraw_frames_--;
+            }
+        }
+    }
+
+    vkDeviceWaitIdle(device_);
+}
+
+void Chim::HandleEvent(const SDL_Event& event)
+{
+    HandleCameraInput(event);
+    switch (event.type)
+    {
+    case SDL_QUIT:
+        keep_window_open_ = false;
+        break;
+    case SDL_WINDOWEVENT:
+        switch (event.window.event)
+        {
+        case SDL_WINDOWEVENT_MINIMIZED:
+            window_minimized_ = true;
+            break;
+        case SDL_WINDOWEVENT_RESTORED:
+            window_minimized_ = false;
+            RequestRedraw();
+            break;
+        case SDL_WINDOWEVENT_SIZE_CHANGED:
+            frame_buffer_resized_ = true;
+            RequestRedraw();
+            break;
+        case SDL_WINDOWEVENT_SHOWN:
+        case SDL_WINDOWEVENT_EXPOSED:
+            RequestRedraw();
+            break;
+        case SDL_WINDOWEVENT_FOCUS_LOST:
+            // Key releases go to the newly focused window, so keys held now would keep the camera moving for good
+            if (camera_input_.x != 0.0f || camera_input_.y != 0.0f || camera_input_.z != 0.0f)
+            {
+                camera_input_ = glm::vec3(0.0f, 0.0f, 0.0f);
+                RequestRedraw();
+            }
+            break;
+        }
+        break;
+    case SDL_KEYDOWN:
+        switch (event.key.keysym.sym)
+        {
+        case SDLK_F1:
+            overlay_visible_ = !overlay_visible_;
+            RequestRedraw();
+            break;
+        case SDLK_F2:
+            LOG(profiler_.Report());
+            if (perf_.IsOpen())
+            {
+                LOG(PerfReport(perf_.Totals(), frame_count_));
+            }
+            break;
+        case SDLK_F3:
+            temporal_enabled_ = !temporal_enabled_;
+            history_valid_ = false;
+            RequestRedraw();
+            break;
+        case SDLK_F4:
+            RequestProbe();
+            break;
+        }
+        break;
+    }
+}
+
+/**
+ * @brief Whether on-demand mode has to draw: after an invalidation, while the camera moves, while the overlay, whose
+ * graphs change every frame, is visible, or until a requested probe has been rendered and written out.
+ */
+bool Chim::NeedsRedraw(void) const
+{
+    return redraw_frames_ > 0 || overlay_visible_ || camera_input_.x != 0.0f || camera_input_.y != 0.0f ||
+           camera_input_.z != 0.0f || probe_requested_ || probe_readback_frame_.has_value();
+}
+
+/**
+ * @brief Tracks held movement keys and turns the camera while the right mouse button is down.
+ */
+void Chim::HandleCameraInput(const SDL_Event& event)
+{
+    if ((event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) && event.key.repeat == 0)
+    {
+        float amount = event.type == SDL_KEYDOWN ? 1.0f : -1.0f;
+        bool movement = true;
+        switch (event.key.keysym.sym)
+        {
+        case SDLK_d:
+            camera_input_.x += amount;
+            break;
+        case SDLK_a:
+            camera_input_.x -= amount;
+            break;
+        case SDLK_w:
+            camera_input_.y += amount;
+            break;
+        case SDLK_s:
+            camera_input_.y -= amount;
+            break;
+        case SDLK_e:
+            camera_input_.z += amount;
+            break;
+        case SDLK_q:
+            camera_input_.z -= amount;
+            break;
+        default:
+            movement = false;
+            break;
+        }
+        // Held keys keep NeedsRedraw true; on release the temporal history still has to settle on the final view
+        if (movement)
+        {
+            RequestRedraw();
+        }
+    }
+    else if (event.type == SDL_MOUSEMOTION && (event.motion.state & SDL_BUTTON_RMASK))
+    {
+        camera_.Rotate(-event.motion.xrel * camera_sensitivity_, -event.motion.yrel * camera_sensitivity_);
+        RequestRedraw();
+    }
+}
+
+/**
+ * @brief Renders every frame of the loaded capture as fast as possible.
+ * @details Each frame is timed from the start of DrawFrame to its return, so the numbers include the fence wait of
+ * the frame in flight before it. That is the steady state cost of a frame, which is what a regression shows up in.
+ */
+ReplayStats Chim::Replay(void)
+{
+    std::vector<double> frame_ms;
+    frame_ms.reserve(replay_.frames.size());
+    perf_.Reset();
+
+    for (const CapturedFrame& frame : replay_.frames)
+    {
+        replay_frame_ = &frame;
+
+        // Captured draws are relative to the captured scene, which now lives at scene_mesh_
+        std::vector<DrawCommand> draws = frame.draws;
+        for (DrawCommand& draw : draws)
+        {
+            draw.first_index += scene_mesh_.first_index;
+            draw.vertex_offset += static_cast<int32_t>(scene_mesh_.first_vertex);
+        }
+        if (draws != draw_list_)
+        {
+            draw_list_ = std::move(draws);
+            InvalidateSceneCommands();
+            RequestProbe();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        DrawFrame();
+        auto end = std::chrono::steady_clock::now();
+
+        profiler_.MarkFrame();
+        frame_ms.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    replay_frame_ = nullptr;
+
+    vkDeviceWaitIdle(device_);
+    ReplayStats stats = ReplayStats::FromFrameTimes(std::move(frame_ms));
+    stats.has_counters = perf_.IsOpen();
+    stats.counters = perf_.Totals();
+    return stats;
+}
+
+/**
+ * @brief Renders jobs from the job socket until a client asks for shutdown.
+ * @details Clients are served one after the other. Results of a job are drained as soon as the client has nothing
+ * more queued; while it does, the next job starts rendering before the last one has finished.
+ */
+void Chim::Serve(void)
+{
+    // Every camera is an independent image: no jitter, and no history carried from one to the next
+    temporal_enabled_ = false;
+    CreateReadbackBuffers();
+    job_server_.Listen(settings_.serve_socket);
+    LOG("Serving render jobs on " + settings_.serve_socket);
+
+    RenderJob job;
+    while (true)
+    {
+        job_server_.Accept();
+        while (job_server_.ReadJob(job))
+        {
+            if (job.command == RenderJobCommand::Shutdown)
+            {
+                FlushReadbacks();
+                job_server_.Close();
+                FreeServedScenes();
+                return;
+            }
+
+            RunJob(job);
+            if (!job_server_.JobWaiting())
+            {
+                FlushReadbacks();
+            }
         }
+        FlushReadbacks();
+    }
+}
+
+/**
+ * @brief Queues one frame per camera of job. Results are sent by CollectReadback as the frames complete.
+ */
+void Chim::RunJob(const RenderJob& job)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    const MeshAllocation *mesh = nullptr;
+    try
+    {
+        mesh = &ServedScene(job.scene);
+    }
+    catch (const std::exception& e)
+    {
+        std::string message = e.what();
+        RenderResultHeader result{job.id, ~0u, 1, 0, 0, 0, message.size()};
+        job_server_.SendResult(result, message.data());
+        return;
+    }
+
+    if (job.width != swap_chain_extent_.width || job.height != swap_chain_extent_.height)
+    {
+        FlushReadbacks();
+        ResizeOffscreenTargets({job.width, job.height});
+    }
+    std::vector<DrawCommand> draws = {mesh->Draw()};
+    if (draws != draw_list_)
+    {
+        draw_list_ = std::move(draws);
+        InvalidateSceneCommands();
+        RequestProbe();
+    }
+
+    for (uint32_t i = 0; i < job.cameras.size(); i++)
+    {
+        const RenderJobCamera& camera = job.cameras[i];
+        camera_.SetPosition(glm::vec3(camera.position[0], camera.position[1], camera.position[2]));
+        camera_.LookAt(glm::vec3(camera.target[0], camera.target[1], camera.target[2]));
+        scene_time_ = camera.time;
+        history_valid_ = false;
+        next_readback_ = ReadbackTag{job.id, i};
+        DrawFrame();
+        profiler_.MarkFrame();
+    }
+    scene_time_.reset();
+
+    auto end = std::chrono::steady_clock::now();
+    LOG("Job " << job.id << ": " << job.cameras.size() << " cameras at " << job.width << "x" << job.height
+               << " queued in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms");
+}
+
+/**
+ * @brief Returns the mesh of a served scene, loading the capture into the geometry buffers on first use. An empty
+ * path is the built-in scene.
+ * @details At most kMaxServedScenes captures stay loaded. Loading one more first frees the scene that was asked for
+ * least recently, once the device is idle, so clients cycling through paths cannot exhaust the geometry buffers.
+ */
+const MeshAllocation& Chim::ServedScene(const std::string& path)
+{
+    if (path.empty())
+    {
+        return scene_mesh_;
+    }
+    auto found = served_scenes_.find(path);
+    if (found != served_scenes_.end())
+    {
+        found->second.last_used = ++served_scene_uses_;
+        return found->second.mesh;
+    }
+
+    Capture capture = LoadCapture(path);
+    if (served_scenes_.size() >= kMaxServedScenes)
+    {
+        auto oldest = std::min_element(served_scenes_.begin(), served_scenes_.end(), [](const auto& a, const auto& b) {
+            return a.second.last_used < b.second.last_used;
+        });
+        vkDeviceWaitIdle(device_);
+        FreeMesh(oldest->second.mesh);
+        served_scenes_.erase(oldest);
+    }
+    MeshAllocation mesh = UploadMesh(capture.vertices, capture.indices);
+    auto inserted = served_scenes_.emplace(path, ServedSceneMesh{mesh, ++served_scene_uses_});
+    return inserted.first->second.mesh;
+}
+
+/**
+ * @brief Releases the meshes of all loaded captures, waiting for the device first.
+ */
+void Chim::FreeServedScenes(void)
+{
+    vkDeviceWaitIdle(device_);
+    for (const auto& [path, served] : served_scenes_)
+    {
+        FreeMesh(served.mesh);
     }
+    served_scenes_.clear();
+}
 
+/**
+ * @brief Recreates the offscreen images and everything sized after them. No readback may be pending.
+ */
+void Chim::ResizeOffscreenTargets(VkExtent2D extent)
+{
     vkDeviceWaitIdle(device_);
+
+    DestroyReadbackBuffers();
+    CleanupSwapChain();
+
+    window_width_ = extent.width;
+    window_height_ = extent.height;
+    CreateOffscreenTargets();
+    CreateImageViews();
+    CreateSceneTargets();
+    CreateFrameBuffers();
+    UpdateTemporalDescriptorSets();
+    CreateReadbackBuffers();
+}
+
+/**
+ * @brief Creates one host-visible buffer per frame in flight that holds a whole offscreen image.
+ */
+void Chim::CreateReadbackBuffers(void)
+{
+    VkDeviceSize size = VkDeviceSize(swap_chain_extent_.width) * swap_chain_extent_.height * 4;
+    readbacks_.resize(MAX_FRAMES_IN_FLIGHT);
+    readback_buffers_.resize(MAX_FRAMES_IN_FLIGHT);
+    readback_buffers_memory_.resize(MAX_FRAMES_IN_FLIGHT);
+    readback_buffers_mapped_.resize(MAX_FRAMES_IN_FLIGHT);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readback_buffers_[i],
+                     readback_buffers_memory_[i]);
+        vkMapMemory(device_, readback_buffers_memory_[i], 0, size, 0, &readback_buffers_mapped_[i]);
+    }
+}
+
+void Chim::DestroyReadbackBuffers(void)
+{
+    for (size_t i = 0; i < readback_buffers_.size(); i++)
+    {
+        vkDestroyBuffer(device_, readback_buffers_[i], nullptr);
+        profiler_.TrackFree(readback_buffers_memory_[i]);
+        vkFreeMemory(device_, readback_buffers_memory_[i], nullptr);
+    }
+    readback_buffers_.clear();
+    readback_buffers_memory_.clear();
+    readback_buffers_mapped_.clear();
+}
+
+/**
+ * @brief Sends the image frame read back, if any. The frame's fence must have signalled.
+ */
+void Chim::CollectReadback(uint32_t frame)
+{
+    if (!readbacks_[frame])
+    {
+        return;
+    }
+    RenderResultHeader result{readbacks_[frame]->job_id,
+                              readbacks_[frame]->camera,
+                              0,
+                              swap_chain_extent_.width,
+                              swap_chain_extent_.height,
+                              static_cast<uint32_t>(swap_chain_image_format_),
+                              uint64_t(swap_chain_extent_.width) * swap_chain_extent_.height * 4};
+    job_server_.SendResult(result, readback_buffers_mapped_[frame]);
+    readbacks_[frame].reset();
+}
+
+/**
+ * @brief Waits for every frame in flight, oldest first, and sends their results.
+ */
+void Chim::FlushReadbacks(void)
+{
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        uint32_t frame = (current_frame_ + i) % MAX_FRAMES_IN_FLIGHT;
+        vkWaitForFences(device_, 1, &in_flight_fences_[frame], VK_TRUE, UINT64_MAX);
+        CollectReadback(frame);
+    }
 }
 
 void Chim::Cleanup(void)
 {
+    FlushStream();
+    if (probe_readback_frame_)
+    {
+        vkWaitForFences(device_, 1, &in_flight_fences_[*probe_readback_frame_], VK_TRUE, UINT64_MAX);
+        WriteProbeViews();
+    }
 
     CleanupSwapChain();
 
+    job_server_.Close();
+    DestroyReadbackBuffers();
+
+    frame_export_.Close();
+    for (VkSemaphore semaphore : export_ready_semaphores_)
+    {
+        vkDestroySemaphore(device_, semaphore, nullptr);
+    }
+    for (VkSemaphore semaphore : export_release_semaphores_)
+    {
+        vkDestroySemaphore(device_, semaphore, nullptr);
+    }
+
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
     {
         vkDestroyBuffer(device_, uniform_buffers_[i], nullptr);
+        profiler_.TrackFree(uniform_buffers_memory_[i]);
         vkFreeMemory(device_, uniform_buffers_memory_[i], nullptr);
     }
 
+    if (scene_descriptor_buffer_ != VK_NULL_HANDLE)
+    {
+        vkDestroyBuffer(device_, scene_descriptor_buffer_, nullptr);
+        profiler_.TrackFree(scene_descriptor_memory_);
+        vkFreeMemory(device_, scene_descriptor_memory_, nullptr);
+    }
+
+    DestroyProbeResources();
+    DestroyStreamResources();
+    DestroyFoliageResources();
+
+    vkDestroyDescriptorPool(device_, descriptor_pool_, nullptr);
     vkDestroyDescriptorSetLayout(device_, descriptor_set_layout_, nullptr);
 
     vkDestroyBuffer(device_, index_buffer_, nullptr);
+    profiler_.TrackFree(index_buffer_memory_);
     vkFreeMemory(device_, index_buffer_memory_, nullptr);
 
     vkDestroyBuffer(device_, vertex_buffer_, nullptr);
+    profiler_.TrackFree(vertex_buffer_memory_);
     vkFreeMemory(device_, vertex_buffer_memory_, nullptr);
 
+    vkDestroyBuffer(device_, overlay_vertex_buffer_, nullptr);
+    profiler_.TrackFree(overlay_vertex_buffer_memory_);
+    vkFreeMemory(device_, overlay_vertex_buffer_memory_, nullptr);
+
+    for (PendingPipeline& pending : pending_pipelines_)
+    {
+        vkDestroyPipeline(device_, pending.optimized.get(), nullptr);
+    }
+    for (const auto& [pipeline, frame] : retired_pipelines_)
+    {
+        vkDestroyPipeline(device_, pipeline, nullptr);
+    }
+    for (const auto& [key, part] : pipeline_parts_)
+    {
+        vkDestroyPipeline(device_, part, nullptr);
+    }
+    vkDestroyPipeline(device_, overlay_pipeline_, nullptr);
+    vkDestroyPipeline(device_, present_pipeline_, nullptr);
+    vkDestroyPipeline(device_, temporal_pipeline_, nullptr);
+    vkDestroyPipelineLayout(device_, present_pipeline_layout_, nullptr);
+    vkDestroyPipelineLayout(device_, temporal_pipeline_layout_, nullptr);
+    vkDestroyDescriptorSetLayout(device_, present_set_layout_, nullptr);
+    vkDestroyDescriptorSetLayout(device_, temporal_set_layout_, nullptr);
+    vkDestroySampler(device_, linear_sampler_, nullptr);
     vkDestroyPipeline(device_, graphics_pipeline_, nullptr);
     vkDestroyPipelineLayout(device_, pipeline_layout_, nullptr);
+    SavePipelineCache();
+    vkDestroyPipelineCache(device_, pipeline_cache_, nullptr);
 
+    vkDestroyRenderPass(device_, present_render_pass_, nullptr);
+    vkDestroyRenderPass(device_, temporal_render_pass_, nullptr);
     vkDestroyRenderPass(device_, render_pass_, nullptr);
+    vkDestroyRenderPass(device_, probe_render_pass_, nullptr);
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
     {
@@ -127,6 +748,8 @@ void Chim::Cleanup(void)
 
     vkDestroyCommandPool(device_, command_pool_, nullptr);
 
+    profiler_.Cleanup();
+
     vkDestroyDevice(device_, nullptr);
 
     if (enable_validation_layers)
@@ -134,44 +757,119 @@ void Chim::Cleanup(void)
         DestroyDebugUtilsMessengerEXT(instance_, debug_messenger_, nullptr);
     }
 
-    vkDestroySurfaceKHR(instance_, surface_, nullptr);
+    if (!settings_.headless)
+    {
+        vkDestroySurfaceKHR(instance_, surface_, nullptr);
+    }
     vkDestroyInstance(instance_, nullptr);
 
-    SDL_DestroyWindow(window_);
-    SDL_Quit();
+    if (!settings_.headless)
+    {
+        SDL_DestroyWindow(window_);
+        SDL_Vulkan_UnloadLibrary();
+        SDL_Quit();
+    }
 }
 
 void Chim::DrawFrame(void)
 {
-    vkWaitForFences(device_, 1, &in_flight_fences_[current_frame_], VK_TRUE, UINT64_MAX);
-
-    uint32_t imageIndex;
-    VkResult result = vkAcquireNextImageKHR(device_, swap_chain_, UINT64_MAX,
-                                            image_available_semaphores_[current_frame_], VK_NULL_HANDLE, &imageIndex);
-    if (result == VK_ERROR_OUT_OF_DATE_KHR)
+    perf_.Mark(CpuPhase::Loop);
+    WaitForFrame(current_frame_);
+    profiler_.ReadGpuResults(current_frame_);
+    SwapOptimizedPipelines();
+    if (!readbacks_.empty())
     {
-        RecreateSwapChain();
-        return;
+        CollectReadback(current_frame_);
+        readbacks_[current_frame_] = std::exchange(next_readback_, std::nullopt);
     }
-    else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+    if (!stream_pending_.empty())
     {
-        throw std::runtime_error("failed to acquire swap chain image!");
+        CollectStreamFrame(current_frame_);
     }
-
+    if (probe_readback_frame_ == current_frame_)
+    {
+        WriteProbeViews();
+    }
+
+    // An exported image may still be read by the consumer; wait for it to hand the slot back
+    VkSemaphore exportRelease = VK_NULL_HANDLE;
+    if (frame_export_.IsConnected())
+    {
+        FrameExportServer::SlotState slot = frame_export_.AcquireSlot(current_frame_);
+        if (slot == FrameExportServer::SlotState::Disconnected)
+        {
+            LOG("Frame consumer disconnected");
+            keep_window_open_ = false;
+            return;
+        }
+        if (slot == FrameExportServer::SlotState::Released)
+        {
+            exportRelease = export_release_semaphores_[current_frame_];
+        }
+    }
+
+    // Headless frames render into the offscreen image owned by the frame in flight
+    uint32_t imageIndex = current_frame_;
+    VkResult result = VK_SUCCESS;
+    if (!settings_.headless)
+    {
+        result = vkAcquireNextImageKHR(device_, swap_chain_, UINT64_MAX, image_available_semaphores_[current_frame_],
+                                       VK_NULL_HANDLE, &imageIndex);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR)
+        {
+            RecreateSwapChain();
+            return;
+        }
+        else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+        {
+            throw std::runtime_error("failed to acquire swap chain image!");
+        }
+    }
+
+    camera_.SetJitter(temporal_enabled_ ? Camera::JitterSequence(frame_count_) : glm::vec2(0.0f, 0.0f));
+    probe_due_ = probe_requested_ && !probe_readback_frame_;
     UpdateUniformBuffer(current_frame_);
 
+    // The overlay costs nothing when hidden: no geometry is built and no draw is recorded
+    overlay_vertex_count_ = 0;
+    if (overlay_visible_)
+    {
+        if (overlay_pipeline_ == VK_NULL_HANDLE)
+        {
+            BuildGraphicsPipeline(overlay_pipeline_desc_, overlay_pipeline_);
+        }
+        overlay_vertex_count_ =
+            overlay_.Build(profiler_.Snapshot(), overlay_vertices_mapped_ + current_frame_ * Overlay::kMaxVertices);
+    }
+
+    if (pvs_ || settings_.occlusion_culling)
+    {
+        CullDraws();
+    }
+    perf_.Mark(CpuPhase::Update);
+
     // Only reset fence if submitting work
     vkResetFences(device_, 1, &in_flight_fences_[current_frame_]);
 
+    if (!stream_pending_.empty())
+    {
+        stream_pending_[current_frame_] = stream_.IsOpen();
+    }
     vkResetCommandBuffer(command_buffers_[current_frame_], 0);
     RecordCommandBuffer(command_buffers_[current_frame_], imageIndex);
+    perf_.Mark(CpuPhase::Record);
 
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
     VkSemaphore waitSemaphores[] = {image_available_semaphores_[current_frame_]};
     VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.waitSemaphoreCount = settings_.headless ? 0 : 1;
+    if (exportRelease != VK_NULL_HANDLE)
+    {
+        waitSemaphores[0] = exportRelease;
+        submitInfo.waitSemaphoreCount = 1;
+    }
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
 
@@ -179,7 +877,12 @@ void Chim::DrawFrame(void)
     submitInfo.pCommandBuffers = &command_buffers_[current_frame_];
 
     VkSemaphore signalSemaphores[] = {render_finished_semaphores_[current_frame_]};
-    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.signalSemaphoreCount = settings_.headless ? 0 : 1;
+    if (frame_export_.IsConnected())
+    {
+        signalSemaphores[0] = export_ready_semaphores_[current_frame_];
+        submitInfo.signalSemaphoreCount = 1;
+    }
     submitInfo.pSignalSemaphores = signalSemaphores;
 
     if (vkQueueSubmit(graphics_queue_, 1, &submitInfo, in_flight_fences_[current_frame_]) != VK_SUCCESS)
@@ -187,6 +890,32 @@ void Chim::DrawFrame(void)
         throw std::runtime_error("Failed to submit draw command buffer!");
     }
 
+    if (frame_export_.IsConnected() && !frame_export_.SendFrame(current_frame_, frame_count_))
+    {
+        LOG("Frame consumer disconnected");
+        keep_window_open_ = false;
+    }
+
+    capture_.EndFrame();
+    perf_.Mark(CpuPhase::Submit);
+    history_index_ = 1 - history_index_;
+    history_valid_ = true;
+    frame_count_++;
+    if (startup_.MarkFirstFrame())
+    {
+        LOG(startup_.Report());
+    }
+    if (settings_.frame_limit > 0 && frame_count_ >= settings_.frame_limit)
+    {
+        keep_window_open_ = false;
+    }
+
+    if (settings_.headless)
+    {
+        current_frame_ = (current_frame_ + 1) % MAX_FRAMES_IN_FLIGHT;
+        return;
+    }
+
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
@@ -209,6 +938,7 @@ void Chim::DrawFrame(void)
     {
         throw std::runtime_error("failed to present swap chain image!");
     }
+    perf_.Mark(CpuPhase::Present);
 
     current_frame_ = (current_frame_ + 1) % MAX_FRAMES_IN_FLIGHT;
 
@@ -216,315 +946,1608 @@ void Chim::DrawFrame(void)
 }
 
 /**
- * @brief Initializes the Vulkan library.
- * @details The instance is the connection between the Vulkan library and the
- * rest of the application.
+ * @brief Initializes the Vulkan library.
+ * @details The instance is the connection between the Vulkan library and the
+ * rest of the application.
+ */
+void Chim::CreateInstance(const std::vector<const char *>& extensions)
+{
+    if (enable_validation_layers && !CheckValidationLayerSupport())
+    {
+        throw ChimException("Validation layers requested, but not available!");
+    }
+
+    VkApplicationInfo app_info{};
+    app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    app_info.pApplicationName = "CHIM";
+    app_info.applicationVersion = VK_API_VERSION_1_0;
+    app_info.pEngineName = "No Engine";
+    app_info.engineVersion = VK_API_VERSION_1_0;
+    // Vulkan 1.0 loaders have no vkEnumerateInstanceVersion and refuse any newer version. Paths that need 1.1 or
+    // later are only taken when both the instance and the device support them, see DeviceCapabilities::Query.
+    auto enumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(
+        vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+    uint32_t loaderVersion = VK_API_VERSION_1_0;
+    if (enumerateInstanceVersion == nullptr || enumerateInstanceVersion(&loaderVersion) != VK_SUCCESS)
+    {
+        loaderVersion = VK_API_VERSION_1_0;
+    }
+    instance_api_version_ = std::min<uint32_t>(loaderVersion, VK_API_VERSION_1_3);
+    app_info.apiVersion = instance_api_version_;
+
+    VkInstanceCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    create_info.pApplicationInfo = &app_info;
+
+    create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    create_info.ppEnabledExtensionNames = extensions.data();
+
+    VkDebugUtilsMessengerCreateInfoEXT debug_create_info{};
+    if (enable_validation_layers)
+    {
+        create_info.enabledLayerCount = static_cast<uint32_t>(validation_layers_.size());
+        create_info.ppEnabledLayerNames = validation_layers_.data();
+
+        PopulateDebugMessengerCreateInfo(debug_create_info);
+        create_info.pNext = (VkDebugUtilsMessengerCreateInfoEXT *)&debug_create_info;
+    }
+    else
+    {
+        create_info.enabledLayerCount = 0;
+        create_info.pNext = nullptr;
+    }
+
+    if (vkCreateInstance(&create_info, nullptr, &instance_) != VK_SUCCESS)
+    {
+        throw ChimException("Failed to create Vulkan instance!");
+    }
+}
+
+void Chim::PopulateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& create_info)
+{
+    create_info = {};
+    create_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+    create_info.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
+                                  VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+                                  VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    create_info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+                              VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+                              VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+    create_info.pfnUserCallback = DebugCallback;
+}
+
+VkResult Chim::CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
+                                            const VkAllocationCallbacks *pAllocator,
+                                            VkDebugUtilsMessengerEXT *pDebugMessenger)
+{
+    auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
+    if (func != nullptr)
+    {
+        return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
+    }
+    else
+    {
+        return VK_ERROR_EXTENSION_NOT_PRESENT;
+    }
+}
+
+void Chim::CreateFrameBuffers(void)
+{
+    swap_chain_frame_buffers_.resize(swap_chain_image_views_.size());
+
+    for (size_t i = 0; i < swap_chain_image_views_.size(); i++)
+    {
+        VkImageView attachments[] = {swap_chain_image_views_[i]};
+
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = present_render_pass_;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.pAttachments = attachments;
+        framebufferInfo.width = swap_chain_extent_.width;
+        framebufferInfo.height = swap_chain_extent_.height;
+        framebufferInfo.layers = 1;
+
+        if (vkCreateFramebuffer(device_, &framebufferInfo, nullptr, &swap_chain_frame_buffers_[i]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create framebuffer!");
+        }
+    }
+}
+
+void Chim::DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger,
+                                         const VkAllocationCallbacks *pAllocator)
+{
+    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
+    if (func != nullptr)
+    {
+        func(instance, debugMessenger, pAllocator);
+    }
+}
+
+void Chim::CreateCommandPool(void)
+{
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = queue_families_.graphicsFamily.value();
+
+    if (vkCreateCommandPool(device_, &poolInfo, nullptr, &command_pool_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create command pool!");
+    }
+}
+
+/**
+ * @brief Creates the shared vertex and index buffers; meshes are placed inside them by UploadMesh.
+ */
+void Chim::CreateGeometryBuffers(void)
+{
+    VkBufferUsageFlags vertexUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    if (vertex_pulling_)
+    {
+        vertexUsage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+    }
+    CreateBuffer(sizeof(Vertex) * VkDeviceSize(kGeometryVertexCapacity), vertexUsage,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertex_buffer_, vertex_buffer_memory_);
+    if (vertex_pulling_)
+    {
+        VkBufferDeviceAddressInfo addressInfo{};
+        addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+        addressInfo.buffer = vertex_buffer_;
+        vertex_buffer_address_ = vkGetBufferDeviceAddress(device_, &addressInfo);
+    }
+    CreateBuffer(sizeof(uint16_t) * VkDeviceSize(kGeometryIndexCapacity),
+                 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, index_buffer_, index_buffer_memory_);
+
+    vertex_ranges_.Init(kGeometryVertexCapacity);
+    index_ranges_.Init(kGeometryIndexCapacity);
+}
+
+/**
+ * @brief Allocates ranges for a mesh in the geometry buffers and copies it there through one staging buffer.
+ * @details Indices stay relative to the mesh's first vertex; the draw adds it back as vertexOffset. Command buffers
+ * that draw the mesh have to be invalidated by the caller.
+ */
+MeshAllocation Chim::UploadMesh(const std::vector<Vertex>& vertices, const std::vector<uint16_t>& indices)
+{
+    std::optional<uint32_t> firstVertex = vertex_ranges_.Allocate(static_cast<uint32_t>(vertices.size()));
+    std::optional<uint32_t> firstIndex = index_ranges_.Allocate(static_cast<uint32_t>(indices.size()));
+    if (!firstVertex || !firstIndex)
+    {
+        if (firstVertex)
+        {
+            vertex_ranges_.Free(*firstVertex, static_cast<uint32_t>(vertices.size()));
+        }
+        if (firstIndex)
+        {
+            index_ranges_.Free(*firstIndex, static_cast<uint32_t>(indices.size()));
+        }
+        throw ChimException("Out of geometry buffer space!");
+    }
+
+    MeshAllocation mesh{*firstVertex, static_cast<uint32_t>(vertices.size()), *firstIndex,
+                        static_cast<uint32_t>(indices.size())};
+
+    VkDeviceSize vertexBytes = sizeof(Vertex) * vertices.size();
+    VkDeviceSize indexBytes = sizeof(uint16_t) * indices.size();
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    CreateBuffer(vertexBytes + indexBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
+                 stagingBufferMemory);
+
+    void *data;
+    vkMapMemory(device_, stagingBufferMemory, 0, vertexBytes + indexBytes, 0, &data);
+    memcpy(data, vertices.data(), (size_t)vertexBytes);
+    memcpy(static_cast<char *>(data) + vertexBytes, indices.data(), (size_t)indexBytes);
+    vkUnmapMemory(device_, stagingBufferMemory);
+
+    VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
+
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = 0;
+    copyRegion.dstOffset = sizeof(Vertex) * VkDeviceSize(mesh.first_vertex);
+    copyRegion.size = vertexBytes;
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer, vertex_buffer_, 1, &copyRegion);
+
+    copyRegion.srcOffset = vertexBytes;
+    copyRegion.dstOffset = sizeof(uint16_t) * VkDeviceSize(mesh.first_index);
+    copyRegion.size = indexBytes;
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer, index_buffer_, 1, &copyRegion);
+
+    EndSingleTimeCommands(commandBuffer);
+
+    ReleaseStagingBuffer(stagingBuffer, stagingBufferMemory);
+
+    return mesh;
+}
+
+/**
+ * @brief Releases a mesh's ranges. The GPU must no longer be drawing it.
+ */
+void Chim::FreeMesh(const MeshAllocation& mesh)
+{
+    vertex_ranges_.Free(mesh.first_vertex, mesh.vertex_count);
+    index_ranges_.Free(mesh.first_index, mesh.index_count);
+}
+
+void chim::Chim::CreateUniformBuffers(void)
+{
+    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+
+    uniform_buffers_.resize(MAX_FRAMES_IN_FLIGHT);
+    uniform_buffers_memory_.resize(MAX_FRAMES_IN_FLIGHT);
+    uniform_buffers_mapped_.resize(MAX_FRAMES_IN_FLIGHT);
+
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        // Descriptor buffers describe the uniform buffer by its device address
+        VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        if (descriptor_buffer_)
+        {
+            usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+        }
+        CreateBuffer(bufferSize, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     uniform_buffers_[i], uniform_buffers_memory_[i]);
+
+        vkMapMemory(device_, uniform_buffers_memory_[i], 0, bufferSize, 0, &uniform_buffers_mapped_[i]);
+    }
+}
+
+void Chim::CreateDescriptorPool(void)
+{
+    // Scene and probe uniform buffer sets and a foliage set (1 uniform buffer, 1 image, 2 storage buffers) per frame in
+    // flight, plus a temporal (3 images), a present (1 image) and a stream (1 image, 1 storage buffer) set per history
+    std::array<VkDescriptorPoolSize, 3> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT * 3);
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = static_cast<uint32_t>(history_.size() * 5 + MAX_FRAMES_IN_FLIGHT);
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[2].descriptorCount = static_cast<uint32_t>(history_.size() + MAX_FRAMES_IN_FLIGHT * 2);
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT * 3 + history_.size() * 3);
+
+    if (vkCreateDescriptorPool(device_, &poolInfo, nullptr, &descriptor_pool_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+}
+
+void Chim::CreateDescriptorSets(void)
+{
+    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptor_set_layout_);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptor_pool_;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    allocInfo.pSetLayouts = layouts.data();
+
+    descriptor_sets_.resize(MAX_FRAMES_IN_FLIGHT);
+    if (vkAllocateDescriptorSets(device_, &allocInfo, descriptor_sets_.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate descriptor sets!");
+    }
+
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = uniform_buffers_[i];
+        bufferInfo.offset = 0;
+        bufferInfo.range = sizeof(UniformBufferObject);
+
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = descriptor_sets_[i];
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(device_, 1, &descriptorWrite, 0, nullptr);
+    }
+}
+
+/**
+ * @brief Creates the descriptor buffer that replaces CreateDescriptorSets when descriptor_buffer_ is set.
+ * @details The scene sets only hold the uniform buffer of their frame in flight, which never changes, so each is
+ * written once here and only bound afterwards.
+ */
+void Chim::CreateDescriptorBuffer(void)
+{
+    get_descriptor_set_layout_size_ = reinterpret_cast<PFN_vkGetDescriptorSetLayoutSizeEXT>(
+        vkGetDeviceProcAddr(device_, "vkGetDescriptorSetLayoutSizeEXT"));
+    get_descriptor_set_layout_binding_offset_ = reinterpret_cast<PFN_vkGetDescriptorSetLayoutBindingOffsetEXT>(
+        vkGetDeviceProcAddr(device_, "vkGetDescriptorSetLayoutBindingOffsetEXT"));
+    get_descriptor_ = reinterpret_cast<PFN_vkGetDescriptorEXT>(vkGetDeviceProcAddr(device_, "vkGetDescriptorEXT"));
+    cmd_bind_descriptor_buffers_ = reinterpret_cast<PFN_vkCmdBindDescriptorBuffersEXT>(
+        vkGetDeviceProcAddr(device_, "vkCmdBindDescriptorBuffersEXT"));
+    cmd_set_descriptor_buffer_offsets_ = reinterpret_cast<PFN_vkCmdSetDescriptorBufferOffsetsEXT>(
+        vkGetDeviceProcAddr(device_, "vkCmdSetDescriptorBufferOffsetsEXT"));
+    if (get_descriptor_set_layout_size_ == nullptr || get_descriptor_set_layout_binding_offset_ == nullptr ||
+        get_descriptor_ == nullptr || cmd_bind_descriptor_buffers_ == nullptr ||
+        cmd_set_descriptor_buffer_offsets_ == nullptr)
+    {
+        throw std::runtime_error("Failed to load VK_EXT_descriptor_buffer functions!");
+    }
+
+    VkDeviceSize layoutSize;
+    VkDeviceSize uniformOffset;
+    get_descriptor_set_layout_size_(device_, descriptor_set_layout_, &layoutSize);
+    get_descriptor_set_layout_binding_offset_(device_, descriptor_set_layout_, 0, &uniformOffset);
+    VkDeviceSize alignment = device_caps_.descriptor_buffer_offset_alignment;
+    VkDeviceSize setStride = (layoutSize + alignment - 1) / alignment * alignment;
+
+    VkDeviceSize bufferSize = setStride * MAX_FRAMES_IN_FLIGHT;
+    CreateBuffer(bufferSize,
+                 VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, scene_descriptor_buffer_,
+                 scene_descriptor_memory_);
+    void *mapped;
+    vkMapMemory(device_, scene_descriptor_memory_, 0, bufferSize, 0, &mapped);
+    char *sets = static_cast<char *>(mapped);
+
+    VkBufferDeviceAddressInfo addressInfo{};
+    addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+    addressInfo.buffer = scene_descriptor_buffer_;
+    scene_descriptor_address_ = vkGetBufferDeviceAddress(device_, &addressInfo);
+
+    scene_descriptor_offsets_.resize(MAX_FRAMES_IN_FLIGHT);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        addressInfo.buffer = uniform_buffers_[i];
+
+        VkDescriptorAddressInfoEXT uniformInfo{};
+        uniformInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT;
+        uniformInfo.address = vkGetBufferDeviceAddress(device_, &addressInfo);
+        uniformInfo.range = sizeof(UniformBufferObject);
+
+        VkDescriptorGetInfoEXT getInfo{};
+        getInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT;
+        getInfo.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        getInfo.data.pUniformBuffer = &uniformInfo;
+
+        scene_descriptor_offsets_[i] = setStride * i;
+        get_descriptor_(device_, &getInfo, device_caps_.uniform_buffer_descriptor_size,
+                        sets + scene_descriptor_offsets_[i] + uniformOffset);
+    }
+    vkUnmapMemory(device_, scene_descriptor_memory_);
+}
+
+/**
+ * @brief Creates the sampler, descriptor sets and pipelines of the temporal and present passes.
+ */
+void Chim::CreateTemporalResources(void)
+{
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = 0.0f;
+
+    if (vkCreateSampler(device_, &samplerInfo, nullptr, &linear_sampler_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create sampler!");
+    }
+
+    // Temporal: current colour, motion vectors, history. Present: the resolved history.
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); i++)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorCount = 1;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(device_, &layoutInfo, nullptr, &temporal_set_layout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+    layoutInfo.bindingCount = 1;
+    if (vkCreateDescriptorSetLayout(device_, &layoutInfo, nullptr, &present_set_layout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+
+    VkPushConstantRange pushConstants{};
+    pushConstants.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstants.size = sizeof(glm::vec4);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &temporal_set_layout_;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstants;
+    if (vkCreatePipelineLayout(device_, &pipelineLayoutInfo, nullptr, &temporal_pipeline_layout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create pipeline layout!");
+    }
+    pipelineLayoutInfo.pSetLayouts = &present_set_layout_;
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    if (vkCreatePipelineLayout(device_, &pipelineLayoutInfo, nullptr, &present_pipeline_layout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create pipeline layout!");
+    }
+
+    GraphicsPipelineDesc desc{};
+    desc.vertex_shader = "fullscreen_vert.spv";
+    desc.fragment_shader = "temporal_frag.spv";
+    desc.layout = temporal_pipeline_layout_;
+    desc.render_pass = temporal_render_pass_;
+    desc.vertex_input = false;
+    desc.cull_mode = VK_CULL_MODE_NONE;
+    desc.depth_test = false;
+    BuildGraphicsPipeline(desc, temporal_pipeline_);
+
+    desc.fragment_shader = "present_frag.spv";
+    desc.layout = present_pipeline_layout_;
+    desc.render_pass = present_render_pass_;
+    BuildGraphicsPipeline(desc, present_pipeline_);
+
+    std::array<VkDescriptorSetLayout, 4> layouts = {temporal_set_layout_, temporal_set_layout_, present_set_layout_,
+                                                    present_set_layout_};
+    std::array<VkDescriptorSet, 4> sets;
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptor_pool_;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+    allocInfo.pSetLayouts = layouts.data();
+    if (vkAllocateDescriptorSets(device_, &allocInfo, sets.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate descriptor sets!");
+    }
+    temporal_sets_ = {sets[0], sets[1]};
+    present_sets_ = {sets[2], sets[3]};
+
+    UpdateTemporalDescriptorSets();
+}
+
+/**
+ * @brief Points the temporal and present descriptor sets at the current targets, which change on resize.
+ * @details Set i belongs to the frame that writes history i: its temporal set reads the other history image and its
+ * present set reads history i.
+ */
+void Chim::UpdateTemporalDescriptorSets(void)
+{
+    for (size_t i = 0; i < history_.size(); i++)
+    {
+        std::array<VkDescriptorImageInfo, 4> images{};
+        images[0].imageView = scene_color_.view;
+        images[1].imageView = motion_vectors_.view;
+        images[2].imageView = history_[1 - i].view;
+        images[3].imageView = history_[i].view;
+        for (VkDescriptorImageInfo& image : images)
+        {
+            image.sampler = linear_sampler_;
+            image.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        }
+
+        std::array<VkWriteDescriptorSet, 4> writes{};
+        for (uint32_t binding = 0; binding < writes.size(); binding++)
+        {
+            writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[binding].dstSet = binding < 3 ? temporal_sets_[i] : present_sets_[i];
+            writes[binding].dstBinding = binding < 3 ? binding : 0;
+            writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            writes[binding].descriptorCount = 1;
+            writes[binding].pImageInfo = &images[binding];
+        }
+
+        vkUpdateDescriptorSets(device_, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+        if (stream_pipeline_ != VK_NULL_HANDLE)
+        {
+            VkDescriptorBufferInfo bufferInfo{};
+            bufferInfo.buffer = stream_buffer_;
+            bufferInfo.range = VK_WHOLE_SIZE;
+
+            std::array<VkWriteDescriptorSet, 2> streamWrites{};
+            streamWrites[0] = writes[3];
+            streamWrites[0].dstSet = stream_sets_[i];
+            streamWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            streamWrites[1].dstSet = stream_sets_[i];
+            streamWrites[1].dstBinding = 1;
+            streamWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            streamWrites[1].descriptorCount = 1;
+            streamWrites[1].pBufferInfo = &bufferInfo;
+            vkUpdateDescriptorSets(device_, static_cast<uint32_t>(streamWrites.size()), streamWrites.data(), 0,
+                                   nullptr);
+        }
+    }
+}
+
+/**
+ * @brief Creates the overlay pipeline and its per-frame vertex buffer.
+ * @details The vertex buffer is host visible and stays mapped. Each frame in flight writes its own slice of
+ * Overlay::kMaxVertices vertices, so a frame never overwrites geometry the GPU is still reading.
+ */
+void Chim::CreateOverlayResources(void)
+{
+    // The pipeline itself is only built when the overlay is first shown, see DrawFrame
+    overlay_pipeline_desc_.vertex_shader = "overlay_vert.spv";
+    overlay_pipeline_desc_.fragment_shader = "overlay_frag.spv";
+    overlay_pipeline_desc_.layout = pipeline_layout_;
+    // The layout's set layout is created for descriptor buffers then, and the pipeline has to say so as well
+    overlay_pipeline_desc_.descriptor_buffer = descriptor_buffer_;
+    overlay_pipeline_desc_.render_pass = present_render_pass_;
+    overlay_pipeline_desc_.cull_mode = VK_CULL_MODE_NONE;
+    overlay_pipeline_desc_.depth_test = false;
+
+    VkDeviceSize bufferSize = sizeof(Vertex) * Overlay::kMaxVertices * MAX_FRAMES_IN_FLIGHT;
+    CreateBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, overlay_vertex_buffer_,
+                 overlay_vertex_buffer_memory_);
+
+    void *data;
+    vkMapMemory(device_, overlay_vertex_buffer_memory_, 0, bufferSize, 0, &data);
+    overlay_vertices_mapped_ = static_cast<Vertex *>(data);
+}
+
+void Chim::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer,
+                        VkDeviceMemory& bufferMemory)
+{
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create buffer!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device_, buffer, &memRequirements);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
+
+    // A buffer whose address is taken needs memory allocated for it
+    VkMemoryAllocateFlagsInfo allocFlags{};
+    allocFlags.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+    allocFlags.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+    if (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)
+    {
+        allocInfo.pNext = &allocFlags;
+    }
+
+    if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate buffer memory!");
+    }
+    profiler_.TrackAllocation(bufferMemory, allocInfo.memoryTypeIndex, allocInfo.allocationSize);
+
+    vkBindBufferMemory(device_, buffer, bufferMemory, 0);
+}
+
+/**
+ * @brief Creates an image with its own memory. Exportable images get a dedicated allocation that can be exported
+ * as an opaque file descriptor.
+ */
+void Chim::CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage,
+                       VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory, bool exportable,
+                       uint32_t layers)
+{
+    VkExternalMemoryImageCreateInfo externalInfo{};
+    externalInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO;
+    externalInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = width;
+    imageInfo.extent.height = height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = layers;
+    imageInfo.format = format;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = usage;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.pNext = exportable ? &externalInfo : nullptr;
+    // Six square layers can also be viewed as a cube map
+    if (layers == 6 && width == height)
+    {
+        imageInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+    }
+
+    if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create image!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device_, image, &memRequirements);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
+
+    VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+    dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicatedInfo.image = image;
+    VkExportMemoryAllocateInfo exportInfo{};
+    exportInfo.sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO;
+    exportInfo.pNext = &dedicatedInfo;
+    exportInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+    if (exportable)
+    {
+        allocInfo.pNext = &exportInfo;
+    }
+
+    if (vkAllocateMemory(device_, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate image memory!");
+    }
+    profiler_.TrackAllocation(imageMemory, allocInfo.memoryTypeIndex, allocInfo.allocationSize);
+
+    vkBindImageMemory(device_, image, imageMemory, 0);
+}
+
+void Chim::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+{
+    VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
+
+    VkBufferCopy copyRegion{};
+    copyRegion.size = size;
+    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+
+    EndSingleTimeCommands(commandBuffer);
+}
+
+VkCommandBuffer Chim::BeginSingleTimeCommands(void)
+{
+    if (upload_batch_ != VK_NULL_HANDLE)
+    {
+        return upload_batch_;
+    }
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = command_pool_;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    return commandBuffer;
+}
+
+void Chim::EndSingleTimeCommands(VkCommandBuffer commandBuffer)
+{
+    if (commandBuffer == upload_batch_)
+    {
+        return;
+    }
+
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    vkQueueSubmit(graphics_queue_, 1, &submitInfo, VK_NULL_HANDLE);
+    vkQueueWaitIdle(graphics_queue_);
+
+    vkFreeCommandBuffers(device_, command_pool_, 1, &commandBuffer);
+}
+
+/**
+ * @brief Collects the one-time commands recorded until EndUploadBatch into a single command buffer.
+ * @details BeginSingleTimeCommands hands out the batch and EndSingleTimeCommands leaves it open, so a series of
+ * uploads costs one submit and one queue wait instead of one of each per upload.
+ */
+void Chim::BeginUploadBatch(void)
+{
+    upload_batch_ = BeginSingleTimeCommands();
+}
+
+void Chim::EndUploadBatch(void)
+{
+    VkCommandBuffer commandBuffer = upload_batch_;
+    upload_batch_ = VK_NULL_HANDLE;
+    EndSingleTimeCommands(commandBuffer);
+
+    for (auto& [buffer, memory] : upload_staging_)
+    {
+        ReleaseStagingBuffer(buffer, memory);
+    }
+    upload_staging_.clear();
+}
+
+/**
+ * @brief Destroys a staging buffer whose copy has completed, or once the upload batch it was recorded into has.
+ */
+void Chim::ReleaseStagingBuffer(VkBuffer buffer, VkDeviceMemory memory)
+{
+    if (upload_batch_ != VK_NULL_HANDLE)
+    {
+        upload_staging_.emplace_back(buffer, memory);
+        return;
+    }
+    vkDestroyBuffer(device_, buffer, nullptr);
+    profiler_.TrackFree(memory);
+    vkFreeMemory(device_, memory, nullptr);
+}
+
+uint32_t Chim::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+{
+    std::optional<uint32_t> memoryType = device_caps_.FindMemoryType(typeFilter, properties);
+    if (!memoryType)
+    {
+        throw std::runtime_error("Failed to find suitable memory type!");
+    }
+    return *memoryType;
+}
+
+void Chim::CreateCommandBuffers(void)
+{
+    command_buffers_.resize(MAX_FRAMES_IN_FLIGHT);
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = command_pool_;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = (uint32_t)command_buffers_.size();
+
+    if (vkAllocateCommandBuffers(device_, &allocInfo, command_buffers_.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to allocate command buffers!");
+    }
+
+    scene_command_buffers_.resize(MAX_FRAMES_IN_FLIGHT);
+    scene_command_generations_.assign(MAX_FRAMES_IN_FLIGHT, 0);
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    allocInfo.commandBufferCount = (uint32_t)scene_command_buffers_.size();
+
+    if (vkAllocateCommandBuffers(device_, &allocInfo, scene_command_buffers_.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to allocate command buffers!");
+    }
+}
+
+void Chim::CreateSyncObjects(void)
+{
+    image_available_semaphores_.resize(MAX_FRAMES_IN_FLIGHT);
+    render_finished_semaphores_.resize(MAX_FRAMES_IN_FLIGHT);
+    in_flight_fences_.resize(MAX_FRAMES_IN_FLIGHT);
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        if (vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &image_available_semaphores_[i]) != VK_SUCCESS ||
+            vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &render_finished_semaphores_[i]) != VK_SUCCESS ||
+            vkCreateFence(device_, &fenceInfo, nullptr, &in_flight_fences_[i]) != VK_SUCCESS)
+        {
+
+            throw std::runtime_error("Failed to create synchronization objects for a frame!");
+        }
+    }
+}
+
+/**
+ * @brief Creates the exported semaphores, waits for a consumer on the export socket and sends it the slots.
+ * @details The offscreen images are already exportable, see CreateOffscreenTargets. The consumer receives its own
+ * duplicates of the exported file descriptors; ours are closed by SendSetup.
+ */
+void Chim::CreateFrameExport(void)
+{
+    auto getMemoryFd = reinterpret_cast<PFN_vkGetMemoryFdKHR>(vkGetDeviceProcAddr(device_, "vkGetMemoryFdKHR"));
+    auto getSemaphoreFd =
+        reinterpret_cast<PFN_vkGetSemaphoreFdKHR>(vkGetDeviceProcAddr(device_, "vkGetSemaphoreFdKHR"));
+    if (getMemoryFd == nullptr || getSemaphoreFd == nullptr)
+    {
+        throw ChimException("Failed to load the external memory and semaphore fd functions!");
+    }
+
+    VkExportSemaphoreCreateInfo exportInfo{};
+    exportInfo.sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO;
+    exportInfo.handleTypes = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT;
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &exportInfo;
+
+    export_ready_semaphores_.resize(MAX_FRAMES_IN_FLIGHT);
+    export_release_semaphores_.resize(MAX_FRAMES_IN_FLIGHT);
+    std::vector<int> fds;
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        if (vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &export_ready_semaphores_[i]) != VK_SUCCESS ||
+            vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &export_release_semaphores_[i]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create frame export semaphores!");
+        }
+
+        VkMemoryGetFdInfoKHR memoryInfo{};
+        memoryInfo.sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR;
+        memoryInfo.memory = offscreen_image_memory_[i];
+        memoryInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+        VkSemaphoreGetFdInfoKHR semaphoreFdInfo{};
+        semaphoreFdInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR;
+        semaphoreFdInfo.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT;
+
+        // Each descriptor is kept as soon as it exists, so a failure further on closes all that were exported
+        int fd;
+        bool exported = getMemoryFd(device_, &memoryInfo, &fd) == VK_SUCCESS;
+        if (exported)
+        {
+            fds.push_back(fd);
+            semaphoreFdInfo.semaphore = export_ready_semaphores_[i];
+            exported = getSemaphoreFd(device_, &semaphoreFdInfo, &fd) == VK_SUCCESS;
+        }
+        if (exported)
+        {
+            fds.push_back(fd);
+            semaphoreFdInfo.semaphore = export_release_semaphores_[i];
+            exported = getSemaphoreFd(device_, &semaphoreFdInfo, &fd) == VK_SUCCESS;
+        }
+        if (!exported)
+        {
+            CloseFileDescriptors(fds);
+            throw ChimException("Failed to export a frame slot!");
+        }
+        fds.push_back(fd);
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device_, swap_chain_images_[0], &memRequirements);
+
+    FrameExportSetup setup{};
+    setup.magic = kFrameExportMagic;
+    setup.version = kFrameExportVersion;
+    setup.width = swap_chain_extent_.width;
+    setup.height = swap_chain_extent_.height;
+    setup.format = swap_chain_image_format_;
+    setup.layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    setup.slot_count = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    setup.allocation_size = memRequirements.size;
+    std::memcpy(setup.device_uuid, device_caps_.device_uuid, sizeof(setup.device_uuid));
+    std::memcpy(setup.driver_uuid, device_caps_.driver_uuid, sizeof(setup.driver_uuid));
+
+    try
+    {
+        frame_export_.Listen(settings_.export_socket);
+        LOG("Waiting for a frame consumer on " + settings_.export_socket);
+        frame_export_.Accept(settings_.export_timeout);
+    }
+    catch (...)
+    {
+        CloseFileDescriptors(fds);
+        throw;
+    }
+    frame_export_.SendSetup(setup, fds);
+}
+
+/**
+ * @brief Creates the multiview probe: layered targets, their framebuffer, and the pipeline with its uniform buffers.
+ * @details The probe has its own fixed size, so unlike the scene targets it survives swap chain recreation. It is
+ * always drawn with fixed vertex input and descriptor sets, whatever the scene pass uses.
  */
-void Chim::CreateInstance(void)
+void Chim::CreateProbeResources(void)
 {
-    if (enable_validation_layers && !CheckValidationLayerSupport())
+    VkExtent2D extent = {kProbeSize, kProbeSize};
+    profiler_.SetRenderArea(ProfilePass::Probe, extent, multiview_views_);
+    CreateRenderTarget(extent, scene_color_format_,
+                       VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT,
+                       probe_color_, multiview_views_);
+    CreateRenderTarget(extent, depth_format_, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT,
+                       probe_depth_, multiview_views_);
+
+    // A multiview framebuffer has one layer; the view mask decides which attachment layers are written
+    std::array<VkImageView, 2> attachments = {probe_color_.view, probe_depth_.view};
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = probe_render_pass_;
+    framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    framebufferInfo.pAttachments = attachments.data();
+    framebufferInfo.width = kProbeSize;
+    framebufferInfo.height = kProbeSize;
+    framebufferInfo.layers = 1;
+    if (vkCreateFramebuffer(device_, &framebufferInfo, nullptr, &probe_frame_buffer_) != VK_SUCCESS)
     {
-        throw ChimException("Validation layers requested, but not available!");
+        throw std::runtime_error("Failed to create framebuffer!");
     }
 
-    VkApplicationInfo app_info{};
-    app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-    app_info.pApplicationName = "CHIM";
-    app_info.applicationVersion = VK_API_VERSION_1_0;
-    app_info.pEngineName = "No Engine";
-    app_info.engineVersion = VK_API_VERSION_1_0;
-    app_info.apiVersion = VK_API_VERSION_1_0;
-
-    VkInstanceCreateInfo create_info{};
-    create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-    create_info.pApplicationInfo = &app_info;
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorCount = 1;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
-    auto extensions = GetRequiredExtensions();
-    create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
-    create_info.ppEnabledExtensionNames = extensions.data();
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+    if (vkCreateDescriptorSetLayout(device_, &layoutInfo, nullptr, &probe_set_layout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
 
-    VkDebugUtilsMessengerCreateInfoEXT debug_create_info{};
-    if (enable_validation_layers)
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &probe_set_layout_;
+    if (vkCreatePipelineLayout(device_, &pipelineLayoutInfo, nullptr, &probe_pipeline_layout_) != VK_SUCCESS)
     {
-        create_info.enabledLayerCount = static_cast<uint32_t>(validation_layers_.size());
-        create_info.ppEnabledLayerNames = validation_layers_.data();
+        throw std::runtime_error("Failed to create pipeline layout!");
+    }
 
-        PopulateDebugMessengerCreateInfo(debug_create_info);
-        create_info.pNext = (VkDebugUtilsMessengerCreateInfoEXT *)&debug_create_info;
+    GraphicsPipelineDesc desc{};
+    desc.vertex_shader = "multiview_vert.spv";
+    desc.fragment_shader = "probe_frag.spv";
+    desc.layout = probe_pipeline_layout_;
+    desc.render_pass = probe_render_pass_;
+    BuildGraphicsPipeline(desc, probe_pipeline_);
+
+    probe_uniform_buffers_.resize(MAX_FRAMES_IN_FLIGHT);
+    probe_uniform_buffers_memory_.resize(MAX_FRAMES_IN_FLIGHT);
+    probe_uniform_buffers_mapped_.resize(MAX_FRAMES_IN_FLIGHT);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        CreateBuffer(sizeof(ProbeUniformBufferObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     probe_uniform_buffers_[i], probe_uniform_buffers_memory_[i]);
+        vkMapMemory(device_, probe_uniform_buffers_memory_[i], 0, sizeof(ProbeUniformBufferObject), 0,
+                    &probe_uniform_buffers_mapped_[i]);
     }
-    else
+
+    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, probe_set_layout_);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptor_pool_;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+    allocInfo.pSetLayouts = layouts.data();
+    probe_sets_.resize(MAX_FRAMES_IN_FLIGHT);
+    if (vkAllocateDescriptorSets(device_, &allocInfo, probe_sets_.data()) != VK_SUCCESS)
     {
-        create_info.enabledLayerCount = 0;
-        create_info.pNext = nullptr;
+        throw std::runtime_error("failed to allocate descriptor sets!");
     }
 
-    if (vkCreateInstance(&create_info, nullptr, &instance_) != VK_SUCCESS)
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
     {
-        throw ChimException("Failed to create Vulkan instance!");
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = probe_uniform_buffers_[i];
+        bufferInfo.range = sizeof(ProbeUniformBufferObject);
+
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = probe_sets_[i];
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pBufferInfo = &bufferInfo;
+        vkUpdateDescriptorSets(device_, 1, &descriptorWrite, 0, nullptr);
     }
-}
 
-void Chim::PopulateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& create_info)
-{
-    create_info = {};
-    create_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-    create_info.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
-                                  VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
-                                  VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-    create_info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
-                              VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
-                              VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-    create_info.pfnUserCallback = DebugCallback;
+    // Every view as RGBA16F texels, layer after layer
+    VkDeviceSize readbackSize = VkDeviceSize(kProbeSize) * kProbeSize * 4 * sizeof(uint16_t) * multiview_views_;
+    CreateBuffer(readbackSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, probe_readback_buffer_,
+                 probe_readback_memory_);
+    vkMapMemory(device_, probe_readback_memory_, 0, readbackSize, 0, &probe_readback_mapped_);
+
+    // The first frame renders the probe
+    probe_requested_ = true;
 }
 
-VkResult Chim::CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
-                                            const VkAllocationCallbacks *pAllocator,
-                                            VkDebugUtilsMessengerEXT *pDebugMessenger)
+void Chim::DestroyProbeResources(void)
 {
-    auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
-    if (func != nullptr)
+    if (probe_frame_buffer_ == VK_NULL_HANDLE)
     {
-        return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
+        return;
     }
-    else
+
+    for (size_t i = 0; i < probe_uniform_buffers_.size(); i++)
     {
-        return VK_ERROR_EXTENSION_NOT_PRESENT;
+        vkDestroyBuffer(device_, probe_uniform_buffers_[i], nullptr);
+        profiler_.TrackFree(probe_uniform_buffers_memory_[i]);
+        vkFreeMemory(device_, probe_uniform_buffers_memory_[i], nullptr);
     }
+    vkDestroyPipeline(device_, probe_pipeline_, nullptr);
+    vkDestroyPipelineLayout(device_, probe_pipeline_layout_, nullptr);
+    vkDestroyDescriptorSetLayout(device_, probe_set_layout_, nullptr);
+    vkDestroyFramebuffer(device_, probe_frame_buffer_, nullptr);
+    DestroyRenderTarget(probe_depth_);
+    DestroyRenderTarget(probe_color_);
+    vkDestroyBuffer(device_, probe_readback_buffer_, nullptr);
+    profiler_.TrackFree(probe_readback_memory_);
+    vkFreeMemory(device_, probe_readback_memory_, nullptr);
 }
 
-void Chim::CreateFrameBuffers(void)
+/**
+ * @brief Asks for the probe to be rendered again, by the next frame that has no probe copy outstanding.
+ */
+void Chim::RequestProbe(void)
 {
-    swap_chain_frame_buffers_.resize(swap_chain_image_views_.size());
-
-    for (size_t i = 0; i < swap_chain_image_views_.size(); i++)
+    if (multiview_views_ > 0)
     {
-        VkImageView attachments[] = {swap_chain_image_views_[i]};
-
-        VkFramebufferCreateInfo framebufferInfo{};
-        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebufferInfo.renderPass = render_pass_;
-        framebufferInfo.attachmentCount = 1;
-        framebufferInfo.pAttachments = attachments;
-        framebufferInfo.width = swap_chain_extent_.width;
-        framebufferInfo.height = swap_chain_extent_.height;
-        framebufferInfo.layers = 1;
-
-        if (vkCreateFramebuffer(device_, &framebufferInfo, nullptr, &swap_chain_frame_buffers_[i]) != VK_SUCCESS)
-        {
-            throw std::runtime_error("Failed to create framebuffer!");
-        }
+        probe_requested_ = true;
+        RequestRedraw();
     }
 }
 
-void Chim::DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger,
-                                         const VkAllocationCallbacks *pAllocator)
+/**
+ * @brief Writes every view of the probe read back by its frame as probe_<view>.pfm, in the working directory. The
+ * frame's fence must have signalled.
+ * @details PFM keeps the scene's linear HDR values: three 32-bit floats per pixel, rows from the bottom up.
+ */
+void Chim::WriteProbeViews(void)
 {
-    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
-    if (func != nullptr)
+    const uint16_t *texels = static_cast<const uint16_t *>(probe_readback_mapped_);
+    std::vector<float> row(kProbeSize * 3);
+    for (uint32_t view = 0; view < multiview_views_; view++)
     {
-        func(instance, debugMessenger, pAllocator);
+        std::string path = "probe_" + std::to_string(view) + ".pfm";
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+        {
+            throw ChimException("Could not write the probe view " + path + "!");
+        }
+        file << "PF\n" << kProbeSize << " " << kProbeSize << "\n-1.0\n";
+        const uint16_t *layer = texels + size_t(view) * kProbeSize * kProbeSize * 4;
+        for (uint32_t y = kProbeSize; y-- > 0;)
+        {
+            for (uint32_t x = 0; x < kProbeSize; x++)
+            {
+                for (uint32_t channel = 0; channel < 3; channel++)
+                {
+                    row[x * 3 + channel] = glm::unpackHalf1x16(layer[(size_t(y) * kProbeSize + x) * 4 + channel]);
+                }
+            }
+            file.write(reinterpret_cast<const char *>(row.data()), row.size() * sizeof(float));
+        }
     }
+    LOG("Wrote " << multiview_views_ << " probe views to probe_<view>.pfm");
+    probe_readback_frame_.reset();
 }
 
-void Chim::CreateCommandPool(void)
+/**
+ * @brief Creates the density map, the instance and draw buffers and both foliage pipelines.
+ * @details The instance buffer holds one blade for every spot of the scatter grid, the most one frame can place, so
+ * the scatter pass never has to check for room. Its size is fixed by the view distance and density at start-up.
+ */
+void Chim::CreateFoliageResources(void)
 {
-    QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(physical_device_);
-
-    VkCommandPoolCreateInfo poolInfo{};
-    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-
-    if (vkCreateCommandPool(device_, &poolInfo, nullptr, &command_pool_) != VK_SUCCESS)
+    foliage_ = FoliageScatter(settings_.foliage_distance, settings_.foliage_density);
+    if (foliage_.cells > 0 && static_cast<uint64_t>(foliage_.cells) * foliage_.cells > kMaxFoliageInstances)
     {
-        throw std::runtime_error("Failed to create command pool!");
+        throw ChimException("Too many foliage instances, lower --foliage-distance or --foliage-density!");
     }
-}
+    foliage_density_ = FoliageDensityMap::Generate(kFoliageFieldSize, kFoliageMapResolution, 1.5f, 1);
 
-void Chim::CreateVertexBuffer(void)
-{
-    VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+    VkExtent2D mapExtent = {kFoliageMapResolution, kFoliageMapResolution};
+    CreateRenderTarget(mapExtent, VK_FORMAT_R8_UNORM, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                       VK_IMAGE_ASPECT_COLOR_BIT, foliage_density_map_);
 
     VkBuffer stagingBuffer;
     VkDeviceMemory stagingBufferMemory;
-    CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+    VkDeviceSize mapBytes = foliage_density_.values.size();
+    CreateBuffer(mapBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
                  stagingBufferMemory);
-
     void *data;
-    vkMapMemory(device_, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, vertices.data(), (size_t)bufferSize);
+    vkMapMemory(device_, stagingBufferMemory, 0, mapBytes, 0, &data);
+    memcpy(data, foliage_density_.values.data(), static_cast<size_t>(mapBytes));
     vkUnmapMemory(device_, stagingBufferMemory);
 
-    CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertex_buffer_, vertex_buffer_memory_);
-
-    CopyBuffer(stagingBuffer, vertex_buffer_, bufferSize);
+    VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = foliage_density_map_.image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                         nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent = {kFoliageMapResolution, kFoliageMapResolution, 1};
+    vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, foliage_density_map_.image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+                         nullptr, 0, nullptr, 1, &barrier);
+    EndSingleTimeCommands(commandBuffer);
+    ReleaseStagingBuffer(stagingBuffer, stagingBufferMemory);
+
+    CreateBuffer(sizeof(FoliageInstance) * VkDeviceSize(foliage_.Capacity()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, foliage_instance_buffer_, foliage_instance_memory_);
+    CreateBuffer(sizeof(VkDrawIndirectCommand) * FoliageScatter::kLodCount,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, foliage_draw_buffer_, foliage_draw_memory_);
+
+    // One layout for both passes: the scatter pass reads the map and writes the instances and draws, the vertex
+    // shader reads the camera and the instances
+    std::array<VkDescriptorSetLayoutBinding, 4> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); i++)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorCount = 1;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT;
 
-    vkDestroyBuffer(device_, stagingBuffer, nullptr);
-    vkFreeMemory(device_, stagingBufferMemory, nullptr);
-}
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(device_, &layoutInfo, nullptr, &foliage_set_layout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
 
-void chim::Chim::CreateIndexBuffer(void)
-{
-    VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+    VkPushConstantRange pushConstants{};
+    pushConstants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstants.size = sizeof(FoliageConstants);
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-                 stagingBufferMemory);
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &foliage_set_layout_;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstants;
+    if (vkCreatePipelineLayout(device_, &pipelineLayoutInfo, nullptr, &foliage_scatter_layout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create pipeline layout!");
+    }
+    pushConstants.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstants.size = sizeof(FoliageDrawConstants);
+    if (vkCreatePipelineLayout(device_, &pipelineLayoutInfo, nullptr, &foliage_draw_layout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create pipeline layout!");
+    }
 
-    void *data;
-    vkMapMemory(device_, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, indices.data(), (size_t)bufferSize);
-    vkUnmapMemory(device_, stagingBufferMemory);
+    VkShaderModule shaderModule = CreateShaderModule(ShaderCode("foliage_comp.spv"));
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = foliage_scatter_layout_;
+    VkResult result =
+        vkCreateComputePipelines(device_, pipeline_cache_, 1, &pipelineInfo, nullptr, &foliage_scatter_pipeline_);
+    vkDestroyShaderModule(device_, shaderModule, nullptr);
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create compute pipeline!");
+    }
 
-    CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, index_buffer_, index_buffer_memory_);
+    // Blades are seen from both sides; the fragment shader is the scene's own
+    GraphicsPipelineDesc desc{};
+    desc.vertex_shader = "foliage_vert.spv";
+    desc.fragment_shader = "frag.spv";
+    desc.layout = foliage_draw_layout_;
+    desc.color_attachments = 2;
+    desc.vertex_input = false;
+    desc.cull_mode = VK_CULL_MODE_NONE;
+    BuildGraphicsPipeline(desc, foliage_pipeline_);
+
+    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, foliage_set_layout_);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptor_pool_;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+    allocInfo.pSetLayouts = layouts.data();
+    foliage_sets_.resize(MAX_FRAMES_IN_FLIGHT);
+    if (vkAllocateDescriptorSets(device_, &allocInfo, foliage_sets_.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate descriptor sets!");
+    }
 
-    CopyBuffer(stagingBuffer, index_buffer_, bufferSize);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        VkDescriptorBufferInfo uniformInfo{};
+        uniformInfo.buffer = uniform_buffers_[i];
+        uniformInfo.range = sizeof(UniformBufferObject);
+        VkDescriptorImageInfo mapInfo{};
+        mapInfo.sampler = linear_sampler_;
+        mapInfo.imageView = foliage_density_map_.view;
+        mapInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        VkDescriptorBufferInfo instanceInfo{};
+        instanceInfo.buffer = foliage_instance_buffer_;
+        instanceInfo.range = VK_WHOLE_SIZE;
+        VkDescriptorBufferInfo drawInfo{};
+        drawInfo.buffer = foliage_draw_buffer_;
+        drawInfo.range = VK_WHOLE_SIZE;
+
+        std::array<VkWriteDescriptorSet, 4> writes{};
+        for (uint32_t binding = 0; binding < writes.size(); binding++)
+        {
+            writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[binding].dstSet = foliage_sets_[i];
+            writes[binding].dstBinding = binding;
+            writes[binding].descriptorCount = 1;
+            writes[binding].descriptorType = bindings[binding].descriptorType;
+        }
+        writes[0].pBufferInfo = &uniformInfo;
+        writes[1].pImageInfo = &mapInfo;
+        writes[2].pBufferInfo = &instanceInfo;
+        writes[3].pBufferInfo = &drawInfo;
+        vkUpdateDescriptorSets(device_, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
 
-    vkDestroyBuffer(device_, stagingBuffer, nullptr);
-    vkFreeMemory(device_, stagingBufferMemory, nullptr);
+    LOG("Foliage: up to " << foliage_.Capacity() << " blades within " << foliage_.view_distance << " units, "
+                          << foliage_.GroupCount() * foliage_.GroupCount() << " workgroups per frame");
 }
 
-void chim::Chim::CreateUniformBuffers(void)
+void Chim::DestroyFoliageResources(void)
 {
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
-
-    uniform_buffers_.resize(MAX_FRAMES_IN_FLIGHT);
-    uniform_buffers_memory_.resize(MAX_FRAMES_IN_FLIGHT);
-    uniform_buffers_mapped_.resize(MAX_FRAMES_IN_FLIGHT);
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    if (foliage_scatter_pipeline_ == VK_NULL_HANDLE)
     {
-        CreateBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniform_buffers_[i],
-                     uniform_buffers_memory_[i]);
-
-        vkMapMemory(device_, uniform_buffers_memory_[i], 0, bufferSize, 0, &uniform_buffers_mapped_[i]);
+        return;
     }
+
+    vkDestroyBuffer(device_, foliage_draw_buffer_, nullptr);
+    profiler_.TrackFree(foliage_draw_memory_);
+    vkFreeMemory(device_, foliage_draw_memory_, nullptr);
+    vkDestroyBuffer(device_, foliage_instance_buffer_, nullptr);
+    profiler_.TrackFree(foliage_instance_memory_);
+    vkFreeMemory(device_, foliage_instance_memory_, nullptr);
+    vkDestroyPipeline(device_, foliage_pipeline_, nullptr);
+    vkDestroyPipeline(device_, foliage_scatter_pipeline_, nullptr);
+    vkDestroyPipelineLayout(device_, foliage_draw_layout_, nullptr);
+    vkDestroyPipelineLayout(device_, foliage_scatter_layout_, nullptr);
+    vkDestroyDescriptorSetLayout(device_, foliage_set_layout_, nullptr);
+    DestroyRenderTarget(foliage_density_map_);
 }
 
-void Chim::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer,
-                        VkDeviceMemory& bufferMemory)
+/**
+ * @brief Resets the foliage draws and scatters this frame's blades into them, ahead of the scene pass.
+ * @details The instance and draw buffers are shared by all frames in flight: the first barrier waits for the
+ * previous frame's foliage draws to have read them before they are written again.
+ */
+void Chim::RecordFoliageScatter(VkCommandBuffer commandBuffer)
 {
-    VkBufferCreateInfo bufferInfo{};
-    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferInfo.size = size;
-    bufferInfo.usage = usage;
-    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 0, nullptr);
 
-    if (vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+    std::array<VkDrawIndirectCommand, FoliageScatter::kLodCount> draws{};
+    for (uint32_t lod = 0; lod < draws.size(); lod++)
     {
-        throw std::runtime_error("failed to create buffer!");
+        draws[lod].vertexCount = FoliageScatter::kLodVertices[lod];
     }
+    vkCmdUpdateBuffer(commandBuffer, foliage_draw_buffer_, 0, sizeof(draws), draws.data());
+
+    VkBufferMemoryBarrier toCompute{};
+    toCompute.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    toCompute.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toCompute.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    toCompute.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toCompute.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toCompute.buffer = foliage_draw_buffer_;
+    toCompute.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+                         nullptr, 1, &toCompute, 0, nullptr);
+
+    profiler_.BeginPass(commandBuffer, current_frame_, ProfilePass::Foliage);
+    FoliageConstants constants = foliage_.Constants(foliage_density_, Camera::FrustumPlanes(clip_from_world_),
+                                                    camera_world_position_);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, foliage_scatter_pipeline_);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, foliage_scatter_layout_, 0, 1,
+                            &foliage_sets_[current_frame_], 0, nullptr);
+    vkCmdPushConstants(commandBuffer, foliage_scatter_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                       &constants);
+    vkCmdDispatch(commandBuffer, foliage_.GroupCount(), foliage_.GroupCount(), 1);
+    profiler_.EndPass(commandBuffer, current_frame_, ProfilePass::Foliage);
+
+    std::array<VkBufferMemoryBarrier, 2> toDraw{};
+    toDraw[0] = toCompute;
+    toDraw[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    toDraw[0].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    toDraw[1] = toDraw[0];
+    toDraw[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    toDraw[1].buffer = foliage_instance_buffer_;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 0, nullptr,
+                         static_cast<uint32_t>(toDraw.size()), toDraw.data(), 0, nullptr);
+}
 
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(device_, buffer, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
-
-    if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
+/**
+ * @brief Records the foliage draws, one indirect draw per level of detail. They never change, so they are part of
+ * the cached scene commands.
+ */
+void Chim::RecordFoliageDraws(VkCommandBuffer commandBuffer)
+{
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, foliage_pipeline_);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, foliage_draw_layout_, 0, 1,
+                            &foliage_sets_[current_frame_], 0, nullptr);
+    for (uint32_t lod = 0; lod < FoliageScatter::kLodCount; lod++)
     {
-        throw std::runtime_error("failed to allocate buffer memory!");
+        FoliageDrawConstants constants{lod, foliage_.Capacity()};
+        vkCmdPushConstants(commandBuffer, foliage_draw_layout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants),
+                           &constants);
+        vkCmdDrawIndirect(commandBuffer, foliage_draw_buffer_, sizeof(VkDrawIndirectCommand) * lod, 1,
+                          sizeof(VkDrawIndirectCommand));
     }
-
-    vkBindBufferMemory(device_, buffer, bufferMemory, 0);
 }
 
-void Chim::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+/**
+ * @brief Opens the frame stream and creates the conversion pipeline and the buffers the frames travel through.
+ * @details The stream keeps the size the output had when it opened, rounded down to what 4:2:0 packing needs; later
+ * frames of another size are scaled to it. The readback buffers prefer host-cached memory, which the CPU reads
+ * quickly but which has to be invalidated before each read.
+ */
+void Chim::CreateStreamResources(void)
 {
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = command_pool_;
-    allocInfo.commandBufferCount = 1;
+    StreamFormat format = StreamFormatForPath(settings_.stream_path);
+    stream_extent_ = swap_chain_extent_;
+    if (format == StreamFormat::Y4m)
+    {
+        stream_extent_.width = std::max(8u, stream_extent_.width & ~7u);
+        stream_extent_.height = std::max(2u, stream_extent_.height & ~1u);
+    }
+    VkDeviceSize frameSize = FrameStream::FrameSize(format, stream_extent_.width, stream_extent_.height);
 
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer);
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorCount = 1;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1] = bindings[0];
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(device_, &layoutInfo, nullptr, &stream_set_layout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
 
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    VkPushConstantRange pushConstants{};
+    pushConstants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstants.size = sizeof(StreamConstants);
 
-    VkBufferCopy copyRegion{};
-    copyRegion.size = size;
-    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &stream_set_layout_;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstants;
+    if (vkCreatePipelineLayout(device_, &pipelineLayoutInfo, nullptr, &stream_pipeline_layout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create pipeline layout!");
+    }
 
-    vkEndCommandBuffer(commandBuffer);
+    VkShaderModule shaderModule = CreateShaderModule(ShaderCode("stream_comp.spv"));
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = stream_pipeline_layout_;
+    VkResult result = vkCreateComputePipelines(device_, pipeline_cache_, 1, &pipelineInfo, nullptr, &stream_pipeline_);
+    vkDestroyShaderModule(device_, shaderModule, nullptr);
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create compute pipeline!");
+    }
 
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
+    CreateBuffer(frameSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, stream_buffer_, stream_buffer_memory_);
 
-    vkQueueSubmit(graphics_queue_, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(graphics_queue_);
+    VkMemoryPropertyFlags readbackProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    if (!device_caps_.FindMemoryType(~0u, readbackProperties))
+    {
+        readbackProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    }
 
-    vkFreeCommandBuffers(device_, command_pool_, 1, &commandBuffer);
+    stream_readback_buffers_.resize(MAX_FRAMES_IN_FLIGHT);
+    stream_readback_memory_.resize(MAX_FRAMES_IN_FLIGHT);
+    stream_readback_mapped_.resize(MAX_FRAMES_IN_FLIGHT);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        CreateBuffer(frameSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, readbackProperties, stream_readback_buffers_[i],
+                     stream_readback_memory_[i]);
+        vkMapMemory(device_, stream_readback_memory_[i], 0, frameSize, 0, &stream_readback_mapped_[i]);
+    }
+    stream_pending_.assign(MAX_FRAMES_IN_FLIGHT, false);
+
+    std::array<VkDescriptorSetLayout, 2> layouts = {stream_set_layout_, stream_set_layout_};
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptor_pool_;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+    allocInfo.pSetLayouts = layouts.data();
+    if (vkAllocateDescriptorSets(device_, &allocInfo, stream_sets_.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate descriptor sets!");
+    }
+    UpdateTemporalDescriptorSets();
+
+    LOG("Streaming " << stream_extent_.width << "x" << stream_extent_.height
+                     << (format == StreamFormat::Y4m ? " Y4M" : " RGBA") << " frames to " << settings_.stream_path);
+    stream_.Open(settings_.stream_path, format, stream_extent_.width, stream_extent_.height, settings_.stream_fps);
 }
 
-uint32_t Chim::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+void Chim::DestroyStreamResources(void)
 {
-    VkPhysicalDeviceMemoryProperties mem_properties;
-    vkGetPhysicalDeviceMemoryProperties(physical_device_, &mem_properties);
+    if (stream_pipeline_ == VK_NULL_HANDLE)
+    {
+        return;
+    }
 
-    for (uint32_t i = 0; i < mem_properties.memoryTypeCount; i++)
+    for (size_t i = 0; i < stream_readback_buffers_.size(); i++)
     {
-        if ((typeFilter & (1 << i)) && (mem_properties.memoryTypes[i].propertyFlags & properties) == properties)
-        {
-            return i;
-        }
+        vkDestroyBuffer(device_, stream_readback_buffers_[i], nullptr);
+        profiler_.TrackFree(stream_readback_memory_[i]);
+        vkFreeMemory(device_, stream_readback_memory_[i], nullptr);
     }
+    vkDestroyBuffer(device_, stream_buffer_, nullptr);
+    profiler_.TrackFree(stream_buffer_memory_);
+    vkFreeMemory(device_, stream_buffer_memory_, nullptr);
+    vkDestroyPipeline(device_, stream_pipeline_, nullptr);
+    vkDestroyPipelineLayout(device_, stream_pipeline_layout_, nullptr);
+    vkDestroyDescriptorSetLayout(device_, stream_set_layout_, nullptr);
+}
 
-    throw std::runtime_error("Failed to find suitable memory type!");
+/**
+ * @brief Converts the frame resolved into history_index_ and copies it into the frame in flight's readback buffer.
+ */
+void Chim::RecordStreamConversion(VkCommandBuffer commandBuffer)
+{
+    // The temporal pass made its output visible to fragment shaders only. The copy of the previous frame may still be
+    // reading the stream buffer, which the transfer stage in the source scope waits for.
+    VkImageMemoryBarrier toCompute{};
+    toCompute.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    toCompute.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    toCompute.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    toCompute.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    toCompute.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    toCompute.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toCompute.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toCompute.image = history_[history_index_].image;
+    toCompute.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &toCompute);
+
+    bool yuv = stream_.Format() == StreamFormat::Y4m;
+    StreamConstants constants{stream_extent_.width, stream_extent_.height, yuv ? 1u : 0u, 0};
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, stream_pipeline_);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, stream_pipeline_layout_, 0, 1,
+                            &stream_sets_[history_index_], 0, nullptr);
+    vkCmdPushConstants(commandBuffer, stream_pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                       &constants);
+
+    // One invocation per pixel, or per block of 8x2 pixels for 4:2:0, in groups of 8x8
+    uint32_t columns = yuv ? stream_extent_.width / 8 : stream_extent_.width;
+    uint32_t rows = yuv ? stream_extent_.height / 2 : stream_extent_.height;
+    vkCmdDispatch(commandBuffer, (columns + 7) / 8, (rows + 7) / 8, 1);
+
+    VkBufferMemoryBarrier toTransfer{};
+    toTransfer.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    toTransfer.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer.buffer = stream_buffer_;
+    toTransfer.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                         nullptr, 1, &toTransfer, 0, nullptr);
+
+    VkBufferCopy region{};
+    region.size = stream_.FrameSize();
+    vkCmdCopyBuffer(commandBuffer, stream_buffer_, stream_readback_buffers_[current_frame_], 1, &region);
+
+    VkBufferMemoryBarrier toHost = toTransfer;
+    toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    toHost.buffer = stream_readback_buffers_[current_frame_];
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1,
+                         &toHost, 0, nullptr);
 }
 
-void Chim::CreateCommandBuffers(void)
+/**
+ * @brief Hands the frame read back into frame's buffer, if any, to the stream. The frame's fence must have signalled.
+ */
+void Chim::CollectStreamFrame(uint32_t frame)
 {
-    command_buffers_.resize(MAX_FRAMES_IN_FLIGHT);
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = command_pool_;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = (uint32_t)command_buffers_.size();
+    // The stream may have failed since the frame was recorded
+    bool pending = stream_pending_[frame];
+    stream_pending_[frame] = false;
+    if (!pending || !stream_.IsOpen())
+    {
+        return;
+    }
 
-    if (vkAllocateCommandBuffers(device_, &allocInfo, command_buffers_.data()) != VK_SUCCESS)
+    VkMappedMemoryRange range{};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = stream_readback_memory_[frame];
+    range.size = VK_WHOLE_SIZE;
+    vkInvalidateMappedMemoryRanges(device_, 1, &range);
+
+    if (!stream_.Write(stream_readback_mapped_[frame]))
     {
-        throw std::runtime_error("Failed to allocate command buffers!");
+        LOG("Frame stream closed by its reader after " << stream_.Close() << " frames");
     }
 }
 
-void Chim::CreateSyncObjects(void)
+/**
+ * @brief Waits for every frame in flight, oldest first, writes their frames and closes the stream.
+ */
+void Chim::FlushStream(void)
 {
-    image_available_semaphores_.resize(MAX_FRAMES_IN_FLIGHT);
-    render_finished_semaphores_.resize(MAX_FRAMES_IN_FLIGHT);
-    in_flight_fences_.resize(MAX_FRAMES_IN_FLIGHT);
-
-    VkSemaphoreCreateInfo semaphoreInfo{};
-    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    if (!stream_.IsOpen())
+    {
+        return;
+    }
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        uint32_t frame = (current_frame_ + i) % MAX_FRAMES_IN_FLIGHT;
+        vkWaitForFences(device_, 1, &in_flight_fences_[frame], VK_TRUE, UINT64_MAX);
+        CollectStreamFrame(frame);
+    }
+    LOG("Streamed " << stream_.Close() << " frames to " << settings_.stream_path);
+}
 
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+/**
+ * @brief Sets up GPU timestamps and pipeline statistics, each only if the device supports it.
+ */
+void Chim::InitProfiler(void)
+{
+    const VkPhysicalDeviceFeatures& supportedFeatures = device_caps_.features;
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-    {
-        if (vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &image_available_semaphores_[i]) != VK_SUCCESS ||
-            vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &render_finished_semaphores_[i]) != VK_SUCCESS ||
-            vkCreateFence(device_, &fenceInfo, nullptr, &in_flight_fences_[i]) != VK_SUCCESS)
-        {
+    profiler_.Init(device_, device_caps_.memory, device_caps_.properties.limits.timestampPeriod, MAX_FRAMES_IN_FLIGHT,
+                   device_caps_.queue_families[queue_families_.graphicsFamily.value()].timestampValidBits,
+                   supportedFeatures.pipelineStatisticsQuery == VK_TRUE);
 
-            throw std::runtime_error("Failed to create synchronization objects for a frame!");
-        }
-    }
+    // A secondary command buffer may only run inside an active statistics query if the device can inherit queries
+    cache_scene_commands_ = profiler_.StatisticsFlags() == 0 || supportedFeatures.inheritedQueries == VK_TRUE;
 }
 
 void Chim::SetupDebugMessenger(void)
@@ -581,13 +2604,19 @@ bool Chim::CheckValidationLayerSupport(void)
 
 std::vector<const char *> Chim::GetRequiredExtensions(void)
 {
-    uint32_t sdl_extension_count;
-    const char **sdl_extensions;
-    SDL_Vulkan_GetInstanceExtensions(window_, &sdl_extension_count, nullptr);
-    sdl_extensions = new const char *[sdl_extension_count];
-    SDL_Vulkan_GetInstanceExtensions(window_, &sdl_extension_count, sdl_extensions);
-
-    std::vector<const char *> extensions(sdl_extensions, sdl_extensions + sdl_extension_count);
+    // Headless rendering needs no surface extensions
+    std::vector<const char *> extensions;
+    if (!settings_.headless)
+    {
+        uint32_t sdl_extension_count;
+        const char **sdl_extensions;
+        // Called before the window exists, which works once SDL has loaded the Vulkan library
+        SDL_Vulkan_GetInstanceExtensions(nullptr, &sdl_extension_count, nullptr);
+        sdl_extensions = new const char *[sdl_extension_count];
+        SDL_Vulkan_GetInstanceExtensions(nullptr, &sdl_extension_count, sdl_extensions);
+
+        extensions.assign(sdl_extensions, sdl_extensions + sdl_extension_count);
+    }
 
     if (enable_validation_layers)
     {
@@ -608,6 +2637,12 @@ VKAPI_ATTR VkBool32 VKAPI_CALL Chim::DebugCallback(VkDebugUtilsMessageSeverityFl
     return VK_FALSE;
 }
 
+/**
+ * @brief Picks the highest rated suitable device.
+ * @details Every device is queried once into a capability snapshot, which the rest of the renderer consults instead
+ * of the driver. A snapshot saved by an earlier run is used as is when it describes the same device and driver; the
+ * chosen device's snapshot is saved for the next run otherwise.
+ */
 void Chim::PickPhysicalDevice(void)
 {
     uint32_t device_count = 0;
@@ -621,185 +2656,817 @@ void Chim::PickPhysicalDevice(void)
     std::vector<VkPhysicalDevice> devices(device_count);
     vkEnumeratePhysicalDevices(instance_, &device_count, devices.data());
 
+    std::optional<DeviceCapabilities> saved;
+    if (!settings_.cache_directory.empty())
+    {
+        saved = DeviceCapabilities::Load(CachePath("chim_device.caps"));
+    }
+    const std::vector<VkFormat> formats = {scene_color_format_, motion_format_, depth_format_};
+
     // Sort candidates by increasing score
-    std::multimap<int, VkPhysicalDevice> candidates;
+    std::vector<DeviceCandidate> devices_considered;
+    std::vector<bool> loaded;
+    std::multimap<int, size_t> candidates;
 
     for (const auto& device : devices)
     {
-        int score = RateDeviceSuitability(device);
-        candidates.insert(std::make_pair(score, device));
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        bool reuse = saved && saved->SameDevice(properties) &&
+                     saved->api_version == std::min(properties.apiVersion, instance_api_version_) &&
+                     std::all_of(formats.begin(), formats.end(), [&](VkFormat f) { return saved->HasFormat(f); });
+
+        devices_considered.push_back(
+            {device, reuse ? *saved : DeviceCapabilities::Query(device, formats, instance_api_version_)});
+        loaded.push_back(reuse);
+        int score = RateDeviceSuitability(devices_considered.back());
+        candidates.insert(std::make_pair(score, devices_considered.size() - 1));
+    }
+
+    // Check if the best candidate is suitable at all
+    if (candidates.rbegin()->first <= 0)
+    {
+        throw ChimException("Failed to find a suitable GPU!");
+    }
+
+    size_t best = candidates.rbegin()->second;
+    DeviceCandidate& chosen = devices_considered[best];
+    physical_device_ = chosen.device;
+    device_caps_ = std::move(chosen.caps);
+    queue_families_ = chosen.queues;
+    swap_chain_support_ = std::move(chosen.swap_chain);
+    if (!loaded[best] && !settings_.cache_directory.empty())
+    {
+        device_caps_.Save(CachePath("chim_device.caps"));
+    }
+}
+
+int Chim::RateDeviceSuitability(DeviceCandidate& candidate)
+{
+
+    if (!IsDeviceSuitable(candidate))
+    {
+        return 0;
+    }
+
+    const VkPhysicalDeviceProperties& device_properties = candidate.caps.properties;
+    const VkPhysicalDeviceFeatures& device_features = candidate.caps.features;
+
+    int score = 0;
+
+    // Discrete GPUs have a significant performance advantage
+    if (device_properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
+    {
+        score += 1000;
+    }
+
+    // Maximum possible size of textures affects graphics quality
+    score += device_properties.limits.maxImageDimension2D;
+
+    // Application can't function without geometry shaders
+    if (!device_features.geometryShader)
+    {
+        return 0;
+    }
+
+    return score;
+}
+
+void Chim::UpdateUniformBuffer(uint32_t currentImage)
+{
+    static auto startTime = std::chrono::high_resolution_clock::now();
+
+    auto currentTime = std::chrono::high_resolution_clock::now();
+    float time = scene_time_.value_or(
+        std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count());
+
+    UniformBufferObject ubo{};
+    ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    ubo.view = camera_.View();
+    ubo.proj = camera_.Projection();
+    ubo.jitter = glm::vec4(camera_.JitterNdc(), 0.0f, 0.0f);
+
+    // A replayed frame overrides the live values with exactly what was recorded, so replays are deterministic
+    if (replay_frame_ != nullptr)
+    {
+        for (const UniformWrite& write : replay_frame_->uniforms)
+        {
+            memcpy(reinterpret_cast<uint8_t *>(&ubo) + write.offset, write.data.data(), write.data.size());
+        }
+        if (replay_frame_->has_camera)
+        {
+            ubo.view = replay_frame_->view;
+            ubo.proj = replay_frame_->proj;
+        }
+    }
+
+    capture_.WriteUniform(offsetof(UniformBufferObject, model), &ubo.model, sizeof(ubo.model));
+    capture_.WriteUniform(offsetof(UniformBufferObject, jitter), &ubo.jitter, sizeof(ubo.jitter));
+    capture_.WriteCamera(ubo.view, ubo.proj);
+
+    // Motion vectors compare against last frame's transforms, minus the jitter. Without history there is nothing to
+    // compare against, so the frame is its own previous frame.
+    glm::mat4 unjittered = ubo.proj;
+    unjittered[2][0] += ubo.jitter.x;
+    unjittered[2][1] += ubo.jitter.y;
+    glm::mat4 viewProj = unjittered * ubo.view;
+    ubo.prev_model = history_valid_ ? prev_model_ : ubo.model;
+    ubo.prev_view_proj = history_valid_ ? prev_view_proj_ : viewProj;
+    prev_model_ = ubo.model;
+    prev_view_proj_ = viewProj;
+    clip_from_object_ = viewProj * ubo.model;
+    clip_from_world_ = viewProj;
+    camera_world_position_ = glm::vec3(glm::inverse(ubo.view)[3]);
+    camera_object_position_ = glm::vec3(glm::inverse(ubo.view * ubo.model)[3]);
+
+    memcpy(uniform_buffers_mapped_[currentImage], &ubo, sizeof(ubo));
+
+    if (probe_due_)
+    {
+        UpdateProbeUniformBuffer(currentImage, ubo);
+    }
+}
+
+/**
+ * @brief Writes the probe's per-view transforms, derived from the frame's camera so replays stay deterministic.
+ * @details A stereo pair puts the eyes half the eye separation to either side of the camera, looking the same way.
+ * Cube faces look along the axes from the camera position with a 90 degree field of view, in the layer order of
+ * Vulkan cube maps (+X, -X, +Y, -Y, +Z, -Z). Neither is jittered: the probe has no history to resolve it.
+ */
+void Chim::UpdateProbeUniformBuffer(uint32_t currentImage, const UniformBufferObject& ubo)
+{
+    const float eyeSeparation = 0.064f;
+
+    ProbeUniformBufferObject probe{};
+    probe.model = ubo.model;
+    if (multiview_views_ == 2)
+    {
+        glm::mat4 projection = Camera::InfiniteProjection(camera_.FieldOfView(), 1.0f, camera_.NearPlane());
+        for (uint32_t eye = 0; eye < 2; eye++)
+        {
+            // Moving the left eye left moves the world right in its view space
+            float offset = (eye == 0 ? 0.5f : -0.5f) * eyeSeparation;
+            glm::mat4 eyeView = glm::translate(glm::mat4(1.0f), glm::vec3(offset, 0.0f, 0.0f)) * ubo.view;
+            probe.view_proj[eye] = projection * eyeView;
+        }
+    }
+    else
+    {
+        const std::array<glm::vec3, kMaxProbeViews> directions = {
+            glm::vec3{1.0f, 0.0f, 0.0f}, glm::vec3{-1.0f, 0.0f, 0.0f}, glm::vec3{0.0f, 1.0f, 0.0f},
+            glm::vec3{0.0f, -1.0f, 0.0f}, glm::vec3{0.0f, 0.0f, 1.0f}, glm::vec3{0.0f, 0.0f, -1.0f}};
+        const std::array<glm::vec3, kMaxProbeViews> ups = {
+            glm::vec3{0.0f, -1.0f, 0.0f}, glm::vec3{0.0f, -1.0f, 0.0f}, glm::vec3{0.0f, 0.0f, 1.0f},
+            glm::vec3{0.0f, 0.0f, -1.0f}, glm::vec3{0.0f, -1.0f, 0.0f}, glm::vec3{0.0f, -1.0f, 0.0f}};
+        glm::mat4 projection = Camera::InfiniteProjection(glm::radians(90.0f), 1.0f, camera_.NearPlane());
+        glm::vec3 center = glm::vec3(glm::inverse(ubo.view)[3]);
+        for (uint32_t face = 0; face < kMaxProbeViews; face++)
+        {
+            probe.view_proj[face] = projection * glm::lookAt(center, center + directions[face], ups[face]);
+        }
+    }
+
+    memcpy(probe_uniform_buffers_mapped_[currentImage], &probe, sizeof(probe));
+}
+
+void Chim::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to begin recording command buffer!");
+    }
+
+    profiler_.ResetQueries(commandBuffer, current_frame_);
+
+    if (probe_due_)
+    {
+        RecordProbePass(commandBuffer);
+    }
+    if (foliage_scatter_pipeline_ != VK_NULL_HANDLE)
+    {
+        RecordFoliageScatter(commandBuffer);
+    }
+
+    // Scene pass, at the internal resolution
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = render_pass_;
+    renderPassInfo.framebuffer = scene_frame_buffer_;
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = render_extent_;
+
+    // Reverse-Z: depth 0 is infinitely far away
+    std::array<VkClearValue, 3> clearValues{};
+    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    clearValues[1].color = {{0.0f, 0.0f, 0.0f, 0.0f}};
+    clearValues[2].depthStencil = {0.0f, 0};
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassInfo.pClearValues = clearValues.data();
+
+    // The profiler brackets the whole pass: a pass that executes secondary command buffers allows nothing else
+    profiler_.BeginPass(commandBuffer, current_frame_, ProfilePass::Main);
+    if (cache_scene_commands_)
+    {
+        VkCommandBuffer sceneCommands = SceneCommands();
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        vkCmdExecuteCommands(commandBuffer, 1, &sceneCommands);
+    }
+    else
+    {
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        RecordSceneDraws(commandBuffer);
+    }
+    vkCmdEndRenderPass(commandBuffer);
+    profiler_.EndPass(commandBuffer, current_frame_, ProfilePass::Main);
+
+    profiler_.CountDraws(scene_draw_count_, scene_triangle_count_);
+    if (capture_.IsRecording())
+    {
+        for (DrawCommand draw : draw_list_)
+        {
+            draw.first_index -= scene_mesh_.first_index;
+            draw.vertex_offset -= static_cast<int32_t>(scene_mesh_.first_vertex);
+            capture_.WriteDraw(draw);
+        }
+    }
+
+    // Everything from here on runs at the output resolution
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float)swap_chain_extent_.width;
+    viewport.height = (float)swap_chain_extent_.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = swap_chain_extent_;
+
+    // Temporal pass: resolve the scene into history_index_, reading the other history image
+    renderPassInfo.renderPass = temporal_render_pass_;
+    renderPassInfo.framebuffer = history_frame_buffers_[history_index_];
+    renderPassInfo.renderArea.extent = swap_chain_extent_;
+    renderPassInfo.clearValueCount = 0;
+    renderPassInfo.pClearValues = nullptr;
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    profiler_.BeginPass(commandBuffer, current_frame_, ProfilePass::Temporal);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, temporal_pipeline_);
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, temporal_pipeline_layout_, 0, 1,
+                            &temporal_sets_[history_index_], 0, nullptr);
+
+    // jitter in texture coordinates, blend weight of the current frame, reset flag
+    glm::vec2 jitter = camera_.JitterNdc();
+    glm::vec4 parameters(jitter.x * 0.5f, jitter.y * 0.5f, temporal_blend_,
+                         history_valid_ && temporal_enabled_ ? 0.0f : 1.0f);
+    vkCmdPushConstants(commandBuffer, temporal_pipeline_layout_, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(parameters),
+                       &parameters);
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+    profiler_.EndPass(commandBuffer, current_frame_, ProfilePass::Temporal);
+    vkCmdEndRenderPass(commandBuffer);
+
+    // Present pass: copy the resolved image into the swap chain image, then the overlay on top
+    renderPassInfo.renderPass = present_render_pass_;
+    renderPassInfo.framebuffer = swap_chain_frame_buffers_[imageIndex];
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, present_pipeline_);
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, present_pipeline_layout_, 0, 1,
+                            &present_sets_[history_index_], 0, nullptr);
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+    if (overlay_vertex_count_ > 0)
+    {
+        profiler_.BeginPass(commandBuffer, current_frame_, ProfilePass::Overlay);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, overlay_pipeline_);
+        VkDeviceSize overlayOffset = sizeof(Vertex) * Overlay::kMaxVertices * current_frame_;
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &overlay_vertex_buffer_, &overlayOffset);
+        vkCmdDraw(commandBuffer, overlay_vertex_count_, 1, 0, 0);
+
+        profiler_.EndPass(commandBuffer, current_frame_, ProfilePass::Overlay);
+    }
+
+    vkCmdEndRenderPass(commandBuffer);
+
+    if (!stream_pending_.empty() && stream_pending_[current_frame_])
+    {
+        RecordStreamConversion(commandBuffer);
+    }
+
+    // A served camera's image is copied out for CollectReadback, which reads it once the frame's fence has signalled
+    if (!readbacks_.empty() && readbacks_[current_frame_])
+    {
+        VkImageMemoryBarrier toTransfer{};
+        toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        toTransfer.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        toTransfer.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.image = swap_chain_images_[imageIndex];
+        toTransfer.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &toTransfer);
+
+        VkBufferImageCopy region{};
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.imageExtent = {swap_chain_extent_.width, swap_chain_extent_.height, 1};
+        vkCmdCopyImageToBuffer(commandBuffer, swap_chain_images_[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                               readback_buffers_[current_frame_], 1, &region);
+
+        VkBufferMemoryBarrier toHost{};
+        toHost.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        toHost.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toHost.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toHost.buffer = readback_buffers_[current_frame_];
+        toHost.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr,
+                             1, &toHost, 0, nullptr);
+    }
+
+    // Exported images are handed to the consumer's queue; the next frame discards their contents, so they never need
+    // to be acquired back
+    if (frame_export_.IsConnected())
+    {
+        VkImageMemoryBarrier release{};
+        release.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        release.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        release.dstAccessMask = 0;
+        release.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        release.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        release.srcQueueFamilyIndex = graphics_queue_family_;
+        release.dstQueueFamilyIndex = VK_QUEUE_FAMILY_EXTERNAL;
+        release.image = swap_chain_images_[imageIndex];
+        release.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                             VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &release);
+    }
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to record command buffer!");
+    }
+}
+
+/**
+ * @brief Records the scene pass draws: everything between beginning and ending the scene render pass.
+ * @details The commands depend only on the draw list, the buffers and the targets, never on the frame, apart from the
+ * per-frame uniform buffer set. They are recorded either inline or into the frame's secondary command buffer.
+ */
+void Chim::RecordSceneDraws(VkCommandBuffer commandBuffer)
+{
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline_);
+
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float)render_extent_.width;
+    viewport.height = (float)render_extent_.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = render_extent_;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    if (vertex_pulling_)
+    {
+        VertexPullConstants pull{vertex_buffer_address_, sizeof(Vertex) / sizeof(float), 0};
+        vkCmdPushConstants(commandBuffer, pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pull), &pull);
+    }
+    else
+    {
+        VkBuffer vertexBuffers[] = {vertex_buffer_};
+        VkDeviceSize offsets[] = {0};
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+    }
+
+    vkCmdBindIndexBuffer(commandBuffer, index_buffer_, 0, VK_INDEX_TYPE_UINT16);
+
+    if (descriptor_buffer_)
+    {
+        VkDescriptorBufferBindingInfoEXT bindingInfo{};
+        bindingInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT;
+        bindingInfo.address = scene_descriptor_address_;
+        bindingInfo.usage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT;
+        cmd_bind_descriptor_buffers_(commandBuffer, 1, &bindingInfo);
+
+        uint32_t bufferIndex = 0;
+        cmd_set_descriptor_buffer_offsets_(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_, 0, 1,
+                                           &bufferIndex, &scene_descriptor_offsets_[current_frame_]);
+    }
+    else
+    {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_, 0, 1,
+                                &descriptor_sets_[current_frame_], 0, nullptr);
+    }
+
+    scene_draw_count_ = 0;
+    scene_triangle_count_ = 0;
+    for (size_t i = 0; i < draw_list_.size(); i++)
+    {
+        if (i < draw_visible_.size() && !draw_visible_[i])
+        {
+            continue;
+        }
+        const DrawCommand& draw = draw_list_[i];
+        vkCmdDrawIndexed(commandBuffer, draw.index_count, 1, draw.first_index, draw.vertex_offset, 0);
+        scene_draw_count_++;
+        scene_triangle_count_ += draw.index_count / 3;
+    }
+
+    if (foliage_pipeline_ != VK_NULL_HANDLE)
+    {
+        RecordFoliageDraws(commandBuffer);
+    }
+}
+
+/**
+ * @brief Decides which draws of draw_list_ this frame records, into draw_visible_.
+ * @details Runs after UpdateUniformBuffer and before the scene pass is recorded. The potentially visible set goes
+ * first because it costs one lookup per draw; the occluders are only tested against the draws it lets through. The
+ * cached scene commands are only re-recorded when the set of visible draws changes.
+ */
+void Chim::CullDraws(void)
+{
+    std::vector<uint8_t> visible(draw_list_.size(), 1);
+    if (pvs_)
+    {
+        CullInvisibleDraws(visible);
+    }
+    if (settings_.occlusion_culling)
+    {
+        CullOccludedDraws(visible);
+    }
+    if (visible != draw_visible_)
+    {
+        draw_visible_ = std::move(visible);
+        InvalidateSceneCommands();
+    }
+}
+
+/**
+ * @brief Clears the draws that cannot be seen from the camera's PVS cell. A camera outside the grid culls nothing.
+ */
+void Chim::CullInvisibleDraws(std::vector<uint8_t>& visible)
+{
+    // The bake knows the draws as they were captured, before Replay moved them to scene_mesh_
+    if (draw_list_ != pvs_draws_)
+    {
+        pvs_draws_ = draw_list_;
+        pvs_objects_.assign(draw_list_.size(), -1);
+        for (size_t i = 0; i < draw_list_.size(); i++)
+        {
+            DrawCommand captured = draw_list_[i];
+            captured.first_index -= scene_mesh_.first_index;
+            captured.vertex_offset -= static_cast<int32_t>(scene_mesh_.first_vertex);
+            if (std::optional<uint32_t> object = pvs_->FindObject(captured))
+            {
+                pvs_objects_[i] = *object;
+            }
+        }
     }
 
-    // Check if the best candidate is suitable at all
-    if (candidates.rbegin()->first > 0)
-    {
-        physical_device_ = candidates.rbegin()->second;
-    }
-    else
+    uint32_t culled = 0;
+    if (std::optional<uint32_t> cell = pvs_->CellAt(camera_object_position_))
     {
-        throw ChimException("Failed to find a suitable GPU!");
+        const uint64_t *bits = pvs_->CellBits(*cell);
+        for (size_t i = 0; i < draw_list_.size(); i++)
+        {
+            if (pvs_objects_[i] >= 0 && !PvsVisible(bits, static_cast<uint32_t>(pvs_objects_[i])))
+            {
+                visible[i] = 0;
+                culled++;
+            }
+        }
     }
+    profiler_.CountPvs(static_cast<uint32_t>(draw_list_.size()), culled);
 }
 
-int Chim::RateDeviceSuitability(VkPhysicalDevice device)
+/**
+ * @brief Computes the bounds of every draw and picks the occluders, for the current draw list.
+ * @details Only draws inside the scene mesh have their geometry on the CPU. The occluders are the draws with the
+ * largest bounds, as many as fit into kMaxOccluders and kMaxOccluderTriangles.
+ */
+void Chim::PrepareOcclusion(void)
 {
+    occlusion_draws_ = draw_list_;
+    draw_bounds_.assign(draw_list_.size(), std::nullopt);
+    occluder_triangles_.clear();
 
-    if (!IsDeviceSuitable(device))
+    std::vector<std::pair<float, size_t>> candidates; // Bounds diagonal, draw
+    for (size_t i = 0; i < draw_list_.size(); i++)
     {
-        return 0;
-    }
-
-    VkPhysicalDeviceProperties device_properties;
-    vkGetPhysicalDeviceProperties(device, &device_properties);
-    VkPhysicalDeviceFeatures device_features;
-    vkGetPhysicalDeviceFeatures(device, &device_features);
-
-    int score = 0;
+        const DrawCommand& draw = draw_list_[i];
+        const int64_t firstIndex = int64_t(draw.first_index) - scene_mesh_.first_index;
+        const int64_t vertexOffset = int64_t(draw.vertex_offset) - scene_mesh_.first_vertex;
+        if (firstIndex < 0 || firstIndex + draw.index_count > int64_t(scene_indices_.size()) || draw.index_count == 0)
+        {
+            continue;
+        }
 
-    // Discrete GPUs have a significant performance advantage
-    if (device_properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
-    {
-        score += 1000;
+        BoundingBox box{glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max())};
+        bool inside = true;
+        for (uint32_t index = 0; index < draw.index_count && inside; index++)
+        {
+            const int64_t vertex = vertexOffset + scene_indices_[firstIndex + index];
+            inside = vertex >= 0 && vertex < int64_t(scene_vertices_.size());
+            if (inside)
+            {
+                const glm::vec3& position = scene_vertices_[vertex].pos;
+                box.min = glm::min(box.min, position);
+                box.max = glm::max(box.max, position);
+            }
+        }
+        if (inside)
+        {
+            draw_bounds_[i] = box;
+            candidates.emplace_back(glm::length(box.max - box.min), i);
+        }
     }
 
-    // Maximum possible size of textures affects graphics quality
-    score += device_properties.limits.maxImageDimension2D;
-
-    // Application can't function without geometry shaders
-    if (!device_features.geometryShader)
+    std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+    uint32_t occluders = 0;
+    for (const auto& candidate : candidates)
     {
-        return 0;
+        const DrawCommand& draw = draw_list_[candidate.second];
+        if (occluders == kMaxOccluders)
+        {
+            break;
+        }
+        if (occluder_triangles_.size() / 3 + draw.index_count / 3 > kMaxOccluderTriangles)
+        {
+            continue;
+        }
+        const int64_t firstIndex = int64_t(draw.first_index) - scene_mesh_.first_index;
+        const int64_t vertexOffset = int64_t(draw.vertex_offset) - scene_mesh_.first_vertex;
+        for (uint32_t index = 0; index < draw.index_count / 3 * 3; index++)
+        {
+            occluder_triangles_.push_back(scene_vertices_[vertexOffset + scene_indices_[firstIndex + index]].pos);
+        }
+        occluders++;
     }
-
-    return score;
 }
 
-void Chim::UpdateUniformBuffer(uint32_t currentImage)
+/**
+ * @brief Rasterizes the occluders from this frame's camera and clears the draws they hide.
+ */
+void Chim::CullOccludedDraws(std::vector<uint8_t>& visible)
 {
-    static auto startTime = std::chrono::high_resolution_clock::now();
-
-    auto currentTime = std::chrono::high_resolution_clock::now();
-    float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+    auto start = std::chrono::steady_clock::now();
+    if (draw_list_ != occlusion_draws_ || draw_bounds_.size() != draw_list_.size())
+    {
+        PrepareOcclusion();
+    }
+    occlusion_.RenderOccluders(clip_from_object_, occluder_triangles_);
 
-    UniformBufferObject ubo{};
-    ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.proj =
-        glm::perspective(glm::radians(45.0f), swap_chain_extent_.width / (float)swap_chain_extent_.height, 0.1f, 10.0f);
-    ubo.proj[1][1] *= -1;
+    uint32_t tested = 0;
+    uint32_t culled = 0;
+    for (size_t i = 0; i < draw_list_.size(); i++)
+    {
+        if (!visible[i])
+        {
+            continue;
+        }
+        tested++;
+        if (draw_bounds_[i] && !occlusion_.IsVisible(*draw_bounds_[i]))
+        {
+            visible[i] = 0;
+            culled++;
+        }
+    }
 
-    memcpy(uniform_buffers_mapped_[currentImage], &ubo, sizeof(ubo));
+    float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    profiler_.CountOcclusion(tested, culled, ms);
 }
 
-void Chim::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+/**
+ * @brief Records the probe pass: the draw list once, rasterized into every view by the multiview render pass.
+ */
+void Chim::RecordProbePass(VkCommandBuffer commandBuffer)
 {
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-
-    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
-    {
-        throw std::runtime_error("Failed to begin recording command buffer!");
-    }
-
     VkRenderPassBeginInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = render_pass_;
-    renderPassInfo.framebuffer = swap_chain_frame_buffers_[imageIndex];
+    renderPassInfo.renderPass = probe_render_pass_;
+    renderPassInfo.framebuffer = probe_frame_buffer_;
     renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = swap_chain_extent_;
+    renderPassInfo.renderArea.extent = {kProbeSize, kProbeSize};
 
-    VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-    renderPassInfo.clearValueCount = 1;
-    renderPassInfo.pClearValues = &clearColor;
+    std::array<VkClearValue, 2> clearValues{};
+    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    clearValues[1].depthStencil = {0.0f, 0};
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassInfo.pClearValues = clearValues.data();
 
+    profiler_.BeginPass(commandBuffer, current_frame_, ProfilePass::Probe);
     vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline_);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, probe_pipeline_);
 
     VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float)swap_chain_extent_.width;
-    viewport.height = (float)swap_chain_extent_.height;
-    viewport.minDepth = 0.0f;
+    viewport.width = static_cast<float>(kProbeSize);
+    viewport.height = static_cast<float>(kProbeSize);
     viewport.maxDepth = 1.0f;
     vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &renderPassInfo.renderArea);
 
-    VkRect2D scissor{};
-    scissor.offset = {0, 0};
-    scissor.extent = swap_chain_extent_;
-    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-
-    VkBuffer vertexBuffers[] = {vertex_buffer_};
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertex_buffer_, &offset);
     vkCmdBindIndexBuffer(commandBuffer, index_buffer_, 0, VK_INDEX_TYPE_UINT16);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, probe_pipeline_layout_, 0, 1,
+                            &probe_sets_[current_frame_], 0, nullptr);
 
-    vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+    uint64_t triangles = 0;
+    for (const DrawCommand& draw : draw_list_)
+    {
+        vkCmdDrawIndexed(commandBuffer, draw.index_count, 1, draw.first_index, draw.vertex_offset, 0);
+        triangles += draw.index_count / 3;
+    }
 
     vkCmdEndRenderPass(commandBuffer);
+    profiler_.EndPass(commandBuffer, current_frame_, ProfilePass::Probe);
+
+    // Every view rasterizes the triangles, but each draw was submitted once
+    profiler_.CountDraws(static_cast<uint32_t>(draw_list_.size()), triangles * multiview_views_);
+
+    // Copy every view out for WriteProbeViews. The next rendering starts from an undefined layout, so the image is
+    // never moved back.
+    VkImageMemoryBarrier toTransfer{};
+    toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    toTransfer.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    toTransfer.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer.image = probe_color_.image;
+    toTransfer.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, multiview_views_};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &toTransfer);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, multiview_views_};
+    region.imageExtent = {kProbeSize, kProbeSize, 1};
+    vkCmdCopyImageToBuffer(commandBuffer, probe_color_.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           probe_readback_buffer_, 1, &region);
+
+    VkBufferMemoryBarrier toHost{};
+    toHost.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    toHost.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toHost.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toHost.buffer = probe_readback_buffer_;
+    toHost.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1,
+                         &toHost, 0, nullptr);
+
+    probe_requested_ = false;
+    probe_readback_frame_ = current_frame_;
+}
+
+/**
+ * @brief Returns the current frame's secondary command buffer for the scene pass, re-recording it if it is stale.
+ * @details Each frame in flight has its own buffer because each binds its own uniform buffer set. A buffer is only
+ * re-recorded after its frame's fence has signalled, so it is never pending while it is reset.
+ */
+VkCommandBuffer Chim::SceneCommands(void)
+{
+    VkCommandBuffer commandBuffer = scene_command_buffers_[current_frame_];
+    if (scene_command_generations_[current_frame_] == scene_generation_)
+    {
+        return commandBuffer;
+    }
+
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = render_pass_;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = scene_frame_buffer_;
+    inheritanceInfo.pipelineStatistics = profiler_.StatisticsFlags();
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    vkResetCommandBuffer(commandBuffer, 0);
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to begin recording command buffer!");
+    }
+
+    RecordSceneDraws(commandBuffer);
 
     if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
     {
         throw std::runtime_error("Failed to record command buffer!");
     }
+
+    scene_command_generations_[current_frame_] = scene_generation_;
+    return commandBuffer;
 }
 
-bool Chim::IsDeviceSuitable(VkPhysicalDevice device)
+bool Chim::IsDeviceSuitable(DeviceCandidate& candidate)
 {
-    QueueFamilyIndices indices = FindQueueFamilies(device);
+    candidate.queues = FindQueueFamilies(candidate.device, candidate.caps);
+
+    bool extensionsSupported = CheckDeviceExtensionSupport(candidate.caps);
 
-    bool extensionsSupported = CheckDeviceExtensionSupport(device);
+    // The scene targets are rendered to and sampled by the temporal pass
+    auto supports = [&candidate](VkFormat format, VkFormatFeatureFlags features) {
+        return (candidate.caps.FormatProperties(format).optimalTilingFeatures & features) == features;
+    };
+    const VkFormatFeatureFlags targetFeatures =
+        VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+    bool formatsSupported = supports(scene_color_format_, targetFeatures) && supports(motion_format_, targetFeatures) &&
+                            supports(depth_format_, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
 
-    bool swapChainAdequate = false;
-    if (extensionsSupported)
+    bool swapChainAdequate = settings_.headless;
+    if (extensionsSupported && !settings_.headless)
     {
-        SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(device);
-        swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+        candidate.swap_chain = QuerySwapChainSupport(candidate.device);
+        swapChainAdequate = !candidate.swap_chain.formats.empty() && !candidate.swap_chain.presentModes.empty();
     }
 
-    return indices.isComplete() && extensionsSupported && swapChainAdequate;
+    return candidate.queues.isComplete() && extensionsSupported && formatsSupported && swapChainAdequate;
 }
 
-bool Chim::CheckDeviceExtensionSupport(VkPhysicalDevice device)
+bool Chim::CheckDeviceExtensionSupport(const DeviceCapabilities& caps)
 {
-    uint32_t extensionCount;
-    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
-
-    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
-    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
-
-    std::set<std::string> requiredExtensions(device_extensions_.begin(), device_extensions_.end());
+    for (const char *extension : GetRequiredDeviceExtensions())
+    {
+        if (!caps.HasExtension(extension))
+        {
+            return false;
+        }
+    }
+    return true;
+}
 
-    for (const auto& extension : availableExtensions)
+/**
+ * @brief Device extensions that must be present. Headless rendering never presents, so it needs none.
+ */
+std::vector<const char *> Chim::GetRequiredDeviceExtensions(void) const
+{
+    if (settings_.headless)
     {
-        requiredExtensions.erase(extension.extensionName);
+        return {};
     }
+    return device_extensions_;
+}
 
-    return requiredExtensions.empty();
+bool Chim::IsDeviceExtensionEnabled(const char *extension) const
+{
+    for (const char *enabled : enabled_device_extensions_)
+    {
+        if (strcmp(enabled, extension) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
 }
 
-chim::QueueFamilyIndices Chim::FindQueueFamilies(VkPhysicalDevice device)
+chim::QueueFamilyIndices Chim::FindQueueFamilies(VkPhysicalDevice device, const DeviceCapabilities& caps)
 {
     QueueFamilyIndices indices;
 
-    uint32_t queueFamilyCount = 0;
-    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
-
-    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
-
     int i = 0;
-    for (const auto& queueFamily : queueFamilies)
+    for (const auto& queueFamily : caps.queue_families)
     {
         if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
         {
             indices.graphicsFamily = i;
         }
 
+        // Without a surface the graphics queue stands in for the present queue
         VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+        if (settings_.headless)
+        {
+            presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+        }
+        else
+        {
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+        }
 
         if (presentSupport)
         {
@@ -893,7 +3560,7 @@ VkExtent2D Chim::ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities)
 
 void Chim::CreateLogicalDevice(void)
 {
-    QueueFamilyIndices indices = FindQueueFamilies(physical_device_);
+    QueueFamilyIndices indices = queue_families_;
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
     std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
@@ -909,7 +3576,12 @@ void Chim::CreateLogicalDevice(void)
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    // Pipeline statistics feed the profiler; enable them whenever they are available
+    const VkPhysicalDeviceFeatures& supportedFeatures = device_caps_.features;
+
     VkPhysicalDeviceFeatures deviceFeatures{};
+    deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+    deviceFeatures.inheritedQueries = supportedFeatures.inheritedQueries;
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -919,8 +3591,93 @@ void Chim::CreateLogicalDevice(void)
 
     createInfo.pEnabledFeatures = &deviceFeatures;
 
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(device_extensions_.size());
-    createInfo.ppEnabledExtensionNames = device_extensions_.data();
+    // Multiview is core since Vulkan 1.1. Vertex pulling needs buffer device addresses, core since Vulkan 1.2.
+    // Pipeline libraries need their extension and its feature, descriptor buffers additionally Vulkan 1.3 for the
+    // extension's dependencies and buffer device addresses. The snapshot only reports features the device can know
+    // about, and only the features in use are chained into the device.
+    VkPhysicalDeviceMultiviewFeatures multiviewFeatures{};
+    multiviewFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+    VkPhysicalDeviceBufferDeviceAddressFeatures addressFeatures{};
+    addressFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT libraryFeatures{};
+    libraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+    VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptorBufferFeatures{};
+    descriptorBufferFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+
+    void *featureChain = nullptr;
+    vertex_pulling_ = settings_.vertex_pulling && device_caps_.buffer_device_address;
+    descriptor_buffer_ =
+        settings_.descriptor_buffer && device_caps_.buffer_device_address && device_caps_.descriptor_buffer;
+    if (vertex_pulling_ || descriptor_buffer_)
+    {
+        addressFeatures.pNext = featureChain;
+        addressFeatures.bufferDeviceAddress = VK_TRUE;
+        featureChain = &addressFeatures;
+    }
+    else if (settings_.vertex_pulling)
+    {
+        LOG("Buffer device addresses are not supported, using vertex input instead");
+    }
+
+    if (descriptor_buffer_)
+    {
+        descriptorBufferFeatures.pNext = featureChain;
+        descriptorBufferFeatures.descriptorBuffer = VK_TRUE;
+        featureChain = &descriptorBufferFeatures;
+    }
+    else if (settings_.descriptor_buffer)
+    {
+        LOG("Descriptor buffers are not supported, using descriptor sets instead");
+    }
+
+    pipeline_library_ = settings_.pipeline_library && device_caps_.graphics_pipeline_library;
+    if (pipeline_library_)
+    {
+        libraryFeatures.pNext = featureChain;
+        libraryFeatures.graphicsPipelineLibrary = VK_TRUE;
+        featureChain = &libraryFeatures;
+    }
+
+    multiview_views_ = device_caps_.multiview ? settings_.multiview_views : 0;
+    if (multiview_views_ > 0)
+    {
+        multiviewFeatures.pNext = featureChain;
+        multiviewFeatures.multiview = VK_TRUE;
+        featureChain = &multiviewFeatures;
+    }
+    else if (settings_.multiview_views > 0)
+    {
+        LOG("Multiview is not supported, rendering without the probe");
+    }
+    createInfo.pNext = featureChain;
+
+    enabled_device_extensions_ = GetRequiredDeviceExtensions();
+    for (const char *extension : optional_device_extensions_)
+    {
+        if (device_caps_.HasExtension(extension))
+        {
+            enabled_device_extensions_.push_back(extension);
+        }
+    }
+    if (descriptor_buffer_)
+    {
+        enabled_device_extensions_.push_back(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+    }
+    if (!settings_.export_socket.empty())
+    {
+        for (const char *extension :
+             {VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME, VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME})
+        {
+            if (!device_caps_.HasExtension(extension))
+            {
+                throw ChimException(std::string("Frame export needs ") + extension);
+            }
+            enabled_device_extensions_.push_back(extension);
+        }
+    }
+
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(enabled_device_extensions_.size());
+    createInfo.ppEnabledExtensionNames = enabled_device_extensions_.data();
 
     if (enable_validation_layers)
     {
@@ -937,13 +3694,16 @@ void Chim::CreateLogicalDevice(void)
         throw std::runtime_error("Failed to create logical device!");
     }
 
+    graphics_queue_family_ = indices.graphicsFamily.value();
     vkGetDeviceQueue(device_, indices.graphicsFamily.value(), 0, &graphics_queue_);
     vkGetDeviceQueue(device_, indices.presentFamily.value(), 0, &present_queue_);
 }
 
 void Chim::CreateSwapChain(void)
 {
-    SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(physical_device_);
+    // Formats and present modes of the surface never change, its extent follows the window
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device_, surface_, &swap_chain_support_.capabilities);
+    const SwapChainSupportDetails& swapChainSupport = swap_chain_support_;
 
     VkSurfaceFormatKHR surfaceFormat = ChooseSwapSurfaceFormat(swapChainSupport.formats);
     VkPresentModeKHR presentMode = ChooseSwapPresentMode(swapChainSupport.presentModes);
@@ -966,7 +3726,7 @@ void Chim::CreateSwapChain(void)
     createInfo.imageArrayLayers = 1;
     createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-    QueueFamilyIndices indices = FindQueueFamilies(physical_device_);
+    const QueueFamilyIndices& indices = queue_families_;
     uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
 
     if (indices.graphicsFamily != indices.presentFamily)
@@ -1000,8 +3760,39 @@ void Chim::CreateSwapChain(void)
     swap_chain_extent_ = extent;
 }
 
+/**
+ * @brief Creates the images that stand in for the swap chain in headless mode.
+ * @details There is one image per frame in flight, each owned by the frame that renders into it, so no acquire
+ * semaphore is needed. The images can be copied out, which later readback paths rely on.
+ */
+void Chim::CreateOffscreenTargets(void)
+{
+    swap_chain_image_format_ = VK_FORMAT_B8G8R8A8_SRGB;
+    swap_chain_extent_ = {window_width_, window_height_};
+
+    swap_chain_images_.resize(MAX_FRAMES_IN_FLIGHT);
+    offscreen_image_memory_.resize(MAX_FRAMES_IN_FLIGHT);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        CreateImage(swap_chain_extent_.width, swap_chain_extent_.height, swap_chain_image_format_,
+                    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swap_chain_images_[i], offscreen_image_memory_[i],
+                    !settings_.export_socket.empty());
+    }
+}
+
 void Chim::CleanupSwapChain()
 {
+    vkDestroyFramebuffer(device_, scene_frame_buffer_, nullptr);
+    for (size_t i = 0; i < history_.size(); i++)
+    {
+        vkDestroyFramebuffer(device_, history_frame_buffers_[i], nullptr);
+        DestroyRenderTarget(history_[i]);
+    }
+    DestroyRenderTarget(scene_color_);
+    DestroyRenderTarget(motion_vectors_);
+    DestroyRenderTarget(depth_);
+
     for (auto framebuffer : swap_chain_frame_buffers_)
     {
         vkDestroyFramebuffer(device_, framebuffer, nullptr);
@@ -1012,90 +3803,316 @@ void Chim::CleanupSwapChain()
         vkDestroyImageView(device_, imageView, nullptr);
     }
 
+    if (settings_.headless)
+    {
+        for (size_t i = 0; i < swap_chain_images_.size(); i++)
+        {
+            vkDestroyImage(device_, swap_chain_images_[i], nullptr);
+            profiler_.TrackFree(offscreen_image_memory_[i]);
+            vkFreeMemory(device_, offscreen_image_memory_[i], nullptr);
+        }
+        swap_chain_images_.clear();
+        offscreen_image_memory_.clear();
+        return;
+    }
+
     vkDestroySwapchainKHR(device_, swap_chain_, nullptr);
 }
 
-void Chim::RecreateSwapChain()
+void Chim::RecreateSwapChain()
+{
+    int width, height;
+    SDL_GetWindowSize(window_, &width, &height);
+
+    // Ensures the window area is greater than 1
+    // if (width <= 1 || height <= 1)
+    //{
+    //    SDL_GetWindowSize(window_, &width, &height);
+    //}
+
+    vkDeviceWaitIdle(device_);
+
+    CleanupSwapChain();
+
+    CreateSwapChain();
+    CreateImageViews();
+    CreateSceneTargets();
+    CreateFrameBuffers();
+    UpdateTemporalDescriptorSets();
+
+    frame_buffer_resized_ = false;
+}
+
+void Chim::CreateImageViews(void)
+{
+    swap_chain_image_views_.resize(swap_chain_images_.size());
+
+    for (size_t i = 0; i < swap_chain_images_.size(); i++)
+    {
+        VkImageViewCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        createInfo.image = swap_chain_images_[i];
+        createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        createInfo.format = swap_chain_image_format_;
+        createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+        createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+        createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+        createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+        createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        createInfo.subresourceRange.baseMipLevel = 0;
+        createInfo.subresourceRange.levelCount = 1;
+        createInfo.subresourceRange.baseArrayLayer = 0;
+        createInfo.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(device_, &createInfo, nullptr, &swap_chain_image_views_[i]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create image views!");
+        }
+    }
+}
+
+/**
+ * @brief Creates the scene targets at the internal resolution and the history images at the output resolution.
+ * @details All targets are shared by the frames in flight; the subpass dependencies of the render passes order one
+ * frame's use of them after the previous frame's. Both history images start out in the layout the temporal pass
+ * reads them in, so the first frame can bind them before either has been written.
+ */
+void Chim::CreateSceneTargets(void)
+{
+    render_extent_ = {std::max(1u, static_cast<uint32_t>(swap_chain_extent_.width * settings_.render_scale)),
+                      std::max(1u, static_cast<uint32_t>(swap_chain_extent_.height * settings_.render_scale))};
+
+    CreateRenderTarget(render_extent_, scene_color_format_,
+                       VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT,
+                       scene_color_);
+    CreateRenderTarget(render_extent_, motion_format_, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                       VK_IMAGE_ASPECT_COLOR_BIT, motion_vectors_);
+    CreateRenderTarget(render_extent_, depth_format_, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                       VK_IMAGE_ASPECT_DEPTH_BIT, depth_);
+
+    std::array<VkImageView, 3> attachments = {scene_color_.view, motion_vectors_.view, depth_.view};
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = render_pass_;
+    framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    framebufferInfo.pAttachments = attachments.data();
+    framebufferInfo.width = render_extent_.width;
+    framebufferInfo.height = render_extent_.height;
+    framebufferInfo.layers = 1;
+
+    if (vkCreateFramebuffer(device_, &framebufferInfo, nullptr, &scene_frame_buffer_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create framebuffer!");
+    }
+
+    VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
+    for (size_t i = 0; i < history_.size(); i++)
+    {
+        CreateRenderTarget(swap_chain_extent_, scene_color_format_,
+                           VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT,
+                           history_[i]);
+
+        framebufferInfo.renderPass = temporal_render_pass_;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.pAttachments = &history_[i].view;
+        framebufferInfo.width = swap_chain_extent_.width;
+        framebufferInfo.height = swap_chain_extent_.height;
+        if (vkCreateFramebuffer(device_, &framebufferInfo, nullptr, &history_frame_buffers_[i]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create framebuffer!");
+        }
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = history_[i].image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                             0, nullptr, 0, nullptr, 1, &barrier);
+    }
+    EndSingleTimeCommands(commandBuffer);
+
+    history_valid_ = false;
+    InvalidateSceneCommands();
+    camera_.SetViewport(render_extent_);
+    // The scene pass runs at the internal resolution, the passes after it at the output resolution
+    profiler_.SetRenderArea(ProfilePass::Main, render_extent_);
+    profiler_.SetRenderArea(ProfilePass::Temporal, swap_chain_extent_);
+    profiler_.SetRenderArea(ProfilePass::Overlay, swap_chain_extent_);
+}
+
+/**
+ * @brief Creates an image and a view of all its layers. A layered target is viewed as a 2D array, the view type
+ * multiview framebuffers attach.
+ */
+void Chim::CreateRenderTarget(VkExtent2D extent, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect,
+                              RenderTarget& target, uint32_t layers)
+{
+    CreateImage(extent.width, extent.height, format, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, target.image,
+                target.memory, false, layers);
+
+    VkImageViewCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    createInfo.image = target.image;
+    createInfo.viewType = layers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+    createInfo.format = format;
+    createInfo.subresourceRange.aspectMask = aspect;
+    createInfo.subresourceRange.baseMipLevel = 0;
+    createInfo.subresourceRange.levelCount = 1;
+    createInfo.subresourceRange.baseArrayLayer = 0;
+    createInfo.subresourceRange.layerCount = layers;
+
+    if (vkCreateImageView(device_, &createInfo, nullptr, &target.view) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create image views!");
+    }
+}
+
+void Chim::DestroyRenderTarget(RenderTarget& target)
 {
-    int width, height;
-    SDL_GetWindowSize(window_, &width, &height);
-
-    // Ensures the window area is greater than 1
-    // if (width <= 1 || height <= 1)
-    //{
-    //    SDL_GetWindowSize(window_, &width, &height);
-    //}
+    vkDestroyImageView(device_, target.view, nullptr);
+    vkDestroyImage(device_, target.image, nullptr);
+    profiler_.TrackFree(target.memory);
+    vkFreeMemory(device_, target.memory, nullptr);
+    target = RenderTarget{};
+}
 
-    vkDeviceWaitIdle(device_);
+/**
+ * @brief Creates the pipeline cache, seeded with the one saved by the previous run.
+ * @details The saved data is only handed to the driver when its header names this device and driver, the same check
+ * the device snapshot is reused under; anything else starts an empty cache.
+ */
+void Chim::CreatePipelineCache(void)
+{
+    std::vector<char> initialData;
+    if (!settings_.cache_directory.empty())
+    {
+        std::ifstream file(CachePath("chim_pipeline.cache"), std::ios::binary);
+        initialData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
 
-    CleanupSwapChain();
+    // VkPipelineCacheHeaderVersionOne: header size, header version, vendor ID, device ID, pipeline cache UUID
+    const VkPhysicalDeviceProperties& properties = device_caps_.properties;
+    uint32_t header[4] = {};
+    if (initialData.size() >= sizeof(header) + VK_UUID_SIZE)
+    {
+        memcpy(header, initialData.data(), sizeof(header));
+    }
+    bool matches = header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE && header[2] == properties.vendorID &&
+                   header[3] == properties.deviceID &&
+                   memcmp(initialData.data() + sizeof(header), properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
 
-    CreateSwapChain();
-    CreateImageViews();
-    CreateFrameBuffers();
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    if (matches)
+    {
+        cacheInfo.initialDataSize = initialData.size();
+        cacheInfo.pInitialData = initialData.data();
+    }
 
-    frame_buffer_resized_ = false;
+    if (vkCreatePipelineCache(device_, &cacheInfo, nullptr, &pipeline_cache_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create pipeline cache!");
+    }
 }
 
-void Chim::CreateImageViews(void)
+/**
+ * @brief Writes the pipeline cache next to the device snapshot, through a temporary file so that an interrupted
+ * write never leaves a truncated cache behind.
+ */
+void Chim::SavePipelineCache(void)
 {
-    swap_chain_image_views_.resize(swap_chain_images_.size());
-
-    for (size_t i = 0; i < swap_chain_images_.size(); i++)
+    size_t size = 0;
+    if (settings_.cache_directory.empty() || pipeline_cache_ == VK_NULL_HANDLE ||
+        vkGetPipelineCacheData(device_, pipeline_cache_, &size, nullptr) != VK_SUCCESS)
     {
-        VkImageViewCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        createInfo.image = swap_chain_images_[i];
-        createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        createInfo.format = swap_chain_image_format_;
-        createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-        createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-        createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-        createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-        createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        createInfo.subresourceRange.baseMipLevel = 0;
-        createInfo.subresourceRange.levelCount = 1;
-        createInfo.subresourceRange.baseArrayLayer = 0;
-        createInfo.subresourceRange.layerCount = 1;
+        return;
+    }
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(device_, pipeline_cache_, &size, data.data()) != VK_SUCCESS)
+    {
+        return;
+    }
 
-        if (vkCreateImageView(device_, &createInfo, nullptr, &swap_chain_image_views_[i]) != VK_SUCCESS)
+    const std::string path = CachePath("chim_pipeline.cache");
+    {
+        std::ofstream file(path + ".tmp", std::ios::binary | std::ios::trunc);
+        file.write(data.data(), static_cast<std::streamsize>(size));
+        if (!file.good())
         {
-            throw std::runtime_error("Failed to create image views!");
+            LOG("Failed to save the pipeline cache to " << path);
+            return;
         }
     }
+    std::error_code error;
+    std::filesystem::rename(path + ".tmp", path, error);
+}
+
+std::string Chim::CachePath(const char *name) const
+{
+    return (std::filesystem::path(settings_.cache_directory) / name).string();
 }
 
 void Chim::CreateGraphicsPipeline()
 {
-    auto vertShaderCode = ReadFile(SHADER_DIRECTORY + std::string("/vert.spv"));
-    auto fragShaderCode = ReadFile(SHADER_DIRECTORY + std::string("/frag.spv"));
+    VkPushConstantRange pushConstants{};
+    pushConstants.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstants.size = sizeof(VertexPullConstants);
 
-    VkShaderModule vertShaderModule = CreateShaderModule(vertShaderCode);
-    VkShaderModule fragShaderModule = CreateShaderModule(fragShaderCode);
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptor_set_layout_;
+    pipelineLayoutInfo.pushConstantRangeCount = vertex_pulling_ ? 1 : 0;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstants;
 
-    VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertShaderStageInfo.module = vertShaderModule;
-    vertShaderStageInfo.pName = "main";
+    if (vkCreatePipelineLayout(device_, &pipelineLayoutInfo, nullptr, &pipeline_layout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create pipeline layout!");
+    }
 
-    VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-    fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module = fragShaderModule;
-    fragShaderStageInfo.pName = "main";
+    GraphicsPipelineDesc desc{};
+    desc.vertex_shader = vertex_pulling_ ? "pull_vert.spv" : "vert.spv";
+    desc.fragment_shader = "frag.spv";
+    desc.layout = pipeline_layout_;
+    desc.color_attachments = 2;
+    desc.vertex_input = !vertex_pulling_;
+    desc.descriptor_buffer = descriptor_buffer_;
+    BuildGraphicsPipeline(desc, graphics_pipeline_);
+}
 
-    VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+/**
+ * @brief Builds a graphics pipeline into pipeline.
+ * @details Pipelines go through pipeline_cache_. When VK_EXT_pipeline_creation_feedback is enabled the profiler is
+ * told whether the cache was hit.
+ *
+ * With pipeline libraries the pipeline is linked from four parts, each built once and shared by every pipeline with
+ * the same state, and an optimized link is started in the background (see SwapOptimizedPipelines). Otherwise the
+ * whole pipeline is compiled here. Either way the time the caller was blocked is reported to the profiler, whose
+ * hitch count shows what first use of a pipeline costs.
+ */
+void Chim::BuildGraphicsPipeline(const GraphicsPipelineDesc& desc, VkPipeline& pipeline)
+{
+    auto start = std::chrono::steady_clock::now();
 
     VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
     auto binding_description = Vertex::GetBindingDescription();
     auto attribute_descriptions = Vertex::GetAttributeDescriptions();
 
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attribute_descriptions.size());
-    vertexInputInfo.pVertexBindingDescriptions = &binding_description;
-    vertexInputInfo.pVertexAttributeDescriptions = attribute_descriptions.data();
+    if (desc.vertex_input)
+    {
+        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attribute_descriptions.size());
+        vertexInputInfo.pVertexBindingDescriptions = &binding_description;
+        vertexInputInfo.pVertexAttributeDescriptions = attribute_descriptions.data();
+    }
 
     VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
     inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -1113,7 +4130,7 @@ void Chim::CreateGraphicsPipeline()
     rasterizer.rasterizerDiscardEnable = VK_FALSE;
     rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
     rasterizer.lineWidth = 1.0f;
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizer.cullMode = desc.cull_mode;
     rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
     rasterizer.depthBiasEnable = VK_FALSE;
 
@@ -1122,6 +4139,14 @@ void Chim::CreateGraphicsPipeline()
     multisampling.sampleShadingEnable = VK_FALSE;
     multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = desc.depth_test ? VK_TRUE : VK_FALSE;
+    depthStencil.depthWriteEnable = desc.depth_test ? VK_TRUE : VK_FALSE;
+    depthStencil.depthCompareOp = VK_COMPARE_OP_GREATER;
+    depthStencil.depthBoundsTestEnable = VK_FALSE;
+    depthStencil.stencilTestEnable = VK_FALSE;
+
     VkPipelineColorBlendAttachmentState colorBlendAttachment{};
     colorBlendAttachment.colorWriteMask =
         VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
@@ -1131,8 +4156,10 @@ void Chim::CreateGraphicsPipeline()
     colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
     colorBlending.logicOpEnable = VK_FALSE;
     colorBlending.logicOp = VK_LOGIC_OP_COPY;
-    colorBlending.attachmentCount = 1;
-    colorBlending.pAttachments = &colorBlendAttachment;
+    std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments(desc.color_attachments,
+                                                                           colorBlendAttachment);
+    colorBlending.attachmentCount = static_cast<uint32_t>(colorBlendAttachments.size());
+    colorBlending.pAttachments = colorBlendAttachments.data();
     colorBlending.blendConstants[0] = 0.0f;
     colorBlending.blendConstants[1] = 0.0f;
     colorBlending.blendConstants[2] = 0.0f;
@@ -1144,53 +4171,416 @@ void Chim::CreateGraphicsPipeline()
     dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
     dynamicState.pDynamicStates = dynamicStates.data();
 
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &descriptor_set_layout_;
-
-    if (vkCreatePipelineLayout(device_, &pipelineLayoutInfo, nullptr, &pipeline_layout_) != VK_SUCCESS)
-    {
-        throw std::runtime_error("Failed to create pipeline layout!");
-    }
-
     VkGraphicsPipelineCreateInfo pipelineInfo{};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = shaderStages;
+    pipelineInfo.flags = desc.descriptor_buffer ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
     pipelineInfo.pVertexInputState = &vertexInputInfo;
     pipelineInfo.pInputAssemblyState = &inputAssembly;
     pipelineInfo.pViewportState = &viewportState;
     pipelineInfo.pRasterizationState = &rasterizer;
     pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pDepthStencilState = &depthStencil;
     pipelineInfo.pColorBlendState = &colorBlending;
     pipelineInfo.pDynamicState = &dynamicState;
-    pipelineInfo.layout = pipeline_layout_;
-    pipelineInfo.renderPass = render_pass_;
+    pipelineInfo.layout = desc.layout;
+    pipelineInfo.renderPass = desc.render_pass != VK_NULL_HANDLE ? desc.render_pass : render_pass_;
     pipelineInfo.subpass = 0;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-    if (vkCreateGraphicsPipelines(device_, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphics_pipeline_) !=
-        VK_SUCCESS)
+    if (pipeline_library_)
+    {
+        // Each part only depends on the state it consumes, so the keys name exactly that state. Creation flags must
+        // match between all parts of a pipeline and are part of every key.
+        std::string flags = " " + std::to_string(pipelineInfo.flags);
+        std::ostringstream preRasterization, fragment, output;
+        preRasterization << "pre-rasterization " << desc.vertex_shader << " " << desc.layout << " "
+                         << pipelineInfo.renderPass << " " << desc.cull_mode;
+        fragment << "fragment " << desc.fragment_shader << " " << desc.layout << " " << pipelineInfo.renderPass << " "
+                 << desc.depth_test;
+        output << "output " << pipelineInfo.renderPass << " " << desc.color_attachments;
+        preRasterization << flags;
+        fragment << flags;
+        output << flags;
+
+        std::array<VkPipeline, 4> parts = {
+            PipelinePart((desc.vertex_input ? "vertex input" : "no vertex input") + flags, pipelineInfo,
+                         VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT, "", VK_SHADER_STAGE_VERTEX_BIT),
+            PipelinePart(preRasterization.str(), pipelineInfo,
+                         VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT, desc.vertex_shader,
+                         VK_SHADER_STAGE_VERTEX_BIT),
+            PipelinePart(fragment.str(), pipelineInfo, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+                         desc.fragment_shader, VK_SHADER_STAGE_FRAGMENT_BIT),
+            PipelinePart(output.str(), pipelineInfo, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT,
+                         "", VK_SHADER_STAGE_FRAGMENT_BIT)};
+
+        pipeline = LinkPipelineParts(parts, desc.layout, pipelineInfo.flags, false);
+        VkPipelineLayout layout = desc.layout;
+        VkPipelineCreateFlags linkFlags = pipelineInfo.flags;
+        pending_pipelines_.push_back(
+            {&pipeline, std::async(std::launch::async, [this, parts, layout, linkFlags] {
+                 VkPipeline optimized = VK_NULL_HANDLE;
+                 perf_.MeasureWorker([&] { optimized = LinkPipelineParts(parts, layout, linkFlags, true); });
+                 return optimized;
+             })});
+
+        profiler_.CountPipelineBuild(
+            std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+        return;
+    }
+
+    auto vertShaderCode = ShaderCode(desc.vertex_shader);
+    auto fragShaderCode = ShaderCode(desc.fragment_shader);
+
+    VkShaderModule vertShaderModule = CreateShaderModule(vertShaderCode);
+    VkShaderModule fragShaderModule = CreateShaderModule(fragShaderCode);
+
+    VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    vertShaderStageInfo.module = vertShaderModule;
+    vertShaderStageInfo.pName = "main";
+
+    VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+    fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    fragShaderStageInfo.module = fragShaderModule;
+    fragShaderStageInfo.pName = "main";
+
+    VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = shaderStages;
+
+    VkPipelineCreationFeedbackEXT pipelineFeedback{};
+    std::array<VkPipelineCreationFeedbackEXT, 2> stageFeedback{};
+    VkPipelineCreationFeedbackCreateInfoEXT feedbackInfo{};
+    feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+    feedbackInfo.pPipelineCreationFeedback = &pipelineFeedback;
+    feedbackInfo.pipelineStageCreationFeedbackCount = static_cast<uint32_t>(stageFeedback.size());
+    feedbackInfo.pPipelineStageCreationFeedbacks = stageFeedback.data();
+    bool feedbackEnabled = IsDeviceExtensionEnabled(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+    if (feedbackEnabled)
+    {
+        pipelineInfo.pNext = &feedbackInfo;
+    }
+
+    if (vkCreateGraphicsPipelines(device_, pipeline_cache_, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
     {
         throw std::runtime_error("Failed to create graphics pipeline!");
     }
 
+    if (feedbackEnabled && (pipelineFeedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT))
+    {
+        profiler_.CountPipeline(pipelineFeedback.flags &
+                                VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT);
+    }
+
     vkDestroyShaderModule(device_, fragShaderModule, nullptr);
     vkDestroyShaderModule(device_, vertShaderModule, nullptr);
+
+    profiler_.CountPipelineBuild(
+        std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+/**
+ * @brief Returns the pipeline library part named key, building it from pipelineInfo the first time.
+ * @details pipelineInfo describes the whole pipeline; the driver only reads the state that belongs to part. shader
+ * is the one stage the part compiles, empty for the interface parts that have none.
+ */
+VkPipeline Chim::PipelinePart(const std::string& key, VkGraphicsPipelineCreateInfo pipelineInfo,
+                              VkGraphicsPipelineLibraryFlagsEXT part, const std::string& shader,
+                              VkShaderStageFlagBits stage)
+{
+    auto found = pipeline_parts_.find(key);
+    if (found != pipeline_parts_.end())
+    {
+        return found->second;
+    }
+
+    VkShaderModule shaderModule = VK_NULL_HANDLE;
+    VkPipelineShaderStageCreateInfo shaderStageInfo{};
+    if (!shader.empty())
+    {
+        shaderModule = CreateShaderModule(ShaderCode(shader));
+        shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStageInfo.stage = stage;
+        shaderStageInfo.module = shaderModule;
+        shaderStageInfo.pName = "main";
+        pipelineInfo.stageCount = 1;
+        pipelineInfo.pStages = &shaderStageInfo;
+    }
+
+    VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+    libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+    libraryInfo.flags = part;
+    pipelineInfo.pNext = &libraryInfo;
+    pipelineInfo.flags |=
+        VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+
+    VkPipeline library;
+    if (vkCreateGraphicsPipelines(device_, pipeline_cache_, 1, &pipelineInfo, nullptr, &library) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create graphics pipeline library!");
+    }
+    if (shaderModule != VK_NULL_HANDLE)
+    {
+        vkDestroyShaderModule(device_, shaderModule, nullptr);
+    }
+
+    pipeline_parts_[key] = library;
+    return library;
+}
+
+/**
+ * @brief Links four pipeline library parts into a complete pipeline.
+ * @details Without optimize the link is fast but the pipeline may run slower. Called from worker threads for the
+ * optimized links; it only touches the device, the internally synchronized pipeline cache and the profiler's atomic
+ * counters.
+ */
+VkPipeline Chim::LinkPipelineParts(const std::array<VkPipeline, 4>& parts, VkPipelineLayout layout,
+                                   VkPipelineCreateFlags flags, bool optimize)
+{
+    VkPipelineLibraryCreateInfoKHR libraryInfo{};
+    libraryInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+    libraryInfo.libraryCount = static_cast<uint32_t>(parts.size());
+    libraryInfo.pLibraries = parts.data();
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = &libraryInfo;
+    pipelineInfo.flags = flags | (optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0);
+    pipelineInfo.layout = layout;
+
+    VkPipelineCreationFeedbackEXT pipelineFeedback{};
+    VkPipelineCreationFeedbackCreateInfoEXT feedbackInfo{};
+    feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+    feedbackInfo.pPipelineCreationFeedback = &pipelineFeedback;
+    bool feedbackEnabled = IsDeviceExtensionEnabled(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+    if (feedbackEnabled)
+    {
+        libraryInfo.pNext = &feedbackInfo;
+    }
+
+    VkPipeline pipeline;
+    if (vkCreateGraphicsPipelines(device_, pipeline_cache_, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to link graphics pipeline!");
+    }
+
+    if (feedbackEnabled && (pipelineFeedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT))
+    {
+        profiler_.CountPipeline(pipelineFeedback.flags &
+                                VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT);
+    }
+
+    return pipeline;
+}
+
+/**
+ * @brief Replaces fast linked pipelines whose optimized link has finished, without waiting for the others.
+ * @details Called after the frame's fence, before anything is recorded. A replaced pipeline may still be used by the
+ * other frames in flight, so it is only destroyed MAX_FRAMES_IN_FLIGHT frames later. Cached scene commands refer to
+ * the old handle and are recorded again.
+ */
+void Chim::SwapOptimizedPipelines(void)
+{
+    std::erase_if(retired_pipelines_, [this](const std::pair<VkPipeline, uint64_t>& retired) {
+        if (retired.second > frame_count_)
+        {
+            return false;
+        }
+        vkDestroyPipeline(device_, retired.first, nullptr);
+        return true;
+    });
+
+    for (auto it = pending_pipelines_.begin(); it != pending_pipelines_.end();)
+    {
+        if (it->optimized.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            ++it;
+            continue;
+        }
+
+        retired_pipelines_.push_back({*it->slot, frame_count_ + MAX_FRAMES_IN_FLIGHT});
+        *it->slot = it->optimized.get();
+        profiler_.CountPipelineOptimized();
+        InvalidateSceneCommands();
+        it = pending_pipelines_.erase(it);
+
+        // Keep the optimized pipelines on disk without waiting for shutdown
+        if (pending_pipelines_.empty())
+        {
+            QueueBackgroundJob([this] { SavePipelineCache(); });
+        }
+    }
+}
+
+void Chim::QueueBackgroundJob(std::function<void()> job)
+{
+    background_jobs_.push_back({frame_count_, std::move(job)});
+}
+
+/**
+ * @brief Waits until the GPU has finished the frame in flight, using the wait to run background jobs.
+ * @details While jobs are queued the fence is polled between them, and the wait only blocks once the queue is empty.
+ * The CPU time spent idle and the time spent on jobs are reported to the profiler: a frame that waits long is
+ * GPU-bound, one that never waits is CPU-bound.
+ */
+void Chim::WaitForFrame(uint32_t frame)
+{
+    auto start = std::chrono::steady_clock::now();
+    float jobMs = 0.0f;
+    VkFence fence = in_flight_fences_[frame];
+    while (!background_jobs_.empty())
+    {
+        bool gpuBusy = vkGetFenceStatus(device_, fence) == VK_NOT_READY;
+        if (!gpuBusy && background_jobs_.front().queued_frame + kBackgroundJobMaxDelay > frame_count_)
+        {
+            break;
+        }
+
+        BackgroundJob job = std::move(background_jobs_.front());
+        background_jobs_.pop_front();
+        perf_.Mark(CpuPhase::Wait);
+        auto jobStart = std::chrono::steady_clock::now();
+        job.run();
+        perf_.Mark(CpuPhase::Jobs);
+        jobMs += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - jobStart).count();
+    }
+    vkWaitForFences(device_, 1, &fence, VK_TRUE, UINT64_MAX);
+    perf_.Mark(CpuPhase::Wait);
+
+    float waitMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    profiler_.CountFenceWait(std::max(waitMs - jobMs, 0.0f), jobMs);
 }
 
+/**
+ * @brief Creates the scene render pass: colour, motion vectors and depth, all at the internal resolution.
+ * @details Colour and motion vectors end up ready to be sampled by the temporal pass.
+ *
+ * With a probe the same pass is also created as a multiview pass without motion vectors: its view mask has a bit
+ * per view, so one subpass is rasterized once per view into the matching layer of every attachment.
+ */
 void Chim::CreateRenderPass(void)
 {
     VkAttachmentDescription colorAttachment{};
-    colorAttachment.format = swap_chain_image_format_;
+    colorAttachment.format = scene_color_format_;
     colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
     colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkAttachmentDescription motionAttachment = colorAttachment;
+    motionAttachment.format = motion_format_;
+
+    VkAttachmentDescription depthAttachment{};
+    depthAttachment.format = depth_format_;
+    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    std::array<VkAttachmentReference, 2> colorAttachmentRefs{};
+    colorAttachmentRefs[0].attachment = 0;
+    colorAttachmentRefs[0].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachmentRefs[1].attachment = 1;
+    colorAttachmentRefs[1].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference depthAttachmentRef{};
+    depthAttachmentRef.attachment = 2;
+    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = static_cast<uint32_t>(colorAttachmentRefs.size());
+    subpass.pColorAttachments = colorAttachmentRefs.data();
+    subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+    // The targets are shared between frames in flight: wait until the previous frame has written depth and the
+    // temporal pass has read the colour and motion targets, and make this frame's writes visible to the next pass
+    std::array<VkSubpassDependency, 2> dependencies{};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                   VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dstStageMask =
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    std::array<VkAttachmentDescription, 3> attachments = {colorAttachment, motionAttachment, depthAttachment};
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    renderPassInfo.pAttachments = attachments.data();
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
+
+    if (vkCreateRenderPass(device_, &renderPassInfo, nullptr, &render_pass_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create render pass!");
+    }
+
+    if (multiview_views_ == 0)
+    {
+        return;
+    }
+
+    // The eyes of a stereo pair see nearly the same thing, which the correlation mask lets the driver exploit; cube
+    // faces do not overlap
+    uint32_t viewMask = (1u << multiview_views_) - 1;
+    VkRenderPassMultiviewCreateInfo multiviewInfo{};
+    multiviewInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+    multiviewInfo.subpassCount = 1;
+    multiviewInfo.pViewMasks = &viewMask;
+    multiviewInfo.correlationMaskCount = multiview_views_ == 2 ? 1 : 0;
+    multiviewInfo.pCorrelationMasks = &viewMask;
+
+    depthAttachmentRef.attachment = 1;
+    subpass.colorAttachmentCount = 1;
+    std::array<VkAttachmentDescription, 2> probeAttachments = {colorAttachment, depthAttachment};
+    renderPassInfo.pNext = &multiviewInfo;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(probeAttachments.size());
+    renderPassInfo.pAttachments = probeAttachments.data();
+
+    if (vkCreateRenderPass(device_, &renderPassInfo, nullptr, &probe_render_pass_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create probe render pass!");
+    }
+}
+
+/**
+ * @brief Creates the single colour attachment passes that follow the scene pass.
+ * @details The temporal pass overwrites every pixel of a history image, so its previous contents are never loaded.
+ * The present pass does the same to the swap chain image before drawing the overlay.
+ */
+void Chim::CreateTemporalRenderPasses(void)
+{
+    VkAttachmentDescription colorAttachment{};
+    colorAttachment.format = scene_color_format_;
+    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
     VkAttachmentReference colorAttachmentRef{};
     colorAttachmentRef.attachment = 0;
@@ -1201,14 +4591,46 @@ void Chim::CreateRenderPass(void)
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
 
+    // Writing a history image has to wait for the previous present pass and stream conversion to finish reading it
+    std::array<VkSubpassDependency, 2> dependencies{};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                   VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    dependencies[0].srcAccessMask = 0;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
     VkRenderPassCreateInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
     renderPassInfo.attachmentCount = 1;
     renderPassInfo.pAttachments = &colorAttachment;
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
 
-    if (vkCreateRenderPass(device_, &renderPassInfo, nullptr, &render_pass_) != VK_SUCCESS)
+    if (vkCreateRenderPass(device_, &renderPassInfo, nullptr, &temporal_render_pass_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create render pass!");
+    }
+
+    // The present pass writes the swap chain (or offscreen) image after it has been acquired
+    colorAttachment.format = swap_chain_image_format_;
+    colorAttachment.finalLayout =
+        settings_.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    renderPassInfo.dependencyCount = 1;
+
+    if (vkCreateRenderPass(device_, &renderPassInfo, nullptr, &present_render_pass_) != VK_SUCCESS)
     {
         throw std::runtime_error("Failed to create render pass!");
     }
@@ -1225,6 +4647,7 @@ void chim::Chim::CreateDescriptorSetLayout(void)
 
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.flags = descriptor_buffer_ ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
     layoutInfo.bindingCount = 1;
     layoutInfo.pBindings = &uboLayoutBinding;
 
@@ -1268,4 +4691,34 @@ std::vector<char> Chim::ReadFile(const std::string& filename)
     file.close();
 
     return buffer;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Reads every compiled shader into shader_code_ so that building pipelines does not wait on the disk.
+ * @details Runs on a worker during Init, before anything reads shader_code_. A missing directory is left for
+ * ShaderCode to report with the name of the file it needed.
+ */
+void Chim::PreloadShaders(void)
+{
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(SHADER_DIRECTORY, error))
+    {
+        if (entry.path().extension() == ".spv")
+        {
+            shader_code_[entry.path().filename().string()] = ReadFile(entry.path().string());
+        }
+    }
+}
+
+/**
+ * @brief The SPIR-V of a file inside SHADER_DIRECTORY, preloaded if it was there during Init.
+ */
+std::vector<char> Chim::ShaderCode(const std::string& name) const
+{
+    auto found = shader_code_.find(name);
+    if (found != shader_code_.end())
+    {
+        return found->second;
+    }
+    return ReadFile(SHADER_DIRECTORY + std::string("/") + name);
+}
@@ -8,17 +8,39 @@
 
 #define SDL_MAIN_HANDLED
 #define GLM_FORCE_RADIANS
+#include "camera.hpp"
+#include "capture.hpp"
+#include "device_caps.hpp"
+#include "foliage.hpp"
+#include "frame_export.hpp"
+#include "frame_stream.hpp"
+#include "geometry.hpp"
+#include "job_server.hpp"
+#include "occlusion.hpp"
+#include "overlay.hpp"
 #include "path_config.h"
+#include "perf_counters.hpp"
+#include "profiler.hpp"
+#include "pvs.hpp"
+#include "render_types.hpp"
+#include "scene.hpp"
+#include "settings.hpp"
 #include <SDL.h>
 #include <SDL_vulkan.h>
 #include <algorithm>
 #include <array>
 #include <chrono>
 #include <cstdint>
+#include <cstring>
+#include <deque>
 #include <exception>
+#include <filesystem>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/vec4.hpp>
 #include <iostream>
@@ -26,6 +48,8 @@
 #include <map>
 #include <optional>
 #include <set>
+#include <thread>
+#include <utility>
 #include <vector>
 #include <vulkan/vulkan.hpp>
 // #include <SDL_image.h> //TODO: Fix this import
@@ -54,50 +78,11 @@ class ChimException : public std::exception
     virtual ~ChimException() throw(){};
 };
 
-struct Vertex
-{
-    glm::vec2 pos;
-    glm::vec3 color;
-
-    static VkVertexInputBindingDescription GetBindingDescription()
-    {
-        VkVertexInputBindingDescription binding_description{};
-        binding_description.binding = 0;
-        binding_description.stride = sizeof(Vertex);
-        binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-        return binding_description;
-    }
-
-    static std::array<VkVertexInputAttributeDescription, 2> GetAttributeDescriptions()
-    {
-        std::array<VkVertexInputAttributeDescription, 2> attribute_descriptions{};
-        attribute_descriptions[0].binding = 0;
-        attribute_descriptions[0].location = 0;
-        attribute_descriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
-        attribute_descriptions[0].offset = offsetof(Vertex, pos);
-
-        attribute_descriptions[1].binding = 0;
-        attribute_descriptions[1].location = 1;
-        attribute_descriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attribute_descriptions[1].offset = offsetof(Vertex, color);
-
-        return attribute_descriptions;
-    }
-};
-
-struct UniformBufferObject
-{
-    glm::mat4 model;
-    glm::mat4 view;
-    glm::mat4 proj;
-};
-
 const std::vector<Vertex> vertices = {
-    {{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}},
-    { {0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}},
-    {  {0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
-    { {-0.5f, 0.5f}, {1.0f, 1.0f, 1.0f}}
+    {{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}},
+    { {0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}},
+    {  {0.5f, 0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+    { {-0.5f, 0.5f, 0.0f}, {1.0f, 1.0f, 1.0f}}
 };
 
 const std::vector<uint16_t> indices = {
@@ -119,52 +104,171 @@ struct SwapChainSupportDetails
     std::vector<VkPresentModeKHR> presentModes;
 };
 
+/**
+ * @brief A physical device considered by Chim::PickPhysicalDevice, with what was learned about it on the way.
+ */
+struct DeviceCandidate
+{
+    VkPhysicalDevice device;
+    DeviceCapabilities caps;
+    QueueFamilyIndices queues;
+    SwapChainSupportDetails swap_chain; // Only queried with a surface
+};
+
+/**
+ * @brief Fixed-function state that differs between the pipelines built by Chim::BuildGraphicsPipeline.
+ */
+struct GraphicsPipelineDesc
+{
+    std::string vertex_shader;   // File name inside SHADER_DIRECTORY
+    std::string fragment_shader; // File name inside SHADER_DIRECTORY
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkRenderPass render_pass = VK_NULL_HANDLE; // Defaults to the scene render pass
+    uint32_t color_attachments = 1;
+    bool vertex_input = true; // False for full screen passes, whose vertex shader makes up its own triangle
+    VkCullModeFlags cull_mode = VK_CULL_MODE_BACK_BIT;
+    bool depth_test = true; // Reverse-Z: test and write with VK_COMPARE_OP_GREATER
+    bool descriptor_buffer = false; // Layout's sets are bound from descriptor buffers
+};
+
+/**
+ * @brief An image with its own memory and a view of the whole image.
+ */
+struct RenderTarget
+{
+    VkImage image = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+};
+
 /**
  * @class Chim
  * @brief Renders the main window.
+ * @details A frame is rendered in three passes. The scene pass draws the geometry into colour, motion vector and
+ * depth targets at the internal resolution (render_extent_). The temporal pass blends that colour with the
+ * reprojected history at the output resolution, which anti-aliases and upscales it. The present pass copies the
+ * result into the swap chain image and draws the overlay on top.
+ *
+ * In headless mode there is no window, surface or swap chain; frames are rendered into offscreen images that take
+ * the place of the swap chain images.
  */
 class Chim
 {
 
   public:
     Chim();
+    explicit Chim(const ChimSettings& settings);
     ~Chim();
 
     void Init(void);
     void Run(void);
     void Cleanup(void);
 
+    ReplayStats Replay(void);
+    bool UsesVertexPulling(void) const { return vertex_pulling_; }
+    const VkPhysicalDeviceProperties& DeviceProperties(void) const { return device_caps_.properties; }
+
   private:
-    void CreateInstance(void); // Create Vulkan instance
+    void CreateInstance(const std::vector<const char *>& extensions); // Create Vulkan instance
     void SetupDebugMessenger(void);
     void CreateSurface(void);
     void PickPhysicalDevice(void);
     void CreateLogicalDevice(void);
 
     void CreateSwapChain(void);
+    void CreateOffscreenTargets(void);
     void CleanupSwapChain(void);
     void RecreateSwapChain(void);
 
     void CreateImageViews(void);
+    void CreateSceneTargets(void);
+    void CreateRenderTarget(VkExtent2D extent, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect,
+                            RenderTarget& target, uint32_t layers = 1);
+    void DestroyRenderTarget(RenderTarget& target);
     void CreateRenderPass(void);
+    void CreateTemporalRenderPasses(void);
     void CreateDescriptorSetLayout(void);
+    void CreatePipelineCache(void);
     void CreateGraphicsPipeline(void);
+    void BuildGraphicsPipeline(const GraphicsPipelineDesc& desc, VkPipeline& pipeline);
+    VkPipeline PipelinePart(const std::string& key, VkGraphicsPipelineCreateInfo pipelineInfo,
+                            VkGraphicsPipelineLibraryFlagsEXT part, const std::string& shader,
+                            VkShaderStageFlagBits stage);
+    VkPipeline LinkPipelineParts(const std::array<VkPipeline, 4>& parts, VkPipelineLayout layout,
+                                 VkPipelineCreateFlags flags, bool optimize);
+    void SwapOptimizedPipelines(void);
+    void QueueBackgroundJob(std::function<void()> job);
+    void WaitForFrame(uint32_t frame);
+    void CreateTemporalResources(void);
+    void UpdateTemporalDescriptorSets(void);
+    void CreateOverlayResources(void);
     void CreateFrameBuffers(void);
     void CreateCommandPool(void);
-    void CreateVertexBuffer(void);
-    void CreateIndexBuffer(void);
+    void CreateGeometryBuffers(void);
+    MeshAllocation UploadMesh(const std::vector<Vertex>& vertices, const std::vector<uint16_t>& indices);
+    void FreeMesh(const MeshAllocation& mesh);
     void CreateUniformBuffers(void);
+    void CreateDescriptorPool(void);
+    void CreateDescriptorSets(void);
+    void CreateDescriptorBuffer(void);
     void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer,
                       VkDeviceMemory& bufferMemory);
     void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+    VkCommandBuffer BeginSingleTimeCommands(void);
+    void EndSingleTimeCommands(VkCommandBuffer commandBuffer);
+    void BeginUploadBatch(void);
+    void EndUploadBatch(void);
+    void ReleaseStagingBuffer(VkBuffer buffer, VkDeviceMemory memory);
+    void CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage,
+                     VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory,
+                     bool exportable = false, uint32_t layers = 1);
     uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
     void CreateCommandBuffers(void);
     void CreateSyncObjects(void);
+    void CreateFrameExport(void);
+    void CreateProbeResources(void);
+    void CreateStreamResources(void);
+    void DestroyStreamResources(void);
+    void RecordStreamConversion(VkCommandBuffer commandBuffer);
+    void CollectStreamFrame(uint32_t frame);
+    void FlushStream(void);
+    void DestroyProbeResources(void);
+    void RequestProbe(void);
+    void WriteProbeViews(void);
+    void CreateFoliageResources(void);
+    void DestroyFoliageResources(void);
+    void RecordFoliageScatter(VkCommandBuffer commandBuffer);
+    void RecordFoliageDraws(VkCommandBuffer commandBuffer);
+
+    // Render-job server
+    void Serve(void);
+    void RunJob(const RenderJob& job);
+    const MeshAllocation& ServedScene(const std::string& path);
+    void FreeServedScenes(void);
+    void ResizeOffscreenTargets(VkExtent2D extent);
+    void CreateReadbackBuffers(void);
+    void DestroyReadbackBuffers(void);
+    void CollectReadback(uint32_t frame);
+    void FlushReadbacks(void);
+    void InitProfiler(void);
 
     void UpdateUniformBuffer(uint32_t currentImage);
+    void UpdateProbeUniformBuffer(uint32_t currentImage, const UniformBufferObject& ubo);
     void RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    void RecordSceneDraws(VkCommandBuffer commandBuffer);
+    void RecordProbePass(VkCommandBuffer commandBuffer);
+    VkCommandBuffer SceneCommands(void);
+    void InvalidateSceneCommands(void) { scene_generation_++; }
+    void CullDraws(void);
+    void CullInvisibleDraws(std::vector<uint8_t>& visible);
+    void PrepareOcclusion(void);
+    void CullOccludedDraws(std::vector<uint8_t>& visible);
 
     void DrawFrame(void);
+    void HandleEvent(const SDL_Event& event);
+    void HandleCameraInput(const SDL_Event& event);
+    void RequestRedraw(void) { redraw_frames_ = temporal_enabled_ ? kTemporalSettleFrames : 1; }
+    bool NeedsRedraw(void) const;
 
     void PopulateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& create_info);
     VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
@@ -178,10 +282,14 @@ class Chim
                                                         VkDebugUtilsMessageTypeFlagsEXT messageType,
                                                         const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
                                                         void *pUserData);
-    int RateDeviceSuitability(VkPhysicalDevice device);
-    bool IsDeviceSuitable(VkPhysicalDevice device);
-    bool CheckDeviceExtensionSupport(VkPhysicalDevice device);
-    QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device);
+    int RateDeviceSuitability(DeviceCandidate& candidate);
+    bool IsDeviceSuitable(DeviceCandidate& candidate);
+    bool CheckDeviceExtensionSupport(const DeviceCapabilities& caps);
+    std::vector<const char *> GetRequiredDeviceExtensions(void) const;
+    bool IsDeviceExtensionEnabled(const char *extension) const;
+    QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device, const DeviceCapabilities& caps);
+    std::string CachePath(const char *name) const;
+    void SavePipelineCache(void);
     // Swap chain
     SwapChainSupportDetails QuerySwapChainSupport(VkPhysicalDevice device);
     VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
@@ -191,59 +299,315 @@ class Chim
     VkShaderModule CreateShaderModule(const std::vector<char>& code);
 
     static std::vector<char> ReadFile(const std::string& filename);
+    void PreloadShaders(void);
+    std::vector<char> ShaderCode(const std::string& name) const;
 
   private:
-    const uint32_t window_width_ = 1280;
-    const uint32_t window_height_ = 720;
+    ChimSettings settings_;
+    uint32_t window_width_ = 1280;
+    uint32_t window_height_ = 720;
     bool keep_window_open_ = true;
     const int MAX_FRAMES_IN_FLIGHT = 2;
     uint32_t current_frame_ = 0;
+    uint64_t frame_count_ = 0;
     // SDL
     SDL_Window *window_ = nullptr;
     SDL_Event ev_;
     bool window_minimized_ = false;
+    // On-demand rendering: frames still to draw before the loop may block again. With TAA a still image keeps
+    // converging for a while, so an invalidation is worth several frames.
+    static constexpr uint32_t kTemporalSettleFrames = 32;
+    static constexpr int kIdleWaitMs = 250; // Upper bound on a blocking wait, so usage sampling keeps running
+    uint32_t redraw_frames_ = 1;
     // SDL_Surface* window_icon_ = nullptr; // TBA
 
     // Vulkan
     VkInstance instance_;
+    uint32_t instance_api_version_ = VK_API_VERSION_1_0; // Highest version the loader supports, capped at 1.3
     VkDebugUtilsMessengerEXT debug_messenger_;
     VkPhysicalDevice physical_device_ = VK_NULL_HANDLE;
+    DeviceCapabilities device_caps_; // Of physical_device_, consulted instead of querying the driver again
+    QueueFamilyIndices queue_families_;
     VkDevice device_;
     VkQueue graphics_queue_;
+    uint32_t graphics_queue_family_ = 0;
     VkSurfaceKHR surface_;
     VkQueue present_queue_;
-    // Swap chain
+    // Swap chain. The surface's formats and present modes are queried once; its capabilities, which follow the
+    // window size, whenever the swap chain is created.
+    SwapChainSupportDetails swap_chain_support_;
     VkSwapchainKHR swap_chain_;
     std::vector<VkImage> swap_chain_images_;
     VkFormat swap_chain_image_format_;
     VkExtent2D swap_chain_extent_;
     std::vector<VkImageView> swap_chain_image_views_;
     std::vector<VkFramebuffer> swap_chain_frame_buffers_;
+    std::vector<VkDeviceMemory> offscreen_image_memory_; // Headless only, backs swap_chain_images_
+
+    // Scene targets, at the internal resolution
+    VkExtent2D render_extent_;
+    const VkFormat scene_color_format_ = VK_FORMAT_R16G16B16A16_SFLOAT;
+    const VkFormat motion_format_ = VK_FORMAT_R16G16_SFLOAT;
+    const VkFormat depth_format_ = VK_FORMAT_D32_SFLOAT;
+    RenderTarget scene_color_;
+    RenderTarget motion_vectors_;
+    RenderTarget depth_;
+    VkFramebuffer scene_frame_buffer_;
+
+    // Temporal anti-aliasing & upscaling, at the output resolution
+    bool temporal_enabled_ = true;
+    const float temporal_blend_ = 0.1f; // Weight of the newest frame
+    std::array<RenderTarget, 2> history_;
+    std::array<VkFramebuffer, 2> history_frame_buffers_;
+    uint32_t history_index_ = 0; // History image written by the next frame, the other one is read
+    bool history_valid_ = false;
+    glm::mat4 prev_model_{1.0f};
+    glm::mat4 prev_view_proj_{1.0f};
+    VkRenderPass temporal_render_pass_;
+    VkRenderPass present_render_pass_;
+    VkSampler linear_sampler_;
+    VkDescriptorSetLayout temporal_set_layout_;
+    VkDescriptorSetLayout present_set_layout_;
+    VkPipelineLayout temporal_pipeline_layout_;
+    VkPipelineLayout present_pipeline_layout_;
+    VkPipeline temporal_pipeline_;
+    VkPipeline present_pipeline_;
+    std::array<VkDescriptorSet, 2> temporal_sets_; // Indexed by history_index_
+    std::array<VkDescriptorSet, 2> present_sets_;
 
     VkRenderPass render_pass_;
     VkDescriptorSetLayout descriptor_set_layout_;
+    VkDescriptorPool descriptor_pool_;
+    std::vector<VkDescriptorSet> descriptor_sets_;
     VkPipeline graphics_pipeline_;
     VkPipelineLayout pipeline_layout_;
+    VkPipelineCache pipeline_cache_ = VK_NULL_HANDLE;
+
+    // Graphics pipeline library: pipelines are linked from cached parts (vertex input, pre-rasterization, fragment
+    // shader, fragment output) without link time optimization. The optimized link runs on a worker thread and
+    // replaces the fast one in *slot once done; the fast one is destroyed when no frame in flight can use it.
+    struct PendingPipeline
+    {
+        VkPipeline *slot;
+        std::future<VkPipeline> optimized;
+    };
+    bool pipeline_library_ = false;
+    std::map<std::string, VkPipeline> pipeline_parts_;
+    std::map<std::string, std::vector<char>> shader_code_; // SPIR-V by file name, filled once during Init
+    std::vector<PendingPipeline> pending_pipelines_;
+    std::vector<std::pair<VkPipeline, uint64_t>> retired_pipelines_; // Destroyed once frame_count_ reaches second
+
+    // Main-thread work that can wait for a frame whose GPU work is still running, see WaitForFrame. A job that has not
+    // found such a moment for kBackgroundJobMaxDelay frames runs anyway.
+    struct BackgroundJob
+    {
+        uint64_t queued_frame;
+        std::function<void()> run;
+    };
+    static constexpr uint64_t kBackgroundJobMaxDelay = 120;
+    std::deque<BackgroundJob> background_jobs_;
 
     VkCommandPool command_pool_;
+    // While set, one-time commands are recorded into this batch and submitted together by EndUploadBatch
+    VkCommandBuffer upload_batch_ = VK_NULL_HANDLE;
+    std::vector<std::pair<VkBuffer, VkDeviceMemory>> upload_staging_; // Freed once the batch has run
 
     std::vector<VkCommandBuffer> command_buffers_;
+    // The scene pass only changes with the draw list or the targets, so its commands are recorded once per frame in
+    // flight into secondary command buffers and re-executed until InvalidateSceneCommands
+    bool cache_scene_commands_ = false;
+    uint64_t scene_generation_ = 1;
+    std::vector<VkCommandBuffer> scene_command_buffers_;
+    std::vector<uint64_t> scene_command_generations_; // scene_generation_ each buffer was recorded at
+    uint32_t scene_draw_count_ = 0;
+    uint64_t scene_triangle_count_ = 0;
     std::vector<VkSemaphore> image_available_semaphores_;
     std::vector<VkSemaphore> render_finished_semaphores_;
     std::vector<VkFence> in_flight_fences_;
     bool frame_buffer_resized_ = false;
 
+    // Camera, moved with WASD/QE while the right mouse button looks around
+    Camera camera_;
+    glm::vec3 camera_input_{0.0f, 0.0f, 0.0f}; // Held movement keys: x right, y forward, z up
+    const float camera_speed_ = 2.0f;          // Units per second
+    const float camera_sensitivity_ = 0.003f;  // Radians per pixel of mouse motion
+
+    // Scene
+    std::vector<Vertex> scene_vertices_ = vertices;
+    std::vector<uint16_t> scene_indices_ = indices;
+    std::vector<DrawCommand> scene_draws_; // Relative to scene_vertices_ and scene_indices_
+    std::vector<DrawCommand> draw_list_;
+    MeshAllocation scene_mesh_;
+
+    // Occlusion culling. The largest draws of the scene mesh are the occluders; every draw is tested by its bounds
+    // before the scene pass is recorded. Draws of other meshes have no CPU geometry and are always drawn.
+    static constexpr uint32_t kMaxOccluders = 8;
+    static constexpr size_t kMaxOccluderTriangles = 4096;
+    OcclusionCuller occlusion_;
+    std::vector<DrawCommand> occlusion_draws_; // The draw list the bounds and occluders below were built for
+    std::vector<std::optional<BoundingBox>> draw_bounds_; // Object space
+    std::vector<glm::vec3> occluder_triangles_;
+    std::vector<uint8_t> draw_visible_; // Per draw of draw_list_, empty when not culling
+    glm::mat4 clip_from_object_{1.0f};  // Unjittered, from the last UpdateUniformBuffer
+
+    // Potentially visible sets baked into the replayed capture by chim_pvs. The cell the camera is in rules out the
+    // draws it cannot see before occlusion culling runs. Draws the bake did not know are always drawn.
+    std::optional<PvsGrid> pvs_;
+    std::vector<DrawCommand> pvs_draws_;    // The draw list pvs_objects_ was built for
+    std::vector<int64_t> pvs_objects_;      // Object of every draw in pvs_, -1 when it has none
+    glm::vec3 camera_object_position_{0.0f}; // From the last UpdateUniformBuffer
+
+    // Foliage: a compute pass places the grass around the camera every frame from the density map, culls it and
+    // picks its level of detail, and writes the instances and the instance counts of one indirect draw per level.
+    // Nothing about the blades is stored or touched on the CPU, whose cost per frame is a dispatch and two draws.
+    static constexpr float kFoliageFieldSize = 128.0f; // Side of the square the density map covers, around the origin
+    static constexpr uint32_t kFoliageMapResolution = 256;
+    static constexpr uint32_t kMaxFoliageInstances = 1u << 22;
+    FoliageScatter foliage_;
+    FoliageDensityMap foliage_density_;
+    RenderTarget foliage_density_map_;
+    VkDescriptorSetLayout foliage_set_layout_ = VK_NULL_HANDLE;
+    VkPipelineLayout foliage_scatter_layout_ = VK_NULL_HANDLE;
+    VkPipelineLayout foliage_draw_layout_ = VK_NULL_HANDLE;
+    VkPipeline foliage_scatter_pipeline_ = VK_NULL_HANDLE;
+    VkPipeline foliage_pipeline_ = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> foliage_sets_; // Per frame in flight, for its uniform buffer
+    VkBuffer foliage_instance_buffer_ = VK_NULL_HANDLE;
+    VkDeviceMemory foliage_instance_memory_ = VK_NULL_HANDLE;
+    VkBuffer foliage_draw_buffer_ = VK_NULL_HANDLE; // One VkDrawIndirectCommand per level of detail
+    VkDeviceMemory foliage_draw_memory_ = VK_NULL_HANDLE;
+    glm::mat4 clip_from_world_{1.0f};      // Unjittered, from the last UpdateUniformBuffer
+    glm::vec3 camera_world_position_{0.0f}; // From the last UpdateUniformBuffer
+
+    // All static geometry shares one vertex and one index buffer. Meshes are ranges inside them, drawn with
+    // vertexOffset/firstIndex, so the scene pass binds each buffer once however many meshes it draws.
+    static constexpr uint32_t kGeometryVertexCapacity = 1u << 20;
+    static constexpr uint32_t kGeometryIndexCapacity = 1u << 22;
     VkBuffer vertex_buffer_;
     VkDeviceMemory vertex_buffer_memory_;
     VkBuffer index_buffer_;
     VkDeviceMemory index_buffer_memory_;
+    RangeAllocator vertex_ranges_;
+    RangeAllocator index_ranges_;
+    // Vertex pulling: the scene pipeline has no vertex input and reads vertex_buffer_ through its device address
+    bool vertex_pulling_ = false;
+    VkDeviceAddress vertex_buffer_address_ = 0;
 
     std::vector<VkBuffer> uniform_buffers_;
     std::vector<VkDeviceMemory> uniform_buffers_memory_;
     std::vector<void *> uniform_buffers_mapped_;
 
+    // Descriptor buffer backend: instead of pool allocated sets, the scene set of each frame in flight is written once
+    // into a descriptor buffer, and binding a set only sets an offset into that buffer
+    bool descriptor_buffer_ = false;
+    VkBuffer scene_descriptor_buffer_ = VK_NULL_HANDLE;
+    VkDeviceMemory scene_descriptor_memory_ = VK_NULL_HANDLE;
+    VkDeviceAddress scene_descriptor_address_ = 0;
+    std::vector<VkDeviceSize> scene_descriptor_offsets_; // Scene set of each frame in flight, from the buffer start
+    PFN_vkGetDescriptorSetLayoutSizeEXT get_descriptor_set_layout_size_ = nullptr;
+    PFN_vkGetDescriptorSetLayoutBindingOffsetEXT get_descriptor_set_layout_binding_offset_ = nullptr;
+    PFN_vkGetDescriptorEXT get_descriptor_ = nullptr;
+    PFN_vkCmdBindDescriptorBuffersEXT cmd_bind_descriptor_buffers_ = nullptr;
+    PFN_vkCmdSetDescriptorBufferOffsetsEXT cmd_set_descriptor_buffer_offsets_ = nullptr;
+
+    // Multiview probe: the scene is drawn into every layer of a layered target by one render pass whose view mask
+    // covers all layers, with the per-view transform picked by gl_ViewIndex. Draws, bindings and vertex fetch are
+    // paid once for all views. Two views are a stereo pair around the camera, six the cube map faces at its position.
+    static constexpr uint32_t kProbeSize = 256; // Width and height of every view
+    uint32_t multiview_views_ = 0;              // 0 without a probe
+    VkRenderPass probe_render_pass_ = VK_NULL_HANDLE;
+    RenderTarget probe_color_;
+    RenderTarget probe_depth_;
+    VkFramebuffer probe_frame_buffer_ = VK_NULL_HANDLE;
+    VkDescriptorSetLayout probe_set_layout_ = VK_NULL_HANDLE;
+    VkPipelineLayout probe_pipeline_layout_ = VK_NULL_HANDLE;
+    VkPipeline probe_pipeline_ = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> probe_sets_;
+    std::vector<VkBuffer> probe_uniform_buffers_;
+    std::vector<VkDeviceMemory> probe_uniform_buffers_memory_;
+    std::vector<void *> probe_uniform_buffers_mapped_;
+
+    // The probe is only rendered when asked for: by the first frame, by a change of the draw list and by F4. Each
+    // rendering is copied into a host-visible buffer and written out once its frame has completed, so the buffer
+    // holds one rendering at a time and a request waits while a copy is outstanding.
+    bool probe_requested_ = false;
+    bool probe_due_ = false;                       // The frame being recorded renders the probe
+    std::optional<uint32_t> probe_readback_frame_; // Frame in flight whose probe copy has not been written out yet
+    VkBuffer probe_readback_buffer_ = VK_NULL_HANDLE;
+    VkDeviceMemory probe_readback_memory_ = VK_NULL_HANDLE;
+    void *probe_readback_mapped_ = nullptr;
+
+    // Frame streaming: a compute shader converts the resolved frame (without the overlay) into the stream's pixel
+    // format, the result is copied into the host-cached buffer of the frame in flight and handed to the stream's
+    // writer thread once that frame's fence has signalled. The render loop never waits on the GPU for it.
+    FrameStream stream_;
+    VkExtent2D stream_extent_{0, 0}; // Fixed when the stream opens; the frame is scaled to it
+    VkDescriptorSetLayout stream_set_layout_ = VK_NULL_HANDLE;
+    VkPipelineLayout stream_pipeline_layout_ = VK_NULL_HANDLE;
+    VkPipeline stream_pipeline_ = VK_NULL_HANDLE;
+    std::array<VkDescriptorSet, 2> stream_sets_; // Indexed by history_index_
+    VkBuffer stream_buffer_ = VK_NULL_HANDLE;    // Device local, written by the conversion
+    VkDeviceMemory stream_buffer_memory_ = VK_NULL_HANDLE;
+    std::vector<VkBuffer> stream_readback_buffers_;
+    std::vector<VkDeviceMemory> stream_readback_memory_;
+    std::vector<void *> stream_readback_mapped_;
+    std::vector<bool> stream_pending_; // Per frame in flight: its readback buffer holds a frame not yet written
+
+    // Frame export: headless frames are rendered into images whose memory is shared with a consumer process. A
+    // slot is a frame in flight's offscreen image with its two semaphores.
+    FrameExportServer frame_export_;
+    std::vector<VkSemaphore> export_ready_semaphores_;   // Signalled by the frame's submit
+    std::vector<VkSemaphore> export_release_semaphores_; // Signalled by the consumer when it has read the frame
+
+    // Render-job server: device, pipelines and scenes stay alive between jobs. A camera's image is copied into its
+    // frame's readback buffer and sent once that frame's fence has signalled, so cameras and consecutive jobs overlap
+    // through the frames in flight.
+    struct ReadbackTag
+    {
+        uint32_t job_id;
+        uint32_t camera;
+    };
+    struct ServedSceneMesh
+    {
+        MeshAllocation mesh;
+        uint64_t last_used; // Value of served_scene_uses_ when a job last asked for it
+    };
+    static constexpr size_t kMaxServedScenes = 8; // The least recently used scene is freed to load another
+    RenderJobServer job_server_;
+    std::map<std::string, ServedSceneMesh> served_scenes_; // Capture path to its mesh in the geometry buffers
+    uint64_t served_scene_uses_ = 0;
+    std::optional<ReadbackTag> next_readback_;            // Taken by the next DrawFrame
+    std::vector<std::optional<ReadbackTag>> readbacks_;   // Per frame in flight, empty unless serving
+    std::vector<VkBuffer> readback_buffers_;
+    std::vector<VkDeviceMemory> readback_buffers_memory_;
+    std::vector<void *> readback_buffers_mapped_;
+    std::optional<float> scene_time_; // Replaces the animation clock when set
+
+    // Capture & replay
+    CaptureWriter capture_;
+    Capture replay_;
+    const CapturedFrame *replay_frame_ = nullptr;
+
+    // Profiling & overlay
+    StartupProfile startup_;
+    Profiler profiler_;
+    PerfCounters perf_; // Only open with --perf-counters
+    Overlay overlay_;
+    bool overlay_visible_ = false;
+    uint32_t overlay_vertex_count_ = 0;
+    VkPipeline overlay_pipeline_ = VK_NULL_HANDLE; // Built the first time the overlay is shown
+    GraphicsPipelineDesc overlay_pipeline_desc_;
+    VkBuffer overlay_vertex_buffer_;
+    VkDeviceMemory overlay_vertex_buffer_memory_;
+    Vertex *overlay_vertices_mapped_ = nullptr; // MAX_FRAMES_IN_FLIGHT slices of Overlay::kMaxVertices
+
     const std::vector<const char *> validation_layers_ = {"VK_LAYER_KHRONOS_validation"};
     const std::vector<const char *> device_extensions_ = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    // Enabled when the device supports them, never required
+    const std::vector<const char *> optional_device_extensions_ = {VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME,
+                                                                   VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME,
+                                                                   VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME};
+    std::vector<const char *> enabled_device_extensions_;
 }; // class Chim
 } // namespace chim
 #endif // CHIM_HPP
\ No newline at end of file
@@ -0,0 +1,283 @@
+#include "device_caps.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+using namespace chim;
+
+namespace
+{
+template <typename T> void WriteValue(std::ofstream& file, const T& value)
+{
+    file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T> bool ReadValue(std::ifstream& file, T& value)
+{
+    return static_cast<bool>(file.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+// Counts in a file that is too short or from another version must not turn into huge allocations
+constexpr uint32_t kMaxCount = 4096;
+} // namespace
+
+/**
+ * @brief Queries everything in one go. The feature and property chains follow the same rules as device creation:
+ * structures are only chained when the version in use or the device's extensions say it knows them.
+ */
+DeviceCapabilities DeviceCapabilities::Query(VkPhysicalDevice device, const std::vector<VkFormat>& formats,
+                                             uint32_t instance_version)
+{
+    DeviceCapabilities caps;
+    vkGetPhysicalDeviceProperties(device, &caps.properties);
+    vkGetPhysicalDeviceFeatures(device, &caps.features);
+    vkGetPhysicalDeviceMemoryProperties(device, &caps.memory);
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+    caps.queue_families.resize(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, caps.queue_families.data());
+
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+    for (const auto& extension : availableExtensions)
+    {
+        caps.extensions.push_back(extension.extensionName);
+    }
+    std::sort(caps.extensions.begin(), caps.extensions.end());
+
+    for (VkFormat format : formats)
+    {
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(device, format, &formatProperties);
+        caps.formats.emplace_back(format, formatProperties);
+    }
+
+    // A device may report a newer version than the instance was created with, but only the instance's can be used
+    caps.api_version = std::min(caps.properties.apiVersion, instance_version);
+    const uint32_t apiVersion = caps.api_version;
+    if (apiVersion < VK_API_VERSION_1_1)
+    {
+        return caps;
+    }
+
+    VkPhysicalDeviceMultiviewFeatures multiviewFeatures{};
+    multiviewFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+    VkPhysicalDeviceBufferDeviceAddressFeatures addressFeatures{};
+    addressFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT libraryFeatures{};
+    libraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+    VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptorBufferFeatures{};
+    descriptorBufferFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &multiviewFeatures;
+
+    VkPhysicalDeviceIDProperties idProperties{};
+    idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+    VkPhysicalDeviceDescriptorBufferPropertiesEXT bufferProperties{};
+    bufferProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &idProperties;
+
+    if (apiVersion >= VK_API_VERSION_1_2)
+    {
+        multiviewFeatures.pNext = &addressFeatures;
+        if (caps.HasExtension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME))
+        {
+            libraryFeatures.pNext = addressFeatures.pNext;
+            addressFeatures.pNext = &libraryFeatures;
+        }
+        if (apiVersion >= VK_API_VERSION_1_3 && caps.HasExtension(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME))
+        {
+            descriptorBufferFeatures.pNext = addressFeatures.pNext;
+            addressFeatures.pNext = &descriptorBufferFeatures;
+            idProperties.pNext = &bufferProperties;
+        }
+    }
+    vkGetPhysicalDeviceFeatures2(device, &features2);
+    vkGetPhysicalDeviceProperties2(device, &properties2);
+
+    caps.multiview = multiviewFeatures.multiview == VK_TRUE;
+    caps.buffer_device_address = addressFeatures.bufferDeviceAddress == VK_TRUE;
+    caps.graphics_pipeline_library = libraryFeatures.graphicsPipelineLibrary == VK_TRUE;
+    caps.descriptor_buffer = descriptorBufferFeatures.descriptorBuffer == VK_TRUE;
+    caps.descriptor_buffer_offset_alignment =
+        std::max<VkDeviceSize>(bufferProperties.descriptorBufferOffsetAlignment, 1);
+    caps.uniform_buffer_descriptor_size = bufferProperties.uniformBufferDescriptorSize;
+    memcpy(caps.device_uuid, idProperties.deviceUUID, VK_UUID_SIZE);
+    memcpy(caps.driver_uuid, idProperties.driverUUID, VK_UUID_SIZE);
+    return caps;
+}
+
+/**
+ * @brief Reads a snapshot written by Save. Empty if the file is missing, from another version or cut short.
+ */
+std::optional<DeviceCapabilities> DeviceCapabilities::Load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    if (!file.is_open() || !ReadValue(file, magic) || !ReadValue(file, version) || magic != kMagic ||
+        version != kVersion)
+    {
+        return std::nullopt;
+    }
+
+    DeviceCapabilities caps;
+    uint32_t queueFamilyCount = 0;
+    uint32_t extensionCount = 0;
+    uint32_t formatCount = 0;
+    bool read = ReadValue(file, caps.properties) && ReadValue(file, caps.features) && ReadValue(file, caps.memory) &&
+                ReadValue(file, caps.api_version) && ReadValue(file, caps.multiview) &&
+                ReadValue(file, caps.buffer_device_address) &&
+                ReadValue(file, caps.graphics_pipeline_library) && ReadValue(file, caps.descriptor_buffer) &&
+                ReadValue(file, caps.descriptor_buffer_offset_alignment) &&
+                ReadValue(file, caps.uniform_buffer_descriptor_size) && ReadValue(file, caps.device_uuid) &&
+                ReadValue(file, caps.driver_uuid) && ReadValue(file, queueFamilyCount) &&
+                queueFamilyCount <= kMaxCount;
+    if (!read)
+    {
+        return std::nullopt;
+    }
+
+    caps.queue_families.resize(queueFamilyCount);
+    for (VkQueueFamilyProperties& family : caps.queue_families)
+    {
+        read = read && ReadValue(file, family);
+    }
+
+    read = read && ReadValue(file, extensionCount) && extensionCount <= kMaxCount;
+    for (uint32_t i = 0; read && i < extensionCount; i++)
+    {
+        uint32_t length = 0;
+        read = ReadValue(file, length) && length < VK_MAX_EXTENSION_NAME_SIZE;
+        if (read)
+        {
+            std::string name(length, '\0');
+            read = static_cast<bool>(file.read(name.data(), length));
+            caps.extensions.push_back(std::move(name));
+        }
+    }
+
+    read = read && ReadValue(file, formatCount) && formatCount <= kMaxCount;
+    for (uint32_t i = 0; read && i < formatCount; i++)
+    {
+        std::pair<VkFormat, VkFormatProperties> format;
+        read = ReadValue(file, format.first) && ReadValue(file, format.second);
+        caps.formats.push_back(format);
+    }
+
+    if (!read)
+    {
+        return std::nullopt;
+    }
+    return caps;
+}
+
+/**
+ * @brief Writes the snapshot through a temporary file, so that a crash never leaves half a snapshot behind.
+ */
+void DeviceCapabilities::Save(const std::string& path) const
+{
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            return;
+        }
+
+        WriteValue(file, kMagic);
+        WriteValue(file, kVersion);
+        WriteValue(file, properties);
+        WriteValue(file, features);
+        WriteValue(file, memory);
+        WriteValue(file, api_version);
+        WriteValue(file, multiview);
+        WriteValue(file, buffer_device_address);
+        WriteValue(file, graphics_pipeline_library);
+        WriteValue(file, descriptor_buffer);
+        WriteValue(file, descriptor_buffer_offset_alignment);
+        WriteValue(file, uniform_buffer_descriptor_size);
+        WriteValue(file, device_uuid);
+        WriteValue(file, driver_uuid);
+
+        WriteValue(file, static_cast<uint32_t>(queue_families.size()));
+        for (const VkQueueFamilyProperties& family : queue_families)
+        {
+            WriteValue(file, family);
+        }
+        WriteValue(file, static_cast<uint32_t>(extensions.size()));
+        for (const std::string& extension : extensions)
+        {
+            WriteValue(file, static_cast<uint32_t>(extension.size()));
+            file.write(extension.data(), static_cast<std::streamsize>(extension.size()));
+        }
+        WriteValue(file, static_cast<uint32_t>(formats.size()));
+        for (const auto& format : formats)
+        {
+            WriteValue(file, format.first);
+            WriteValue(file, format.second);
+        }
+        if (!file.good())
+        {
+            return;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+}
+
+/**
+ * @brief True when current, the properties the driver reports now, belong to the device and driver the snapshot was
+ * taken of. A driver update changes driverVersion and usually pipelineCacheUUID, which invalidates the snapshot.
+ */
+bool DeviceCapabilities::SameDevice(const VkPhysicalDeviceProperties& current) const
+{
+    return properties.vendorID == current.vendorID && properties.deviceID == current.deviceID &&
+           properties.driverVersion == current.driverVersion && properties.apiVersion == current.apiVersion &&
+           memcmp(properties.pipelineCacheUUID, current.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+bool DeviceCapabilities::HasExtension(const char *name) const
+{
+    return std::binary_search(extensions.begin(), extensions.end(), std::string(name));
+}
+
+bool DeviceCapabilities::HasFormat(VkFormat format) const
+{
+    return std::any_of(formats.begin(), formats.end(), [format](const auto& entry) { return entry.first == format; });
+}
+
+/**
+ * @brief Properties of a format passed to Query, all zero for any other format.
+ */
+VkFormatProperties DeviceCapabilities::FormatProperties(VkFormat format) const
+{
+    for (const auto& entry : formats)
+    {
+        if (entry.first == format)
+        {
+            return entry.second;
+        }
+    }
+    return VkFormatProperties{};
+}
+
+std::optional<uint32_t> DeviceCapabilities::FindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags flags) const
+{
+    for (uint32_t i = 0; i < memory.memoryTypeCount; i++)
+    {
+        if ((type_filter & (1 << i)) && (memory.memoryTypes[i].propertyFlags & flags) == flags)
+        {
+            return i;
+        }
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,63 @@
+/**
+ * @file device_caps.hpp
+ * @author George Power
+ * @brief Snapshot of what a physical device supports, queried once and kept on disk next to the pipeline cache.
+ */
+#ifndef DEVICE_CAPS_HPP
+#define DEVICE_CAPS_HPP
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace chim
+{
+/**
+ * @struct DeviceCapabilities
+ * @brief Everything the renderer asks a physical device that does not depend on a surface.
+ * @details Built with Query when a device is considered, then consulted instead of the driver. A snapshot saved by a
+ * previous run is reused when it describes the same device and driver (see SameDevice), which saves the extension,
+ * queue family and feature queries at start-up. Surface support and swap chain formats depend on the window and are
+ * not part of it.
+ */
+struct DeviceCapabilities
+{
+    static constexpr uint32_t kMagic = 0x53504143; // "CAPS"
+    static constexpr uint32_t kVersion = 2;
+
+    VkPhysicalDeviceProperties properties{};
+    VkPhysicalDeviceFeatures features{};
+    VkPhysicalDeviceMemoryProperties memory{};
+    std::vector<VkQueueFamilyProperties> queue_families;
+    std::vector<std::string> extensions; // Sorted
+    std::vector<std::pair<VkFormat, VkFormatProperties>> formats; // Only the formats Query was asked about
+
+    // Version the device is used at, the lower of its own and the instance's
+    uint32_t api_version = VK_API_VERSION_1_0;
+
+    // Vulkan 1.1+ features and properties, false or zero when the device cannot report them at api_version
+    bool multiview = false;
+    bool buffer_device_address = false;
+    bool graphics_pipeline_library = false;
+    bool descriptor_buffer = false;
+    VkDeviceSize descriptor_buffer_offset_alignment = 1;
+    size_t uniform_buffer_descriptor_size = 0;
+    uint8_t device_uuid[VK_UUID_SIZE] = {};
+    uint8_t driver_uuid[VK_UUID_SIZE] = {};
+
+    static DeviceCapabilities Query(VkPhysicalDevice device, const std::vector<VkFormat>& formats,
+                                    uint32_t instance_version);
+    static std::optional<DeviceCapabilities> Load(const std::string& path);
+    void Save(const std::string& path) const;
+
+    bool SameDevice(const VkPhysicalDeviceProperties& current) const;
+    bool HasExtension(const char *name) const;
+    bool HasFormat(VkFormat format) const;
+    VkFormatProperties FormatProperties(VkFormat format) const;
+    std::optional<uint32_t> FindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags flags) const;
+};
+} // namespace chim
+#endif // DEVICE_CAPS_HPP
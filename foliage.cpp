@@ -0,0 +1,95 @@
+#include "foliage.hpp"
+#include <algorithm>
+#include <cmath>
+
+using namespace chim;
+
+namespace
+{
+float Hash(int32_t x, int32_t y, uint32_t seed)
+{
+    uint32_t h = static_cast<uint32_t>(x) * 374761393u + static_cast<uint32_t>(y) * 668265263u + seed * 2246822519u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    h ^= h >> 16;
+    return static_cast<float>(h >> 8) / static_cast<float>(1u << 24);
+}
+
+float Smooth(float t)
+{
+    return t * t * (3.0f - 2.0f * t);
+}
+
+float ValueNoise(float x, float y, uint32_t seed)
+{
+    const float fx = std::floor(x);
+    const float fy = std::floor(y);
+    const int32_t ix = static_cast<int32_t>(fx);
+    const int32_t iy = static_cast<int32_t>(fy);
+    const float tx = Smooth(x - fx);
+    const float ty = Smooth(y - fy);
+    const float bottom = Hash(ix, iy, seed) + (Hash(ix + 1, iy, seed) - Hash(ix, iy, seed)) * tx;
+    const float top = Hash(ix, iy + 1, seed) + (Hash(ix + 1, iy + 1, seed) - Hash(ix, iy + 1, seed)) * tx;
+    return bottom + (top - bottom) * ty;
+}
+} // namespace
+
+/**
+ * @brief Meadow-like patches of four octaves of value noise over a field centred on the origin, bare within clearing
+ * of the centre so that the scene standing there stays in sight.
+ */
+FoliageDensityMap FoliageDensityMap::Generate(float size, uint32_t resolution, float clearing, uint32_t seed)
+{
+    FoliageDensityMap map;
+    map.min = glm::vec2(-0.5f * size);
+    map.size = size;
+    map.resolution = resolution;
+    map.values.resize(static_cast<size_t>(resolution) * resolution);
+
+    const float featureSize = 8.0f; // World units across the largest patches
+    for (uint32_t y = 0; y < resolution; y++)
+    {
+        for (uint32_t x = 0; x < resolution; x++)
+        {
+            const glm::vec2 position = map.min + glm::vec2(x + 0.5f, y + 0.5f) * (size / resolution);
+            float noise = 0.0f;
+            float amplitude = 0.5f;
+            float frequency = 1.0f / featureSize;
+            for (uint32_t octave = 0; octave < 4; octave++)
+            {
+                noise += amplitude * ValueNoise(position.x * frequency, position.y * frequency, seed + octave);
+                amplitude *= 0.5f;
+                frequency *= 2.0f;
+            }
+            float density = Smooth(std::clamp((noise - 0.3f) / 0.35f, 0.0f, 1.0f));
+            if (clearing > 0.0f)
+            {
+                density *= Smooth(std::clamp((glm::length(position) - clearing) / (0.5f * clearing), 0.0f, 1.0f));
+            }
+            map.values[static_cast<size_t>(y) * resolution + x] = static_cast<uint8_t>(density * 255.0f + 0.5f);
+        }
+    }
+    return map;
+}
+
+/**
+ * @brief A grid with one spot every 1 / sqrt(density) units, wide enough for the view distance in every direction.
+ */
+FoliageScatter::FoliageScatter(float view_distance, float density)
+    : view_distance(view_distance), spacing(1.0f / std::sqrt(density)),
+      cells(static_cast<uint32_t>(std::ceil(2.0f * view_distance / spacing)) + 1)
+{
+}
+
+FoliageConstants FoliageScatter::Constants(const FoliageDensityMap& map, const Camera::Frustum& frustum,
+                                           const glm::vec3& camera) const
+{
+    FoliageConstants constants{};
+    std::copy(frustum.begin(), frustum.end(), constants.planes);
+    constants.camera = glm::vec4(camera, view_distance);
+    constants.field = glm::vec4(map.min, map.size, spacing);
+    constants.first_cell = glm::ivec2(static_cast<int32_t>(std::floor((camera.x - view_distance) / spacing)),
+                                      static_cast<int32_t>(std::floor((camera.y - view_distance) / spacing)));
+    constants.cells = cells;
+    constants.lod_distance = view_distance * 0.25f;
+    return constants;
+}
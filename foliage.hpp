@@ -0,0 +1,58 @@
+/**
+ * @file foliage.hpp
+ * @author George Power
+ * @brief Grass scattered on the GPU every frame from a density map.
+ */
+#ifndef FOLIAGE_HPP
+#define FOLIAGE_HPP
+
+#include "camera.hpp"
+#include "render_types.hpp"
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace chim
+{
+/**
+ * @struct FoliageDensityMap
+ * @brief How densely grass grows over a square field on the ground (z = 0), 0 for bare and 255 for every spot of
+ * the placement grid taken.
+ */
+struct FoliageDensityMap
+{
+    glm::vec2 min{0.0f}; // Corner of the field
+    float size = 0.0f;   // Side of the field
+    uint32_t resolution = 0;
+    std::vector<uint8_t> values; // resolution * resolution, rows along +Y
+
+    static FoliageDensityMap Generate(float size, uint32_t resolution, float clearing, uint32_t seed);
+};
+
+/**
+ * @struct FoliageScatter
+ * @brief The fixed-size grid the scatter pass walks around the camera each frame.
+ * @details The grid covers the square around the camera out to the view distance, snapped to world space cells, so
+ * that a blade keeps its place while the camera moves. Its size only depends on the view distance and the spacing,
+ * which makes the pass cost the same on the CPU every frame, however many blades it ends up placing.
+ */
+struct FoliageScatter
+{
+    static constexpr uint32_t kGroupSize = 8;                     // Invocations along each side of a workgroup
+    static constexpr uint32_t kLodCount = 2;                      // Draws, one per level of detail
+    static constexpr uint32_t kLodVertices[kLodCount] = {15, 3}; // Five triangles, or one
+
+    float view_distance = 0.0f;
+    float spacing = 0.0f;
+    uint32_t cells = 0;
+
+    FoliageScatter() = default;
+    FoliageScatter(float view_distance, float density);
+
+    uint32_t Capacity(void) const { return cells * cells; }
+    uint32_t GroupCount(void) const { return (cells + kGroupSize - 1) / kGroupSize; }
+    FoliageConstants Constants(const FoliageDensityMap& map, const Camera::Frustum& frustum,
+                               const glm::vec3& camera) const;
+};
+} // namespace chim
+#endif // FOLIAGE_HPP
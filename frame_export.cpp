@@ -0,0 +1,220 @@
+#include "frame_export.hpp"
+#include "chim.hpp"
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace chim;
+
+#ifndef _WIN32
+namespace
+{
+volatile std::sig_atomic_t interrupted = 0;
+
+void OnInterrupt(int)
+{
+    interrupted = 1;
+}
+} // namespace
+#endif
+
+FrameExportServer::~FrameExportServer()
+{
+    Close();
+}
+
+#ifdef _WIN32
+void FrameExportServer::Listen(const std::string& path)
+{
+    throw ChimException("Frame export needs Unix domain sockets with descriptor passing! " + path);
+}
+
+void FrameExportServer::Accept(uint32_t) {}
+void FrameExportServer::SendSetup(const FrameExportSetup&, const std::vector<int>&) {}
+bool FrameExportServer::SendFrame(uint32_t, uint64_t)
+{
+    return false;
+}
+FrameExportServer::SlotState FrameExportServer::AcquireSlot(uint32_t)
+{
+    return SlotState::Disconnected;
+}
+void FrameExportServer::Close(void) {}
+void chim::CloseFileDescriptors(const std::vector<int>&) {}
+#else
+/**
+ * @brief Closes exported descriptors that were not handed to a consumer.
+ */
+void chim::CloseFileDescriptors(const std::vector<int>& fds)
+{
+    for (int fd : fds)
+    {
+        close(fd);
+    }
+}
+
+/**
+ * @brief Binds a Unix socket at path, replacing a stale socket file left by an earlier run.
+ */
+void FrameExportServer::Listen(const std::string& path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        throw ChimException("Frame export socket path is too long! " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    listener_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener_ < 0)
+    {
+        throw ChimException("Failed to create frame export socket! " + path);
+    }
+    unlink(path.c_str());
+    if (bind(listener_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listener_, 1) != 0)
+    {
+        throw ChimException("Failed to listen on frame export socket! " + path);
+    }
+    path_ = path;
+}
+
+/**
+ * @brief Blocks until a consumer connects, for at most timeout_seconds unless that is 0.
+ * @details Ctrl+C only sets a flag while waiting, so the wait ends with an exception and the caller can unwind and
+ * remove the socket file instead of the process being killed in the middle of Init.
+ */
+void FrameExportServer::Accept(uint32_t timeout_seconds)
+{
+    struct sigaction onInterrupt{};
+    struct sigaction previous{};
+    onInterrupt.sa_handler = OnInterrupt;
+    sigemptyset(&onInterrupt.sa_mask);
+    interrupted = 0;
+    sigaction(SIGINT, &onInterrupt, &previous);
+
+    // Polled in short slices, as the signal may be delivered to another thread and leave poll waiting
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout_seconds);
+    pollfd fd{listener_, POLLIN, 0};
+    int ready = 0;
+    while (ready == 0 && !interrupted && (timeout_seconds == 0 || std::chrono::steady_clock::now() < deadline))
+    {
+        ready = poll(&fd, 1, 250);
+        if (ready < 0 && errno == EINTR)
+        {
+            ready = 0;
+        }
+    }
+    sigaction(SIGINT, &previous, nullptr);
+
+    if (interrupted)
+    {
+        throw ChimException("Interrupted while waiting for a frame consumer on " + path_);
+    }
+    if (ready == 0)
+    {
+        throw ChimException("No frame consumer connected to " + path_ + " in time!");
+    }
+    connection_ = ready > 0 ? accept(listener_, nullptr, nullptr) : -1;
+    if (connection_ < 0)
+    {
+        throw ChimException("Failed to accept a frame consumer on " + path_);
+    }
+}
+
+/**
+ * @brief Sends the setup message with the slot descriptors, then closes them; the consumer holds its own copies.
+ */
+void FrameExportServer::SendSetup(const FrameExportSetup& setup, const std::vector<int>& fds)
+{
+    busy_.assign(setup.slot_count, false);
+    released_.assign(setup.slot_count, false);
+
+    iovec payload{};
+    payload.iov_base = const_cast<FrameExportSetup *>(&setup);
+    payload.iov_len = sizeof(setup);
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+    msghdr message{};
+    message.msg_iov = &payload;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+
+    cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    std::memcpy(CMSG_DATA(header), fds.data(), sizeof(int) * fds.size());
+
+    ssize_t sent = sendmsg(connection_, &message, MSG_NOSIGNAL);
+    CloseFileDescriptors(fds);
+    if (sent != static_cast<ssize_t>(sizeof(setup)))
+    {
+        throw ChimException("Failed to send the frame export setup on " + path_);
+    }
+}
+
+/**
+ * @brief Tells the consumer that slot holds frame once its ready semaphore signals. False if the consumer is gone.
+ */
+bool FrameExportServer::SendFrame(uint32_t slot, uint64_t frame)
+{
+    FrameExportMessage message{slot, 0, frame};
+    if (send(connection_, &message, sizeof(message), MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(message)))
+    {
+        Close();
+        return false;
+    }
+    busy_[slot] = true;
+    return true;
+}
+
+/**
+ * @brief Waits until slot may be rendered into again, handling the releases of other slots on the way.
+ */
+FrameExportServer::SlotState FrameExportServer::AcquireSlot(uint32_t slot)
+{
+    while (busy_[slot])
+    {
+        FrameReleaseMessage message{};
+        if (recv(connection_, &message, sizeof(message), MSG_WAITALL) != static_cast<ssize_t>(sizeof(message)) ||
+            message.slot >= busy_.size())
+        {
+            Close();
+            return SlotState::Disconnected;
+        }
+        busy_[message.slot] = false;
+        released_[message.slot] = true;
+    }
+
+    if (released_[slot])
+    {
+        released_[slot] = false;
+        return SlotState::Released;
+    }
+    return SlotState::Free;
+}
+
+void FrameExportServer::Close(void)
+{
+    if (connection_ >= 0)
+    {
+        close(connection_);
+        connection_ = -1;
+    }
+    if (listener_ >= 0)
+    {
+        close(listener_);
+        listener_ = -1;
+        unlink(path_.c_str());
+    }
+}
+#endif
@@ -0,0 +1,101 @@
+/**
+ * @file frame_export.hpp
+ * @author George Power
+ * @brief Hands rendered frames to another process over a Unix socket, as external memory and semaphores.
+ */
+#ifndef FRAME_EXPORT_HPP
+#define FRAME_EXPORT_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace chim
+{
+/**
+ * @brief First message on the socket, sent once a consumer connects.
+ * @details It carries slot_count * 3 file descriptors (SCM_RIGHTS) in the order memory, ready semaphore, release
+ * semaphore for each slot. The memory holds one VkImage created with exactly the parameters below, optimal tiling,
+ * colour attachment and transfer source usage, and VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT; the semaphores are
+ * binary and VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT. Opaque handles only work between processes on the same
+ * device and driver, which the UUIDs let the consumer check.
+ *
+ * Everything is in host byte order; both ends run on the same machine.
+ */
+struct FrameExportSetup
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;       // VkFormat
+    uint32_t layout;       // VkImageLayout the image is in when a frame is ready
+    uint32_t slot_count;
+    uint32_t padding;
+    uint64_t allocation_size;
+    uint8_t device_uuid[16];
+    uint8_t driver_uuid[16];
+};
+
+/**
+ * @brief Sent by the renderer after each frame is submitted. The frame is complete once the slot's ready semaphore
+ * has signalled, so the consumer waits on it in its own submit instead of on the CPU.
+ */
+struct FrameExportMessage
+{
+    uint32_t slot;
+    uint32_t padding;
+    uint64_t frame;
+};
+
+/**
+ * @brief Sent by the consumer once it has submitted the work that reads a slot, signalling the slot's release
+ * semaphore. Ownership of the image was released to VK_QUEUE_FAMILY_EXTERNAL by the renderer and has to be acquired
+ * by the consumer.
+ */
+struct FrameReleaseMessage
+{
+    uint32_t slot;
+};
+
+const uint32_t kFrameExportMagic = 0x58454843; // "CHEX"
+const uint32_t kFrameExportVersion = 1;
+
+void CloseFileDescriptors(const std::vector<int>& fds);
+
+/**
+ * @class FrameExportServer
+ * @brief Server end of the frame export socket; serves one consumer.
+ * @details A slot that was sent to the consumer is busy until the consumer releases it. The renderer asks for its
+ * slot before rendering into it again, which blocks until the release arrives, so a slow consumer throttles the
+ * renderer instead of seeing frames overwritten.
+ */
+class FrameExportServer
+{
+  public:
+    enum class SlotState
+    {
+        Free,         // Never sent; nothing to wait for
+        Released,     // The consumer signalled the release semaphore, the next submit has to wait on it
+        Disconnected  // The consumer went away
+    };
+
+    ~FrameExportServer();
+
+    void Listen(const std::string& path);
+    void Accept(uint32_t timeout_seconds);
+    bool IsConnected(void) const { return connection_ >= 0; }
+    void SendSetup(const FrameExportSetup& setup, const std::vector<int>& fds);
+    bool SendFrame(uint32_t slot, uint64_t frame);
+    SlotState AcquireSlot(uint32_t slot);
+    void Close(void);
+
+  private:
+    int listener_ = -1;
+    int connection_ = -1;
+    std::string path_;
+    std::vector<bool> busy_;     // Sent and not released yet, per slot
+    std::vector<bool> released_; // Released, but the renderer has not waited on the release semaphore yet
+};
+} // namespace chim
+#endif // FRAME_EXPORT_HPP
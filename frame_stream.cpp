@@ -0,0 +1,140 @@
+#include "frame_stream.hpp"
+#include "chim.hpp"
+#include <cstring>
+#ifndef _WIN32
+#include <csignal>
+#endif
+
+using namespace chim;
+
+/**
+ * @brief Y4M for a .y4m path, raw RGBA for anything else.
+ */
+StreamFormat chim::StreamFormatForPath(const std::string& path)
+{
+    const std::string extension = ".y4m";
+    bool y4m = path.size() >= extension.size() &&
+               path.compare(path.size() - extension.size(), extension.size(), extension) == 0;
+    return y4m ? StreamFormat::Y4m : StreamFormat::Rgba;
+}
+
+FrameStream::~FrameStream()
+{
+    Close();
+}
+
+/**
+ * @brief Opens the stream and starts the writer. Y4M needs a width divisible by 8 and an even height, which the
+ * caller has to round the size to.
+ */
+void FrameStream::Open(const std::string& path, StreamFormat format, uint32_t width, uint32_t height, uint32_t fps)
+{
+#ifndef _WIN32
+    // An encoder that quits closes the pipe; the failed write stops the stream instead of the signal killing Chim
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+    file_.open(path, std::ios::binary | std::ios::trunc);
+    if (!file_.is_open())
+    {
+        throw ChimException("Failed to open frame stream! " + path);
+    }
+
+    path_ = path;
+    format_ = format;
+    frame_size_ = FrameSize(format, width, height);
+    frames_written_ = 0;
+    closing_ = false;
+    failed_ = false;
+    if (format == StreamFormat::Y4m)
+    {
+        file_ << "YUV4MPEG2 W" << width << " H" << height << " F" << fps << ":1 Ip A1:1 C420jpeg\n";
+    }
+    writer_ = std::thread(&FrameStream::WriterLoop, this);
+}
+
+size_t FrameStream::FrameSize(StreamFormat format, uint32_t width, uint32_t height)
+{
+    size_t pixels = size_t(width) * height;
+    return format == StreamFormat::Y4m ? pixels * 3 / 2 : pixels * 4;
+}
+
+/**
+ * @brief Queues a copy of frame, blocking while the queue is full. False once the stream has failed.
+ */
+bool FrameStream::Write(const void *frame)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] { return queued_.size() < kMaxQueuedFrames || failed_; });
+    if (failed_)
+    {
+        return false;
+    }
+
+    std::vector<char> buffer;
+    if (!spare_.empty())
+    {
+        buffer = std::move(spare_.back());
+        spare_.pop_back();
+    }
+    buffer.resize(frame_size_);
+    std::memcpy(buffer.data(), frame, frame_size_);
+    queued_.push_back(std::move(buffer));
+    changed_.notify_all();
+    return true;
+}
+
+/**
+ * @brief Writes whatever is still queued and closes the file.
+ * @return The number of frames written.
+ */
+uint64_t FrameStream::Close(void)
+{
+    if (!writer_.joinable())
+    {
+        return frames_written_;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing_ = true;
+    }
+    changed_.notify_all();
+    writer_.join();
+    file_.close();
+    queued_.clear();
+    spare_.clear();
+    return frames_written_;
+}
+
+void FrameStream::WriterLoop(void)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        changed_.wait(lock, [this] { return !queued_.empty() || closing_; });
+        if (queued_.empty())
+        {
+            return;
+        }
+        std::vector<char> frame = std::move(queued_.front());
+        queued_.pop_front();
+        lock.unlock();
+
+        if (format_ == StreamFormat::Y4m)
+        {
+            file_ << "FRAME\n";
+        }
+        file_.write(frame.data(), static_cast<std::streamsize>(frame.size()));
+        bool written = file_.good();
+
+        lock.lock();
+        spare_.push_back(std::move(frame));
+        if (!written)
+        {
+            failed_ = true;
+            changed_.notify_all();
+            return;
+        }
+        frames_written_++;
+        changed_.notify_all();
+    }
+}
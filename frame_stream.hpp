@@ -0,0 +1,68 @@
+/**
+ * @file frame_stream.hpp
+ * @author George Power
+ * @brief Writes rendered frames into a file or pipe as Y4M video or raw RGBA, for an external encoder.
+ */
+#ifndef FRAME_STREAM_HPP
+#define FRAME_STREAM_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace chim
+{
+enum class StreamFormat
+{
+    Y4m, // 4:2:0 planar YUV, full range BT.601 (C420jpeg): the Y plane, then U and V at half resolution
+    Rgba // Tightly packed sRGB RGBA rows; the reader has to be told the size and frame rate
+};
+
+StreamFormat StreamFormatForPath(const std::string& path);
+
+/**
+ * @class FrameStream
+ * @brief Appends frames to the stream on a worker thread.
+ * @details Write only copies the frame into the queue, so a slow disk or encoder stalls the renderer only once
+ * kMaxQueuedFrames frames are waiting. A path may name a FIFO, in which case Open blocks until a reader opens it.
+ */
+class FrameStream
+{
+  public:
+    static constexpr size_t kMaxQueuedFrames = 8;
+
+    ~FrameStream();
+
+    void Open(const std::string& path, StreamFormat format, uint32_t width, uint32_t height, uint32_t fps);
+    bool IsOpen(void) const { return writer_.joinable(); }
+    StreamFormat Format(void) const { return format_; }
+    size_t FrameSize(void) const { return frame_size_; }
+    static size_t FrameSize(StreamFormat format, uint32_t width, uint32_t height);
+    bool Write(const void *frame);
+    uint64_t Close(void);
+
+  private:
+    void WriterLoop(void);
+
+  private:
+    std::ofstream file_;
+    std::string path_;
+    StreamFormat format_ = StreamFormat::Rgba;
+    size_t frame_size_ = 0;
+    uint64_t frames_written_ = 0;
+
+    std::thread writer_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::deque<std::vector<char>> queued_;
+    std::vector<std::vector<char>> spare_; // Written frames, reused by Write
+    bool closing_ = false;
+    bool failed_ = false; // The reader went away or the disk is full
+};
+} // namespace chim
+#endif // FRAME_STREAM_HPP
@@ -0,0 +1,75 @@
+#include "geometry.hpp"
+#include <iterator>
+
+using namespace chim;
+
+void RangeAllocator::Init(uint32_t capacity)
+{
+    capacity_ = capacity;
+    used_ = 0;
+    free_ranges_.clear();
+    if (capacity > 0)
+    {
+        free_ranges_[0] = capacity;
+    }
+}
+
+/**
+ * @brief Takes count elements from the first free range large enough, or nothing if none is.
+ */
+std::optional<uint32_t> RangeAllocator::Allocate(uint32_t count)
+{
+    if (count == 0)
+    {
+        return std::nullopt;
+    }
+
+    for (auto it = free_ranges_.begin(); it != free_ranges_.end(); ++it)
+    {
+        if (it->second < count)
+        {
+            continue;
+        }
+
+        uint32_t offset = it->first;
+        uint32_t remaining = it->second - count;
+        free_ranges_.erase(it);
+        if (remaining > 0)
+        {
+            free_ranges_[offset + count] = remaining;
+        }
+        used_ += count;
+        return offset;
+    }
+
+    return std::nullopt;
+}
+
+/**
+ * @brief Returns a range from Allocate, merging it with the free ranges directly before and after it.
+ */
+void RangeAllocator::Free(uint32_t offset, uint32_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    used_ -= count;
+
+    auto next = free_ranges_.lower_bound(offset);
+    if (next != free_ranges_.end() && offset + count == next->first)
+    {
+        count += next->second;
+        next = free_ranges_.erase(next);
+    }
+    if (next != free_ranges_.begin())
+    {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset)
+        {
+            previous->second += count;
+            return;
+        }
+    }
+    free_ranges_[offset] = count;
+}
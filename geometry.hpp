@@ -0,0 +1,52 @@
+/**
+ * @file geometry.hpp
+ * @author George Power
+ * @brief Suballocation of meshes inside the shared vertex and index buffers.
+ */
+#ifndef GEOMETRY_HPP
+#define GEOMETRY_HPP
+
+#include "render_types.hpp"
+#include <cstdint>
+#include <map>
+#include <optional>
+
+namespace chim
+{
+/**
+ * @class RangeAllocator
+ * @brief First-fit allocator of element ranges in a buffer of fixed capacity.
+ * @details Only the bookkeeping lives here; the buffer itself belongs to the renderer. Free ranges are kept sorted by
+ * offset and merged with their neighbours when released, so fragmentation only builds up between live ranges.
+ */
+class RangeAllocator
+{
+  public:
+    void Init(uint32_t capacity);
+
+    std::optional<uint32_t> Allocate(uint32_t count);
+    void Free(uint32_t offset, uint32_t count);
+
+    uint32_t Capacity(void) const { return capacity_; }
+    uint32_t Used(void) const { return used_; }
+
+  private:
+    uint32_t capacity_ = 0;
+    uint32_t used_ = 0;
+    std::map<uint32_t, uint32_t> free_ranges_; // Offset -> count
+};
+
+/**
+ * @brief Where a mesh lives inside the geometry buffers, in vertices and indices.
+ */
+struct MeshAllocation
+{
+    uint32_t first_vertex = 0;
+    uint32_t vertex_count = 0;
+    uint32_t first_index = 0;
+    uint32_t index_count = 0;
+
+    DrawCommand Draw(void) const { return {index_count, first_index, static_cast<int32_t>(first_vertex)}; }
+};
+} // namespace chim
+#endif // GEOMETRY_HPP
@@ -0,0 +1,179 @@
+#include "job_server.hpp"
+#include "chim.hpp"
+#include <cstring>
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace chim;
+
+namespace
+{
+// Anything larger is a broken client rather than a job
+const uint32_t kMaxJobExtent = 16384;
+const uint32_t kMaxJobCameras = 65536;
+const uint32_t kMaxScenePath = 4096;
+} // namespace
+
+RenderJobServer::~RenderJobServer()
+{
+    Close();
+}
+
+#ifdef _WIN32
+void RenderJobServer::Listen(const std::string& path)
+{
+    throw ChimException("Serving render jobs needs Unix domain sockets! " + path);
+}
+
+void RenderJobServer::Accept(void) {}
+bool RenderJobServer::ReadJob(RenderJob&)
+{
+    return false;
+}
+bool RenderJobServer::JobWaiting(void) const
+{
+    return false;
+}
+void RenderJobServer::SendResult(const RenderResultHeader&, const void *) {}
+void RenderJobServer::Close(void) {}
+bool RenderJobServer::Receive(void *, size_t)
+{
+    return false;
+}
+void RenderJobServer::Disconnect(void) {}
+#else
+/**
+ * @brief Binds a Unix socket at path, replacing a stale socket file left by an earlier run.
+ */
+void RenderJobServer::Listen(const std::string& path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        throw ChimException("Job socket path is too long! " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    listener_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener_ < 0)
+    {
+        throw ChimException("Failed to create job socket! " + path);
+    }
+    unlink(path.c_str());
+    if (bind(listener_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listener_, 4) != 0)
+    {
+        throw ChimException("Failed to listen on job socket! " + path);
+    }
+    path_ = path;
+}
+
+/**
+ * @brief Blocks until the next client connects.
+ */
+void RenderJobServer::Accept(void)
+{
+    connection_ = accept(listener_, nullptr, nullptr);
+    if (connection_ < 0)
+    {
+        throw ChimException("Failed to accept a job client on " + path_);
+    }
+}
+
+/**
+ * @brief Blocks until the client sends a job. False once the client has gone or sent something malformed, after
+ * which the connection is closed and the next client can be accepted.
+ */
+bool RenderJobServer::ReadJob(RenderJob& job)
+{
+    RenderJobHeader header{};
+    if (!Receive(&header, sizeof(header)))
+    {
+        return false;
+    }
+    bool valid = header.magic == kRenderJobMagic && header.version == kRenderJobVersion;
+    if (valid && header.command == static_cast<uint32_t>(RenderJobCommand::Shutdown))
+    {
+        job.command = RenderJobCommand::Shutdown;
+        return true;
+    }
+    valid = valid && header.command == static_cast<uint32_t>(RenderJobCommand::Render) && header.width > 0 &&
+            header.height > 0 && header.width <= kMaxJobExtent && header.height <= kMaxJobExtent &&
+            header.camera_count <= kMaxJobCameras && header.scene_length <= kMaxScenePath;
+    if (!valid)
+    {
+        LOG("Malformed render job, dropping the client");
+        Disconnect();
+        return false;
+    }
+
+    job.command = RenderJobCommand::Render;
+    job.id = header.job_id;
+    job.width = header.width;
+    job.height = header.height;
+    job.scene.resize(header.scene_length);
+    job.cameras.resize(header.camera_count);
+    return Receive(job.scene.data(), job.scene.size()) &&
+           Receive(job.cameras.data(), job.cameras.size() * sizeof(RenderJobCamera));
+}
+
+/**
+ * @brief True if the client has already sent (part of) another job, so rendering can go on without draining the
+ * frames in flight.
+ */
+bool RenderJobServer::JobWaiting(void) const
+{
+    pollfd fd{connection_, POLLIN, 0};
+    return connection_ >= 0 && poll(&fd, 1, 0) > 0 && (fd.revents & POLLIN);
+}
+
+/**
+ * @brief Sends a result. A client that has gone away is only noticed by the next ReadJob.
+ */
+void RenderJobServer::SendResult(const RenderResultHeader& header, const void *data)
+{
+    if (connection_ < 0 || send(connection_, &header, sizeof(header), MSG_NOSIGNAL) != sizeof(header) ||
+        send(connection_, data, header.size, MSG_NOSIGNAL) != static_cast<ssize_t>(header.size))
+    {
+        Disconnect();
+    }
+}
+
+void RenderJobServer::Close(void)
+{
+    Disconnect();
+    if (listener_ >= 0)
+    {
+        close(listener_);
+        listener_ = -1;
+        unlink(path_.c_str());
+    }
+}
+
+bool RenderJobServer::Receive(void *data, size_t size)
+{
+    if (size == 0)
+    {
+        return connection_ >= 0;
+    }
+    if (connection_ < 0 || recv(connection_, data, size, MSG_WAITALL) != static_cast<ssize_t>(size))
+    {
+        Disconnect();
+        return false;
+    }
+    return true;
+}
+
+void RenderJobServer::Disconnect(void)
+{
+    if (connection_ >= 0)
+    {
+        close(connection_);
+        connection_ = -1;
+    }
+}
+#endif
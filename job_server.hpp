@@ -0,0 +1,102 @@
+/**
+ * @file job_server.hpp
+ * @author George Power
+ * @brief Accepts render jobs over a Unix socket and streams the rendered images back.
+ */
+#ifndef JOB_SERVER_HPP
+#define JOB_SERVER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace chim
+{
+enum class RenderJobCommand : uint32_t
+{
+    Render = 0,
+    Shutdown // Stop serving; the server answers nothing
+};
+
+/**
+ * @brief A job on the wire: this header, scene_length bytes of scene path, then camera_count RenderJobCamera.
+ * @details An empty scene path renders the built-in scene, anything else is a capture file whose geometry is
+ * rendered. Everything is in host byte order; client and server run on the same machine.
+ */
+struct RenderJobHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t command; // RenderJobCommand
+    uint32_t job_id;  // Chosen by the client, echoed in every result
+    uint32_t width;
+    uint32_t height;
+    uint32_t camera_count;
+    uint32_t scene_length;
+};
+
+struct RenderJobCamera
+{
+    float position[3];
+    float target[3];
+    float time; // Seconds of scene animation
+};
+
+/**
+ * @brief One result per camera, in camera order, followed by size bytes: tightly packed rows of the image in format
+ * when status is 0, an error message otherwise. A job that fails as a whole gets one result with camera ~0u.
+ */
+struct RenderResultHeader
+{
+    uint32_t job_id;
+    uint32_t camera;
+    uint32_t status; // 0 on success
+    uint32_t width;
+    uint32_t height;
+    uint32_t format; // VkFormat
+    uint64_t size;
+};
+
+const uint32_t kRenderJobMagic = 0x424A4843; // "CHJB"
+const uint32_t kRenderJobVersion = 1;
+
+/**
+ * @brief A decoded render job.
+ */
+struct RenderJob
+{
+    RenderJobCommand command = RenderJobCommand::Render;
+    uint32_t id = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::string scene;
+    std::vector<RenderJobCamera> cameras;
+};
+
+/**
+ * @class RenderJobServer
+ * @brief Server end of the job socket; serves one client at a time, one after the other.
+ */
+class RenderJobServer
+{
+  public:
+    ~RenderJobServer();
+
+    void Listen(const std::string& path);
+    void Accept(void);
+    bool ReadJob(RenderJob& job);
+    bool JobWaiting(void) const;
+    void SendResult(const RenderResultHeader& header, const void *data);
+    void Close(void);
+
+  private:
+    bool Receive(void *data, size_t size);
+    void Disconnect(void);
+
+  private:
+    int listener_ = -1;
+    int connection_ = -1;
+    std::string path_;
+};
+} // namespace chim
+#endif // JOB_SERVER_HPP
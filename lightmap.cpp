@@ -0,0 +1,850 @@
+#include "lightmap.hpp"
+#include "bvh.hpp"
+#include "capture.hpp"
+#include "chim.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <optional>
+#include <thread>
+
+using namespace chim;
+
+namespace
+{
+constexpr float kPi = 3.14159265358979f;
+constexpr uint32_t kTexelsPerJob = 64;
+constexpr uint32_t kMaxAtlasWidth = 8192;
+constexpr uint32_t kNoChart = ~0u;
+
+// Deterministic per texel, so a bake gives the same result on any number of threads
+float Random(uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+}
+
+uint64_t Hash(uint64_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+constexpr uint64_t kHashSeed = 14695981039346656037ull;
+
+uint32_t ToRgbe(const glm::vec3& color)
+{
+    const float largest = std::max({color.x, color.y, color.z});
+    if (largest < 1e-32f)
+    {
+        return 0;
+    }
+    int exponent = 0;
+    const float scale = std::frexp(largest, &exponent) * 256.0f / largest;
+    return static_cast<uint32_t>(std::max(0.0f, color.x * scale)) |
+           static_cast<uint32_t>(std::max(0.0f, color.y * scale)) << 8 |
+           static_cast<uint32_t>(std::max(0.0f, color.z * scale)) << 16 | static_cast<uint32_t>(exponent + 128) << 24;
+}
+
+glm::vec3 FromRgbe(uint32_t rgbe)
+{
+    const uint32_t exponent = rgbe >> 24;
+    if (exponent == 0)
+    {
+        return glm::vec3(0.0f);
+    }
+    const float scale = std::ldexp(1.0f, static_cast<int>(exponent) - (128 + 8));
+    return glm::vec3(((rgbe & 0xFF) + 0.5f) * scale, (((rgbe >> 8) & 0xFF) + 0.5f) * scale,
+                     (((rgbe >> 16) & 0xFF) + 0.5f) * scale);
+}
+
+float Luminance(const glm::vec3& color)
+{
+    return 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z;
+}
+
+/**
+ * @brief The axis the triangle's normal is closest to, times two, plus one when it points the negative way. Nothing
+ * for degenerate triangles.
+ */
+std::optional<uint32_t> ChartDirection(const glm::vec3 *corners)
+{
+    const glm::vec3 normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+    uint32_t axis = 0;
+    for (uint32_t i = 1; i < 3; i++)
+    {
+        axis = std::abs(normal[i]) > std::abs(normal[axis]) ? i : axis;
+    }
+    if (std::abs(normal[axis]) < 1e-12f)
+    {
+        return std::nullopt;
+    }
+    return axis * 2 + (normal[axis] < 0.0f ? 1 : 0);
+}
+
+glm::vec2 Project(const glm::vec3& position, uint32_t direction)
+{
+    switch (direction / 2)
+    {
+    case 0:
+        return glm::vec2(position.y, position.z);
+    case 1:
+        return glm::vec2(position.z, position.x);
+    default:
+        return glm::vec2(position.x, position.y);
+    }
+}
+
+bool BoxesOverlap(const glm::vec3& min_a, const glm::vec3& max_a, const glm::vec3& min_b, const glm::vec3& max_b)
+{
+    return min_a.x <= max_b.x && min_b.x <= max_a.x && min_a.y <= max_b.y && min_b.y <= max_a.y &&
+           min_a.z <= max_b.z && min_b.z <= max_a.z;
+}
+
+// Directions around the normal with a density proportional to their cosine, so samples need no weighting
+glm::vec3 CosineDirection(const glm::vec3& normal, float r1, float r2)
+{
+    const float sign = std::copysign(1.0f, normal.z);
+    const float a = -1.0f / (sign + normal.z);
+    const float b = normal.x * normal.y * a;
+    const glm::vec3 tangent(1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+    const glm::vec3 bitangent(b, sign + normal.y * normal.y * a, -normal.y);
+    const float radius = std::sqrt(r1);
+    const float angle = 2.0f * kPi * r2;
+    return tangent * (radius * std::cos(angle)) + bitangent * (radius * std::sin(angle)) +
+           normal * std::sqrt(std::max(0.0f, 1.0f - r1));
+}
+
+struct SurfaceTexel
+{
+    uint32_t atlas; // Index into the atlas
+    glm::vec3 position;
+    glm::vec3 normal;
+};
+
+/**
+ * @brief Traces the paths of one texel, packet by packet.
+ * @details A packet holds eight paths leaving the texel. At every vertex of a path the sun is sampled directly with a
+ * shadow ray, then the path continues in a cosine-weighted direction: escaping adds the sky, hitting a surface
+ * multiplies what follows by that surface's vertex colour. Surfaces are lit on the side their winding faces; paths
+ * that hit a back face continue from it all the same. The first packet of a texel is the most coherent, since all its
+ * rays start at the same point.
+ */
+class PathTracer
+{
+  public:
+    PathTracer(const TriangleBvh& bvh, const Capture& capture, const std::vector<uint32_t>& triangle_vertices,
+               const LightmapBakeSettings& settings, float scene_size)
+        : bvh_(bvh), capture_(capture), triangle_vertices_(triangle_vertices), settings_(settings),
+          far_(scene_size * 2.0f + 1.0f), offset_(std::max(scene_size, 1.0f) * 1e-4f)
+    {
+    }
+
+    glm::vec3 Trace(const SurfaceTexel& texel, uint64_t& rays) const;
+
+  private:
+    glm::vec3 Albedo(uint32_t triangle, float u, float v) const;
+    glm::vec3 SunDirection(uint32_t& state) const;
+
+  private:
+    const TriangleBvh& bvh_;
+    const Capture& capture_;
+    const std::vector<uint32_t>& triangle_vertices_;
+    const LightmapBakeSettings& settings_;
+    float far_;
+    float offset_; // Rays start this far off the surface
+};
+
+glm::vec3 PathTracer::Trace(const SurfaceTexel& texel, uint64_t& rays) const
+{
+    constexpr uint32_t kLanes = RayPacket::kSize;
+    const uint32_t packets = std::max(1u, (settings_.samples + kLanes - 1) / kLanes);
+    uint32_t state = texel.atlas * 2654435761u + 0x6C8E9CF5u;
+    state = state != 0 ? state : 1;
+
+    glm::vec3 total(0.0f);
+    for (uint32_t packet = 0; packet < packets; packet++)
+    {
+        std::array<glm::vec3, kLanes> points;
+        std::array<glm::vec3, kLanes> normals;
+        std::array<glm::vec3, kLanes> throughput;
+        std::array<glm::vec3, kLanes> radiance;
+        points.fill(texel.position);
+        normals.fill(texel.normal);
+        throughput.fill(glm::vec3(1.0f));
+        radiance.fill(glm::vec3(0.0f));
+
+        uint8_t active = 0xFF;
+        for (uint32_t bounce = 0; active != 0 && bounce <= settings_.bounces; bounce++)
+        {
+            RayPacket shadow;
+            shadow.active = 0;
+            std::array<float, kLanes> cosines{};
+            for (uint32_t lane = 0; lane < kLanes; lane++)
+            {
+                const glm::vec3 sun = SunDirection(state);
+                cosines[lane] = glm::dot(normals[lane], sun);
+                if ((active & (1u << lane)) && cosines[lane] > 0.0f)
+                {
+                    shadow.SetRay(lane, points[lane] + normals[lane] * offset_, sun, far_);
+                    shadow.active |= 1u << lane;
+                }
+            }
+            if (shadow.active != 0)
+            {
+                const uint8_t lit = shadow.active & ~bvh_.Occluded(shadow);
+                rays += std::popcount(shadow.active);
+                for (uint32_t lane = 0; lane < kLanes; lane++)
+                {
+                    if (lit & (1u << lane))
+                    {
+                        radiance[lane] = radiance[lane] + throughput[lane] * settings_.sun_color * cosines[lane];
+                    }
+                }
+            }
+
+            RayPacket rays_out;
+            rays_out.active = active;
+            for (uint32_t lane = 0; lane < kLanes; lane++)
+            {
+                const glm::vec3 direction = CosineDirection(normals[lane], Random(state), Random(state));
+                rays_out.SetRay(lane, points[lane] + normals[lane] * offset_, direction, far_);
+            }
+            bvh_.Intersect(rays_out);
+            rays += std::popcount(active);
+
+            for (uint32_t lane = 0; lane < kLanes; lane++)
+            {
+                if (!(active & (1u << lane)))
+                {
+                    continue;
+                }
+                const uint32_t triangle = rays_out.triangle[lane];
+                if (triangle == RayPacket::kNoHit)
+                {
+                    radiance[lane] = radiance[lane] + throughput[lane] * settings_.sky_color;
+                    active &= ~(1u << lane);
+                    continue;
+                }
+                if (bounce == settings_.bounces)
+                {
+                    active &= ~(1u << lane);
+                    continue;
+                }
+
+                const glm::vec3 direction(rays_out.direction[0][lane], rays_out.direction[1][lane],
+                                          rays_out.direction[2][lane]);
+                const glm::vec3 *corners = bvh_.Corners(triangle);
+                glm::vec3 normal = glm::normalize(glm::cross(corners[1] - corners[0], corners[2] - corners[0]));
+                if (glm::dot(normal, direction) > 0.0f)
+                {
+                    normal = normal * -1.0f;
+                }
+                points[lane] = points[lane] + normals[lane] * offset_ + direction * rays_out.t_max[lane];
+                normals[lane] = normal;
+                throughput[lane] = throughput[lane] * Albedo(triangle, rays_out.u[lane], rays_out.v[lane]);
+            }
+        }
+
+        for (const glm::vec3& lane : radiance)
+        {
+            total = total + lane;
+        }
+    }
+    return total / static_cast<float>(packets * kLanes);
+}
+
+glm::vec3 PathTracer::Albedo(uint32_t triangle, float u, float v) const
+{
+    const uint32_t *vertices = &triangle_vertices_[bvh_.Source(triangle) * 3];
+    return capture_.vertices[vertices[0]].color * (1.0f - u - v) + capture_.vertices[vertices[1]].color * u +
+           capture_.vertices[vertices[2]].color * v;
+}
+
+// The sun is a small disc, so shadows soften with the distance to what casts them
+glm::vec3 PathTracer::SunDirection(uint32_t& state) const
+{
+    const glm::vec3 jitter(Random(state) - 0.5f, Random(state) - 0.5f, Random(state) - 0.5f);
+    return glm::normalize(settings_.sun_direction + jitter * (2.0f * settings_.sun_radius));
+}
+
+/**
+ * @brief Places the charts on shelves, tallest first, in an atlas as wide as the smallest power of two that fits.
+ */
+void PackCharts(Lightmap& lightmap)
+{
+    uint64_t area = 0;
+    uint32_t widest = 1;
+    std::vector<uint32_t> order(lightmap.charts.size());
+    for (uint32_t i = 0; i < lightmap.charts.size(); i++)
+    {
+        area += static_cast<uint64_t>(lightmap.charts[i].width) * lightmap.charts[i].height;
+        widest = std::max(widest, lightmap.charts[i].width);
+        order[i] = i;
+    }
+    // Shelves waste some space at their ends and above their shorter charts
+    lightmap.width = std::bit_ceil(std::max(widest, static_cast<uint32_t>(std::sqrt(area * 1.25))));
+    if (lightmap.width > kMaxAtlasWidth)
+    {
+        throw ChimException("Failed to bake the lightmap: the atlas would be too large, lower --texels-per-unit!");
+    }
+
+    std::sort(order.begin(), order.end(), [&lightmap](uint32_t a, uint32_t b) {
+        const LightmapChart& first = lightmap.charts[a];
+        const LightmapChart& second = lightmap.charts[b];
+        return first.height != second.height ? first.height > second.height : first.width > second.width;
+    });
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t shelfHeight = 0;
+    for (uint32_t i : order)
+    {
+        LightmapChart& chart = lightmap.charts[i];
+        if (x + chart.width > lightmap.width)
+        {
+            x = 0;
+            y += shelfHeight;
+            shelfHeight = 0;
+        }
+        chart.x = x;
+        chart.y = y;
+        x += chart.width;
+        shelfHeight = std::max(shelfHeight, chart.height);
+    }
+    lightmap.height = y + shelfHeight;
+}
+} // namespace
+
+glm::vec3 Lightmap::Texel(uint32_t x, uint32_t y) const
+{
+    return FromRgbe(texels[static_cast<size_t>(y) * width + x]);
+}
+
+/**
+ * @brief Bilinear sample of the chart at a position on its triangles.
+ */
+glm::vec3 Lightmap::Sample(const LightmapChart& chart, const glm::vec3& position) const
+{
+    const glm::vec2 plane = (Project(position, chart.direction) - chart.plane_min) * texels_per_unit;
+    const float x = std::clamp(chart.x + kBorder + plane.x - 0.5f, static_cast<float>(chart.x),
+                               static_cast<float>(chart.x + chart.width - 1));
+    const float y = std::clamp(chart.y + kBorder + plane.y - 0.5f, static_cast<float>(chart.y),
+                               static_cast<float>(chart.y + chart.height - 1));
+    const uint32_t x0 = static_cast<uint32_t>(x);
+    const uint32_t y0 = static_cast<uint32_t>(y);
+    const uint32_t x1 = std::min(x0 + 1, chart.x + chart.width - 1);
+    const uint32_t y1 = std::min(y0 + 1, chart.y + chart.height - 1);
+    const float fx = x - x0;
+    const float fy = y - y0;
+    return (Texel(x0, y0) * (1.0f - fx) + Texel(x1, y0) * fx) * (1.0f - fy) +
+           (Texel(x0, y1) * (1.0f - fx) + Texel(x1, y1) * fx) * fy;
+}
+
+std::vector<uint8_t> Lightmap::Encode(void) const
+{
+    PayloadWriter out;
+    out.Put(kVersion);
+    out.Put(width);
+    out.Put(height);
+    out.Put(texels_per_unit);
+    out.Put(settings_hash);
+    out.Put(static_cast<uint32_t>(charts.size()));
+    for (const LightmapChart& chart : charts)
+    {
+        out.Put(chart.object);
+        out.Put(chart.direction);
+        out.Put(chart.hash);
+        out.Put(chart.min);
+        out.Put(chart.max);
+        out.Put(chart.plane_min);
+        out.Put(chart.x);
+        out.Put(chart.y);
+        out.Put(chart.width);
+        out.Put(chart.height);
+    }
+    out.Put(texels.data(), texels.size() * sizeof(uint32_t));
+    return std::move(out.Bytes());
+}
+
+Lightmap Lightmap::Decode(const std::vector<uint8_t>& payload)
+{
+    PayloadReader in(payload);
+    if (in.Get<uint32_t>() != kVersion)
+    {
+        throw ChimException("Unsupported lightmap record version!");
+    }
+
+    Lightmap lightmap;
+    lightmap.width = in.Get<uint32_t>();
+    lightmap.height = in.Get<uint32_t>();
+    lightmap.texels_per_unit = in.Get<float>();
+    lightmap.settings_hash = in.Get<uint64_t>();
+    if (static_cast<uint64_t>(lightmap.width) * lightmap.height * sizeof(uint32_t) > payload.size())
+    {
+        throw ChimException("Malformed lightmap record!");
+    }
+
+    lightmap.charts.resize(std::min<size_t>(in.Get<uint32_t>(), payload.size()));
+    for (LightmapChart& chart : lightmap.charts)
+    {
+        chart.object = in.Get<DrawCommand>();
+        chart.direction = in.Get<uint32_t>();
+        chart.hash = in.Get<uint64_t>();
+        chart.min = in.Get<glm::vec3>();
+        chart.max = in.Get<glm::vec3>();
+        chart.plane_min = in.Get<glm::vec2>();
+        chart.x = in.Get<uint32_t>();
+        chart.y = in.Get<uint32_t>();
+        chart.width = in.Get<uint32_t>();
+        chart.height = in.Get<uint32_t>();
+        if (chart.direction >= 6 || chart.width == 0 || chart.height == 0 || chart.x + chart.width > lightmap.width ||
+            chart.y + chart.height > lightmap.height)
+        {
+            throw ChimException("Malformed lightmap record!");
+        }
+    }
+
+    lightmap.texels.resize(static_cast<size_t>(lightmap.width) * lightmap.height);
+    in.Get(lightmap.texels.data(), lightmap.texels.size() * sizeof(uint32_t));
+    return lightmap;
+}
+
+/**
+ * @brief Path traces the static lighting of a capture's scene into a lightmap atlas.
+ * @details The draws of the capture are the static objects. Their triangles are grouped into charts by the axis their
+ * normals are closest to and projected along it, which never overlaps for flat and box-like geometry, and the charts
+ * are packed into one atlas. Every texel whose centre lies on a triangle is path traced (see PathTracer) on a pool of
+ * threads taking 64 texels at a time. The result is denoised within each chart by a few passes of an edge-avoiding
+ * a-trous filter that stops at changes in brightness and normal, and then grown into the empty texels around the
+ * triangles so that filtering never reads black.
+ *
+ * With a previous bake made with the same settings, a chart is copied instead of traced when its geometry did not
+ * change and nothing that did change lies within rebake_distance of it, since geometry only shadows or reflects onto
+ * what is near.
+ */
+Lightmap chim::BakeLightmap(const Capture& capture, const LightmapBakeSettings& settings, LightmapBakeStats& stats)
+{
+    stats = {};
+    Lightmap lightmap;
+
+    // The scene as one triangle soup for the BVH, and the triangles of every chart
+    const std::vector<DrawCommand> objects = CapturedObjects(capture);
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> triangleObjects;
+    std::vector<uint32_t> triangleVertices;
+    std::vector<std::vector<uint32_t>> chartVertices;
+    glm::vec3 sceneMin(std::numeric_limits<float>::max());
+    glm::vec3 sceneMax(-std::numeric_limits<float>::max());
+    for (uint32_t object = 0; object < objects.size(); object++)
+    {
+        const std::vector<uint32_t> vertices = DrawTriangleVertices(capture, objects[object]);
+        std::array<std::vector<uint32_t>, 6> byDirection;
+        for (size_t i = 0; i + 2 < vertices.size(); i += 3)
+        {
+            glm::vec3 corners[3];
+            for (int corner = 0; corner < 3; corner++)
+            {
+                corners[corner] = capture.vertices[vertices[i + corner]].pos;
+            }
+            std::optional<uint32_t> direction = ChartDirection(corners);
+            if (!direction)
+            {
+                continue;
+            }
+            std::vector<uint32_t>& chart = byDirection[*direction];
+            chart.insert(chart.end(), vertices.begin() + i, vertices.begin() + i + 3);
+            positions.insert(positions.end(), corners, corners + 3);
+            triangleObjects.push_back(object);
+            triangleVertices.insert(triangleVertices.end(), vertices.begin() + i, vertices.begin() + i + 3);
+        }
+
+        for (uint32_t direction = 0; direction < byDirection.size(); direction++)
+        {
+            if (byDirection[direction].empty())
+            {
+                continue;
+            }
+            LightmapChart chart;
+            chart.object = objects[object];
+            chart.direction = direction;
+            chart.min = glm::vec3(std::numeric_limits<float>::max());
+            chart.max = glm::vec3(-std::numeric_limits<float>::max());
+            chart.hash = Hash(kHashSeed, &direction, sizeof(direction));
+            for (uint32_t vertex : byDirection[direction])
+            {
+                const Vertex& data = capture.vertices[vertex];
+                chart.min = glm::min(chart.min, data.pos);
+                chart.max = glm::max(chart.max, data.pos);
+                chart.hash = Hash(chart.hash, &data.pos, sizeof(data.pos));
+                chart.hash = Hash(chart.hash, &data.color, sizeof(data.color));
+            }
+            sceneMin = glm::min(sceneMin, chart.min);
+            sceneMax = glm::max(sceneMax, chart.max);
+            lightmap.charts.push_back(chart);
+            chartVertices.push_back(std::move(byDirection[direction]));
+        }
+    }
+    if (positions.empty())
+    {
+        throw ChimException("Failed to bake the lightmap: the capture has no geometry!");
+    }
+    const float sceneSize = glm::length(sceneMax - sceneMin);
+
+    TriangleBvh bvh;
+    bvh.Build(positions, triangleObjects);
+
+    // Chart sizes, at a density that gives the whole atlas about kAutoTexels texels unless one was asked for. Rebakes
+    // keep the density of the previous bake, which would otherwise drift with every change and invalidate every chart
+    float texelsPerUnit = settings.texels_per_unit;
+    if (texelsPerUnit <= 0.0f && settings.previous != nullptr)
+    {
+        texelsPerUnit = settings.previous->texels_per_unit;
+    }
+    if (texelsPerUnit <= 0.0f)
+    {
+        double area = 0.0;
+        for (const LightmapChart& chart : lightmap.charts)
+        {
+            const glm::vec2 extent = Project(chart.max, chart.direction) - Project(chart.min, chart.direction);
+            area += std::max(extent.x, 1e-3f * sceneSize) * std::max(extent.y, 1e-3f * sceneSize);
+        }
+        texelsPerUnit = static_cast<float>(std::sqrt(LightmapBakeSettings::kAutoTexels / std::max(area, 1e-12)));
+    }
+    lightmap.texels_per_unit = texelsPerUnit;
+    for (LightmapChart& chart : lightmap.charts)
+    {
+        chart.plane_min = Project(chart.min, chart.direction);
+        const glm::vec2 extent = Project(chart.max, chart.direction) - chart.plane_min;
+        chart.width = std::max(1u, static_cast<uint32_t>(std::ceil(extent.x * texelsPerUnit))) + 2 * Lightmap::kBorder;
+        chart.height = std::max(1u, static_cast<uint32_t>(std::ceil(extent.y * texelsPerUnit))) + 2 * Lightmap::kBorder;
+    }
+
+    lightmap.settings_hash = Hash(kHashSeed, &texelsPerUnit, sizeof(texelsPerUnit));
+    for (const glm::vec3& value : {settings.sun_direction, settings.sun_color, settings.sky_color})
+    {
+        lightmap.settings_hash = Hash(lightmap.settings_hash, &value, sizeof(value));
+    }
+    for (uint32_t value : {settings.samples, settings.bounces, settings.denoise_passes})
+    {
+        lightmap.settings_hash = Hash(lightmap.settings_hash, &value, sizeof(value));
+    }
+    lightmap.settings_hash = Hash(lightmap.settings_hash, &settings.sun_radius, sizeof(settings.sun_radius));
+
+    // Charts of the previous bake that can be kept: same geometry, and nothing changed near them
+    std::vector<const LightmapChart *> reused(lightmap.charts.size(), nullptr);
+    const Lightmap *previous = settings.previous;
+    if (previous != nullptr && previous->settings_hash == lightmap.settings_hash)
+    {
+        std::vector<std::pair<glm::vec3, glm::vec3>> changed;
+        std::vector<bool> matched(previous->charts.size(), false);
+        for (size_t i = 0; i < lightmap.charts.size(); i++)
+        {
+            const LightmapChart& chart = lightmap.charts[i];
+            auto old = std::find_if(previous->charts.begin(), previous->charts.end(), [&chart](const LightmapChart& c) {
+                return c.object == chart.object && c.direction == chart.direction;
+            });
+            if (old != previous->charts.end())
+            {
+                matched[old - previous->charts.begin()] = true;
+                if (old->hash == chart.hash && old->width == chart.width && old->height == chart.height)
+                {
+                    reused[i] = &*old;
+                    continue;
+                }
+                changed.emplace_back(old->min, old->max);
+            }
+            changed.emplace_back(chart.min, chart.max);
+        }
+        for (size_t i = 0; i < previous->charts.size(); i++)
+        {
+            if (!matched[i])
+            {
+                changed.emplace_back(previous->charts[i].min, previous->charts[i].max);
+            }
+        }
+
+        const glm::vec3 reach(settings.rebake_distance > 0.0f ? settings.rebake_distance : sceneSize * 0.25f);
+        for (size_t i = 0; i < lightmap.charts.size(); i++)
+        {
+            for (size_t j = 0; j < changed.size() && reused[i] != nullptr; j++)
+            {
+                if (BoxesOverlap(lightmap.charts[i].min - reach, lightmap.charts[i].max + reach, changed[j].first,
+                                 changed[j].second))
+                {
+                    reused[i] = nullptr;
+                }
+            }
+        }
+    }
+
+    PackCharts(lightmap);
+    const size_t atlasSize = static_cast<size_t>(lightmap.width) * lightmap.height;
+    lightmap.texels.assign(atlasSize, 0);
+
+    // Find the surface under every texel of the charts to bake
+    std::vector<uint32_t> owner(atlasSize, kNoChart);
+    std::vector<glm::vec3> normals(atlasSize, glm::vec3(0.0f));
+    std::vector<SurfaceTexel> surface;
+    for (uint32_t i = 0; i < lightmap.charts.size(); i++)
+    {
+        const LightmapChart& chart = lightmap.charts[i];
+        if (reused[i] != nullptr)
+        {
+            for (uint32_t row = 0; row < chart.height; row++)
+            {
+                std::copy_n(previous->texels.begin() + static_cast<size_t>(reused[i]->y + row) * previous->width +
+                                reused[i]->x,
+                            chart.width,
+                            lightmap.texels.begin() + static_cast<size_t>(chart.y + row) * lightmap.width + chart.x);
+            }
+            stats.charts_reused++;
+            continue;
+        }
+        stats.charts_baked++;
+
+        const std::vector<uint32_t>& vertices = chartVertices[i];
+        for (size_t t = 0; t + 2 < vertices.size(); t += 3)
+        {
+            glm::vec3 corners[3];
+            glm::vec2 texel[3];
+            for (int corner = 0; corner < 3; corner++)
+            {
+                corners[corner] = capture.vertices[vertices[t + corner]].pos;
+                texel[corner] = (Project(corners[corner], chart.direction) - chart.plane_min) * texelsPerUnit +
+                                glm::vec2(static_cast<float>(Lightmap::kBorder));
+            }
+            const float area = (texel[1].x - texel[0].x) * (texel[2].y - texel[0].y) -
+                               (texel[1].y - texel[0].y) * (texel[2].x - texel[0].x);
+            if (std::abs(area) < 1e-12f)
+            {
+                continue;
+            }
+            const glm::vec3 normal = glm::normalize(glm::cross(corners[1] - corners[0], corners[2] - corners[0]));
+
+            const glm::vec2 low = glm::min(texel[0], glm::min(texel[1], texel[2]));
+            const glm::vec2 high = glm::max(texel[0], glm::max(texel[1], texel[2]));
+            const uint32_t left = static_cast<uint32_t>(std::max(0.0f, std::floor(low.x)));
+            const uint32_t top = static_cast<uint32_t>(std::max(0.0f, std::floor(low.y)));
+            const uint32_t right = std::min(chart.width - 1, static_cast<uint32_t>(std::max(0.0f, high.x)));
+            const uint32_t bottom = std::min(chart.height - 1, static_cast<uint32_t>(std::max(0.0f, high.y)));
+            for (uint32_t y = top; y <= bottom; y++)
+            {
+                for (uint32_t x = left; x <= right; x++)
+                {
+                    const glm::vec2 centre(x + 0.5f, y + 0.5f);
+                    float weights[3];
+                    for (int e = 0; e < 3; e++)
+                    {
+                        const glm::vec2& a = texel[(e + 1) % 3];
+                        const glm::vec2& b = texel[(e + 2) % 3];
+                        weights[e] = ((b.x - a.x) * (centre.y - a.y) - (b.y - a.y) * (centre.x - a.x)) / area;
+                    }
+                    const size_t atlas = static_cast<size_t>(chart.y + y) * lightmap.width + chart.x + x;
+                    if (weights[0] < -1e-5f || weights[1] < -1e-5f || weights[2] < -1e-5f || owner[atlas] == i)
+                    {
+                        continue;
+                    }
+                    owner[atlas] = i;
+                    normals[atlas] = normal;
+                    surface.push_back({static_cast<uint32_t>(atlas),
+                                       corners[0] * weights[0] + corners[1] * weights[1] + corners[2] * weights[2],
+                                       normal});
+                }
+            }
+        }
+    }
+
+    // Trace on every core
+    std::vector<glm::vec3> radiance(atlasSize, glm::vec3(0.0f));
+    const PathTracer tracer(bvh, capture, triangleVertices, settings, sceneSize);
+    std::atomic<size_t> nextTexel{0};
+    std::atomic<uint64_t> rays{0};
+    auto traceTexels = [&]() {
+        uint64_t traced = 0;
+        for (size_t first = nextTexel.fetch_add(kTexelsPerJob); first < surface.size();
+             first = nextTexel.fetch_add(kTexelsPerJob))
+        {
+            for (size_t i = first; i < std::min(first + kTexelsPerJob, surface.size()); i++)
+            {
+                radiance[surface[i].atlas] = tracer.Trace(surface[i], traced);
+            }
+        }
+        rays += traced;
+    };
+    const uint32_t threads =
+        settings.threads > 0 ? settings.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::future<void>> workers;
+    for (uint32_t i = 1; i < threads; i++)
+    {
+        workers.push_back(std::async(std::launch::async, traceTexels));
+    }
+    traceTexels();
+    for (std::future<void>& worker : workers)
+    {
+        worker.get();
+    }
+    stats.texels_traced = surface.size();
+    stats.rays = rays;
+
+    // Edge-avoiding a-trous passes, each with twice the reach of the last
+    const float kernel[5] = {1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+    std::vector<glm::vec3> filtered(atlasSize);
+    for (uint32_t pass = 0; pass < settings.denoise_passes; pass++)
+    {
+        const int step = 1 << pass;
+        for (const SurfaceTexel& texel : surface)
+        {
+            const int x = static_cast<int>(texel.atlas % lightmap.width);
+            const int y = static_cast<int>(texel.atlas / lightmap.width);
+            const float luminance = Luminance(radiance[texel.atlas]);
+            glm::vec3 sum(0.0f);
+            float weightSum = 0.0f;
+            for (int dy = -2; dy <= 2; dy++)
+            {
+                for (int dx = -2; dx <= 2; dx++)
+                {
+                    const int nx = x + dx * step;
+                    const int ny = y + dy * step;
+                    if (nx < 0 || ny < 0 || nx >= static_cast<int>(lightmap.width) ||
+                        ny >= static_cast<int>(lightmap.height))
+                    {
+                        continue;
+                    }
+                    const size_t neighbour = static_cast<size_t>(ny) * lightmap.width + nx;
+                    if (owner[neighbour] != owner[texel.atlas])
+                    {
+                        continue;
+                    }
+                    const float difference = std::abs(Luminance(radiance[neighbour]) - luminance);
+                    const float weight = kernel[dx + 2] * kernel[dy + 2] *
+                                         std::exp(-difference / (0.25f * luminance + 0.01f)) *
+                                         std::pow(std::max(0.0f, glm::dot(normals[neighbour], texel.normal)), 16.0f);
+                    sum = sum + radiance[neighbour] * weight;
+                    weightSum += weight;
+                }
+            }
+            filtered[texel.atlas] = weightSum > 0.0f ? sum / weightSum : radiance[texel.atlas];
+        }
+        for (const SurfaceTexel& texel : surface)
+        {
+            radiance[texel.atlas] = filtered[texel.atlas];
+        }
+    }
+
+    // Grow every chart into its empty texels, one ring per pass, so filtering at triangle edges never reads black
+    for (uint32_t pass = 0; pass <= Lightmap::kBorder; pass++)
+    {
+        std::vector<uint32_t> grown = owner;
+        for (uint32_t i = 0; i < lightmap.charts.size(); i++)
+        {
+            const LightmapChart& chart = lightmap.charts[i];
+            if (reused[i] != nullptr)
+            {
+                continue;
+            }
+            for (uint32_t y = chart.y; y < chart.y + chart.height; y++)
+            {
+                for (uint32_t x = chart.x; x < chart.x + chart.width; x++)
+                {
+                    const size_t atlas = static_cast<size_t>(y) * lightmap.width + x;
+                    if (owner[atlas] != kNoChart)
+                    {
+                        continue;
+                    }
+                    glm::vec3 sum(0.0f);
+                    uint32_t count = 0;
+                    for (uint32_t ny = std::max(y, chart.y + 1) - 1; ny <= std::min(y + 1, chart.y + chart.height - 1);
+                         ny++)
+                    {
+                        for (uint32_t nx = std::max(x, chart.x + 1) - 1;
+                             nx <= std::min(x + 1, chart.x + chart.width - 1); nx++)
+                        {
+                            const size_t neighbour = static_cast<size_t>(ny) * lightmap.width + nx;
+                            if (owner[neighbour] == i)
+                            {
+                                sum = sum + radiance[neighbour];
+                                count++;
+                            }
+                        }
+                    }
+                    if (count > 0)
+                    {
+                        radiance[atlas] = sum / static_cast<float>(count);
+                        grown[atlas] = i;
+                    }
+                }
+            }
+        }
+        owner = std::move(grown);
+    }
+
+    for (uint32_t i = 0; i < lightmap.charts.size(); i++)
+    {
+        const LightmapChart& chart = lightmap.charts[i];
+        if (reused[i] != nullptr)
+        {
+            continue;
+        }
+        for (uint32_t y = chart.y; y < chart.y + chart.height; y++)
+        {
+            for (uint32_t x = chart.x; x < chart.x + chart.width; x++)
+            {
+                const size_t atlas = static_cast<size_t>(y) * lightmap.width + x;
+                lightmap.texels[atlas] = ToRgbe(radiance[atlas]);
+            }
+        }
+    }
+    return lightmap;
+}
+
+/**
+ * @brief Multiplies the colour of every vertex of the capture by the light baked at it.
+ * @details The scene pass has neither texture coordinates nor samplers, so the lightmap is resolved at the vertices
+ * once, when the capture is loaded, and the rasterizer interpolates it between them. Vertices shared by several
+ * charts take the average.
+ */
+void chim::ApplyLightmap(const Lightmap& lightmap, Capture& capture)
+{
+    std::vector<glm::vec3> light(capture.vertices.size(), glm::vec3(0.0f));
+    std::vector<uint32_t> count(capture.vertices.size(), 0);
+    for (const LightmapChart& chart : lightmap.charts)
+    {
+        const std::vector<uint32_t> vertices = DrawTriangleVertices(capture, chart.object);
+        for (size_t i = 0; i + 2 < vertices.size(); i += 3)
+        {
+            glm::vec3 corners[3];
+            for (int corner = 0; corner < 3; corner++)
+            {
+                corners[corner] = capture.vertices[vertices[i + corner]].pos;
+            }
+            if (ChartDirection(corners) != chart.direction)
+            {
+                continue;
+            }
+            for (int corner = 0; corner < 3; corner++)
+            {
+                light[vertices[i + corner]] = light[vertices[i + corner]] + lightmap.Sample(chart, corners[corner]);
+                count[vertices[i + corner]]++;
+            }
+        }
+    }
+
+    for (size_t vertex = 0; vertex < capture.vertices.size(); vertex++)
+    {
+        if (count[vertex] > 0)
+        {
+            capture.vertices[vertex].color =
+                capture.vertices[vertex].color * (light[vertex] / static_cast<float>(count[vertex]));
+        }
+    }
+}
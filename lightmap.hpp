@@ -0,0 +1,90 @@
+/**
+ * @file lightmap.hpp
+ * @author George Power
+ * @brief Static lighting path traced offline into a lightmap atlas.
+ */
+#ifndef LIGHTMAP_HPP
+#define LIGHTMAP_HPP
+
+#include "render_types.hpp"
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace chim
+{
+struct Capture;
+
+/**
+ * @struct LightmapChart
+ * @brief The triangles of one draw that face the same way, projected along that axis into a rectangle of the atlas.
+ */
+struct LightmapChart
+{
+    DrawCommand object{};       // The draw, as it was captured
+    uint32_t direction = 0;     // Axis the triangles' normals are closest to, times two, plus one when negative
+    uint64_t hash = 0;          // Of the triangles and their colours, to find what changed since the last bake
+    glm::vec3 min{0.0f};        // Bounds of the triangles
+    glm::vec3 max{0.0f};
+    glm::vec2 plane_min{0.0f};  // Smallest projected coordinates, at the inner corner of the border
+    uint32_t x = 0;             // Rectangle in the atlas, border included
+    uint32_t y = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+/**
+ * @struct Lightmap
+ * @brief Atlas of charts holding the light arriving at every texel, as a factor of the surface's own colour.
+ * @details Texels are stored as RGBE, 8 bits per channel with a shared exponent, so bright and dim areas keep the
+ * same relative precision at a quarter of the size of floats. Every chart has a border of kBorder texels filled from
+ * its edges, so that filtering at the edge of a chart never reads a neighbour.
+ */
+struct Lightmap
+{
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint32_t kBorder = 1;
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    float texels_per_unit = 0.0f;
+    uint64_t settings_hash = 0; // Of the lighting and sampling settings; a bake only reuses texels baked with the same
+    std::vector<LightmapChart> charts;
+    std::vector<uint32_t> texels; // RGBE, width * height
+
+    glm::vec3 Texel(uint32_t x, uint32_t y) const;
+    glm::vec3 Sample(const LightmapChart& chart, const glm::vec3& position) const;
+
+    std::vector<uint8_t> Encode(void) const;
+    static Lightmap Decode(const std::vector<uint8_t>& payload);
+};
+
+struct LightmapBakeSettings
+{
+    static constexpr uint32_t kAutoTexels = 1u << 17;
+
+    float texels_per_unit = 0.0f; // 0 picks the density that gives the atlas about kAutoTexels texels
+    uint32_t samples = 64;        // Paths per texel, rounded up to whole packets
+    uint32_t bounces = 2;         // Indirect bounces after the first hit
+    glm::vec3 sun_direction{0.4f, 0.3f, 0.866f}; // Towards the sun, normalized
+    glm::vec3 sun_color{0.75f, 0.7f, 0.6f};
+    float sun_radius = 0.01f; // Angular radius in radians, for soft shadow edges
+    glm::vec3 sky_color{0.3f, 0.35f, 0.45f};
+    uint32_t denoise_passes = 3;
+    float rebake_distance = 0.0f; // How far changed geometry affects the lighting; 0 uses a quarter of the scene
+    uint32_t threads = 0;         // 0 uses every hardware thread
+    const Lightmap *previous = nullptr; // Earlier bake to keep the unaffected charts of
+};
+
+struct LightmapBakeStats
+{
+    uint32_t charts_baked = 0;
+    uint32_t charts_reused = 0;
+    uint64_t texels_traced = 0;
+    uint64_t rays = 0;
+};
+
+Lightmap BakeLightmap(const Capture& capture, const LightmapBakeSettings& settings, LightmapBakeStats& stats);
+void ApplyLightmap(const Lightmap& lightmap, Capture& capture);
+} // namespace chim
+#endif // LIGHTMAP_HPP
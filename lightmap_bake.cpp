@@ -0,0 +1,111 @@
+#include "capture.hpp"
+#include "lightmap.hpp"
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <string>
+
+namespace
+{
+constexpr const char *kUsage =
+    "Usage: chim_lightmap [options] <capture>\n"
+    "  --texels-per-unit <n>  Lightmap density (default: whatever gives about 128K texels)\n"
+    "  --samples <count>      Paths per texel (default 64)\n"
+    "  --bounces <count>      Indirect bounces (default 2)\n"
+    "  --sun <x> <y> <z>      Direction towards the sun (default 0.4 0.3 0.866)\n"
+    "  --threads <count>      Worker threads (default: one per hardware thread)\n"
+    "  --full                 Bake every chart, even those the capture's last bake still has right";
+} // namespace
+
+/**
+ * @brief Bakes the static lighting of a capture's scene into a lightmap and stores it in the capture.
+ * @details Baking a capture that already holds a lightmap only traces the charts that changed or lie near a change,
+ * unless the settings differ or --full is given. Replays apply the stored lightmap to the scene.
+ */
+int main(int argc, char *argv[])
+{
+    chim::LightmapBakeSettings settings;
+    bool full = false;
+    std::string path;
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string option = argv[i];
+            if (option == "--texels-per-unit" && i + 1 < argc)
+            {
+                settings.texels_per_unit = std::stof(argv[++i]);
+            }
+            else if (option == "--samples" && i + 1 < argc)
+            {
+                settings.samples = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (option == "--bounces" && i + 1 < argc)
+            {
+                settings.bounces = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (option == "--sun" && i + 3 < argc)
+            {
+                settings.sun_direction.x = std::stof(argv[++i]);
+                settings.sun_direction.y = std::stof(argv[++i]);
+                settings.sun_direction.z = std::stof(argv[++i]);
+                if (glm::length(settings.sun_direction) <= 0.0f)
+                {
+                    throw std::invalid_argument(option);
+                }
+                settings.sun_direction = glm::normalize(settings.sun_direction);
+            }
+            else if (option == "--threads" && i + 1 < argc)
+            {
+                settings.threads = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (option == "--full")
+            {
+                full = true;
+            }
+            else if (option.rfind("--", 0) == 0 || !path.empty())
+            {
+                throw std::invalid_argument(option);
+            }
+            else
+            {
+                path = option;
+            }
+        }
+    }
+    catch (std::exception&)
+    {
+        path.clear();
+    }
+    if (path.empty())
+    {
+        std::cerr << kUsage << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        chim::Capture capture = chim::LoadCapture(path);
+        if (capture.lightmap && !full)
+        {
+            settings.previous = &*capture.lightmap;
+        }
+        chim::LightmapBakeStats stats;
+        auto start = std::chrono::steady_clock::now();
+        chim::Lightmap lightmap = chim::BakeLightmap(capture, settings, stats);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<uint8_t> payload = lightmap.Encode();
+        chim::ReplaceCaptureRecord(path, chim::CaptureOp::Lightmap, payload);
+        std::cout << "Baked " << stats.charts_baked << " charts and kept " << stats.charts_reused << " in a "
+                  << lightmap.width << "x" << lightmap.height << " atlas (" << payload.size() << " bytes): "
+                  << stats.texels_traced << " texels, " << stats.rays << " rays in " << seconds << " s ("
+                  << (seconds > 0.0 ? stats.rays / seconds / 1e6 : 0.0) << " Mrays/s)" << std::endl;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -4,11 +4,9 @@
 
 int main(int argc, char *argv[])
 {
-
-    chim::Chim app;
-
     try
     {
+        chim::Chim app(chim::ParseArguments(argc, argv));
         app.Init();
         app.Run();
         app.Cleanup();
@@ -0,0 +1,802 @@
+#include "path_config.h"
+#include "render_types.hpp"
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace
+{
+void Check(VkResult result, const char *what)
+{
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error(std::string("Failed to ") + what + "!");
+    }
+}
+
+/**
+ * @brief The instance, device and queue shared by all benchmarks, plus the helpers they build on.
+ */
+class BenchContext
+{
+  public:
+    explicit BenchContext(const std::string& device_name)
+    {
+        VkApplicationInfo appInfo{};
+        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        appInfo.pApplicationName = "chim_microbench";
+        appInfo.apiVersion = VK_API_VERSION_1_1;
+        VkInstanceCreateInfo instanceInfo{};
+        instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        instanceInfo.pApplicationInfo = &appInfo;
+        Check(vkCreateInstance(&instanceInfo, nullptr, &instance_), "create instance");
+
+        uint32_t deviceCount = 0;
+        vkEnumeratePhysicalDevices(instance_, &deviceCount, nullptr);
+        std::vector<VkPhysicalDevice> devices(deviceCount);
+        vkEnumeratePhysicalDevices(instance_, &deviceCount, devices.data());
+        for (VkPhysicalDevice device : devices)
+        {
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(device, &properties);
+            bool wanted = device_name.empty() ? properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU
+                                              : std::strstr(properties.deviceName, device_name.c_str()) != nullptr;
+            if (wanted || (physical_device_ == VK_NULL_HANDLE && device_name.empty()))
+            {
+                physical_device_ = device;
+                properties_ = properties;
+            }
+            if (wanted)
+            {
+                break;
+            }
+        }
+        if (physical_device_ == VK_NULL_HANDLE)
+        {
+            throw std::runtime_error("Failed to find a Vulkan device" +
+                                     (device_name.empty() ? std::string() : " named " + device_name) + "!");
+        }
+        vkGetPhysicalDeviceMemoryProperties(physical_device_, &memory_);
+
+        uint32_t familyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_device_, &familyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> families(familyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_device_, &familyCount, families.data());
+        while (queue_family_ < familyCount && !(families[queue_family_].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+        {
+            queue_family_++;
+        }
+        if (queue_family_ == familyCount)
+        {
+            throw std::runtime_error("Failed to find a graphics queue!");
+        }
+
+        float priority = 1.0f;
+        VkDeviceQueueCreateInfo queueInfo{};
+        queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueInfo.queueFamilyIndex = queue_family_;
+        queueInfo.queueCount = 1;
+        queueInfo.pQueuePriorities = &priority;
+        VkDeviceCreateInfo deviceInfo{};
+        deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        deviceInfo.queueCreateInfoCount = 1;
+        deviceInfo.pQueueCreateInfos = &queueInfo;
+        Check(vkCreateDevice(physical_device_, &deviceInfo, nullptr, &device_), "create logical device");
+        vkGetDeviceQueue(device_, queue_family_, 0, &queue_);
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queue_family_;
+        Check(vkCreateCommandPool(device_, &poolInfo, nullptr, &command_pool_), "create command pool");
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        Check(vkCreateFence(device_, &fenceInfo, nullptr, &fence_), "create fence");
+    }
+
+    ~BenchContext()
+    {
+        vkDeviceWaitIdle(device_);
+        vkDestroyFence(device_, fence_, nullptr);
+        vkDestroyCommandPool(device_, command_pool_, nullptr);
+        vkDestroyDevice(device_, nullptr);
+        vkDestroyInstance(instance_, nullptr);
+    }
+
+    VkDevice Device(void) const { return device_; }
+    const char *DeviceName(void) const { return properties_.deviceName; }
+
+    uint32_t FindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags flags) const
+    {
+        for (uint32_t i = 0; i < memory_.memoryTypeCount; i++)
+        {
+            if ((type_filter & (1 << i)) && (memory_.memoryTypes[i].propertyFlags & flags) == flags)
+            {
+                return i;
+            }
+        }
+        throw std::runtime_error("Failed to find suitable memory type!");
+    }
+
+    // A buffer with a dedicated allocation, the way Chim::CreateBuffer makes them
+    void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags, VkBuffer& buffer,
+                      VkDeviceMemory& memory) const
+    {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        Check(vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer), "create buffer");
+
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(device_, buffer, &requirements);
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = requirements.size;
+        allocInfo.memoryTypeIndex = FindMemoryType(requirements.memoryTypeBits, flags);
+        Check(vkAllocateMemory(device_, &allocInfo, nullptr, &memory), "allocate buffer memory");
+        vkBindBufferMemory(device_, buffer, memory, 0);
+    }
+
+    void DestroyBuffer(VkBuffer buffer, VkDeviceMemory memory) const
+    {
+        vkDestroyBuffer(device_, buffer, nullptr);
+        vkFreeMemory(device_, memory, nullptr);
+    }
+
+    void CreateImage(VkFormat format, VkImageUsageFlags usage, VkImage& image, VkDeviceMemory& memory,
+                     VkImageView& view) const
+    {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = format;
+        imageInfo.extent = {kTargetSize, kTargetSize, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = usage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        Check(vkCreateImage(device_, &imageInfo, nullptr, &image), "create image");
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(device_, image, &requirements);
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = requirements.size;
+        allocInfo.memoryTypeIndex = FindMemoryType(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        Check(vkAllocateMemory(device_, &allocInfo, nullptr, &memory), "allocate image memory");
+        vkBindImageMemory(device_, image, memory, 0);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = format;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        Check(vkCreateImageView(device_, &viewInfo, nullptr, &view), "create image view");
+    }
+
+    VkCommandBuffer AllocateCommandBuffer(void) const
+    {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = command_pool_;
+        allocInfo.commandBufferCount = 1;
+        VkCommandBuffer commandBuffer;
+        Check(vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer), "allocate command buffer");
+        return commandBuffer;
+    }
+
+    void FreeCommandBuffer(VkCommandBuffer commandBuffer) const
+    {
+        vkFreeCommandBuffers(device_, command_pool_, 1, &commandBuffer);
+    }
+
+    // The single time command pattern of Chim::BeginSingleTimeCommands and EndSingleTimeCommands
+    VkCommandBuffer BeginSingleTimeCommands(void) const
+    {
+        VkCommandBuffer commandBuffer = AllocateCommandBuffer();
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        return commandBuffer;
+    }
+
+    void EndSingleTimeCommands(VkCommandBuffer commandBuffer) const
+    {
+        vkEndCommandBuffer(commandBuffer);
+        Submit(&commandBuffer, 1);
+        FreeCommandBuffer(commandBuffer);
+    }
+
+    // Submits the command buffers one by one and waits for the last
+    void Submit(const VkCommandBuffer *command_buffers, uint32_t count) const
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            VkSubmitInfo submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &command_buffers[i];
+            Check(vkQueueSubmit(queue_, 1, &submitInfo, i + 1 == count ? fence_ : VK_NULL_HANDLE), "submit");
+        }
+        vkWaitForFences(device_, 1, &fence_, VK_TRUE, UINT64_MAX);
+        vkResetFences(device_, 1, &fence_);
+    }
+
+    VkShaderModule CreateShaderModule(const std::vector<char>& code) const
+    {
+        VkShaderModuleCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = code.size();
+        createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+        VkShaderModule module;
+        Check(vkCreateShaderModule(device_, &createInfo, nullptr, &module), "create shader module");
+        return module;
+    }
+
+    static constexpr uint32_t kTargetSize = 64;
+
+  private:
+    VkInstance instance_ = VK_NULL_HANDLE;
+    VkPhysicalDevice physical_device_ = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties properties_{};
+    VkPhysicalDeviceMemoryProperties memory_{};
+    uint32_t queue_family_ = 0;
+    VkDevice device_ = VK_NULL_HANDLE;
+    VkQueue queue_ = VK_NULL_HANDLE;
+    VkCommandPool command_pool_ = VK_NULL_HANDLE;
+    VkFence fence_ = VK_NULL_HANDLE;
+};
+
+BenchContext *context = nullptr;
+
+std::vector<char> ReadShader(const std::string& name)
+{
+    std::ifstream file(SHADER_DIRECTORY + std::string("/") + name, std::ios::ate | std::ios::binary);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Failed to open file! " + name);
+    }
+    std::vector<char> buffer(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    return buffer;
+}
+
+/**
+ * @brief The scene pass in miniature: colour and motion vector targets, the scene shaders and their uniform buffer,
+ * and a triangle to draw.
+ */
+struct ScenePass
+{
+    VkRenderPass render_pass = VK_NULL_HANDLE;
+    VkImage images[2] = {};
+    VkDeviceMemory image_memory[2] = {};
+    VkImageView views[2] = {};
+    VkFramebuffer framebuffer = VK_NULL_HANDLE;
+    VkDescriptorSetLayout set_layout = VK_NULL_HANDLE;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+    VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+    VkBuffer uniform_buffer = VK_NULL_HANDLE;
+    VkDeviceMemory uniform_memory = VK_NULL_HANDLE;
+    VkBuffer geometry_buffer = VK_NULL_HANDLE; // Vertices, then indices
+    VkDeviceMemory geometry_memory = VK_NULL_HANDLE;
+
+    static constexpr VkFormat kFormats[2] = {VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R16G16_SFLOAT};
+    static constexpr VkDeviceSize kIndexOffset = 3 * sizeof(chim::Vertex);
+
+    ScenePass()
+    {
+        VkDevice device = context->Device();
+        VkAttachmentDescription attachments[2]{};
+        VkAttachmentReference references[2]{};
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            attachments[i].format = kFormats[i];
+            attachments[i].samples = VK_SAMPLE_COUNT_1_BIT;
+            attachments[i].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            attachments[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            attachments[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            attachments[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            attachments[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            attachments[i].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            references[i] = {i, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+            context->CreateImage(kFormats[i], VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, images[i], image_memory[i],
+                                 views[i]);
+        }
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 2;
+        subpass.pColorAttachments = references;
+        VkRenderPassCreateInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = 2;
+        renderPassInfo.pAttachments = attachments;
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        Check(vkCreateRenderPass(device, &renderPassInfo, nullptr, &render_pass), "create render pass");
+
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = render_pass;
+        framebufferInfo.attachmentCount = 2;
+        framebufferInfo.pAttachments = views;
+        framebufferInfo.width = BenchContext::kTargetSize;
+        framebufferInfo.height = BenchContext::kTargetSize;
+        framebufferInfo.layers = 1;
+        Check(vkCreateFramebuffer(device, &framebufferInfo, nullptr, &framebuffer), "create framebuffer");
+
+        VkDescriptorSetLayoutBinding uboBinding{};
+        uboBinding.binding = 0;
+        uboBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        uboBinding.descriptorCount = 1;
+        uboBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        VkDescriptorSetLayoutCreateInfo setLayoutInfo{};
+        setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        setLayoutInfo.bindingCount = 1;
+        setLayoutInfo.pBindings = &uboBinding;
+        Check(vkCreateDescriptorSetLayout(device, &setLayoutInfo, nullptr, &set_layout), "create set layout");
+
+        VkPipelineLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layoutInfo.setLayoutCount = 1;
+        layoutInfo.pSetLayouts = &set_layout;
+        Check(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &layout), "create pipeline layout");
+
+        VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1};
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        Check(vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptor_pool), "create descriptor pool");
+        VkDescriptorSetAllocateInfo setInfo{};
+        setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        setInfo.descriptorPool = descriptor_pool;
+        setInfo.descriptorSetCount = 1;
+        setInfo.pSetLayouts = &set_layout;
+        Check(vkAllocateDescriptorSets(device, &setInfo, &descriptor_set), "allocate descriptor set");
+
+        // Two copies of the uniforms, so that descriptor updates can alternate like frames in flight
+        const VkMemoryPropertyFlags hostVisible =
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        context->CreateBuffer(2 * kUniformStride, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, hostVisible, uniform_buffer,
+                              uniform_memory);
+        WriteDescriptor(0);
+
+        context->CreateBuffer(kIndexOffset + 3 * sizeof(uint16_t),
+                              VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, hostVisible,
+                              geometry_buffer, geometry_memory);
+        const chim::Vertex vertices[3] = {{{0.0f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}},
+                                          {{0.5f, 0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}},
+                                          {{-0.5f, 0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}}};
+        const uint16_t indices[3] = {0, 1, 2};
+        void *data;
+        vkMapMemory(device, geometry_memory, 0, VK_WHOLE_SIZE, 0, &data);
+        memcpy(data, vertices, sizeof(vertices));
+        memcpy(static_cast<char *>(data) + kIndexOffset, indices, sizeof(indices));
+        vkUnmapMemory(device, geometry_memory);
+    }
+
+    ~ScenePass()
+    {
+        VkDevice device = context->Device();
+        context->DestroyBuffer(geometry_buffer, geometry_memory);
+        context->DestroyBuffer(uniform_buffer, uniform_memory);
+        vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+        vkDestroyPipelineLayout(device, layout, nullptr);
+        vkDestroyDescriptorSetLayout(device, set_layout, nullptr);
+        vkDestroyFramebuffer(device, framebuffer, nullptr);
+        vkDestroyRenderPass(device, render_pass, nullptr);
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            vkDestroyImageView(device, views[i], nullptr);
+            vkDestroyImage(device, images[i], nullptr);
+            vkFreeMemory(device, image_memory[i], nullptr);
+        }
+    }
+
+    void WriteDescriptor(uint32_t frame) const
+    {
+        VkDescriptorBufferInfo bufferInfo{uniform_buffer, frame * kUniformStride, sizeof(chim::UniformBufferObject)};
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptor_set;
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        write.pBufferInfo = &bufferInfo;
+        vkUpdateDescriptorSets(context->Device(), 1, &write, 0, nullptr);
+    }
+
+    // Builds the scene pipeline from the scene shaders, with fixed vertex input, the way Chim builds it in one piece
+    VkPipeline CreatePipeline(VkPipelineCache cache) const
+    {
+        VkDevice device = context->Device();
+        VkShaderModule vertModule = context->CreateShaderModule(ReadShader("vert.spv"));
+        VkShaderModule fragModule = context->CreateShaderModule(ReadShader("frag.spv"));
+        VkPipelineShaderStageCreateInfo stages[2]{};
+        stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+        stages[0].module = vertModule;
+        stages[0].pName = "main";
+        stages[1] = stages[0];
+        stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        stages[1].module = fragModule;
+
+        auto bindingDescription = chim::Vertex::GetBindingDescription();
+        auto attributeDescriptions = chim::Vertex::GetAttributeDescriptions();
+        VkPipelineVertexInputStateCreateInfo vertexInput{};
+        vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInput.vertexBindingDescriptionCount = 1;
+        vertexInput.pVertexBindingDescriptions = &bindingDescription;
+        vertexInput.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+        vertexInput.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+        VkViewport viewport{0.0f, 0.0f, BenchContext::kTargetSize, BenchContext::kTargetSize, 0.0f, 1.0f};
+        VkRect2D scissor{{0, 0}, {BenchContext::kTargetSize, BenchContext::kTargetSize}};
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.pViewports = &viewport;
+        viewportState.scissorCount = 1;
+        viewportState.pScissors = &scissor;
+
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+        rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+        rasterizer.lineWidth = 1.0f;
+
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        VkPipelineColorBlendAttachmentState blendAttachments[2]{};
+        for (VkPipelineColorBlendAttachmentState& blend : blendAttachments)
+        {
+            blend.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT |
+                                   VK_COLOR_COMPONENT_A_BIT;
+        }
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.attachmentCount = 2;
+        colorBlending.pAttachments = blendAttachments;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = 2;
+        pipelineInfo.pStages = stages;
+        pipelineInfo.pVertexInputState = &vertexInput;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.layout = layout;
+        pipelineInfo.renderPass = render_pass;
+
+        VkPipeline pipeline;
+        VkResult result = vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, &pipeline);
+        vkDestroyShaderModule(device, fragModule, nullptr);
+        vkDestroyShaderModule(device, vertModule, nullptr);
+        Check(result, "create graphics pipeline");
+        return pipeline;
+    }
+
+    static constexpr VkDeviceSize kUniformStride = 256; // The largest minUniformBufferOffsetAlignment allowed
+};
+
+VkPipelineCache CreatePipelineCache(void)
+{
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    VkPipelineCache cache;
+    Check(vkCreatePipelineCache(context->Device(), &cacheInfo, nullptr, &cache), "create pipeline cache");
+    return cache;
+}
+
+// Buffer creation with a dedicated allocation each, as Chim::CreateBuffer does
+void BM_CreateBuffer(benchmark::State& state)
+{
+    const VkDeviceSize size = static_cast<VkDeviceSize>(state.range(0));
+    for (auto _ : state)
+    {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+        context->CreateBuffer(size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory);
+        context->DestroyBuffer(buffer, memory);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CreateBuffer)->Arg(256)->Arg(64 << 10)->Arg(4 << 20);
+
+// The same buffers bound into one shared allocation with a bump pointer, the alternative to dedicated allocations
+void BM_SuballocateBuffer(benchmark::State& state)
+{
+    constexpr VkDeviceSize kBlockSize = 64 << 20;
+    const VkDeviceSize size = static_cast<VkDeviceSize>(state.range(0));
+    VkDevice device = context->Device();
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkBuffer probe;
+    Check(vkCreateBuffer(device, &bufferInfo, nullptr, &probe), "create buffer");
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, probe, &requirements);
+    vkDestroyBuffer(device, probe, nullptr);
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = kBlockSize;
+    allocInfo.memoryTypeIndex =
+        context->FindMemoryType(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    VkDeviceMemory block;
+    Check(vkAllocateMemory(device, &allocInfo, nullptr, &block), "allocate buffer memory");
+
+    VkDeviceSize offset = 0;
+    for (auto _ : state)
+    {
+        VkBuffer buffer;
+        Check(vkCreateBuffer(device, &bufferInfo, nullptr, &buffer), "create buffer");
+        vkGetBufferMemoryRequirements(device, buffer, &requirements);
+        offset = (offset + requirements.alignment - 1) / requirements.alignment * requirements.alignment;
+        if (offset + requirements.size > kBlockSize)
+        {
+            offset = 0;
+        }
+        vkBindBufferMemory(device, buffer, block, offset);
+        offset += requirements.size;
+        vkDestroyBuffer(device, buffer, nullptr);
+    }
+    vkFreeMemory(device, block, nullptr);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SuballocateBuffer)->Arg(256)->Arg(64 << 10)->Arg(4 << 20);
+
+/**
+ * @brief Staging copies into device local buffers. One-off copies submit and wait once per copy, as Chim::CopyBuffer
+ * does outside an upload batch; batched copies record them all into one command buffer.
+ */
+void CopyBuffers(benchmark::State& state, bool batched)
+{
+    constexpr VkDeviceSize kCopySize = 64 << 10;
+    const uint32_t copies = static_cast<uint32_t>(state.range(0));
+    VkBuffer staging;
+    VkDeviceMemory stagingMemory;
+    context->CreateBuffer(kCopySize * copies, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging,
+                          stagingMemory);
+    VkBuffer target;
+    VkDeviceMemory targetMemory;
+    context->CreateBuffer(kCopySize * copies, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                          target, targetMemory);
+
+    for (auto _ : state)
+    {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        for (uint32_t i = 0; i < copies; i++)
+        {
+            if (commandBuffer == VK_NULL_HANDLE)
+            {
+                commandBuffer = context->BeginSingleTimeCommands();
+            }
+            VkBufferCopy region{i * kCopySize, i * kCopySize, kCopySize};
+            vkCmdCopyBuffer(commandBuffer, staging, target, 1, &region);
+            if (!batched)
+            {
+                context->EndSingleTimeCommands(std::exchange(commandBuffer, VK_NULL_HANDLE));
+            }
+        }
+        if (commandBuffer != VK_NULL_HANDLE)
+        {
+            context->EndSingleTimeCommands(commandBuffer);
+        }
+    }
+    context->DestroyBuffer(target, targetMemory);
+    context->DestroyBuffer(staging, stagingMemory);
+    state.SetItemsProcessed(state.iterations() * copies);
+    state.SetBytesProcessed(state.iterations() * copies * kCopySize);
+}
+
+void BM_CopyBufferEach(benchmark::State& state)
+{
+    CopyBuffers(state, false);
+}
+BENCHMARK(BM_CopyBufferEach)->Arg(1)->Arg(16)->Arg(64);
+
+void BM_CopyBufferBatched(benchmark::State& state)
+{
+    CopyBuffers(state, true);
+}
+BENCHMARK(BM_CopyBufferBatched)->Arg(1)->Arg(16)->Arg(64);
+
+// Pointing the scene set at the next frame's uniforms, the per-frame write of the descriptor set path
+void BM_UpdateDescriptorSet(benchmark::State& state)
+{
+    ScenePass pass;
+    uint32_t frame = 0;
+    for (auto _ : state)
+    {
+        pass.WriteDescriptor(frame);
+        frame = 1 - frame;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_UpdateDescriptorSet);
+
+// Shader modules and pipeline from scratch against an empty cache, as on a first run without chim_pipeline.cache
+void BM_CreatePipelineCold(benchmark::State& state)
+{
+    ScenePass pass;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        VkPipelineCache cache = CreatePipelineCache();
+        state.ResumeTiming();
+        VkPipeline pipeline = pass.CreatePipeline(cache);
+        state.PauseTiming();
+        vkDestroyPipeline(context->Device(), pipeline, nullptr);
+        vkDestroyPipelineCache(context->Device(), cache, nullptr);
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_CreatePipelineCold)->Unit(benchmark::kMicrosecond);
+
+// The same pipeline against a cache that has seen it before, as on later runs
+void BM_CreatePipelineWarm(benchmark::State& state)
+{
+    ScenePass pass;
+    VkPipelineCache cache = CreatePipelineCache();
+    vkDestroyPipeline(context->Device(), pass.CreatePipeline(cache), nullptr);
+    for (auto _ : state)
+    {
+        VkPipeline pipeline = pass.CreatePipeline(cache);
+        state.PauseTiming();
+        vkDestroyPipeline(context->Device(), pipeline, nullptr);
+        state.ResumeTiming();
+    }
+    vkDestroyPipelineCache(context->Device(), cache, nullptr);
+}
+BENCHMARK(BM_CreatePipelineWarm)->Unit(benchmark::kMicrosecond);
+
+// Recording a scene pass of indexed draws; items are draws, so the time per item is the recording cost of one draw
+void BM_RecordDraws(benchmark::State& state)
+{
+    const uint32_t draws = static_cast<uint32_t>(state.range(0));
+    ScenePass pass;
+    VkPipelineCache cache = CreatePipelineCache();
+    VkPipeline pipeline = pass.CreatePipeline(cache);
+    VkCommandBuffer commandBuffer = context->AllocateCommandBuffer();
+    VkClearValue clearValues[2]{};
+
+    for (auto _ : state)
+    {
+        vkResetCommandBuffer(commandBuffer, 0);
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = pass.render_pass;
+        renderPassInfo.framebuffer = pass.framebuffer;
+        renderPassInfo.renderArea = {{0, 0}, {BenchContext::kTargetSize, BenchContext::kTargetSize}};
+        renderPassInfo.clearValueCount = 2;
+        renderPassInfo.pClearValues = clearValues;
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        VkDeviceSize vertexOffset = 0;
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &pass.geometry_buffer, &vertexOffset);
+        vkCmdBindIndexBuffer(commandBuffer, pass.geometry_buffer, ScenePass::kIndexOffset, VK_INDEX_TYPE_UINT16);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pass.layout, 0, 1,
+                                &pass.descriptor_set, 0, nullptr);
+        for (uint32_t i = 0; i < draws; i++)
+        {
+            vkCmdDrawIndexed(commandBuffer, 3, 1, 0, 0, 0);
+        }
+        vkCmdEndRenderPass(commandBuffer);
+        vkEndCommandBuffer(commandBuffer);
+    }
+
+    context->FreeCommandBuffer(commandBuffer);
+    vkDestroyPipeline(context->Device(), pipeline, nullptr);
+    vkDestroyPipelineCache(context->Device(), cache, nullptr);
+    state.SetItemsProcessed(state.iterations() * draws);
+}
+BENCHMARK(BM_RecordDraws)->Arg(1)->Arg(100)->Arg(1000);
+
+// Submitting empty command buffers and waiting for the last; items are submits, so this is the cost of a submit
+void BM_QueueSubmit(benchmark::State& state)
+{
+    const uint32_t submits = static_cast<uint32_t>(state.range(0));
+    std::vector<VkCommandBuffer> commandBuffers(submits);
+    for (VkCommandBuffer& commandBuffer : commandBuffers)
+    {
+        commandBuffer = context->AllocateCommandBuffer();
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        vkEndCommandBuffer(commandBuffer);
+    }
+
+    for (auto _ : state)
+    {
+        context->Submit(commandBuffers.data(), submits);
+    }
+
+    for (VkCommandBuffer commandBuffer : commandBuffers)
+    {
+        context->FreeCommandBuffer(commandBuffer);
+    }
+    state.SetItemsProcessed(state.iterations() * submits);
+}
+BENCHMARK(BM_QueueSubmit)->Arg(1)->Arg(8);
+} // namespace
+
+/**
+ * @brief Microbenchmarks of the Vulkan primitives Chim is built from: buffer creation and suballocation, one-off and
+ * batched copies, descriptor updates, pipeline creation with a cold or warm cache, recording draws and submitting.
+ * @details Usage: chim_microbench [--device <name>] [benchmark options]. The benchmarks share one small device instead
+ * of a whole renderer, so a change to a primitive can be measured without the rest of the frame. By default the first
+ * CPU implementation, such as lavapipe, is used: its timings do not depend on the GPU in the machine. --device picks
+ * the first device whose name contains <name> instead.
+ */
+int main(int argc, char *argv[])
+{
+    benchmark::Initialize(&argc, argv);
+    std::string deviceName;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "--device" && i + 1 < argc)
+        {
+            deviceName = argv[++i];
+        }
+        else
+        {
+            std::cerr << "Usage: chim_microbench [--device <name>] [benchmark options]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    try
+    {
+        BenchContext benchContext(deviceName);
+        context = &benchContext;
+        benchmark::AddCustomContext("device", benchContext.DeviceName());
+        benchmark::RunSpecifiedBenchmarks();
+        benchmark::Shutdown();
+        context = nullptr;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
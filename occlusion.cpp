@@ -0,0 +1,278 @@
+#include "occlusion.hpp"
+#include <algorithm>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+using namespace chim;
+
+namespace
+{
+// Corners with a smaller clip space w are treated as crossing the near plane
+constexpr float kMinW = 1e-5f;
+
+constexpr uint32_t kTilePixels = OcclusionCuller::kTileWidth * OcclusionCuller::kTileHeight;
+
+glm::vec2 ToPixels(const glm::vec4& clip)
+{
+    return glm::vec2((clip.x / clip.w * 0.5f + 0.5f) * OcclusionCuller::kWidth,
+                     (clip.y / clip.w * 0.5f + 0.5f) * OcclusionCuller::kHeight);
+}
+} // namespace
+
+OcclusionCuller::~OcclusionCuller()
+{
+    StopWorkers();
+}
+
+void OcclusionCuller::Init(uint32_t threads)
+{
+    StopWorkers();
+    threads_ = std::clamp(threads, 1u, kTilesY);
+    depth_.assign(kTilesX * kTilesY * kTilePixels, 0.0f);
+    tile_min_.assign(kTilesX * kTilesY, 0.0f);
+    for (uint32_t band = 1; band < threads_; band++)
+    {
+        workers_.emplace_back(&OcclusionCuller::WorkerLoop, this, band);
+    }
+}
+
+void OcclusionCuller::StopWorkers(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    start_.notify_all();
+    for (std::thread& worker : workers_)
+    {
+        worker.join();
+    }
+    workers_.clear();
+    stopping_ = false;
+}
+
+void OcclusionCuller::WorkerLoop(uint32_t band)
+{
+    uint64_t generation = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        start_.wait(lock, [this, generation] { return stopping_ || generation_ != generation; });
+        if (stopping_)
+        {
+            return;
+        }
+        generation = generation_;
+        const std::vector<ScreenTriangle>& triangles = *triangles_;
+
+        lock.unlock();
+        RasterizeBand(triangles, band);
+        lock.lock();
+        if (--bands_left_ == 0)
+        {
+            done_.notify_one();
+        }
+    }
+}
+
+/**
+ * @brief Clears the buffer and rasterizes the occluders seen through clip_from_object, which later tests use as well.
+ */
+void OcclusionCuller::RenderOccluders(const glm::mat4& clip_from_object, const std::vector<glm::vec3>& triangles)
+{
+    clip_from_object_ = clip_from_object;
+
+    // Set up every triangle once; the bands only walk the pixels
+    std::vector<ScreenTriangle> screenTriangles;
+    screenTriangles.reserve(triangles.size() / 3);
+    for (size_t i = 0; i + 2 < triangles.size(); i += 3)
+    {
+        glm::vec4 clip[3];
+        bool behind = false;
+        for (int v = 0; v < 3; v++)
+        {
+            clip[v] = clip_from_object * glm::vec4(triangles[i + v], 1.0f);
+            behind = behind || clip[v].w < kMinW;
+        }
+        if (behind)
+        {
+            continue;
+        }
+
+        glm::vec2 p[3] = {ToPixels(clip[0]), ToPixels(clip[1]), ToPixels(clip[2])};
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+        if (std::abs(area) < 1e-6f)
+        {
+            continue;
+        }
+        // Occluders hide from both sides, so either winding is made positive inside
+        float sign = area > 0.0f ? 1.0f : -1.0f;
+
+        ScreenTriangle triangle;
+        for (int e = 0; e < 3; e++)
+        {
+            const glm::vec2& a = p[(e + 1) % 3];
+            const glm::vec2& b = p[(e + 2) % 3];
+            float edgeA = (a.y - b.y) * sign;
+            float edgeB = (b.x - a.x) * sign;
+            triangle.edges[e] = glm::vec3(edgeA, edgeB, -(edgeA * a.x + edgeB * a.y));
+        }
+        triangle.depth = std::min({clip[0].z / clip[0].w, clip[1].z / clip[1].w, clip[2].z / clip[2].w});
+
+        glm::vec2 low = glm::min(p[0], glm::min(p[1], p[2]));
+        glm::vec2 high = glm::max(p[0], glm::max(p[1], p[2]));
+        triangle.bounds = glm::ivec4(std::max(0, static_cast<int>(low.x)), std::max(0, static_cast<int>(low.y)),
+                                     std::min(static_cast<int>(kWidth) - 1, static_cast<int>(high.x)),
+                                     std::min(static_cast<int>(kHeight) - 1, static_cast<int>(high.y)));
+        if (triangle.bounds.x <= triangle.bounds.z && triangle.bounds.y <= triangle.bounds.w)
+        {
+            screenTriangles.push_back(triangle);
+        }
+    }
+
+    // Band 0 runs on the calling thread, the others on the workers
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        triangles_ = &screenTriangles;
+        bands_left_ = static_cast<uint32_t>(workers_.size());
+        generation_++;
+    }
+    start_.notify_all();
+    RasterizeBand(screenTriangles, 0);
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return bands_left_ == 0; });
+    triangles_ = nullptr;
+}
+
+/**
+ * @brief Clears and rasterizes the tile rows of one of threads_ bands, then updates their per-tile minimum.
+ */
+void OcclusionCuller::RasterizeBand(const std::vector<ScreenTriangle>& triangles, uint32_t band)
+{
+    const uint32_t rowsPerBand = (kTilesY + threads_ - 1) / threads_;
+    const uint32_t firstRow = std::min(band * rowsPerBand, kTilesY);
+    const uint32_t endRow = std::min(firstRow + rowsPerBand, kTilesY);
+    float *rows = depth_.data() + firstRow * kTilesX * kTilePixels;
+    std::fill(rows, rows + (endRow - firstRow) * kTilesX * kTilePixels, 0.0f);
+
+    const int bandTop = static_cast<int>(firstRow * kTileHeight);
+    const int bandBottom = static_cast<int>(endRow * kTileHeight) - 1;
+    for (const ScreenTriangle& triangle : triangles)
+    {
+        const int top = std::max(triangle.bounds.y, bandTop);
+        const int bottom = std::min(triangle.bounds.w, bandBottom);
+        if (top > bottom)
+        {
+            continue;
+        }
+        const int left = triangle.bounds.x / static_cast<int>(kTileWidth);
+        const int right = triangle.bounds.z / static_cast<int>(kTileWidth);
+
+#ifdef __AVX2__
+        const __m256 offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+        const __m256 depth = _mm256_set1_ps(triangle.depth);
+        const __m256 zero = _mm256_setzero_ps();
+#endif
+        for (int y = top; y <= bottom; y++)
+        {
+            const float centerY = y + 0.5f;
+            float *row = depth_.data() + ((y / kTileHeight) * kTilesX * kTilePixels) + (y % kTileHeight) * kTileWidth;
+            for (int tileX = left; tileX <= right; tileX++)
+            {
+                float *pixels = row + tileX * kTilePixels;
+                const float x0 = static_cast<float>(tileX * static_cast<int>(kTileWidth));
+#ifdef __AVX2__
+                const __m256 x = _mm256_add_ps(_mm256_set1_ps(x0), offsets);
+                __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+                for (const glm::vec3& edge : triangle.edges)
+                {
+                    __m256 value = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(edge.x), x),
+                                                 _mm256_set1_ps(edge.y * centerY + edge.z));
+                    inside = _mm256_and_ps(inside, _mm256_cmp_ps(value, zero, _CMP_GE_OQ));
+                }
+                __m256 old = _mm256_loadu_ps(pixels);
+                _mm256_storeu_ps(pixels, _mm256_blendv_ps(old, _mm256_max_ps(old, depth), inside));
+#else
+                for (uint32_t i = 0; i < kTileWidth; i++)
+                {
+                    const float centerX = x0 + i + 0.5f;
+                    bool inside = true;
+                    for (const glm::vec3& edge : triangle.edges)
+                    {
+                        inside = inside && edge.x * centerX + edge.y * centerY + edge.z >= 0.0f;
+                    }
+                    if (inside)
+                    {
+                        pixels[i] = std::max(pixels[i], triangle.depth);
+                    }
+                }
+#endif
+            }
+        }
+    }
+
+    for (uint32_t tile = firstRow * kTilesX; tile < endRow * kTilesX; tile++)
+    {
+        const float *pixels = depth_.data() + tile * kTilePixels;
+        tile_min_[tile] = *std::min_element(pixels, pixels + kTilePixels);
+    }
+}
+
+/**
+ * @brief True unless the box, in the object space of the last RenderOccluders, is off screen or hidden behind the
+ * occluders everywhere it covers.
+ */
+bool OcclusionCuller::IsVisible(const BoundingBox& box) const
+{
+    glm::vec2 low(static_cast<float>(kWidth), static_cast<float>(kHeight));
+    glm::vec2 high(0.0f);
+    float nearest = 0.0f;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec3 position((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y,
+                           (corner & 4) ? box.max.z : box.min.z);
+        glm::vec4 clip = clip_from_object_ * glm::vec4(position, 1.0f);
+        if (clip.w < kMinW)
+        {
+            return true;
+        }
+        glm::vec2 pixel = ToPixels(clip);
+        low = glm::min(low, pixel);
+        high = glm::max(high, pixel);
+        nearest = std::max(nearest, clip.z / clip.w);
+    }
+
+    const int left = std::max(0, static_cast<int>(low.x));
+    const int top = std::max(0, static_cast<int>(low.y));
+    const int right = std::min(static_cast<int>(kWidth) - 1, static_cast<int>(high.x));
+    const int bottom = std::min(static_cast<int>(kHeight) - 1, static_cast<int>(high.y));
+    if (left > right || top > bottom || high.x < 0.0f || high.y < 0.0f)
+    {
+        return false;
+    }
+
+    for (int tileY = top / static_cast<int>(kTileHeight); tileY <= bottom / static_cast<int>(kTileHeight); tileY++)
+    {
+        for (int tileX = left / static_cast<int>(kTileWidth); tileX <= right / static_cast<int>(kTileWidth); tileX++)
+        {
+            const uint32_t tile = tileY * kTilesX + tileX;
+            if (tile_min_[tile] > nearest)
+            {
+                continue;
+            }
+            // Somewhere in this tile nothing is in front of the box; find out whether that is inside its bounds
+            const float *pixels = depth_.data() + tile * kTilePixels;
+            for (uint32_t i = 0; i < kTilePixels; i++)
+            {
+                const int x = tileX * static_cast<int>(kTileWidth) + static_cast<int>(i % kTileWidth);
+                const int y = tileY * static_cast<int>(kTileHeight) + static_cast<int>(i / kTileWidth);
+                if (x >= left && x <= right && y >= top && y <= bottom && pixels[i] <= nearest)
+                {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file occlusion.hpp
+ * @author George Power
+ * @brief Software occlusion culling: occluders rasterized into a small CPU depth buffer that draws are tested against.
+ */
+#ifndef OCCLUSION_HPP
+#define OCCLUSION_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace chim
+{
+struct BoundingBox
+{
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+};
+
+/**
+ * @class OcclusionCuller
+ * @brief Rasterizes a few large occluders into a low-resolution depth buffer and tests bounding boxes against it.
+ * @details Depth follows the renderer's reverse-Z convention: 1 is the near plane and the buffer clears to 0. Each
+ * occluder triangle is written at its farthest depth, so the buffer never claims an occluder is nearer than it is.
+ * A box is hidden when every pixel it covers holds an occluder nearer than the box's nearest corner. Boxes off
+ * screen are hidden too; boxes crossing the near plane are always visible, and triangles crossing it are not
+ * rasterized.
+ *
+ * The buffer is stored in tiles of 8x4 pixels, so that one tile row is one 8-wide AVX2 register. Rows of tiles are
+ * split into bands, each walking every occluder: the first on the calling thread, the others on workers that Init
+ * starts once and every RenderOccluders wakes. A per-tile minimum lets most tests finish without touching the pixels.
+ */
+class OcclusionCuller
+{
+  public:
+    static constexpr uint32_t kWidth = 256;
+    static constexpr uint32_t kHeight = 128;
+    static constexpr uint32_t kTileWidth = 8;
+    static constexpr uint32_t kTileHeight = 4;
+    static constexpr uint32_t kTilesX = kWidth / kTileWidth;
+    static constexpr uint32_t kTilesY = kHeight / kTileHeight;
+
+    ~OcclusionCuller();
+
+    void Init(uint32_t threads);
+
+    // Triangles are three object space positions each, transformed by clip_from_object
+    void RenderOccluders(const glm::mat4& clip_from_object, const std::vector<glm::vec3>& triangles);
+    bool IsVisible(const BoundingBox& box) const;
+
+  private:
+    struct ScreenTriangle
+    {
+        glm::vec3 edges[3]; // A, B and C of the edge function A * x + B * y + C, positive inside
+        float depth;        // Farthest of the three vertices
+        glm::ivec4 bounds;  // Pixel bounds: min x, min y, max x, max y, inclusive
+    };
+
+    void RasterizeBand(const std::vector<ScreenTriangle>& triangles, uint32_t band);
+    void WorkerLoop(uint32_t band);
+    void StopWorkers(void);
+
+  private:
+    uint32_t threads_ = 1;
+    glm::mat4 clip_from_object_ = glm::mat4(1.0f);
+    std::vector<float> depth_;    // kTileWidth * kTileHeight pixels per tile, tiles in rows
+    std::vector<float> tile_min_; // Farthest occluder depth per tile
+
+    // Workers rasterize bands 1 and up of triangles_ whenever generation_ changes
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    const std::vector<ScreenTriangle> *triangles_ = nullptr;
+    uint64_t generation_ = 0;
+    uint32_t bands_left_ = 0;
+    bool stopping_ = false;
+};
+} // namespace chim
+#endif // OCCLUSION_HPP
@@ -0,0 +1,168 @@
+#include "overlay.hpp"
+#include "chim.hpp"
+#include <cmath>
+#include <iterator>
+
+using namespace chim;
+
+namespace
+{
+const float kPanelLeft = -0.98f;
+const float kPanelRight = -0.30f;
+const float kPanelTop = -0.98f;
+const float kRowGap = 0.015f;
+const float kBudgetMs = 1000.0f / 60.0f;
+
+const glm::vec3 kBackground = {0.05f, 0.05f, 0.07f};
+const glm::vec3 kTrack = {0.15f, 0.15f, 0.18f};
+const glm::vec3 kPassColors[] = {
+    glm::vec3{0.25f, 0.55f, 0.95f},
+    glm::vec3{0.35f, 0.85f, 0.55f},
+    glm::vec3{0.95f, 0.55f, 0.25f},
+    glm::vec3{0.85f, 0.35f, 0.75f},
+    glm::vec3{0.55f, 0.75f, 0.2f},
+};
+static_assert(std::size(kPassColors) == static_cast<size_t>(ProfilePass::Count), "One colour per profiled pass");
+} // namespace
+
+/**
+ * @brief Writes the overlay for one frame into out.
+ * @return The number of vertices written (a triangle list), never more than kMaxVertices.
+ */
+uint32_t Overlay::Build(const ProfilerSnapshot& snapshot, Vertex *out)
+{
+    out_ = out;
+    count_ = 0;
+
+    const float graph_height = 0.18f;
+    const float bar_height = 0.03f;
+    const float left = kPanelLeft + kRowGap;
+    const float right = kPanelRight - kRowGap;
+
+    // Rows: cpu graph, gpu graph, pass timings, overdraw per pass, draws, triangles, one per heap, pipeline cache,
+    // fence idle share
+    size_t bar_rows = 5 + snapshot.pass_statistics.size() + snapshot.heap_used.size();
+    float bottom = kPanelTop + kRowGap + 2 * (graph_height + kRowGap) + bar_rows * (bar_height + kRowGap);
+    Quad(kPanelLeft, kPanelTop, kPanelRight, bottom, kBackground);
+
+    float y = kPanelTop + kRowGap;
+    Graph(snapshot.cpu_frame_ms, left, y, right, y + graph_height, kBudgetMs);
+    y += graph_height + kRowGap;
+    Graph(snapshot.gpu_frame_ms, left, y, right, y + graph_height, kBudgetMs);
+    y += graph_height + kRowGap;
+
+    // Per-pass GPU time, stacked, full width is one frame budget
+    Quad(left, y, right, y + bar_height, kTrack);
+    float x = left;
+    for (size_t pass = 0; pass < snapshot.pass_gpu_ms.size(); pass++)
+    {
+        float width = std::min(snapshot.pass_gpu_ms[pass] / kBudgetMs, 1.0f) * (right - left);
+        float end = std::min(x + width, right);
+        if (end > x)
+        {
+            Quad(x, y, end, y + bar_height, kPassColors[pass]);
+        }
+        x = end;
+    }
+    y += bar_height + kRowGap;
+
+    // Fragment shader invocations per pixel of each pass's render area, a full bar is 4x overdraw
+    for (size_t pass = 0; pass < snapshot.pass_statistics.size(); pass++)
+    {
+        float overdraw = snapshot.pass_area_pixels[pass] > 0
+                             ? static_cast<float>(snapshot.pass_statistics[pass].fragment_invocations) /
+                                   snapshot.pass_area_pixels[pass]
+                             : 0.0f;
+        Meter(overdraw / 4.0f, left, y, right, y + bar_height, kPassColors[pass]);
+        y += bar_height + kRowGap;
+    }
+
+    // Counts are shown on a log scale, a full bar is one million
+    Meter(std::log10(1.0f + snapshot.draw_calls) / 6.0f, left, y, right, y + bar_height, {0.6f, 0.4f, 0.9f});
+    y += bar_height + kRowGap;
+    Meter(std::log10(1.0f + snapshot.triangles) / 6.0f, left, y, right, y + bar_height, {0.9f, 0.4f, 0.6f});
+    y += bar_height + kRowGap;
+
+    for (size_t heap = 0; heap < snapshot.heap_used.size(); heap++)
+    {
+        float fraction = snapshot.heap_size[heap] > 0
+                             ? static_cast<float>(snapshot.heap_used[heap]) / snapshot.heap_size[heap]
+                             : 0.0f;
+        Meter(fraction, left, y, right, y + bar_height, {0.3f, 0.8f, 0.8f});
+        y += bar_height + kRowGap;
+    }
+
+    uint64_t pipelines = snapshot.pipeline_cache_hits + snapshot.pipeline_cache_misses;
+    float hit_rate = pipelines > 0 ? static_cast<float>(snapshot.pipeline_cache_hits) / pipelines : 0.0f;
+    Meter(hit_rate, left, y, right, y + bar_height, {0.8f, 0.8f, 0.3f});
+    y += bar_height + kRowGap;
+
+    // Share of the last frame the CPU sat waiting for the GPU, a full bar is a fully GPU-bound frame
+    float cpu_ms = snapshot.cpu_frame_ms.back();
+    float idle = cpu_ms > 0.0f ? snapshot.fence_idle_ms.back() / cpu_ms : 0.0f;
+    Meter(idle, left, y, right, y + bar_height, {0.8f, 0.8f, 0.8f});
+
+    return count_;
+}
+
+void Overlay::Quad(float x0, float y0, float x1, float y1, const glm::vec3& color)
+{
+    if (count_ + 6 > kMaxVertices)
+    {
+        return;
+    }
+
+    // Clockwise in framebuffer space, matching the winding of the scene geometry
+    const Vertex quad[6] = {
+        {{x0, y0, 0.0f}, color},
+        {{x1, y0, 0.0f}, color},
+        {{x1, y1, 0.0f}, color},
+        {{x1, y1, 0.0f}, color},
+        {{x0, y1, 0.0f}, color},
+        {{x0, y0, 0.0f}, color},
+    };
+    std::copy(std::begin(quad), std::end(quad), out_ + count_);
+    count_ += 6;
+}
+
+/**
+ * @brief Draws one bar per sample, scaled so that the top of the graph is twice the budget.
+ */
+void Overlay::Graph(const std::vector<float>& values, float x0, float y0, float x1, float y1, float budget_ms)
+{
+    Quad(x0, y0, x1, y1, kTrack);
+    if (values.empty())
+    {
+        return;
+    }
+
+    float bar_width = (x1 - x0) / values.size();
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        float fraction = std::min(values[i] / (2.0f * budget_ms), 1.0f);
+        if (fraction <= 0.0f)
+        {
+            continue;
+        }
+
+        glm::vec3 color = values[i] <= budget_ms ? glm::vec3{0.2f, 0.8f, 0.3f}
+                          : values[i] <= 2.0f * budget_ms ? glm::vec3{0.9f, 0.8f, 0.2f}
+                                                          : glm::vec3{0.9f, 0.2f, 0.2f};
+        float left = x0 + i * bar_width;
+        Quad(left, y1 - fraction * (y1 - y0), left + bar_width, y1, color);
+    }
+
+    // Budget line
+    float budget_y = (y0 + y1) * 0.5f;
+    Quad(x0, budget_y - 0.002f, x1, budget_y + 0.002f, {0.8f, 0.8f, 0.8f});
+}
+
+void Overlay::Meter(float fraction, float x0, float y0, float x1, float y1, const glm::vec3& color)
+{
+    Quad(x0, y0, x1, y1, kTrack);
+    fraction = std::clamp(fraction, 0.0f, 1.0f);
+    if (fraction > 0.0f)
+    {
+        Quad(x0, y0, x0 + fraction * (x1 - x0), y1, color);
+    }
+}
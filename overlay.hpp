@@ -0,0 +1,38 @@
+/**
+ * @file overlay.hpp
+ * @author George Power
+ * @brief Builds the geometry of the on-screen performance overlay.
+ */
+#ifndef OVERLAY_HPP
+#define OVERLAY_HPP
+
+#include "profiler.hpp"
+#include "render_types.hpp"
+#include <cstdint>
+
+namespace chim
+{
+/**
+ * @class Overlay
+ * @brief Turns a profiler snapshot into coloured quads in normalized device coordinates.
+ * @details The overlay has no text; every statistic is drawn as a bar or a bar graph. The console report
+ * (Profiler::Report) gives the exact numbers. Geometry is written straight into a mapped vertex buffer.
+ */
+class Overlay
+{
+  public:
+    static constexpr uint32_t kMaxVertices = 4096;
+
+    uint32_t Build(const ProfilerSnapshot& snapshot, Vertex *out);
+
+  private:
+    void Quad(float x0, float y0, float x1, float y1, const glm::vec3& color);
+    void Graph(const std::vector<float>& values, float x0, float y0, float x1, float y1, float budget_ms);
+    void Meter(float fraction, float x0, float y0, float x1, float y1, const glm::vec3& color);
+
+  private:
+    Vertex *out_ = nullptr;
+    uint32_t count_ = 0;
+};
+} // namespace chim
+#endif // OVERLAY_HPP
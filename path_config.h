@@ -1 +1,4 @@
+// CMake points SHADER_DIRECTORY at the shaders it compiled into the build directory
+#ifndef SHADER_DIRECTORY
 #define SHADER_DIRECTORY "C:\\Users\\nino\\Documents\\GitHub\\Chim\\shaders"
+#endif
@@ -0,0 +1,189 @@
+#include "perf_counters.hpp"
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace chim;
+
+const char *chim::CpuPhaseName(CpuPhase phase)
+{
+    switch (phase)
+    {
+    case CpuPhase::Loop:
+        return "loop";
+    case CpuPhase::Wait:
+        return "wait";
+    case CpuPhase::Jobs:
+        return "jobs";
+    case CpuPhase::Update:
+        return "update";
+    case CpuPhase::Record:
+        return "record";
+    case CpuPhase::Submit:
+        return "submit";
+    case CpuPhase::Present:
+        return "present";
+    case CpuPhase::Worker:
+        return "worker";
+    default:
+        return "?";
+    }
+}
+
+PerfSample& PerfSample::operator+=(const PerfSample& other)
+{
+    cycles += other.cycles;
+    instructions += other.instructions;
+    cache_misses += other.cache_misses;
+    branch_misses += other.branch_misses;
+    return *this;
+}
+
+PerfSample PerfSample::operator-(const PerfSample& other) const
+{
+    return {cycles - other.cycles, instructions - other.instructions, cache_misses - other.cache_misses,
+            branch_misses - other.branch_misses};
+}
+
+/**
+ * @brief One line per phase that counted anything: cycles, instructions per cycle and misses, all per frame.
+ */
+std::string chim::PerfReport(const PhaseCounters& counters, uint64_t frames)
+{
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(2);
+    out << "[Counters] per frame over " << frames << " frames";
+    const double perFrame = frames > 0 ? 1.0 / frames : 0.0;
+    for (size_t phase = 0; phase < counters.size(); phase++)
+    {
+        const PerfSample& sample = counters[phase];
+        if (sample.cycles == 0)
+        {
+            continue;
+        }
+        out << "\n  " << CpuPhaseName(static_cast<CpuPhase>(phase)) << ": " << sample.cycles * perFrame / 1e3
+            << "k cycles, ipc " << static_cast<double>(sample.instructions) / sample.cycles << ", cache misses "
+            << sample.cache_misses * perFrame << ", branch misses " << sample.branch_misses * perFrame;
+    }
+    return out.str();
+}
+
+PerfCounters::~PerfCounters()
+{
+    Close();
+}
+
+/**
+ * @brief Starts counting on the calling thread.
+ * @return False with the reason in error when the counters cannot be opened.
+ */
+bool PerfCounters::Open(std::string& error)
+{
+#ifdef __linux__
+    const uint64_t configs[4] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+                                 PERF_COUNT_HW_BRANCH_MISSES};
+    for (size_t i = 0; i < 4; i++)
+    {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        // This thread on any CPU; the first counter leads the group
+        int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd_, 0));
+        if (fd < 0)
+        {
+            error = std::string("perf_event_open: ") + std::strerror(errno);
+            Close();
+            return false;
+        }
+        if (i == 0)
+        {
+            group_fd_ = fd;
+        }
+        else
+        {
+            member_fds_[i - 1] = fd;
+        }
+    }
+    last_ = Read();
+    return true;
+#else
+    error = "perf_event_open is only available on Linux";
+    return false;
+#endif
+}
+
+void PerfCounters::Close(void)
+{
+#ifdef __linux__
+    for (int& fd : member_fds_)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (group_fd_ >= 0)
+    {
+        close(group_fd_);
+        group_fd_ = -1;
+    }
+#endif
+}
+
+PerfSample PerfCounters::Read(void) const
+{
+    PerfSample sample;
+#ifdef __linux__
+    // PERF_FORMAT_GROUP: the number of counters, then their values in the order they joined the group
+    uint64_t values[5] = {};
+    if (group_fd_ >= 0 && read(group_fd_, values, sizeof(values)) == static_cast<ssize_t>(sizeof(values)))
+    {
+        sample = {values[1], values[2], values[3], values[4]};
+    }
+#endif
+    return sample;
+}
+
+void PerfCounters::MarkOpen(CpuPhase phase)
+{
+    PerfSample now = Read();
+    Add(phase, now - last_);
+    last_ = now;
+}
+
+void PerfCounters::Add(CpuPhase phase, const PerfSample& sample)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    totals_[static_cast<size_t>(phase)] += sample;
+}
+
+/**
+ * @brief Drops everything counted so far, so that a measurement can start after warm-up.
+ */
+void PerfCounters::Reset(void)
+{
+    if (IsOpen())
+    {
+        last_ = Read();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    totals_ = {};
+}
+
+PhaseCounters PerfCounters::Totals(void) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return totals_;
+}
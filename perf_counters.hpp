@@ -0,0 +1,108 @@
+/**
+ * @file perf_counters.hpp
+ * @author George Power
+ * @brief Hardware performance counters per frame phase, read through Linux perf_event_open.
+ */
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace chim
+{
+/**
+ * @brief The parts of a frame the CPU counters are split into.
+ */
+enum class CpuPhase : uint32_t
+{
+    Loop = 0, // Between two frames: events, input, camera
+    Wait,     // Idle on the frame's fence
+    Jobs,     // Background jobs run while waiting
+    Update,   // Uniforms, descriptors, overlay
+    Record,   // Command buffer recording
+    Submit,   // Queue submission and frame hand-off
+    Present,
+    Worker, // Jobs on worker threads, such as optimized pipeline links
+    Count
+};
+
+const char *CpuPhaseName(CpuPhase phase);
+
+struct PerfSample
+{
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t cache_misses = 0;
+    uint64_t branch_misses = 0;
+
+    PerfSample& operator+=(const PerfSample& other);
+    PerfSample operator-(const PerfSample& other) const;
+};
+
+using PhaseCounters = std::array<PerfSample, static_cast<size_t>(CpuPhase::Count)>;
+
+std::string PerfReport(const PhaseCounters& counters, uint64_t frames);
+
+/**
+ * @class PerfCounters
+ * @brief Counts cycles, instructions, cache misses and branch misses of the thread that opened it.
+ * @details The four counters run as one perf event group, so a single read returns a consistent set. Mark charges
+ * everything counted since the previous mark to a phase; worker threads measure their jobs with MeasureWorker, which
+ * opens a group of its own for the calling thread. Counting is user space only, which works with the default
+ * perf_event_paranoid setting of 2. Without perf events (another OS, a VM without a PMU) Open fails and every other
+ * call does nothing.
+ */
+class PerfCounters
+{
+  public:
+    ~PerfCounters();
+
+    bool Open(std::string& error);
+    void Close(void);
+    bool IsOpen(void) const { return group_fd_ >= 0; }
+
+    void Mark(CpuPhase phase)
+    {
+        if (IsOpen())
+        {
+            MarkOpen(phase);
+        }
+    }
+    template <typename Job> void MeasureWorker(Job&& job)
+    {
+        if (!IsOpen())
+        {
+            job();
+            return;
+        }
+        PerfCounters worker;
+        std::string error;
+        bool counting = worker.Open(error);
+        PerfSample begin = worker.Read();
+        job();
+        if (counting)
+        {
+            Add(CpuPhase::Worker, worker.Read() - begin);
+        }
+    }
+
+    void Reset(void);
+    PhaseCounters Totals(void) const;
+
+  private:
+    PerfSample Read(void) const;
+    void MarkOpen(CpuPhase phase);
+    void Add(CpuPhase phase, const PerfSample& sample);
+
+  private:
+    int group_fd_ = -1; // The cycles counter, leader of the group
+    std::array<int, 3> member_fds_ = {-1, -1, -1};
+    PerfSample last_{}; // At the previous mark
+    mutable std::mutex mutex_; // Guards totals_, which worker threads add to
+    PhaseCounters totals_{};
+};
+} // namespace chim
+#endif // PERF_COUNTERS_HPP
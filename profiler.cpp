@@ -0,0 +1,508 @@
+#include "profiler.hpp"
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+using namespace chim;
+
+const char *chim::ProfilePassName(ProfilePass pass)
+{
+    switch (pass)
+    {
+    case ProfilePass::Main:
+        return "main";
+    case ProfilePass::Temporal:
+        return "temporal";
+    case ProfilePass::Overlay:
+        return "overlay";
+    case ProfilePass::Probe:
+        return "probe";
+    case ProfilePass::Foliage:
+        return "foliage";
+    default:
+        return "unknown";
+    }
+}
+
+namespace
+{
+// CPU time used by all threads of the process so far, in seconds
+double ProcessCpuSeconds(void)
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+    {
+        return 0.0;
+    }
+    auto ticks = [](const FILETIME& time) { return (uint64_t(time.dwHighDateTime) << 32) | time.dwLowDateTime; };
+    return (ticks(kernel) + ticks(user)) * 100e-9; // 100 ns ticks
+#else
+    timespec time{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+#endif
+}
+} // namespace
+
+/**
+ * @brief Creates the timestamp query pool.
+ * @details GPU timing is silently disabled when the graphics queue does not support timestamps
+ * (timestamp_valid_bits == 0), and pipeline statistics when the pipelineStatisticsQuery feature was not enabled. CPU
+ * timing and counters keep working either way.
+ */
+void Profiler::Init(VkDevice device, const VkPhysicalDeviceMemoryProperties& memory_properties,
+                    float timestamp_period, uint32_t frames_in_flight, uint32_t timestamp_valid_bits,
+                    bool pipeline_statistics)
+{
+    device_ = device;
+    frames_in_flight_ = frames_in_flight;
+    passes_written_.assign(frames_in_flight, 0);
+    last_frame_ = std::chrono::steady_clock::now();
+    last_sample_ = last_frame_;
+    last_sample_cpu_seconds_ = ProcessCpuSeconds();
+
+    timestamp_period_ = timestamp_period;
+    memory_properties_ = memory_properties;
+
+    if (timestamp_valid_bits != 0)
+    {
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = frames_in_flight * static_cast<uint32_t>(ProfilePass::Count) * 2;
+
+        if (vkCreateQueryPool(device_, &poolInfo, nullptr, &timestamp_pool_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create timestamp query pool!");
+        }
+    }
+
+    if (pipeline_statistics)
+    {
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        poolInfo.queryCount = frames_in_flight * static_cast<uint32_t>(ProfilePass::Count);
+        poolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+                                      VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+                                      VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+                                      VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+                                      VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+                                      VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+        if (vkCreateQueryPool(device_, &poolInfo, nullptr, &statistics_pool_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create pipeline statistics query pool!");
+        }
+        statistics_flags_ = poolInfo.pipelineStatistics;
+    }
+}
+
+void Profiler::Cleanup(void)
+{
+    if (timestamp_pool_ != VK_NULL_HANDLE)
+    {
+        vkDestroyQueryPool(device_, timestamp_pool_, nullptr);
+        timestamp_pool_ = VK_NULL_HANDLE;
+    }
+    if (statistics_pool_ != VK_NULL_HANDLE)
+    {
+        vkDestroyQueryPool(device_, statistics_pool_, nullptr);
+        statistics_pool_ = VK_NULL_HANDLE;
+    }
+}
+
+/**
+ * @brief Closes the current CPU frame and publishes the per-frame counters.
+ */
+void Profiler::MarkFrame(void)
+{
+    auto now = std::chrono::steady_clock::now();
+    float frame_ms = std::chrono::duration<float, std::milli>(now - last_frame_).count();
+    last_frame_ = now;
+
+    PushHistory(cpu_history_, frame_ms);
+    history_head_.store((history_head_.load(std::memory_order_relaxed) + 1) % kHistorySize,
+                        std::memory_order_release);
+
+    last_draw_calls_.store(draw_calls_.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+    last_triangles_.store(triangles_.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+    frames_rendered_.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Records how long the frame about to be recorded waited for its fence: idle_ms with nothing to do, job_ms
+ * running background jobs. Call it before MarkFrame so both land in the same history slot.
+ */
+void Profiler::CountFenceWait(float idle_ms, float job_ms)
+{
+    PushHistory(fence_idle_history_, idle_ms);
+    background_job_ms_.store(job_ms, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Updates the frame rate and CPU usage once at least a second has passed since the previous sample.
+ * @details Call it from the main loop whether or not a frame was drawn, so idle periods are measured as well.
+ */
+void Profiler::SampleUsage(void)
+{
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - last_sample_).count();
+    if (seconds < 1.0)
+    {
+        return;
+    }
+
+    double cpu_seconds = ProcessCpuSeconds();
+    uint64_t frames = frames_rendered_.load(std::memory_order_relaxed);
+    frames_per_second_.store(static_cast<float>((frames - last_sample_frames_) / seconds), std::memory_order_relaxed);
+    cpu_usage_.store(static_cast<float>((cpu_seconds - last_sample_cpu_seconds_) / seconds),
+                     std::memory_order_relaxed);
+
+    last_sample_ = now;
+    last_sample_cpu_seconds_ = cpu_seconds;
+    last_sample_frames_ = frames;
+}
+
+void Profiler::PushHistory(std::array<std::atomic<float>, kHistorySize>& history, float value)
+{
+    history[history_head_.load(std::memory_order_relaxed)].store(value, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Reads back the timestamps recorded the last time this frame slot was used.
+ * @details Must be called after the frame's in-flight fence has been waited on, so the results are available and
+ * no wait flag is needed.
+ */
+void Profiler::ReadGpuResults(uint32_t frame)
+{
+    if (passes_written_[frame] == 0)
+    {
+        return;
+    }
+
+    ReadStatistics(frame);
+    if (timestamp_pool_ == VK_NULL_HANDLE)
+    {
+        passes_written_[frame] = 0;
+        return;
+    }
+
+    // Each recorded pass is read on its own. Passes that are only recorded in some frames are reset every frame,
+    // and a read that spans one left unwritten fails with VK_NOT_READY.
+    uint64_t first = std::numeric_limits<uint64_t>::max();
+    uint64_t last = 0;
+    for (uint32_t pass = 0; pass < static_cast<uint32_t>(ProfilePass::Count); pass++)
+    {
+        std::array<uint64_t, 2> timestamps{};
+        if ((passes_written_[frame] & (1u << pass)) == 0 ||
+            vkGetQueryPoolResults(device_, timestamp_pool_, QueryIndex(frame, static_cast<ProfilePass>(pass)), 2,
+                                  sizeof(timestamps), timestamps.data(), sizeof(uint64_t),
+                                  VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+        {
+            pass_gpu_ms_[pass].store(0.0f, std::memory_order_relaxed);
+            continue;
+        }
+        uint64_t begin = timestamps[0];
+        uint64_t end = timestamps[1];
+        first = std::min(first, begin);
+        last = std::max(last, end);
+        pass_gpu_ms_[pass].store(static_cast<float>(end - begin) * timestamp_period_ / 1e6f,
+                                 std::memory_order_relaxed);
+    }
+
+    PushHistory(gpu_history_, last > first ? static_cast<float>(last - first) * timestamp_period_ / 1e6f : 0.0f);
+    passes_written_[frame] = 0;
+}
+
+/**
+ * @brief Reads the pipeline statistics of every pass recorded in this frame slot.
+ */
+void Profiler::ReadStatistics(uint32_t frame)
+{
+    if (statistics_pool_ == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    for (uint32_t pass = 0; pass < static_cast<uint32_t>(ProfilePass::Count); pass++)
+    {
+        PipelineStatistics statistics{};
+        if ((passes_written_[frame] & (1u << pass)) != 0)
+        {
+            vkGetQueryPoolResults(device_, statistics_pool_, StatisticsIndex(frame, static_cast<ProfilePass>(pass)), 1,
+                                  sizeof(statistics), &statistics, sizeof(statistics), VK_QUERY_RESULT_64_BIT);
+        }
+        pass_statistics_[pass] = statistics;
+    }
+}
+
+void Profiler::ResetQueries(VkCommandBuffer command_buffer, uint32_t frame)
+{
+    if (timestamp_pool_ != VK_NULL_HANDLE)
+    {
+        vkCmdResetQueryPool(command_buffer, timestamp_pool_, QueryIndex(frame, ProfilePass::Main),
+                            static_cast<uint32_t>(ProfilePass::Count) * 2);
+    }
+    if (statistics_pool_ != VK_NULL_HANDLE)
+    {
+        vkCmdResetQueryPool(command_buffer, statistics_pool_, StatisticsIndex(frame, ProfilePass::Main),
+                            static_cast<uint32_t>(ProfilePass::Count));
+    }
+}
+
+/**
+ * @brief Starts timing a pass.
+ * @details Pipeline statistics queries may not straddle a render pass boundary, so a pass has to begin and end on
+ * the same side of vkCmdBeginRenderPass/vkCmdEndRenderPass.
+ */
+void Profiler::BeginPass(VkCommandBuffer command_buffer, uint32_t frame, ProfilePass pass)
+{
+    if (timestamp_pool_ != VK_NULL_HANDLE)
+    {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_pool_,
+                            QueryIndex(frame, pass));
+    }
+    if (statistics_pool_ != VK_NULL_HANDLE)
+    {
+        vkCmdBeginQuery(command_buffer, statistics_pool_, StatisticsIndex(frame, pass), 0);
+    }
+}
+
+void Profiler::EndPass(VkCommandBuffer command_buffer, uint32_t frame, ProfilePass pass)
+{
+    if (statistics_pool_ != VK_NULL_HANDLE)
+    {
+        vkCmdEndQuery(command_buffer, statistics_pool_, StatisticsIndex(frame, pass));
+    }
+    if (timestamp_pool_ != VK_NULL_HANDLE)
+    {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_pool_,
+                            QueryIndex(frame, pass) + 1);
+    }
+    passes_written_[frame] |= 1u << static_cast<uint32_t>(pass);
+}
+
+/**
+ * @brief Records a pipeline build that blocked the render thread for ms milliseconds.
+ */
+void Profiler::CountPipelineBuild(float ms)
+{
+    pipeline_builds_.fetch_add(1, std::memory_order_relaxed);
+    if (ms > kPipelineHitchMs)
+    {
+        pipeline_hitches_.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Builds run on several threads at start-up, so the maximum is raised with a compare-exchange
+    float worst = pipeline_build_worst_ms_.load(std::memory_order_relaxed);
+    while (ms > worst && !pipeline_build_worst_ms_.compare_exchange_weak(worst, ms, std::memory_order_relaxed))
+    {
+    }
+}
+
+void Profiler::CountOcclusion(uint32_t tested, uint32_t culled, float ms)
+{
+    occlusion_tested_.store(tested, std::memory_order_relaxed);
+    occlusion_culled_.store(culled, std::memory_order_relaxed);
+    occlusion_ms_.store(ms, std::memory_order_relaxed);
+}
+
+void Profiler::CountPvs(uint32_t tested, uint32_t culled)
+{
+    pvs_tested_.store(tested, std::memory_order_relaxed);
+    pvs_culled_.store(culled, std::memory_order_relaxed);
+}
+
+void Profiler::TrackAllocation(VkDeviceMemory memory, uint32_t memory_type, VkDeviceSize size)
+{
+    uint32_t heap = memory_properties_.memoryTypes[memory_type].heapIndex;
+    heap_used_[heap].fetch_add(size, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(allocations_mutex_);
+    allocations_[memory] = {heap, size};
+}
+
+void Profiler::TrackFree(VkDeviceMemory memory)
+{
+    std::lock_guard<std::mutex> lock(allocations_mutex_);
+    auto it = allocations_.find(memory);
+    if (it == allocations_.end())
+    {
+        return;
+    }
+    heap_used_[it->second.first].fetch_sub(it->second.second, std::memory_order_relaxed);
+    allocations_.erase(it);
+}
+
+ProfilerSnapshot Profiler::Snapshot(void) const
+{
+    ProfilerSnapshot snapshot;
+    uint32_t head = history_head_.load(std::memory_order_acquire);
+
+    snapshot.cpu_frame_ms.reserve(kHistorySize);
+    snapshot.gpu_frame_ms.reserve(kHistorySize);
+    snapshot.fence_idle_ms.reserve(kHistorySize);
+    for (uint32_t i = 0; i < kHistorySize; i++)
+    {
+        uint32_t index = (head + i) % kHistorySize;
+        snapshot.cpu_frame_ms.push_back(cpu_history_[index].load(std::memory_order_relaxed));
+        snapshot.gpu_frame_ms.push_back(gpu_history_[index].load(std::memory_order_relaxed));
+        snapshot.fence_idle_ms.push_back(fence_idle_history_[index].load(std::memory_order_relaxed));
+    }
+    snapshot.background_job_ms = background_job_ms_.load(std::memory_order_relaxed);
+    snapshot.occlusion_tested = occlusion_tested_.load(std::memory_order_relaxed);
+    snapshot.occlusion_culled = occlusion_culled_.load(std::memory_order_relaxed);
+    snapshot.occlusion_ms = occlusion_ms_.load(std::memory_order_relaxed);
+    snapshot.pvs_tested = pvs_tested_.load(std::memory_order_relaxed);
+    snapshot.pvs_culled = pvs_culled_.load(std::memory_order_relaxed);
+
+    for (size_t pass = 0; pass < snapshot.pass_gpu_ms.size(); pass++)
+    {
+        snapshot.pass_gpu_ms[pass] = pass_gpu_ms_[pass].load(std::memory_order_relaxed);
+        snapshot.pass_statistics[pass] = pass_statistics_[pass];
+        snapshot.pass_area_pixels[pass] = pass_area_pixels_[pass].load(std::memory_order_relaxed);
+    }
+
+    snapshot.draw_calls = last_draw_calls_.load(std::memory_order_relaxed);
+    snapshot.triangles = last_triangles_.load(std::memory_order_relaxed);
+
+    for (uint32_t heap = 0; heap < memory_properties_.memoryHeapCount; heap++)
+    {
+        snapshot.heap_used.push_back(heap_used_[heap].load(std::memory_order_relaxed));
+        snapshot.heap_size.push_back(memory_properties_.memoryHeaps[heap].size);
+    }
+
+    snapshot.pipeline_cache_hits = pipeline_cache_hits_.load(std::memory_order_relaxed);
+    snapshot.pipeline_builds = pipeline_builds_.load(std::memory_order_relaxed);
+    snapshot.pipeline_hitches = pipeline_hitches_.load(std::memory_order_relaxed);
+    snapshot.pipeline_build_worst_ms = pipeline_build_worst_ms_.load(std::memory_order_relaxed);
+    snapshot.pipelines_optimized = pipelines_optimized_.load(std::memory_order_relaxed);
+    snapshot.frames_rendered = frames_rendered_.load(std::memory_order_relaxed);
+    snapshot.frames_per_second = frames_per_second_.load(std::memory_order_relaxed);
+    snapshot.cpu_usage = cpu_usage_.load(std::memory_order_relaxed);
+    snapshot.pipeline_cache_misses = pipeline_cache_misses_.load(std::memory_order_relaxed);
+
+    return snapshot;
+}
+
+/**
+ * @brief Formats the latest frame as a single block of text for the console.
+ */
+std::string Profiler::Report(void) const
+{
+    ProfilerSnapshot snapshot = Snapshot();
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+
+    out << "[Profiler] cpu " << snapshot.cpu_frame_ms.back() << " ms, gpu " << snapshot.gpu_frame_ms.back()
+        << " ms\n";
+    for (size_t pass = 0; pass < snapshot.pass_gpu_ms.size(); pass++)
+    {
+        const PipelineStatistics& statistics = snapshot.pass_statistics[pass];
+        out << "  pass " << ProfilePassName(static_cast<ProfilePass>(pass)) << ": " << snapshot.pass_gpu_ms[pass]
+            << " ms\n";
+        out << "    vertices " << statistics.input_vertices << ", primitives " << statistics.input_primitives
+            << ", clipping in/out " << statistics.clipping_invocations << "/" << statistics.clipped_primitives
+            << ", fragments " << statistics.fragment_invocations << ", compute " << statistics.compute_invocations;
+        if (snapshot.pass_area_pixels[pass] > 0)
+        {
+            // Fragments per pixel of the pass's own render area, > 1 means overdraw
+            out << ", fragments/pixel "
+                << static_cast<double>(statistics.fragment_invocations) / snapshot.pass_area_pixels[pass];
+        }
+        out << "\n";
+    }
+    out << "  draws " << snapshot.draw_calls << ", triangles " << snapshot.triangles << "\n";
+    if (snapshot.pvs_tested > 0)
+    {
+        out << "  pvs culled " << snapshot.pvs_culled << " of " << snapshot.pvs_tested << " draws\n";
+    }
+    if (snapshot.occlusion_tested > 0)
+    {
+        out << "  occlusion culled " << snapshot.occlusion_culled << " of " << snapshot.occlusion_tested
+            << " draws in " << snapshot.occlusion_ms << " ms\n";
+    }
+    for (size_t heap = 0; heap < snapshot.heap_used.size(); heap++)
+    {
+        out << "  heap " << heap << ": " << snapshot.heap_used[heap] / 1024 << " / "
+            << snapshot.heap_size[heap] / 1024 << " KiB\n";
+    }
+    out << "  pipeline cache hits " << snapshot.pipeline_cache_hits << ", misses " << snapshot.pipeline_cache_misses
+        << "\n";
+    out << "  pipeline builds " << snapshot.pipeline_builds << " (worst " << snapshot.pipeline_build_worst_ms
+        << " ms, hitches over " << kPipelineHitchMs << " ms " << snapshot.pipeline_hitches << "), optimized links "
+        << snapshot.pipelines_optimized << "\n";
+    // Over the whole history: a CPU that mostly waits for the fence is feeding a GPU-bound frame
+    float cpu_ms = 0.0f;
+    float idle_ms = 0.0f;
+    for (size_t i = 0; i < snapshot.cpu_frame_ms.size(); i++)
+    {
+        cpu_ms += snapshot.cpu_frame_ms[i];
+        idle_ms += snapshot.fence_idle_ms[i];
+    }
+    float idle_share = cpu_ms > 0.0f ? idle_ms / cpu_ms : 0.0f;
+    out << "  fence wait " << snapshot.fence_idle_ms.back() << " ms idle, " << snapshot.background_job_ms
+        << " ms on background jobs; idle " << idle_share * 100.0f << "% of cpu frame time ("
+        << (idle_share > kGpuBoundIdleShare ? "gpu" : "cpu") << "-bound)\n";
+    out << "  frames " << snapshot.frames_rendered << ", " << snapshot.frames_per_second << " fps, process cpu "
+        << snapshot.cpu_usage * 100.0f << "%";
+
+    return out.str();
+}
+
+void StartupProfile::Record(const char *name, Clock::time_point begin, Clock::time_point end)
+{
+    StageTime stage{name, std::chrono::duration<float, std::milli>(begin - start_).count(),
+                    std::chrono::duration<float, std::milli>(end - begin).count(),
+                    std::this_thread::get_id() != main_thread_};
+    std::lock_guard<std::mutex> lock(mutex_);
+    stages_.push_back(std::move(stage));
+}
+
+bool StartupProfile::MarkFirstFrame(void)
+{
+    if (first_frame_ms_ > 0.0f)
+    {
+        return false;
+    }
+    first_frame_ms_ = MillisecondsSince(start_);
+    return true;
+}
+
+/**
+ * @brief One line per stage in start order: the offset from start-up, the duration and the name.
+ */
+std::string StartupProfile::Report(void) const
+{
+    std::vector<StageTime> stages;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stages = stages_;
+    }
+    std::sort(stages.begin(), stages.end(),
+              [](const StageTime& a, const StageTime& b) { return a.begin_ms < b.begin_ms; });
+
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(1);
+    out << "[Startup] init " << init_ms_ << " ms, first frame " << first_frame_ms_ << " ms";
+    for (const StageTime& stage : stages)
+    {
+        out << "\n  +" << stage.begin_ms << " ms  " << stage.ms << " ms  " << stage.name;
+        if (stage.worker)
+        {
+            out << " (worker)";
+        }
+    }
+    return out.str();
+}
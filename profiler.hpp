@@ -0,0 +1,248 @@
+/**
+ * @file profiler.hpp
+ * @author George Power
+ * @brief Collects CPU frame times, GPU pass timings and renderer counters.
+ */
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace chim
+{
+/**
+ * @brief Passes that are timed on the GPU. Each pass owns a begin/end pair of timestamp queries and one pipeline
+ * statistics query.
+ */
+enum class ProfilePass : uint32_t
+{
+    Main = 0,
+    Temporal,
+    Overlay,
+    Probe,   // Multiview probe pass, only with --multiview
+    Foliage, // Foliage scatter compute pass, only with --foliage
+    Count
+};
+
+const char *ProfilePassName(ProfilePass pass);
+
+/**
+ * @brief Counters of a VK_QUERY_TYPE_PIPELINE_STATISTICS query, in the order the device writes them.
+ */
+struct PipelineStatistics
+{
+    uint64_t input_vertices = 0;
+    uint64_t input_primitives = 0;
+    uint64_t clipping_invocations = 0; // Primitives that reached the clipping stage
+    uint64_t clipped_primitives = 0;   // Primitives that left it
+    uint64_t fragment_invocations = 0;
+    uint64_t compute_invocations = 0;
+};
+
+/**
+ * @brief Point-in-time copy of everything the profiler knows, safe to read while the counters keep moving.
+ */
+struct ProfilerSnapshot
+{
+    std::vector<float> cpu_frame_ms; // Oldest first
+    std::vector<float> gpu_frame_ms; // Oldest first
+    std::vector<float> fence_idle_ms; // Oldest first, CPU time spent waiting for the frame's fence
+    float background_job_ms = 0.0f;   // Spent on background jobs during the last fence wait
+    uint32_t occlusion_tested = 0;    // Draws tested against the occluders in the last frame
+    uint32_t occlusion_culled = 0;
+    float occlusion_ms = 0.0f;
+    uint32_t pvs_tested = 0; // Draws looked up in the camera cell's visible set in the last frame
+    uint32_t pvs_culled = 0;
+    std::array<float, static_cast<size_t>(ProfilePass::Count)> pass_gpu_ms{};
+    std::array<PipelineStatistics, static_cast<size_t>(ProfilePass::Count)> pass_statistics{};
+    // Pixels each pass renders to, times its views; 0 for passes without fragments
+    std::array<uint64_t, static_cast<size_t>(ProfilePass::Count)> pass_area_pixels{};
+    uint64_t draw_calls = 0;
+    uint64_t triangles = 0;
+    std::vector<VkDeviceSize> heap_used;
+    std::vector<VkDeviceSize> heap_size;
+    uint64_t pipeline_cache_hits = 0;
+    uint64_t pipeline_cache_misses = 0;
+    uint64_t pipeline_builds = 0;     // Built on the render thread
+    uint64_t pipeline_hitches = 0;    // Builds longer than Profiler::kPipelineHitchMs
+    float pipeline_build_worst_ms = 0.0f;
+    uint64_t pipelines_optimized = 0; // Optimized links swapped in after a fast link
+    uint64_t frames_rendered = 0;  // Since start-up
+    float frames_per_second = 0.0f; // Over the last sampled interval
+    float cpu_usage = 0.0f;         // Process CPU time over the last sampled interval, 1 is one core fully busy
+};
+
+/**
+ * @class Profiler
+ * @brief Frame profiler backing the performance overlay.
+ * @details Counters are plain atomics so that any thread may bump them without taking a lock. GPU timestamps are
+ * written into one query pool slice per frame in flight and read back without waiting once the frame's fence has
+ * signalled, so the profiler never stalls the queue. Pipeline statistics are collected the same way when the device
+ * supports them; both query types bracket exactly the same commands of a pass.
+ */
+class Profiler
+{
+  public:
+    static constexpr uint32_t kHistorySize = 120;
+    static constexpr float kPipelineHitchMs = 4.0f; // A quarter of a 60 Hz frame
+    static constexpr float kGpuBoundIdleShare = 0.1f; // Above this share of frame time waiting on fences
+
+    void Init(VkDevice device, const VkPhysicalDeviceMemoryProperties& memory_properties, float timestamp_period,
+              uint32_t frames_in_flight, uint32_t timestamp_valid_bits, bool pipeline_statistics);
+    void Cleanup(void);
+
+    // CPU timing
+    void MarkFrame(void);
+    void SampleUsage(void);
+    void CountFenceWait(float idle_ms, float job_ms);
+
+    // GPU timing
+    void ReadGpuResults(uint32_t frame);
+    void ResetQueries(VkCommandBuffer command_buffer, uint32_t frame);
+    void BeginPass(VkCommandBuffer command_buffer, uint32_t frame, ProfilePass pass);
+    void EndPass(VkCommandBuffer command_buffer, uint32_t frame, ProfilePass pass);
+    void SetRenderArea(ProfilePass pass, VkExtent2D extent, uint32_t views = 1)
+    {
+        pass_area_pixels_[static_cast<size_t>(pass)] = uint64_t(extent.width) * extent.height * views;
+    }
+    // Statistics a secondary command buffer must inherit when executed inside a pass, 0 when they are not collected
+    VkQueryPipelineStatisticFlags StatisticsFlags(void) const { return statistics_flags_; }
+
+    // Counters
+    void CountDraws(uint32_t draw_count, uint64_t triangle_count)
+    {
+        draw_calls_.fetch_add(draw_count, std::memory_order_relaxed);
+        triangles_.fetch_add(triangle_count, std::memory_order_relaxed);
+    }
+    void CountPipeline(bool cache_hit)
+    {
+        (cache_hit ? pipeline_cache_hits_ : pipeline_cache_misses_).fetch_add(1, std::memory_order_relaxed);
+    }
+    void CountPipelineBuild(float ms);
+    void CountPipelineOptimized(void) { pipelines_optimized_.fetch_add(1, std::memory_order_relaxed); }
+    void CountOcclusion(uint32_t tested, uint32_t culled, float ms);
+    void CountPvs(uint32_t tested, uint32_t culled);
+    void TrackAllocation(VkDeviceMemory memory, uint32_t memory_type, VkDeviceSize size);
+    void TrackFree(VkDeviceMemory memory);
+
+    ProfilerSnapshot Snapshot(void) const;
+    std::string Report(void) const;
+
+  private:
+    uint32_t QueryIndex(uint32_t frame, ProfilePass pass) const
+    {
+        return (frame * static_cast<uint32_t>(ProfilePass::Count) + static_cast<uint32_t>(pass)) * 2;
+    }
+    uint32_t StatisticsIndex(uint32_t frame, ProfilePass pass) const
+    {
+        return frame * static_cast<uint32_t>(ProfilePass::Count) + static_cast<uint32_t>(pass);
+    }
+    void ReadStatistics(uint32_t frame);
+    void PushHistory(std::array<std::atomic<float>, kHistorySize>& history, float value);
+
+  private:
+    VkDevice device_ = VK_NULL_HANDLE;
+    VkQueryPool timestamp_pool_ = VK_NULL_HANDLE;
+    VkQueryPool statistics_pool_ = VK_NULL_HANDLE;
+    VkQueryPipelineStatisticFlags statistics_flags_ = 0;
+    float timestamp_period_ = 1.0f;
+    uint32_t frames_in_flight_ = 0;
+    std::vector<uint32_t> passes_written_; // Bit mask of passes recorded per frame in flight
+
+    std::chrono::steady_clock::time_point last_frame_{};
+    // Frame rate and CPU usage, resampled about once a second by SampleUsage
+    std::chrono::steady_clock::time_point last_sample_{};
+    double last_sample_cpu_seconds_ = 0.0;
+    uint64_t last_sample_frames_ = 0;
+    std::atomic<uint64_t> frames_rendered_{0};
+    std::atomic<float> frames_per_second_{0.0f};
+    std::atomic<float> cpu_usage_{0.0f};
+    std::atomic<uint32_t> history_head_{0};
+    std::array<std::atomic<float>, kHistorySize> cpu_history_{};
+    std::array<std::atomic<float>, kHistorySize> gpu_history_{};
+    std::array<std::atomic<float>, kHistorySize> fence_idle_history_{};
+    std::atomic<float> background_job_ms_{0.0f};
+    std::atomic<uint32_t> occlusion_tested_{0};
+    std::atomic<uint32_t> occlusion_culled_{0};
+    std::atomic<float> occlusion_ms_{0.0f};
+    std::atomic<uint32_t> pvs_tested_{0};
+    std::atomic<uint32_t> pvs_culled_{0};
+    std::array<std::atomic<float>, static_cast<size_t>(ProfilePass::Count)> pass_gpu_ms_{};
+    // Only written and read on the render thread, after the frame's fence
+    std::array<PipelineStatistics, static_cast<size_t>(ProfilePass::Count)> pass_statistics_{};
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(ProfilePass::Count)> pass_area_pixels_{};
+
+    // Per-frame counters are accumulated in the *_ members and published to last_* by MarkFrame
+    std::atomic<uint64_t> draw_calls_{0};
+    std::atomic<uint64_t> triangles_{0};
+    std::atomic<uint64_t> last_draw_calls_{0};
+    std::atomic<uint64_t> last_triangles_{0};
+    std::atomic<uint64_t> pipeline_cache_hits_{0};
+    std::atomic<uint64_t> pipeline_cache_misses_{0};
+    std::atomic<uint64_t> pipeline_builds_{0};
+    std::atomic<uint64_t> pipeline_hitches_{0};
+    std::atomic<float> pipeline_build_worst_ms_{0.0f};
+    std::atomic<uint64_t> pipelines_optimized_{0};
+
+    VkPhysicalDeviceMemoryProperties memory_properties_{};
+    std::array<std::atomic<uint64_t>, VK_MAX_MEMORY_HEAPS> heap_used_{};
+    std::mutex allocations_mutex_; // Guards the bookkeeping map only, never the counters
+    std::unordered_map<VkDeviceMemory, std::pair<uint32_t, VkDeviceSize>> allocations_;
+};
+/**
+ * @class StartupProfile
+ * @brief Wall-clock timings of the start-up stages and the time to the first frame.
+ * @details Stages may run on worker threads and overlap; each is recorded with its offset from the start so the report
+ * shows what ran in parallel. The clock starts when the profile is constructed, together with the renderer.
+ */
+class StartupProfile
+{
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    // Runs stage and records how long it took under name. Safe to call from any thread.
+    template <typename Stage> void Time(const char *name, Stage&& stage)
+    {
+        Clock::time_point begin = Clock::now();
+        stage();
+        Record(name, begin, Clock::now());
+    }
+    void Record(const char *name, Clock::time_point begin, Clock::time_point end);
+    void MarkInitialized(void) { init_ms_ = MillisecondsSince(start_); }
+    // True the first time it is called
+    bool MarkFirstFrame(void);
+    std::string Report(void) const;
+
+  private:
+    struct StageTime
+    {
+        std::string name;
+        float begin_ms;
+        float ms;
+        bool worker; // Not run on the thread that constructed the profile
+    };
+
+    float MillisecondsSince(Clock::time_point time) const
+    {
+        return std::chrono::duration<float, std::milli>(Clock::now() - time).count();
+    }
+
+  private:
+    Clock::time_point start_ = Clock::now();
+    std::thread::id main_thread_ = std::this_thread::get_id();
+    mutable std::mutex mutex_; // Guards stages_
+    std::vector<StageTime> stages_;
+    float init_ms_ = 0.0f;
+    float first_frame_ms_ = 0.0f; // 0 until the first frame has been submitted
+};
+} // namespace chim
+#endif // PROFILER_HPP
@@ -0,0 +1,300 @@
+#include "pvs.hpp"
+#include "bvh.hpp"
+#include "capture.hpp"
+#include "chim.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <map>
+#include <thread>
+
+using namespace chim;
+
+namespace
+{
+// Deterministic per cell, so a bake gives the same result on any number of threads
+float Random(uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+}
+
+struct PvsObject
+{
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+    std::vector<glm::vec3> samples;
+};
+
+bool BoxesOverlap(const glm::vec3& min_a, const glm::vec3& max_a, const glm::vec3& min_b, const glm::vec3& max_b)
+{
+    return min_a.x <= max_b.x && min_b.x <= max_a.x && min_a.y <= max_b.y && min_b.y <= max_a.y &&
+           min_a.z <= max_b.z && min_b.z <= max_a.z;
+}
+
+/**
+ * @brief Picks points on the object's triangles, with a chance proportional to each triangle's area.
+ */
+std::vector<glm::vec3> SampleSurface(const std::vector<glm::vec3>& triangles, uint32_t count, uint32_t seed)
+{
+    std::vector<float> cumulativeArea;
+    float total = 0.0f;
+    for (size_t i = 0; i + 2 < triangles.size(); i += 3)
+    {
+        total += glm::length(glm::cross(triangles[i + 1] - triangles[i], triangles[i + 2] - triangles[i])) * 0.5f;
+        cumulativeArea.push_back(total);
+    }
+    if (cumulativeArea.empty())
+    {
+        return {};
+    }
+
+    std::vector<glm::vec3> samples;
+    uint32_t state = seed * 2654435761u + 1;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        size_t triangle = std::lower_bound(cumulativeArea.begin(), cumulativeArea.end(), Random(state) * total) -
+                          cumulativeArea.begin();
+        triangle = std::min(triangle, cumulativeArea.size() - 1);
+        float u = Random(state);
+        float v = Random(state);
+        if (u + v > 1.0f)
+        {
+            u = 1.0f - u;
+            v = 1.0f - v;
+        }
+        const glm::vec3 *corners = &triangles[triangle * 3];
+        samples.push_back(corners[0] + (corners[1] - corners[0]) * u + (corners[2] - corners[0]) * v);
+    }
+    return samples;
+}
+} // namespace
+
+std::optional<uint32_t> PvsGrid::CellAt(const glm::vec3& position) const
+{
+    uint32_t index[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float cell = std::floor((position[axis] - origin[axis]) / cell_size[axis]);
+        if (!(cell >= 0.0f && cell < static_cast<float>(cells[axis])))
+        {
+            return std::nullopt;
+        }
+        index[axis] = static_cast<uint32_t>(cell);
+    }
+    return (index[2] * cells.y + index[1]) * cells.x + index[0];
+}
+
+std::optional<uint32_t> PvsGrid::FindObject(const DrawCommand& draw) const
+{
+    auto found = std::find(objects.begin(), objects.end(), draw);
+    if (found == objects.end())
+    {
+        return std::nullopt;
+    }
+    return static_cast<uint32_t>(found - objects.begin());
+}
+
+/**
+ * @brief Serializes the grid for a CaptureOp::Visibility record.
+ * @details Row indices are stored as uint16_t whenever there are few enough distinct rows, which is the common case.
+ */
+std::vector<uint8_t> PvsGrid::Encode(void) const
+{
+    PayloadWriter out;
+    out.Put(kVersion);
+    out.Put(origin);
+    out.Put(cell_size);
+    out.Put(cells);
+    out.Put(static_cast<uint32_t>(objects.size()));
+    out.Put(objects.data(), objects.size() * sizeof(DrawCommand));
+
+    const uint32_t rowCount = WordsPerRow() > 0 ? static_cast<uint32_t>(rows.size() / WordsPerRow()) : 0;
+    out.Put(rowCount);
+    out.Put(rows.data(), rows.size() * sizeof(uint64_t));
+    for (uint32_t row : cell_rows)
+    {
+        if (rowCount <= UINT16_MAX)
+        {
+            out.Put(static_cast<uint16_t>(row));
+        }
+        else
+        {
+            out.Put(row);
+        }
+    }
+    return std::move(out.Bytes());
+}
+
+PvsGrid PvsGrid::Decode(const std::vector<uint8_t>& payload)
+{
+    PayloadReader in(payload);
+    if (in.Get<uint32_t>() != kVersion)
+    {
+        throw ChimException("Unsupported visibility record version!");
+    }
+
+    PvsGrid grid;
+    grid.origin = in.Get<glm::vec3>();
+    grid.cell_size = in.Get<glm::vec3>();
+    grid.cells = in.Get<glm::uvec3>();
+    const uint64_t cellCount = static_cast<uint64_t>(grid.cells.x) * grid.cells.y * grid.cells.z;
+    if (cellCount > payload.size())
+    {
+        throw ChimException("Malformed visibility record!");
+    }
+
+    grid.objects.resize(std::min<size_t>(in.Get<uint32_t>(), payload.size()));
+    in.Get(grid.objects.data(), grid.objects.size() * sizeof(DrawCommand));
+
+    const uint32_t rowCount = in.Get<uint32_t>();
+    grid.rows.resize(std::min<size_t>(static_cast<size_t>(rowCount) * grid.WordsPerRow(), payload.size()));
+    in.Get(grid.rows.data(), grid.rows.size() * sizeof(uint64_t));
+
+    grid.cell_rows.resize(cellCount);
+    for (uint32_t& row : grid.cell_rows)
+    {
+        row = rowCount <= UINT16_MAX ? in.Get<uint16_t>() : in.Get<uint32_t>();
+        if (row >= rowCount)
+        {
+            throw ChimException("Malformed visibility record!");
+        }
+    }
+    return grid;
+}
+
+/**
+ * @brief Bakes a PVS for the static geometry of a capture.
+ * @details The distinct draws of the capture are the objects. The grid covers their bounds plus a margin, so that a
+ * camera standing a little outside the scene still finds a cell. An object is visible from a cell when it overlaps
+ * the cell, or when any segment from a random point in the cell to a random point on the object's surface is not
+ * blocked by another object. This is sampled, not exact: with too few samples small gaps are missed and the objects
+ * behind them pop in late, so the defaults lean towards more samples. Cells are baked on a pool of threads that take
+ * the next unbaked cell until none are left; identical rows are merged afterwards.
+ */
+PvsGrid chim::BakePvs(const Capture& capture, const PvsBakeSettings& settings)
+{
+    PvsGrid grid;
+    grid.objects = CapturedObjects(capture);
+
+    // One triangle soup for the whole scene, tagged with the object every triangle belongs to
+    std::vector<PvsObject> objects(grid.objects.size());
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> triangleObjects;
+    glm::vec3 sceneMin(std::numeric_limits<float>::max());
+    glm::vec3 sceneMax(-std::numeric_limits<float>::max());
+    for (uint32_t object = 0; object < grid.objects.size(); object++)
+    {
+        std::vector<glm::vec3> triangles;
+        for (uint32_t vertex : DrawTriangleVertices(capture, grid.objects[object]))
+        {
+            const glm::vec3& corner = capture.vertices[vertex].pos;
+            objects[object].min = glm::min(objects[object].min, corner);
+            objects[object].max = glm::max(objects[object].max, corner);
+            triangles.push_back(corner);
+            positions.push_back(corner);
+            if (triangles.size() % 3 == 0)
+            {
+                triangleObjects.push_back(object);
+            }
+        }
+        if (!triangles.empty())
+        {
+            sceneMin = glm::min(sceneMin, objects[object].min);
+            sceneMax = glm::max(sceneMax, objects[object].max);
+        }
+        objects[object].samples = SampleSurface(triangles, std::max(1u, settings.object_samples), object);
+    }
+    if (positions.empty())
+    {
+        throw ChimException("Failed to bake visibility: the capture has no geometry!");
+    }
+
+    TriangleBvh bvh;
+    bvh.Build(positions, triangleObjects);
+
+    const glm::vec3 extent = sceneMax - sceneMin;
+    const float margin = std::max({extent.x, extent.y, extent.z, 1e-3f}) * 0.25f;
+    grid.cells = glm::uvec3(std::max(1u, settings.cells.x), std::max(1u, settings.cells.y),
+                            std::max(1u, settings.cells.z));
+    grid.origin = sceneMin - glm::vec3(margin);
+    for (int axis = 0; axis < 3; axis++)
+    {
+        grid.cell_size[axis] = (extent[axis] + 2.0f * margin) / static_cast<float>(grid.cells[axis]);
+    }
+
+    const uint32_t cellCount = grid.cells.x * grid.cells.y * grid.cells.z;
+    const uint32_t words = grid.WordsPerRow();
+    std::vector<uint64_t> cellBits(static_cast<size_t>(cellCount) * words, 0);
+    std::atomic<uint32_t> nextCell{0};
+    auto bakeCells = [&]() {
+        std::vector<glm::vec3> starts(std::max(1u, settings.cell_samples));
+        for (uint32_t cell = nextCell++; cell < cellCount; cell = nextCell++)
+        {
+            const glm::uvec3 index(cell % grid.cells.x, (cell / grid.cells.x) % grid.cells.y,
+                                   cell / (grid.cells.x * grid.cells.y));
+            glm::vec3 cellMin;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                cellMin[axis] = grid.origin[axis] + index[axis] * grid.cell_size[axis];
+            }
+            const glm::vec3 cellMax = cellMin + grid.cell_size;
+
+            uint32_t state = cell * 2246822519u + 0x9E3779B9u;
+            for (glm::vec3& start : starts)
+            {
+                start = cellMin + glm::vec3(Random(state), Random(state), Random(state)) * grid.cell_size;
+            }
+
+            uint64_t *bits = cellBits.data() + static_cast<size_t>(cell) * words;
+            for (uint32_t object = 0; object < objects.size(); object++)
+            {
+                bool visible = BoxesOverlap(cellMin, cellMax, objects[object].min, objects[object].max);
+                for (size_t s = 0; s < starts.size() && !visible; s++)
+                {
+                    for (size_t t = 0; t < objects[object].samples.size() && !visible; t++)
+                    {
+                        visible = !bvh.Occluded(starts[s], objects[object].samples[t], object);
+                    }
+                }
+                if (visible)
+                {
+                    bits[object / 64] |= 1ull << (object % 64);
+                }
+            }
+        }
+    };
+
+    const uint32_t threads =
+        settings.threads > 0 ? settings.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::future<void>> workers;
+    for (uint32_t i = 1; i < std::min(threads, cellCount); i++)
+    {
+        workers.push_back(std::async(std::launch::async, bakeCells));
+    }
+    bakeCells();
+    for (std::future<void>& worker : workers)
+    {
+        worker.get();
+    }
+
+    std::map<std::vector<uint64_t>, uint32_t> rowIndex;
+    grid.cell_rows.resize(cellCount);
+    for (uint32_t cell = 0; cell < cellCount; cell++)
+    {
+        std::vector<uint64_t> row(cellBits.begin() + static_cast<size_t>(cell) * words,
+                                  cellBits.begin() + static_cast<size_t>(cell + 1) * words);
+        auto [found, inserted] = rowIndex.try_emplace(row, static_cast<uint32_t>(rowIndex.size()));
+        if (inserted)
+        {
+            grid.rows.insert(grid.rows.end(), row.begin(), row.end());
+        }
+        grid.cell_rows[cell] = found->second;
+    }
+    return grid;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file pvs.hpp
+ * @author George Power
+ * @brief Potentially visible sets: per-cell object visibility baked offline for static scenes.
+ */
+#ifndef PVS_HPP
+#define PVS_HPP
+
+#include "render_types.hpp"
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <optional>
+#include <vector>
+
+namespace chim
+{
+struct Capture;
+
+/**
+ * @struct PvsGrid
+ * @brief A uniform grid over the scene, in object space, with the set of objects visible from each cell.
+ * @details Objects are the distinct draws of the scene, identified by their DrawCommand as it was captured. Cells that
+ * see the same objects share one row of the bitset, so open areas and solid space cost one entry per cell.
+ */
+struct PvsGrid
+{
+    static constexpr uint32_t kVersion = 1;
+
+    glm::vec3 origin = glm::vec3(0.0f);
+    glm::vec3 cell_size = glm::vec3(1.0f);
+    glm::uvec3 cells = glm::uvec3(0);
+    std::vector<DrawCommand> objects;
+    std::vector<uint32_t> cell_rows; // Row of every cell, x fastest
+    std::vector<uint64_t> rows;      // WordsPerRow() words per row, bit i set when objects[i] is visible
+
+    uint32_t WordsPerRow(void) const { return static_cast<uint32_t>((objects.size() + 63) / 64); }
+    std::optional<uint32_t> CellAt(const glm::vec3& position) const;
+    const uint64_t *CellBits(uint32_t cell) const { return rows.data() + cell_rows[cell] * WordsPerRow(); }
+    std::optional<uint32_t> FindObject(const DrawCommand& draw) const;
+
+    std::vector<uint8_t> Encode(void) const;
+    static PvsGrid Decode(const std::vector<uint8_t>& payload);
+};
+
+struct PvsBakeSettings
+{
+    glm::uvec3 cells = glm::uvec3(16, 16, 4);
+    uint32_t cell_samples = 32;   // Points per cell that rays start from
+    uint32_t object_samples = 32; // Points on the surface of each object that rays aim at
+    uint32_t threads = 0;         // 0 uses every hardware thread
+};
+
+PvsGrid BakePvs(const Capture& capture, const PvsBakeSettings& settings);
+
+inline bool PvsVisible(const uint64_t *bits, uint32_t object)
+{
+    return (bits[object / 64] >> (object % 64)) & 1;
+}
+} // namespace chim
+#endif // PVS_HPP
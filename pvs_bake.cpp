@@ -0,0 +1,112 @@
+#include "capture.hpp"
+#include "pvs.hpp"
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <string>
+
+namespace
+{
+constexpr const char *kUsage =
+    "Usage: chim_pvs [options] <capture>\n"
+    "  --cells <x> <y> <z>  Cells of the grid along each axis (default 16 16 4)\n"
+    "  --samples <count>    Points per cell and per object that visibility rays connect (default 32)\n"
+    "  --threads <count>    Worker threads (default: one per hardware thread)";
+
+// Whether some cell cannot see some object. A flat scene, or one without walls, sees everything from everywhere.
+bool CullsAnything(const chim::PvsGrid& grid)
+{
+    const size_t rowCount = grid.WordsPerRow() > 0 ? grid.rows.size() / grid.WordsPerRow() : 0;
+    for (size_t row = 0; row < rowCount; row++)
+    {
+        for (uint32_t object = 0; object < grid.objects.size(); object++)
+        {
+            if (!chim::PvsVisible(grid.rows.data() + row * grid.WordsPerRow(), object))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+} // namespace
+
+/**
+ * @brief Bakes the potentially visible sets of a capture's static scene and stores them in the capture.
+ * @details Replays of the capture then look up the camera's cell and skip every draw it cannot see. Baking again
+ * replaces the stored sets.
+ */
+int main(int argc, char *argv[])
+{
+    chim::PvsBakeSettings settings;
+    std::string path;
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string option = argv[i];
+            if (option == "--cells" && i + 3 < argc)
+            {
+                settings.cells.x = static_cast<uint32_t>(std::stoul(argv[++i]));
+                settings.cells.y = static_cast<uint32_t>(std::stoul(argv[++i]));
+                settings.cells.z = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (option == "--samples" && i + 1 < argc)
+            {
+                settings.cell_samples = static_cast<uint32_t>(std::stoul(argv[++i]));
+                settings.object_samples = settings.cell_samples;
+            }
+            else if (option == "--threads" && i + 1 < argc)
+            {
+                settings.threads = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (option.rfind("--", 0) == 0 || !path.empty())
+            {
+                throw std::invalid_argument(option);
+            }
+            else
+            {
+                path = option;
+            }
+        }
+    }
+    catch (std::exception&)
+    {
+        path.clear();
+    }
+    if (path.empty())
+    {
+        std::cerr << kUsage << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        chim::Capture capture = chim::LoadCapture(path);
+        auto start = std::chrono::steady_clock::now();
+        chim::PvsGrid grid = chim::BakePvs(capture, settings);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // Sets that rule nothing out would only cost replays a lookup per frame, so they are not stored
+        std::vector<uint8_t> payload;
+        if (CullsAnything(grid))
+        {
+            payload = grid.Encode();
+        }
+        else
+        {
+            std::cout << "Every cell sees every object, so no visible sets are stored" << std::endl;
+        }
+        chim::ReplaceCaptureRecord(path, chim::CaptureOp::Visibility, payload);
+        const size_t distinctRows = grid.WordsPerRow() > 0 ? grid.rows.size() / grid.WordsPerRow() : 0;
+        std::cout << "Baked " << grid.objects.size() << " objects in " << grid.cell_rows.size() << " cells ("
+                  << distinctRows << " distinct sets, " << payload.size() << " bytes) in " << seconds << " s"
+                  << std::endl;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
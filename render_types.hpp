@@ -0,0 +1,147 @@
+/**
+ * @file render_types.hpp
+ * @author George Power
+ * @brief Plain data types shared by the renderer and its tools.
+ */
+#ifndef RENDER_TYPES_HPP
+#define RENDER_TYPES_HPP
+
+#define GLM_FORCE_RADIANS
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.h>
+
+namespace chim
+{
+struct Vertex
+{
+    glm::vec3 pos;
+    glm::vec3 color;
+
+    static VkVertexInputBindingDescription GetBindingDescription()
+    {
+        VkVertexInputBindingDescription binding_description{};
+        binding_description.binding = 0;
+        binding_description.stride = sizeof(Vertex);
+        binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return binding_description;
+    }
+
+    static std::array<VkVertexInputAttributeDescription, 2> GetAttributeDescriptions()
+    {
+        std::array<VkVertexInputAttributeDescription, 2> attribute_descriptions{};
+        attribute_descriptions[0].binding = 0;
+        attribute_descriptions[0].location = 0;
+        attribute_descriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+        attribute_descriptions[0].offset = offsetof(Vertex, pos);
+
+        attribute_descriptions[1].binding = 0;
+        attribute_descriptions[1].location = 1;
+        attribute_descriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+        attribute_descriptions[1].offset = offsetof(Vertex, color);
+
+        return attribute_descriptions;
+    }
+};
+
+struct UniformBufferObject
+{
+    glm::mat4 model;
+    glm::mat4 view;
+    glm::mat4 proj;
+    // Previous frame's transforms, for motion vectors. prev_view_proj has no jitter.
+    glm::mat4 prev_model;
+    glm::mat4 prev_view_proj;
+    glm::vec4 jitter; // xy: offset that proj adds in normalized device coordinates
+};
+
+const uint32_t kMaxProbeViews = 6;
+
+/**
+ * @brief Uniforms of the multiview probe pass, see shaders/basic_multiview.vert. View i renders attachment layer i.
+ */
+struct ProbeUniformBufferObject
+{
+    glm::mat4 model;
+    glm::mat4 view_proj[kMaxProbeViews];
+};
+
+/**
+ * @brief Push constants of the frame stream conversion, see shaders/stream.comp.
+ */
+struct StreamConstants
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t yuv; // 1 for 4:2:0 YUV, 0 for RGBA
+    uint32_t padding;
+};
+
+/**
+ * @brief Push constants of the foliage scatter pass, see shaders/foliage.comp. Exactly the 128 bytes every device
+ * supports.
+ */
+struct FoliageConstants
+{
+    glm::vec4 planes[5];   // World space frustum: left, right, bottom, top, near
+    glm::vec4 camera;      // xyz: world position, w: view distance
+    glm::vec4 field;       // xy: corner of the density map, z: its size, w: spacing of the placement grid
+    glm::ivec2 first_cell; // Grid cell of the first invocation
+    uint32_t cells;        // Invocations along each side of the grid
+    float lod_distance;    // Blades nearer than this get the full mesh
+};
+
+/**
+ * @brief A blade placed by the foliage scatter pass, as read by shaders/foliage.vert.
+ */
+struct FoliageInstance
+{
+    glm::vec4 position_height; // xyz: root in world space, w: height
+    glm::vec4 color_angle;     // rgb: colour at the tip, a: facing around +Z in radians
+};
+
+/**
+ * @brief Push constants of the foliage draws, see shaders/foliage.vert.
+ */
+struct FoliageDrawConstants
+{
+    uint32_t lod;      // 0 for the full blade, 1 for a single triangle
+    uint32_t capacity; // Instances the buffer holds; the far blades fill it from the end
+};
+
+// The shaders read these with std430 offsets, which push constant blocks and storage buffers use
+static_assert(offsetof(FoliageConstants, camera) == 80 && offsetof(FoliageConstants, field) == 96 &&
+                  offsetof(FoliageConstants, first_cell) == 112 && offsetof(FoliageConstants, cells) == 120 &&
+                  offsetof(FoliageConstants, lod_distance) == 124 && sizeof(FoliageConstants) == 128,
+              "FoliageConstants must match the push constants of foliage.comp");
+static_assert(offsetof(FoliageInstance, color_angle) == 16 && sizeof(FoliageInstance) == 32,
+              "FoliageInstance must match the Instance of foliage.comp and foliage.vert");
+static_assert(offsetof(FoliageDrawConstants, capacity) == 4 && sizeof(FoliageDrawConstants) == 8,
+              "FoliageDrawConstants must match the push constants of foliage.vert");
+
+/**
+ * @brief Push constants of the vertex pulling path, see shaders/basic_pull.vert.
+ */
+struct VertexPullConstants
+{
+    VkDeviceAddress vertices; // Device address of the geometry vertex buffer
+    uint32_t stride;          // Floats per vertex
+    uint32_t padding;
+};
+
+/**
+ * @brief One indexed draw out of the shared vertex and index buffers.
+ */
+struct DrawCommand
+{
+    uint32_t index_count;
+    uint32_t first_index;
+    int32_t vertex_offset;
+
+    bool operator==(const DrawCommand&) const = default;
+};
+} // namespace chim
+#endif // RENDER_TYPES_HPP
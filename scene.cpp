@@ -0,0 +1,118 @@
+#include "scene.hpp"
+#include "chim.hpp"
+
+using namespace chim;
+
+namespace
+{
+/**
+ * @brief Appends a box as its own draw. Each face has its own vertices, shaded by the way it faces, and is wound
+ * counter-clockwise seen from outside.
+ */
+void AddBox(SceneGeometry& scene, const glm::vec3& min, const glm::vec3& max, const glm::vec3& color)
+{
+    // Corners of each face in counter-clockwise order seen from outside, as (x, y, z) picks of min (0) or max (1)
+    const uint8_t faces[6][4][3] = {
+        {{0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1}}, // +Z
+        {{0, 0, 0}, {0, 1, 0}, {1, 1, 0}, {1, 0, 0}}, // -Z
+        {{1, 0, 0}, {1, 1, 0}, {1, 1, 1}, {1, 0, 1}}, // +X
+        {{0, 0, 0}, {0, 0, 1}, {0, 1, 1}, {0, 1, 0}}, // -X
+        {{0, 1, 0}, {0, 1, 1}, {1, 1, 1}, {1, 1, 0}}, // +Y
+        {{0, 0, 0}, {1, 0, 0}, {1, 0, 1}, {0, 0, 1}}, // -Y
+    };
+    const float shades[6] = {1.0f, 0.45f, 0.8f, 0.6f, 0.7f, 0.55f};
+
+    const DrawCommand draw{36, static_cast<uint32_t>(scene.indices.size()), 0};
+    for (uint32_t face = 0; face < 6; face++)
+    {
+        const uint16_t first = static_cast<uint16_t>(scene.vertices.size());
+        for (const auto& corner : faces[face])
+        {
+            const glm::vec3 position(corner[0] ? max.x : min.x, corner[1] ? max.y : min.y,
+                                     corner[2] ? max.z : min.z);
+            scene.vertices.push_back({position, color * shades[face]});
+        }
+        for (uint16_t index : {0, 1, 2, 2, 3, 0})
+        {
+            scene.indices.push_back(static_cast<uint16_t>(first + index));
+        }
+    }
+    scene.draws.push_back(draw);
+}
+
+/**
+ * @brief Appends a square of ground at z = 0 as its own draw, split into cells so that the lightmap, which is
+ * resolved at the vertices, can show the shadows falling on it.
+ */
+void AddGround(SceneGeometry& scene, float size, uint32_t cells, const glm::vec3& color)
+{
+    const DrawCommand draw{6 * cells * cells, static_cast<uint32_t>(scene.indices.size()), 0};
+    const uint16_t first = static_cast<uint16_t>(scene.vertices.size());
+    for (uint32_t y = 0; y <= cells; y++)
+    {
+        for (uint32_t x = 0; x <= cells; x++)
+        {
+            const glm::vec3 position((x / float(cells) - 0.5f) * size, (y / float(cells) - 0.5f) * size, 0.0f);
+            scene.vertices.push_back({position, color});
+        }
+    }
+    for (uint32_t y = 0; y < cells; y++)
+    {
+        for (uint32_t x = 0; x < cells; x++)
+        {
+            const uint32_t corner = first + y * (cells + 1) + x;
+            const uint32_t above = corner + cells + 1;
+            for (uint32_t index : {corner, corner + 1, above + 1, above + 1, above, corner})
+            {
+                scene.indices.push_back(static_cast<uint16_t>(index));
+            }
+        }
+    }
+    scene.draws.push_back(draw);
+}
+} // namespace
+
+/**
+ * @brief The original coloured quad, one draw.
+ */
+SceneGeometry chim::QuadScene(void)
+{
+    return {vertices, indices, {{static_cast<uint32_t>(indices.size()), 0, 0}}};
+}
+
+/**
+ * @brief A square of ground with a wall across it and a row of blocks on either side, each a draw of its own.
+ * @details As the scene turns the wall hides one row or the other, which gives occlusion culling, the visible sets
+ * and the lightmap baker real depth and shadows to work with.
+ */
+SceneGeometry chim::BlocksScene(void)
+{
+    SceneGeometry scene;
+    AddGround(scene, 4.0f, 24, glm::vec3(0.45f, 0.6f, 0.35f));
+    AddBox(scene, glm::vec3(-1.6f, -0.08f, 0.0f), glm::vec3(1.6f, 0.08f, 1.0f), glm::vec3(0.85f, 0.8f, 0.75f));
+
+    const glm::vec3 colors[4] = {{0.9f, 0.3f, 0.25f}, {0.3f, 0.5f, 0.9f}, {0.95f, 0.8f, 0.3f}, {0.6f, 0.4f, 0.8f}};
+    for (int32_t side = -1; side <= 1; side += 2)
+    {
+        for (int32_t i = 0; i < 4; i++)
+        {
+            const glm::vec3 centre(-1.2f + 0.8f * i, 0.7f * side, 0.0f);
+            const float height = 0.25f + 0.1f * ((i + side + 2) % 3);
+            AddBox(scene, centre - glm::vec3(0.15f, 0.15f, 0.0f), centre + glm::vec3(0.15f, 0.15f, height), colors[i]);
+        }
+    }
+    return scene;
+}
+
+SceneGeometry chim::BuiltinScene(const std::string& name)
+{
+    if (name == "quad")
+    {
+        return QuadScene();
+    }
+    if (name == "blocks")
+    {
+        return BlocksScene();
+    }
+    throw ChimException("Unknown scene " + name + ", expected quad or blocks!");
+}
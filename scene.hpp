@@ -0,0 +1,31 @@
+/**
+ * @file scene.hpp
+ * @author George Power
+ * @brief Built-in scenes to render when no capture is replayed.
+ */
+#ifndef SCENE_HPP
+#define SCENE_HPP
+
+#include "render_types.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace chim
+{
+/**
+ * @struct SceneGeometry
+ * @brief Vertices and indices of a scene, and its draws relative to them.
+ */
+struct SceneGeometry
+{
+    std::vector<Vertex> vertices;
+    std::vector<uint16_t> indices;
+    std::vector<DrawCommand> draws;
+};
+
+SceneGeometry QuadScene(void);
+SceneGeometry BlocksScene(void);
+SceneGeometry BuiltinScene(const std::string& name);
+} // namespace chim
+#endif // SCENE_HPP
@@ -0,0 +1,236 @@
+#include "settings.hpp"
+#include "chim.hpp"
+
+using namespace chim;
+
+namespace
+{
+const char *NextArgument(int argc, char *argv[], int& i)
+{
+    if (i + 1 >= argc)
+    {
+        throw ChimException(std::string("Missing value for ") + argv[i] + "\n" + Usage());
+    }
+    return argv[++i];
+}
+
+uint32_t ParseCount(const char *value, const char *option)
+{
+    try
+    {
+        return static_cast<uint32_t>(std::stoul(value));
+    }
+    catch (const std::exception&)
+    {
+        throw ChimException(std::string("Invalid number for ") + option + ": " + value);
+    }
+}
+
+float ParseScale(const char *value, const char *option)
+{
+    float scale = 0.0f;
+    try
+    {
+        scale = std::stof(value);
+    }
+    catch (const std::exception&)
+    {
+        throw ChimException(std::string("Invalid number for ") + option + ": " + value);
+    }
+    if (!(scale >= 0.25f && scale <= 1.0f))
+    {
+        throw ChimException(std::string(option) + " must be between 0.25 and 1: " + value);
+    }
+    return scale;
+}
+
+float ParsePositive(const char *value, const char *option)
+{
+    float number = 0.0f;
+    try
+    {
+        number = std::stof(value);
+    }
+    catch (const std::exception&)
+    {
+        throw ChimException(std::string("Invalid number for ") + option + ": " + value);
+    }
+    if (!(number > 0.0f))
+    {
+        throw ChimException(std::string(option) + " must be positive: " + value);
+    }
+    return number;
+}
+} // namespace
+
+/**
+ * @brief Builds the settings from the command line. Unknown options are an error.
+ */
+ChimSettings chim::ParseArguments(int argc, char *argv[])
+{
+    ChimSettings settings;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+        if (option == "--width")
+        {
+            settings.width = ParseCount(NextArgument(argc, argv, i), "--width");
+        }
+        else if (option == "--height")
+        {
+            settings.height = ParseCount(NextArgument(argc, argv, i), "--height");
+        }
+        else if (option == "--scene")
+        {
+            settings.scene = NextArgument(argc, argv, i);
+            if (settings.scene != "quad" && settings.scene != "blocks")
+            {
+                throw ChimException("--scene must be quad or blocks: " + settings.scene);
+            }
+        }
+        else if (option == "--headless")
+        {
+            settings.headless = true;
+        }
+        else if (option == "--frames")
+        {
+            settings.frame_limit = ParseCount(NextArgument(argc, argv, i), "--frames");
+        }
+        else if (option == "--render-scale")
+        {
+            settings.render_scale = ParseScale(NextArgument(argc, argv, i), "--render-scale");
+        }
+        else if (option == "--on-demand")
+        {
+            settings.on_demand = true;
+        }
+        else if (option == "--vertex-pulling")
+        {
+            settings.vertex_pulling = true;
+        }
+        else if (option == "--no-pipeline-library")
+        {
+            settings.pipeline_library = false;
+        }
+        else if (option == "--descriptor-buffer")
+        {
+            settings.descriptor_buffer = true;
+        }
+        else if (option == "--multiview")
+        {
+            const char *value = NextArgument(argc, argv, i);
+            settings.multiview_views = ParseCount(value, "--multiview");
+            if (settings.multiview_views != 2 && settings.multiview_views != 6)
+            {
+                throw ChimException(std::string("--multiview must be 2 or 6: ") + value);
+            }
+        }
+        else if (option == "--capture")
+        {
+            settings.capture_path = NextArgument(argc, argv, i);
+            settings.capture_frames = ParseCount(NextArgument(argc, argv, i), "--capture");
+        }
+        else if (option == "--export")
+        {
+            settings.export_socket = NextArgument(argc, argv, i);
+            settings.headless = true;
+        }
+        else if (option == "--export-timeout")
+        {
+            settings.export_timeout = ParseCount(NextArgument(argc, argv, i), "--export-timeout");
+        }
+        else if (option == "--stream")
+        {
+            settings.stream_path = NextArgument(argc, argv, i);
+        }
+        else if (option == "--stream-fps")
+        {
+            settings.stream_fps = std::max(1u, ParseCount(NextArgument(argc, argv, i), "--stream-fps"));
+        }
+        else if (option == "--cache-dir")
+        {
+            settings.cache_directory = NextArgument(argc, argv, i);
+        }
+        else if (option == "--no-disk-cache")
+        {
+            settings.cache_directory.clear();
+        }
+        else if (option == "--perf-counters")
+        {
+            settings.perf_counters = true;
+        }
+        else if (option == "--occlusion-culling")
+        {
+            settings.occlusion_culling = true;
+        }
+        else if (option == "--no-pvs")
+        {
+            settings.pvs = false;
+        }
+        else if (option == "--no-lightmap")
+        {
+            settings.lightmap = false;
+        }
+        else if (option == "--foliage")
+        {
+            settings.foliage = true;
+        }
+        else if (option == "--foliage-distance")
+        {
+            settings.foliage_distance = ParsePositive(NextArgument(argc, argv, i), "--foliage-distance");
+        }
+        else if (option == "--foliage-density")
+        {
+            settings.foliage_density = ParsePositive(NextArgument(argc, argv, i), "--foliage-density");
+        }
+        else if (option == "--serve")
+        {
+            settings.serve_socket = NextArgument(argc, argv, i);
+            settings.headless = true;
+        }
+        else if (option == "--replay")
+        {
+            settings.replay_path = NextArgument(argc, argv, i);
+            settings.headless = true;
+        }
+        else
+        {
+            throw ChimException("Unknown option " + option + "\n" + Usage());
+        }
+    }
+
+    return settings;
+}
+
+std::string chim::Usage(void)
+{
+    return "Usage: CHIM [options]\n"
+           "  --width <pixels>             Window or render target width\n"
+           "  --height <pixels>            Window or render target height\n"
+           "  --scene <quad|blocks>        Built-in scene: a single quad, or blocks hidden behind a wall in turn\n"
+           "  --headless                   Render offscreen, without a window\n"
+           "  --frames <count>             Exit after <count> frames\n"
+           "  --render-scale <0.25..1>     Render the scene at a fraction of the resolution and upscale it\n"
+           "  --on-demand                  Only redraw when something changed, sleep otherwise\n"
+           "  --vertex-pulling             Fetch vertices from a storage buffer by device address\n"
+           "  --no-pipeline-library        Compile whole pipelines instead of linking pipeline library parts\n"
+           "  --descriptor-buffer          Bind scene descriptors from a descriptor buffer instead of descriptor sets\n"
+           "  --multiview <2|6>            Also render a stereo pair or cube map probe in one multiview pass\n"
+           "  --capture <file> <frames>    Record the first <frames> frames into <file>\n"
+           "  --replay <file>              Replay a capture headless and report frame times\n"
+           "  --export <socket>            Render headless and share frames with the process connecting to <socket>\n"
+           "  --export-timeout <seconds>   How long to wait for that process, 0 for as long as it takes (default 60)\n"
+           "  --stream <file>              Stream frames into <file> or a pipe: Y4M for *.y4m, raw RGBA otherwise\n"
+           "  --stream-fps <fps>           Frame rate declared in the Y4M header (default 60)\n"
+           "  --serve <socket>             Stay up headless and render the jobs sent to <socket>\n"
+           "  --cache-dir <dir>            Keep the pipeline cache and device snapshot in <dir> (default .)\n"
+           "  --no-disk-cache              Neither load nor save them\n"
+           "  --perf-counters              Count CPU cycles, instructions and misses per frame phase (Linux)\n"
+           "  --occlusion-culling          Skip draws hidden behind the largest ones, tested on the CPU\n"
+           "  --no-pvs                     Ignore the visible sets baked into a replayed capture by chim_pvs\n"
+           "  --no-lightmap                Ignore the lighting baked into a replayed capture by chim_lightmap\n"
+           "  --foliage                    Grow grass around the camera, scattered on the GPU every frame\n"
+           "  --foliage-distance <units>   How far the grass reaches (default 20)\n"
+           "  --foliage-density <n>        Blades per square unit where the grass is thickest (default 400)";
+}
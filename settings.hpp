@@ -0,0 +1,72 @@
+/**
+ * @file settings.hpp
+ * @author George Power
+ * @brief Start-up options of the renderer, usually taken from the command line.
+ */
+#ifndef SETTINGS_HPP
+#define SETTINGS_HPP
+
+#include <cstdint>
+#include <string>
+
+namespace chim
+{
+/**
+ * @brief Everything that is decided before Chim::Init and stays fixed afterwards.
+ */
+struct ChimSettings
+{
+    uint32_t width = 1280;
+    uint32_t height = 720;
+    // Built-in scene rendered when no capture is replayed: "quad" or "blocks"
+    std::string scene = "quad";
+    // Render into offscreen images without a window or swap chain
+    bool headless = false;
+    // Stop after this many frames, 0 runs until the window is closed
+    uint32_t frame_limit = 0;
+    // Fraction of the output resolution the scene is rendered at, upscaled by the temporal pass
+    float render_scale = 1.0f;
+    // Only render after input, window events or scene changes; block on the event queue otherwise
+    bool on_demand = false;
+    // Fetch vertices in the vertex shader through buffer device addresses instead of fixed vertex input
+    bool vertex_pulling = false;
+    // Link pipelines from pre-built parts with VK_EXT_graphics_pipeline_library when the device supports it
+    bool pipeline_library = true;
+    // Write the scene descriptors into a mapped descriptor buffer (VK_EXT_descriptor_buffer) instead of descriptor sets
+    bool descriptor_buffer = false;
+    // Also render a probe on request in one multiview pass: 2 views (stereo pair) or 6 (cube map faces), 0 for none
+    uint32_t multiview_views = 0;
+
+    // Record the first capture_frames frames into capture_path
+    std::string capture_path;
+    uint32_t capture_frames = 0;
+    // Replay a capture headless, as fast as possible
+    std::string replay_path;
+    // Render headless into exported images and hand the frames to the consumer connected to this Unix socket
+    std::string export_socket;
+    uint32_t export_timeout = 60; // Seconds to wait for the consumer to connect, 0 waits indefinitely
+    // Stream every frame into this file or pipe, as Y4M video if it ends in .y4m and raw RGBA otherwise
+    std::string stream_path;
+    uint32_t stream_fps = 60; // Frame rate written into the Y4M header
+    // Run as a headless service that renders the jobs sent to this Unix socket
+    std::string serve_socket;
+    // Where the pipeline cache and the device capability snapshot are kept between runs, empty to keep neither
+    std::string cache_directory = ".";
+    // Count cycles, instructions and cache and branch misses per frame phase with perf_event_open (Linux only)
+    bool perf_counters = false;
+    // Skip scene draws hidden behind the largest draws, tested against a CPU depth buffer before recording
+    bool occlusion_culling = false;
+    // Skip draws that the potentially visible sets baked into a replayed capture rule out from the camera's cell
+    bool pvs = true;
+    // Light the scene of a replayed capture with the lightmap baked into it
+    bool lightmap = true;
+    // Scatter grass around the camera with a compute pass every frame, out to foliage_distance
+    bool foliage = false;
+    float foliage_distance = 20.0f;
+    float foliage_density = 400.0f; // Blades per square unit at full density
+};
+
+ChimSettings ParseArguments(int argc, char *argv[]);
+std::string Usage(void);
+} // namespace chim
+#endif // SETTINGS_HPP
@@ -1,9 +1,14 @@
 #version 450
 
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec4 currentPosition;
+layout(location = 2) in vec4 previousPosition;
 
 layout(location = 0) out vec4 outColor;
+layout(location = 1) out vec2 outMotion;
 
 void main() {
     outColor = vec4(fragColor, 1.0);
+    // Screen space motion since the previous frame, in texture coordinates
+    outMotion = (currentPosition.xy / currentPosition.w - previousPosition.xy / previousPosition.w) * 0.5;
 }
\ No newline at end of file
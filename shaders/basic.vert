@@ -4,17 +4,25 @@ layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
     mat4 view;
     mat4 proj;
+    mat4 prev_model;
+    mat4 prev_view_proj;
+    vec4 jitter;
 } ubo;
 
-layout(location = 0) in vec2 inPosition;
+layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 
 layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec4 currentPosition;
+layout(location = 2) out vec4 previousPosition;
 
 void main()
 {
-	//gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 0.0, 1.0);
-    // above line causes failure
-	gl_Position = vec4(inPosition, 0.0, 1.0);
+	gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
     fragColor = inColor;
+
+    // Motion is measured without the jitter, so a still camera over a still scene has none
+    currentPosition = gl_Position;
+    currentPosition.xy -= ubo.jitter.xy * gl_Position.w;
+    previousPosition = ubo.prev_view_proj * ubo.prev_model * vec4(inPosition, 1.0);
 }
\ No newline at end of file
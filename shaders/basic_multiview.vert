@@ -0,0 +1,19 @@
+#version 450
+#extension GL_EXT_multiview : require
+
+// Draws the scene into every view of the probe pass at once; gl_ViewIndex picks the view's transform
+layout(binding = 0) uniform ProbeUniformBufferObject {
+    mat4 model;
+    mat4 view_proj[6];
+} ubo;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+
+layout(location = 0) out vec3 fragColor;
+
+void main()
+{
+    gl_Position = ubo.view_proj[gl_ViewIndex] * ubo.model * vec4(inPosition, 1.0);
+    fragColor = inColor;
+}
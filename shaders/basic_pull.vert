@@ -0,0 +1,43 @@
+#version 450
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+    mat4 prev_model;
+    mat4 prev_view_proj;
+    vec4 jitter;
+} ubo;
+
+// Vertices are read as a plain stream of floats, so any layout that starts with position and colour works
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer VertexData {
+    float values[];
+};
+
+layout(push_constant) uniform VertexPulling {
+    uvec2 vertices; // Device address of the geometry vertex buffer
+    uint stride;    // Floats per vertex
+} pull;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec4 currentPosition;
+layout(location = 2) out vec4 previousPosition;
+
+void main()
+{
+    // gl_VertexIndex already includes the draw's vertexOffset
+    VertexData data = VertexData(pull.vertices);
+    uint base = uint(gl_VertexIndex) * pull.stride;
+    vec3 inPosition = vec3(data.values[base], data.values[base + 1], data.values[base + 2]);
+    vec3 inColor = vec3(data.values[base + 3], data.values[base + 4], data.values[base + 5]);
+
+    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    fragColor = inColor;
+
+    // Motion is measured without the jitter, so a still camera over a still scene has none
+    currentPosition = gl_Position;
+    currentPosition.xy -= ubo.jitter.xy * gl_Position.w;
+    previousPosition = ubo.prev_view_proj * ubo.prev_model * vec4(inPosition, 1.0);
+}
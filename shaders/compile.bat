@@ -1,3 +1,14 @@
 C:/VulkanSDK/1.3.268.0/Bin/glslc.exe basic.vert -o vert.spv
+C:/VulkanSDK/1.3.268.0/Bin/glslc.exe --target-env=vulkan1.2 basic_pull.vert -o pull_vert.spv
 C:/VulkanSDK/1.3.268.0/Bin/glslc.exe basic.frag -o frag.spv
+C:/VulkanSDK/1.3.268.0/Bin/glslc.exe overlay.vert -o overlay_vert.spv
+C:/VulkanSDK/1.3.268.0/Bin/glslc.exe overlay.frag -o overlay_frag.spv
+C:/VulkanSDK/1.3.268.0/Bin/glslc.exe fullscreen.vert -o fullscreen_vert.spv
+C:/VulkanSDK/1.3.268.0/Bin/glslc.exe temporal.frag -o temporal_frag.spv
+C:/VulkanSDK/1.3.268.0/Bin/glslc.exe present.frag -o present_frag.spv
+C:/VulkanSDK/1.3.268.0/Bin/glslc.exe --target-env=vulkan1.1 basic_multiview.vert -o multiview_vert.spv
+C:/VulkanSDK/1.3.268.0/Bin/glslc.exe probe.frag -o probe_frag.spv
+C:/VulkanSDK/1.3.268.0/Bin/glslc.exe stream.comp -o stream_comp.spv
+C:/VulkanSDK/1.3.268.0/Bin/glslc.exe foliage.comp -o foliage_comp.spv
+C:/VulkanSDK/1.3.268.0/Bin/glslc.exe foliage.vert -o foliage_vert.spv
 pause
\ No newline at end of file
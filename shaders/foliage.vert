@@ -0,0 +1,66 @@
+#version 450
+
+// Builds the blades placed by foliage.comp from the instance alone, without vertex buffers. The full blade is a
+// strip of three tapering, forward-bending segments with a tip, drawn as five triangles; the far one a single
+// triangle from root to tip.
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+    mat4 prev_model;
+    mat4 prev_view_proj;
+    vec4 jitter;
+} ubo;
+
+struct Instance
+{
+    vec4 position_height;
+    vec4 color_angle;
+};
+
+layout(std430, binding = 2) readonly buffer Instances {
+    Instance instances[];
+};
+
+layout(push_constant) uniform Parameters {
+    uint lod;
+    uint capacity;
+} parameters;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec4 currentPosition;
+layout(location = 2) out vec4 previousPosition;
+
+const float kBladeWidth = 0.012;
+const float kBend = 0.3; // Forward lean of the tip, as a fraction of the height
+const uint kFarPoints[3] = uint[3](0u, 1u, 6u);
+
+void main()
+{
+    uint index = parameters.lod == 0u ? uint(gl_InstanceIndex) : parameters.capacity - 1u - uint(gl_InstanceIndex);
+    Instance blade = instances[index];
+
+    // Points 0-5 are the left and right edges at the bottom of each segment, 6 the tip
+    uint point = parameters.lod == 0u ? uint(gl_VertexIndex) / 3u + uint(gl_VertexIndex) % 3u
+                                      : kFarPoints[gl_VertexIndex];
+    float level = point == 6u ? 1.0 : float(point / 2u) / 3.0;
+    float side = point == 6u ? 0.0 : (point % 2u == 0u ? -0.5 : 0.5);
+
+    float height = blade.position_height.w;
+    float angle = blade.color_angle.a;
+    vec3 right = vec3(cos(angle), sin(angle), 0.0);
+    vec3 forward = vec3(-right.y, right.x, 0.0);
+    // Far blades are a third of the triangles, so they are drawn wider to cover about as much
+    float width = kBladeWidth * (parameters.lod == 0u ? 1.0 : 1.5) * (1.0 - level);
+    vec4 position = vec4(blade.position_height.xyz + right * side * width + forward * kBend * height * level * level +
+                             vec3(0.0, 0.0, height * level),
+                         1.0);
+
+    gl_Position = ubo.proj * ubo.view * position;
+    fragColor = blade.color_angle.rgb * mix(0.35, 1.0, level);
+
+    // The grass stands in world space, so only the camera moves it
+    currentPosition = gl_Position;
+    currentPosition.xy -= ubo.jitter.xy * gl_Position.w;
+    previousPosition = ubo.prev_view_proj * position;
+}
@@ -0,0 +1,47 @@
+#version 450
+
+layout(binding = 0) uniform sampler2D currentColor;
+layout(binding = 1) uniform sampler2D motionVectors;
+layout(binding = 2) uniform sampler2D history;
+
+layout(push_constant) uniform TemporalParameters {
+    vec2 jitter;  // Offset of this frame's projection, in texture coordinates
+    float blend;  // Weight of the current frame
+    float reset;  // Non-zero when the history holds nothing usable
+} params;
+
+layout(location = 0) in vec2 inUV;
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+    // The current frame is rendered at the internal resolution; bilinear sampling upscales it
+    vec2 uv = inUV + params.jitter;
+    vec3 current = texture(currentColor, uv).rgb;
+
+    // History is only trusted within the range of the current frame's 3x3 neighbourhood, which rejects most
+    // disoccluded and shaded-differently samples without needing depth
+    vec2 texel = 1.0 / vec2(textureSize(currentColor, 0));
+    vec3 low = current;
+    vec3 high = current;
+    for (int y = -1; y <= 1; y++)
+    {
+        for (int x = -1; x <= 1; x++)
+        {
+            vec3 neighbour = texture(currentColor, uv + vec2(x, y) * texel).rgb;
+            low = min(low, neighbour);
+            high = max(high, neighbour);
+        }
+    }
+
+    vec2 previousUV = inUV - texture(motionVectors, uv).xy;
+    if (params.reset != 0.0 || any(lessThan(previousUV, vec2(0.0))) || any(greaterThan(previousUV, vec2(1.0))))
+    {
+        outColor = vec4(current, 1.0);
+        return;
+    }
+
+    vec3 previous = clamp(texture(history, previousUV).rgb, low, high);
+    outColor = vec4(mix(previous, current, params.blend), 1.0);
+}